@@ -0,0 +1,521 @@
+#include <easynet/EventLoop.h>
+#include <easynet/TcpClient.h>
+#include <easynet/TcpConnection.h>
+#include <easynet/utils/Histogram.h>
+#include <easynet/utils/TimeUtil.h>
+#include <easynet/utils/log.h>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+#include <algorithm>
+#include <random>
+#include <deque>
+#include <vector>
+#include <string>
+#include <memory>
+#include <iostream>
+
+using namespace std;
+using namespace easynet;
+
+namespace
+{
+
+const int kConnectTimeoutSecs = 10;
+const int64_t kConnectWaitMicros = 1000000;  // before the first step, for the connections to be established
+const int64_t kDrainMicros = 2000000;        // after every step, for the responses of the step to arrive
+const double kAchievedRatio = 0.95;          // a step achieving less of its target rate is saturated
+const double kP99Ratio = 10.0;               // and so is a step whose p99 is this times of the first step's
+const uint64_t kMinP99Micros = 1000;         // and above this
+
+enum Schedule
+{
+	SCHEDULE_CONSTANT,
+	SCHEDULE_POISSON,
+};
+
+struct Options
+{
+	std::string ip;
+	unsigned short port;
+	std::vector<int> rates;  // requests per second of every step
+	Schedule schedule;
+	int connections;
+	int messageBytes;
+	int threads;
+	int stepSecs;
+	bool json;
+};
+
+// a request waiting for its response, the echo server returns the bytes in order
+struct Request
+{
+	int64_t scheduledMicros;
+	int step;  // -1 if it has been given up at the end of its step
+};
+
+struct Session
+{
+	std::unique_ptr<TcpClient> client;
+	bool connected;
+	std::deque<Request> requests;
+	size_t receivedBytes;  // of the response being received
+};
+
+// the results of a thread in a step
+struct StepResult
+{
+	StepResult() : sent(0), received(0), unanswered(0), failed(0), lastReceivedMicros(0) {}
+
+	uint64_t sent;
+	uint64_t received;
+	uint64_t unanswered;  // no response by the end of the drain
+	uint64_t failed;      // not sent since no connection was established
+	int64_t lastReceivedMicros;  // since the step began
+	Histogram latency;    // microseconds from the scheduled send time
+};
+
+// sends its share of every step's rate over its connections, open loop: the requests are sent when
+// they're scheduled no matter how many are still waiting for responses, and the latency of a request
+// is measured from when it was scheduled rather than when it was sent, so a server stall shows up as
+// the latency of every request scheduled during it, not just the one that was in flight.
+// the threads share @beginMicros, so they run the steps at the same time without talking to each other.
+class ClientThread
+{
+public:
+	ClientThread(const Options &options, int connections, int64_t beginMicros, unsigned int seed)
+	           : options_(options),
+	             connections_(connections),
+	             beginMicros_(beginMicros),
+	             message_(options.messageBytes, 'x'),
+	             random_(seed),
+	             loop_(nullptr),
+	             step_(0),
+	             meanIntervalMicros_(0),
+	             stepEndMicros_(0),
+	             nextMicros_(0),
+	             nextSession_(0),
+	             connectFailures_(0),
+	             disconnections_(0)
+	{
+		for (size_t i = 0; i < options_.rates.size(); i++)
+		{
+			results_.push_back(std::unique_ptr<StepResult>(new StepResult()));
+		}
+	}
+
+	void run();
+
+	const StepResult& getResult(int step) const { return *results_[step]; }
+	int getConnectFailures() const { return connectFailures_; }
+	int getDisconnections() const { return disconnections_; }
+
+private:
+	void startStep(int step);
+	void finishStep(int step);
+	void onSendTimer();
+	void onMessage(Session *session, TcpConnection &tcpConnection);
+	Session* nextConnectedSession();
+	int64_t stepBeginMicros(int step) const { return beginMicros_ + step * (options_.stepSecs * 1000000LL + kDrainMicros); }
+	double intervalMicros();
+
+	const Options &options_;
+	int connections_;
+	int64_t beginMicros_;
+	std::string message_;
+	std::mt19937_64 random_;
+	std::exponential_distribution<double> exponential_;
+
+	EventLoop *loop_;
+	std::vector<std::unique_ptr<Session>> sessions_;
+	std::vector<std::unique_ptr<StepResult>> results_;
+	int step_;
+	double meanIntervalMicros_;
+	int64_t stepEndMicros_;
+	double nextMicros_;  // when the next request is scheduled
+	size_t nextSession_;
+	int connectFailures_;
+	int disconnections_;
+};
+
+double ClientThread::intervalMicros()
+{
+	if (options_.schedule == SCHEDULE_POISSON)
+	{
+		// exponential intervals of the mean
+		return exponential_(random_) * meanIntervalMicros_;
+	}
+	return meanIntervalMicros_;
+}
+
+void ClientThread::startStep(int step)
+{
+	step_ = step;
+	double rate = static_cast<double>(options_.rates[step]) / options_.threads;
+	meanIntervalMicros_ = 1000000.0 / rate;
+	stepEndMicros_ = stepBeginMicros(step) + options_.stepSecs * 1000000LL;
+	nextMicros_ = stepBeginMicros(step) + intervalMicros();
+	loop_->runAtMicros(static_cast<int64_t>(nextMicros_), std::bind(&ClientThread::onSendTimer, this));
+	loop_->runAtMicros(stepEndMicros_ + kDrainMicros, std::bind(&ClientThread::finishStep, this, step));
+}
+
+// gives up the requests of @step still waiting, they count with the latency they've waited so far
+void ClientThread::finishStep(int step)
+{
+	int64_t nowMicros = loop_->nowMicros();
+	StepResult &result = *results_[step];
+	for (auto &session : sessions_)
+	{
+		for (auto &request : session->requests)
+		{
+			if (request.step == step)
+			{
+				result.unanswered++;
+				result.latency.record(nowMicros - request.scheduledMicros);
+				request.step = -1;
+			}
+		}
+	}
+
+	if (step + 1 < static_cast<int>(options_.rates.size()))
+	{
+		startStep(step + 1);
+		return;
+	}
+
+	for (auto &session : sessions_)
+	{
+		session->client->close();
+	}
+	loop_->quit();
+}
+
+// sends every request scheduled up to now, the timer is late sometimes and the requests it missed
+// go out together, their latency includes the delay
+void ClientThread::onSendTimer()
+{
+	int64_t nowMicros = loop_->nowMicros();
+	StepResult &result = *results_[step_];
+	while (nextMicros_ <= nowMicros && nextMicros_ < stepEndMicros_)
+	{
+		Session *session = nextConnectedSession();
+		if (session)
+		{
+			session->requests.push_back(Request{static_cast<int64_t>(nextMicros_), step_});
+			session->client->getTcpConnection().send(message_.data(), message_.size());
+			result.sent++;
+		}
+		else
+		{
+			result.failed++;
+		}
+		nextMicros_ += intervalMicros();
+	}
+
+	if (nextMicros_ < stepEndMicros_)
+	{
+		loop_->runAtMicros(static_cast<int64_t>(nextMicros_), std::bind(&ClientThread::onSendTimer, this));
+	}
+}
+
+Session* ClientThread::nextConnectedSession()
+{
+	for (size_t i = 0; i < sessions_.size(); i++)
+	{
+		Session *session = sessions_[nextSession_++ % sessions_.size()].get();
+		if (session->connected)
+		{
+			return session;
+		}
+	}
+	return nullptr;
+}
+
+void ClientThread::onMessage(Session *session, TcpConnection &tcpConnection)
+{
+	int64_t nowMicros = loop_->nowMicros();
+	Buffer &buffer = tcpConnection.getInputBuffer();
+	session->receivedBytes += buffer.size();
+	buffer.clear();
+
+	while (session->receivedBytes >= message_.size() && !session->requests.empty())
+	{
+		session->receivedBytes -= message_.size();
+		const Request &request = session->requests.front();
+		if (request.step >= 0)
+		{
+			StepResult &result = *results_[request.step];
+			result.received++;
+			result.latency.record(nowMicros - request.scheduledMicros);
+			result.lastReceivedMicros = nowMicros - stepBeginMicros(request.step);
+		}
+		session->requests.pop_front();
+	}
+}
+
+void ClientThread::run()
+{
+	EventLoop loop;
+	loop_ = &loop;
+	for (int i = 0; i < connections_; i++)
+	{
+		std::unique_ptr<Session> session(new Session());
+		Session *s = session.get();
+		s->client.reset(new TcpClient(&loop));
+		s->connected = false;
+		s->receivedBytes = 0;
+
+		s->client->setConnectedHandler([s](TcpConnection &tcpConnection){
+			tcpConnection.setNoDelay(true);
+			s->connected = true;
+		});
+		s->client->setReadHandler(std::bind(&ClientThread::onMessage, this, s, std::placeholders::_1));
+		s->client->setConnectingErrorHandler([this](int errNo, const std::string &errMsg){
+			LOG_WARN("connect to %s:%d failed, error:%d %s", options_.ip.c_str(), options_.port, errNo, errMsg.c_str());
+			connectFailures_++;
+		});
+		s->client->setConnectingTimeoutHandler([this]{
+			connectFailures_++;
+		});
+		s->client->setPeerShutdownHandler([this, s](TcpConnection &tcpConnection){
+			s->connected = false;
+			disconnections_++;
+			tcpConnection.close();
+		});
+		s->client->setDisconnectedHandler([this, s](TcpConnection &tcpConnection){
+			if (s->connected)
+			{
+				s->connected = false;
+				disconnections_++;
+			}
+		});
+
+		s->client->connect(options_.ip, options_.port, kConnectTimeoutSecs);
+		sessions_.push_back(std::move(session));
+	}
+
+	loop.runAtMicros(beginMicros_, std::bind(&ClientThread::startStep, this, 0));
+	loop.loop();
+	sessions_.clear();
+	loop_ = nullptr;
+}
+
+bool parseRates(const char *arg, std::vector<int> *rates)
+{
+	std::string text(arg);
+	size_t begin = 0;
+	while (begin <= text.size())
+	{
+		size_t end = text.find(',', begin);
+		if (end == std::string::npos)
+		{
+			end = text.size();
+		}
+		int rate = atoi(text.substr(begin, end - begin).c_str());
+		if (rate <= 0)
+		{
+			return false;
+		}
+		rates->push_back(rate);
+		begin = end + 1;
+	}
+	return !rates->empty();
+}
+
+struct StepReport
+{
+	int rate;
+	double achieved;
+	uint64_t sent;
+	uint64_t received;
+	uint64_t unanswered;
+	uint64_t failed;
+	HistogramSnapshot latency;
+	bool saturated;
+};
+
+void printCsv(const std::vector<StepReport> &reports)
+{
+	printf("rate,achieved,sent,received,unanswered,failed,mean_us,p50_us,p90_us,p99_us,p999_us,max_us,saturated\n");
+	for (auto &r : reports)
+	{
+		printf("%d,%.1f,%llu,%llu,%llu,%llu,%.1f,%llu,%llu,%llu,%llu,%llu,%d\n",
+			r.rate, r.achieved, static_cast<unsigned long long>(r.sent), static_cast<unsigned long long>(r.received),
+			static_cast<unsigned long long>(r.unanswered), static_cast<unsigned long long>(r.failed), r.latency.mean(),
+			static_cast<unsigned long long>(r.latency.percentile(50)), static_cast<unsigned long long>(r.latency.percentile(90)),
+			static_cast<unsigned long long>(r.latency.percentile(99)), static_cast<unsigned long long>(r.latency.percentile(99.9)),
+			static_cast<unsigned long long>(r.latency.max), r.saturated ? 1 : 0);
+	}
+}
+
+void printJson(const Options &options, const std::vector<StepReport> &reports, int knee)
+{
+	printf("{\n");
+	printf("  \"server\": \"%s:%u\",\n", options.ip.c_str(), options.port);
+	printf("  \"schedule\": \"%s\",\n", options.schedule == SCHEDULE_POISSON ? "poisson" : "constant");
+	printf("  \"connections\": %d,\n", options.connections);
+	printf("  \"message_bytes\": %d,\n", options.messageBytes);
+	printf("  \"threads\": %d,\n", options.threads);
+	printf("  \"step_seconds\": %d,\n", options.stepSecs);
+	printf("  \"steps\": [\n");
+	for (size_t i = 0; i < reports.size(); i++)
+	{
+		const StepReport &r = reports[i];
+		printf("    {\"rate\": %d, \"achieved\": %.1f, \"sent\": %llu, \"received\": %llu, \"unanswered\": %llu, \"failed\": %llu, "
+			"\"mean_us\": %.1f, \"p50_us\": %llu, \"p90_us\": %llu, \"p99_us\": %llu, \"p999_us\": %llu, \"max_us\": %llu, "
+			"\"saturated\": %s}%s\n",
+			r.rate, r.achieved, static_cast<unsigned long long>(r.sent), static_cast<unsigned long long>(r.received),
+			static_cast<unsigned long long>(r.unanswered), static_cast<unsigned long long>(r.failed), r.latency.mean(),
+			static_cast<unsigned long long>(r.latency.percentile(50)), static_cast<unsigned long long>(r.latency.percentile(90)),
+			static_cast<unsigned long long>(r.latency.percentile(99)), static_cast<unsigned long long>(r.latency.percentile(99.9)),
+			static_cast<unsigned long long>(r.latency.max), r.saturated ? "true" : "false",
+			i + 1 < reports.size() ? "," : "");
+	}
+	printf("  ],\n");
+	printf("  \"knee_rate\": %d\n", knee);
+	printf("}\n");
+}
+
+}
+
+// open loop load against ./server or any echo server: every step sends requests of @message_bytes at the
+// step's rate for @step_time seconds, spaced evenly(constant) or as a poisson process(poisson), round robin
+// over the connections, whether or not the earlier ones are answered. the latency is measured from the
+// scheduled send time, so it's not hidden when the server stalls(coordinated omission).
+// the steps run in the order given, the saturation knee is the rate of the last step before the first
+// saturated one: one achieving less than 95% of its rate, or whose p99 is 10 times of the first step's.
+// the results go to stdout as csv or json, one record per step.
+int main(int argc, const char* argv[])
+{
+	if (argc < 4)
+	{
+        cout << "usage:" << argv[0] << " <host_ip> <port> <rates(requests per second, comma separated)> [poisson|constant] "
+             << "[connections=100] [message_bytes=64] [threads=1] [step_time(seconds)=10] [csv|json]" << endl;
+        return 0;
+	}
+
+	Options options;
+	options.ip = argv[1];
+	unsigned int port = 0;
+	options.schedule = SCHEDULE_POISSON;
+	options.connections = 100;
+	options.messageBytes = 64;
+	options.threads = 1;
+	options.stepSecs = 10;
+	options.json = false;
+
+	sscanf(argv[2], "%u", &port);
+	if (!parseRates(argv[3], &options.rates))
+	{
+		cout << "rates must be positive numbers separated by commas, such as 10000,20000,40000" << endl;
+		return 1;
+	}
+	if (argc > 4) options.schedule = strcmp(argv[4], "constant") == 0 ? SCHEDULE_CONSTANT : SCHEDULE_POISSON;
+	if (argc > 5) sscanf(argv[5], "%d", &options.connections);
+	if (argc > 6) sscanf(argv[6], "%d", &options.messageBytes);
+	if (argc > 7) sscanf(argv[7], "%d", &options.threads);
+	if (argc > 8) sscanf(argv[8], "%d", &options.stepSecs);
+	if (argc > 9) options.json = strcmp(argv[9], "json") == 0;
+	options.port = static_cast<unsigned short>(port);
+
+	if (options.threads < 1 || options.connections < options.threads || options.messageBytes < 1 || options.stepSecs < 1)
+	{
+		cout << "connections must be no less than threads, threads, message_bytes and step_time must be positive" << endl;
+		return 1;
+	}
+
+	Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_WARN);
+	Logger::getInstance().setLogFile("loadgen-log.txt");
+
+	fprintf(stderr, "server:%s:%u schedule:%s connections:%d message:%d bytes threads:%d steps:%u of %d seconds\n",
+		options.ip.c_str(), port, options.schedule == SCHEDULE_POISSON ? "poisson" : "constant", options.connections,
+		options.messageBytes, options.threads, static_cast<unsigned int>(options.rates.size()), options.stepSecs);
+
+	int64_t beginMicros = TimeUtil::currentMonoTimeMicros() + kConnectWaitMicros;
+	std::random_device seeds;
+	std::vector<std::unique_ptr<ClientThread>> clients;
+	for (int i = 0; i < options.threads; i++)
+	{
+		// the remainder goes to the first ones
+		int connections = options.connections / options.threads + (i < options.connections % options.threads ? 1 : 0);
+		clients.push_back(std::unique_ptr<ClientThread>(new ClientThread(options, connections, beginMicros, seeds())));
+	}
+
+	std::vector<std::thread> threads;
+	for (auto &client : clients)
+	{
+		threads.push_back(std::thread(&ClientThread::run, client.get()));
+	}
+	for (auto &thread : threads)
+	{
+		thread.join();
+	}
+
+	std::vector<StepReport> reports;
+	int knee = 0;
+	bool saturated = false;
+	for (size_t step = 0; step < options.rates.size(); step++)
+	{
+		StepReport report;
+		report.rate = options.rates[step];
+		report.sent = 0;
+		report.received = 0;
+		report.unanswered = 0;
+		report.failed = 0;
+		int64_t lastReceivedMicros = 0;
+		for (auto &client : clients)
+		{
+			const StepResult &result = client->getResult(step);
+			HistogramSnapshot snapshot;
+			result.latency.snapshot(&snapshot);
+			report.latency.merge(snapshot);
+			report.sent += result.sent;
+			report.received += result.received;
+			report.unanswered += result.unanswered;
+			report.failed += result.failed;
+			lastReceivedMicros = std::max(lastReceivedMicros, result.lastReceivedMicros);
+		}
+		// over the step, or till its last response if the server fell behind and answered in the drain
+		report.achieved = report.received / (std::max(lastReceivedMicros, static_cast<int64_t>(options.stepSecs) * 1000000) / 1000000.0);
+
+		uint64_t p99 = report.latency.percentile(99);
+		uint64_t baseP99 = reports.empty() ? p99 : reports.front().latency.percentile(99);
+		report.saturated = report.achieved < report.rate * kAchievedRatio
+		                   || (p99 > baseP99 * kP99Ratio && p99 > kMinP99Micros);
+		if (report.saturated)
+		{
+			saturated = true;
+		}
+		else if (!saturated)
+		{
+			knee = report.rate;
+		}
+		reports.push_back(report);
+	}
+
+	if (options.json)
+	{
+		printJson(options, reports, knee);
+	}
+	else
+	{
+		printCsv(reports);
+	}
+
+	int connectFailures = 0;
+	int disconnections = 0;
+	for (auto &client : clients)
+	{
+		connectFailures += client->getConnectFailures();
+		disconnections += client->getDisconnections();
+	}
+	fprintf(stderr, "knee:%d requests/s", knee);
+	if (connectFailures > 0 || disconnections > 0)
+	{
+		fprintf(stderr, " connect failures:%d disconnections:%d", connectFailures, disconnections);
+	}
+	fprintf(stderr, "\n");
+
+	return 0;
+}
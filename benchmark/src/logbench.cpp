@@ -0,0 +1,98 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <easynet/utils/TimeUtil.h>
+#include <easynet/utils/log.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+using namespace std;
+using namespace easynet;
+
+namespace
+{
+
+std::atomic<bool> stopped(false);
+
+void logInLoop(int threadNum, uint64_t *calls)
+{
+	uint64_t n = 0;
+	while (!stopped)
+	{
+		LOG_WARN("connection %d send error, error:%d %s, queued %llu bytes",
+			threadNum, 104, "Connection reset by peer", static_cast<unsigned long long>(n));
+		n++;
+	}
+	*calls = n;
+}
+
+}
+
+// log calls per second of several threads, with the logger writing synchronously(sync), or through
+// the per-thread rings dropping the records(drop) or waiting(block) when a ring is full
+int main(int argc, const char* argv[])
+{
+	if (argc < 2)
+	{
+        cout << "usage:" << argv[0] << " <sync|drop|block> [threads=8] [test_time(seconds)=5] [ring_bytes_per_thread=1048576]" << endl;
+        return 0;
+	}
+
+	std::string mode = argv[1];
+	int threadNum = 8;
+	int testTimeSecs = 5;
+	unsigned int ringBytes = 1024 * 1024;
+
+	if (argc > 2) sscanf(argv[2], "%d", &threadNum);
+	if (argc > 3) sscanf(argv[3], "%d", &testTimeSecs);
+	if (argc > 4) sscanf(argv[4], "%u", &ringBytes);
+
+	Logger &logger = Logger::getInstance();
+	logger.setLogLevel(Logger::LOG_LEVEL_INFO);
+	logger.setLogFile("logbench-log.txt");
+	if (mode == "drop")
+	{
+		logger.enableAsync(ringBytes, Logger::ASYNC_OVERFLOW_DROP);
+	}
+	else if (mode == "block")
+	{
+		logger.enableAsync(ringBytes, Logger::ASYNC_OVERFLOW_BLOCK);
+	}
+
+	std::vector<uint64_t> calls(threadNum, 0);
+	std::vector<std::thread> threads;
+	int64_t begin = TimeUtil::currentMonoTimeMicros();
+	for (int i = 0; i < threadNum; i++)
+	{
+		threads.emplace_back(logInLoop, i, &calls[i]);
+	}
+
+	std::this_thread::sleep_for(std::chrono::seconds(testTimeSecs));
+	stopped = true;
+	for (auto &t : threads)
+	{
+		t.join();
+	}
+	double secs = (TimeUtil::currentMonoTimeMicros() - begin) / 1000000.0;
+
+	// the records left in the rings
+	logger.flush();
+	double drainSecs = (TimeUtil::currentMonoTimeMicros() - begin) / 1000000.0 - secs;
+
+	uint64_t total = 0;
+	for (auto n : calls)
+	{
+		total += n;
+	}
+	uint64_t dropped = logger.getDroppedRecords();
+
+	printf("mode:%s threads:%d\n", mode.c_str(), threadNum);
+	printf("%14s %14s %14s %14s %12s\n", "calls/s", "calls/s/thread", "written/s", "dropped", "drain(s)");
+	printf("%14.0f %14.0f %14.0f %14llu %12.3f\n", total / secs, total / secs / threadNum,
+		(total - dropped) / (secs + drainSecs), static_cast<unsigned long long>(dropped), drainSecs);
+
+	logger.disableAsync();
+	return 0;
+}
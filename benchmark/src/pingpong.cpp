@@ -0,0 +1,269 @@
+#include <easynet/EventLoop.h>
+#include <easynet/TcpClient.h>
+#include <easynet/TcpConnection.h>
+#include <easynet/utils/Histogram.h>
+#include <easynet/utils/TimeUtil.h>
+#include <easynet/utils/log.h>
+#include <cstdio>
+#include <thread>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <string>
+#include <memory>
+#include <iostream>
+
+using namespace std;
+using namespace easynet;
+
+namespace
+{
+
+const int kConnectTimeoutSecs = 10;
+
+struct Options
+{
+	std::string ip;
+	unsigned short port;
+	int connections;
+	int pipeline;       // messages in flight on a connection
+	int messageBytes;
+	int threads;
+	int testTimeSecs;
+	int warmupSecs;
+};
+
+// a connection keeping @pipeline messages in flight, the echo server returns the bytes in order,
+// so the message completed by every @messageBytes bytes received is the oldest one sent
+struct Session
+{
+	std::unique_ptr<TcpClient> client;
+	std::deque<int64_t> sendNanos;
+	size_t receivedBytes;  // of the message being received
+};
+
+// a client thread with its own loop, the results are read after it's joined
+class ClientThread
+{
+public:
+	ClientThread(const Options &options, int connections)
+	           : options_(options),
+	             connections_(connections),
+	             message_(options.messageBytes, 'x'),
+	             measuring_(false),
+	             measuredMicros_(0),
+	             messages_(0),
+	             bytes_(0),
+	             connectFailures_(0),
+	             disconnections_(0)
+	{}
+
+	void run();
+
+	const Histogram& getLatency() const { return latency_; }
+	int64_t getMeasuredMicros() const { return measuredMicros_; }
+	uint64_t getMessages() const { return messages_; }
+	uint64_t getBytes() const { return bytes_; }
+	int getConnectFailures() const { return connectFailures_; }
+	int getDisconnections() const { return disconnections_; }
+
+private:
+	void send(Session *session, TcpConnection &tcpConnection, int64_t nowNanos);
+	void onMessage(Session *session, TcpConnection &tcpConnection);
+
+	const Options &options_;
+	int connections_;
+	std::string message_;
+
+	bool measuring_;
+	int64_t measuredMicros_;
+	uint64_t messages_;
+	uint64_t bytes_;
+	int connectFailures_;
+	int disconnections_;
+	Histogram latency_;   // nanoseconds
+};
+
+void ClientThread::send(Session *session, TcpConnection &tcpConnection, int64_t nowNanos)
+{
+	session->sendNanos.push_back(nowNanos);
+	tcpConnection.send(message_.data(), message_.size());
+}
+
+void ClientThread::onMessage(Session *session, TcpConnection &tcpConnection)
+{
+	// a clock read for all the messages completed by this read
+	int64_t nowNanos = TimeUtil::currentMonoTimeNanos();
+	Buffer &buffer = tcpConnection.getInputBuffer();
+	session->receivedBytes += buffer.size();
+	buffer.clear();
+
+	while (session->receivedBytes >= message_.size() && !session->sendNanos.empty())
+	{
+		session->receivedBytes -= message_.size();
+		if (measuring_)
+		{
+			latency_.record(nowNanos - session->sendNanos.front());
+			messages_++;
+			bytes_ += message_.size();
+		}
+		session->sendNanos.pop_front();
+		send(session, tcpConnection, nowNanos);
+	}
+}
+
+void ClientThread::run()
+{
+	EventLoop loop;
+	std::vector<std::unique_ptr<Session>> sessions;
+	for (int i = 0; i < connections_; i++)
+	{
+		std::unique_ptr<Session> session(new Session());
+		Session *s = session.get();
+		s->client.reset(new TcpClient(&loop));
+		s->receivedBytes = 0;
+
+		s->client->setConnectedHandler([this, s](TcpConnection &tcpConnection){
+			tcpConnection.setNoDelay(true);
+			s->sendNanos.clear();
+			s->receivedBytes = 0;
+			int64_t nowNanos = TimeUtil::currentMonoTimeNanos();
+			for (int j = 0; j < options_.pipeline; j++)
+			{
+				send(s, tcpConnection, nowNanos);
+			}
+		});
+		s->client->setReadHandler(std::bind(&ClientThread::onMessage, this, s, std::placeholders::_1));
+		s->client->setConnectingErrorHandler([this](int errNo, const std::string &errMsg){
+			LOG_WARN("connect to %s:%d failed, error:%d %s", options_.ip.c_str(), options_.port, errNo, errMsg.c_str());
+			connectFailures_++;
+		});
+		s->client->setConnectingTimeoutHandler([this]{
+			connectFailures_++;
+		});
+		s->client->setPeerShutdownHandler([this](TcpConnection &tcpConnection){
+			disconnections_++;
+			tcpConnection.close();
+		});
+		s->client->setDisconnectedHandler([this](TcpConnection &tcpConnection){
+			disconnections_++;
+		});
+
+		s->client->connect(options_.ip, options_.port, kConnectTimeoutSecs);
+		sessions.push_back(std::move(session));
+	}
+
+	int64_t beginMicros = 0;
+	loop.runAfter(options_.warmupSecs * 1000, [&]{
+		measuring_ = true;
+		beginMicros = TimeUtil::currentMonoTimeMicros();
+	});
+	loop.runAfter((options_.warmupSecs + options_.testTimeSecs) * 1000, [&]{
+		measuring_ = false;
+		measuredMicros_ = TimeUtil::currentMonoTimeMicros() - beginMicros;
+		for (auto &session : sessions)
+		{
+			session->client->close();
+		}
+		loop.quit();
+	});
+	loop.loop();
+}
+
+}
+
+// echo throughput and latency over long-lived connections, against ./server or any echo server.
+// every connection keeps @pipeline messages of @message_bytes in flight, and sends the next one as soon as
+// one is echoed. the latency of every message is measured in nanoseconds from when it was sent,
+// the connections are spread over @threads client threads, each with its own loop.
+int main(int argc, const char* argv[])
+{
+	if (argc < 3)
+	{
+        cout << "usage:" << argv[0] << " <host_ip> <port> [connections=100] [pipeline=1] [message_bytes=64] "
+             << "[threads=1] [test_time(seconds)=10] [warmup(seconds)=1]" << endl;
+        return 0;
+	}
+
+	Options options;
+	options.ip = argv[1];
+	unsigned int port = 0;
+	options.connections = 100;
+	options.pipeline = 1;
+	options.messageBytes = 64;
+	options.threads = 1;
+	options.testTimeSecs = 10;
+	options.warmupSecs = 1;
+
+	sscanf(argv[2], "%u", &port);
+	if (argc > 3) sscanf(argv[3], "%d", &options.connections);
+	if (argc > 4) sscanf(argv[4], "%d", &options.pipeline);
+	if (argc > 5) sscanf(argv[5], "%d", &options.messageBytes);
+	if (argc > 6) sscanf(argv[6], "%d", &options.threads);
+	if (argc > 7) sscanf(argv[7], "%d", &options.testTimeSecs);
+	if (argc > 8) sscanf(argv[8], "%d", &options.warmupSecs);
+	options.port = static_cast<unsigned short>(port);
+
+	if (options.connections < options.threads || options.pipeline < 1 || options.messageBytes < 1 || options.testTimeSecs < 1)
+	{
+		cout << "connections must be no less than threads, pipeline, message_bytes and test_time must be positive" << endl;
+		return 1;
+	}
+
+	Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_WARN);
+	Logger::getInstance().setLogFile("pingpong-log.txt");
+
+	printf("server:%s:%u connections:%d pipeline:%d message:%d bytes threads:%d test time:%d seconds\n",
+		options.ip.c_str(), port, options.connections, options.pipeline, options.messageBytes,
+		options.threads, options.testTimeSecs);
+
+	std::vector<std::unique_ptr<ClientThread>> clients;
+	for (int i = 0; i < options.threads; i++)
+	{
+		// the remainder goes to the first ones
+		int connections = options.connections / options.threads + (i < options.connections % options.threads ? 1 : 0);
+		clients.push_back(std::unique_ptr<ClientThread>(new ClientThread(options, connections)));
+	}
+
+	std::vector<std::thread> threads;
+	for (auto &client : clients)
+	{
+		threads.push_back(std::thread(&ClientThread::run, client.get()));
+	}
+	for (auto &thread : threads)
+	{
+		thread.join();
+	}
+
+	HistogramSnapshot latency;
+	uint64_t messages = 0;
+	uint64_t bytes = 0;
+	int64_t measuredMicros = 0;
+	int connectFailures = 0;
+	int disconnections = 0;
+	for (auto &client : clients)
+	{
+		HistogramSnapshot snapshot;
+		client->getLatency().snapshot(&snapshot);
+		latency.merge(snapshot);
+		messages += client->getMessages();
+		bytes += client->getBytes();
+		measuredMicros = std::max(measuredMicros, client->getMeasuredMicros());
+		connectFailures += client->getConnectFailures();
+		disconnections += client->getDisconnections();
+	}
+
+	double secs = measuredMicros > 0 ? measuredMicros / 1000000.0 : options.testTimeSecs;
+	printf("%14s %12s %10s %10s %10s %10s %10s %10s\n",
+		"messages/s", "MB/s", "mean(us)", "p50(us)", "p90(us)", "p99(us)", "p99.9(us)", "max(us)");
+	printf("%14.0f %12.2f %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+		messages / secs, bytes / secs / 1000000.0, latency.mean() / 1000.0,
+		latency.percentile(50) / 1000.0, latency.percentile(90) / 1000.0, latency.percentile(99) / 1000.0,
+		latency.percentile(99.9) / 1000.0, latency.max / 1000.0);
+	if (connectFailures > 0 || disconnections > 0)
+	{
+		printf("connect failures:%d disconnections:%d\n", connectFailures, disconnections);
+	}
+
+	return 0;
+}
@@ -0,0 +1,219 @@
+#include <easynet/EventLoop.h>
+#include <easynet/TcpServer.h>
+#include <easynet/TcpClient.h>
+#include <easynet/TcpConnection.h>
+#include <easynet/Worker.h>
+#include <easynet/utils/log.h>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <iostream>
+
+using namespace std;
+using namespace easynet;
+
+namespace
+{
+
+const char kHeavyRequest = 'H';
+const int64_t kHeavyConnectIntervalMillis = 100;
+
+struct Client
+{
+	std::unique_ptr<TcpClient> tcpClient;
+	int worker = -1;  // index of the server's worker serving this connection
+};
+
+}
+
+// skewed traffic: the server first gets many idle connections, the ones on worker 0 are closed,
+// then a few heavy connections arrive, each of them keeps the server busy with ping-pong requests.
+// balancing by the number of connections sends the heavy connections to worker 0,
+// balancing by the utilization spreads them.
+int main(int argc, const char* argv[])
+{
+	if (argc < 2)
+	{
+        cout << "usage:" << argv[0] << " <count|utilization> [workers=4] [idle_connections=400] [heavy_connections=8] "
+             << "[test_time(seconds)=5] [busy_micros_per_request=200] [port=12260]" << endl;
+        return 0;
+	}
+
+	int workerNum = 4;
+	int idleNum = 400;
+	int heavyNum = 8;
+	int testTimeSecs = 5;
+	int busyMicros = 200;
+	unsigned int port = 12260;
+
+	Worker::LoadBalanceStrategy strategy = Worker::LOAD_BALANCE_STRATEGY_TOKEN_RING_BY_METRIC_SMALLER;
+	if (std::strcmp(argv[1], "utilization") == 0)
+	{
+		strategy = Worker::LOAD_BALANCE_STRATEGY_TOKEN_RING_BY_UTILIZATION;
+	}
+
+	if (argc > 2) sscanf(argv[2], "%d", &workerNum);
+	if (argc > 3) sscanf(argv[3], "%d", &idleNum);
+	if (argc > 4) sscanf(argv[4], "%d", &heavyNum);
+	if (argc > 5) sscanf(argv[5], "%d", &testTimeSecs);
+	if (argc > 6) sscanf(argv[6], "%d", &busyMicros);
+	if (argc > 7) sscanf(argv[7], "%u", &port);
+
+	Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+	Logger::getInstance().setLogFile("skewed-log.txt");
+	LOG_INFO("skewed load balancing test, strategy %s, %d workers, %d idle connections, %d heavy connections",
+		argv[1], workerNum, idleNum, heavyNum);
+
+	std::string ip("127.0.0.1");
+	std::vector<EventLoop*> serverLoops;
+
+	TcpServer server(ip, static_cast<unsigned short>(port));
+	server.setWorkerNum(workerNum);
+	server.setWorkerLoadBalanceStrategy(strategy);
+	server.setWorkerUtilization(true);  // printed for both strategies
+
+	// tells the client which worker serves the connection
+	server.setNewTcpConnectionHandler([&](TcpConnection &tcpConn){
+		char index = 0;
+		for (size_t i = 0; i < serverLoops.size(); i++)
+		{
+			if (serverLoops[i] == tcpConn.getLoop())
+			{
+				index = static_cast<char>(i);
+			}
+		}
+		tcpConn.send(&index, 1);
+	});
+
+	server.setReadHandler([&](TcpConnection &tcpConn){
+		Buffer &buffer = tcpConn.getInputBuffer();
+		size_t n = buffer.size();
+		buffer.deleteBegin(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			int64_t end = TimeUtil::currentMonoTimeMicros() + busyMicros;
+			while (TimeUtil::currentMonoTimeMicros() < end)
+			{}
+			tcpConn.send(&kHeavyRequest, 1);
+		}
+	});
+
+	server.setPeerShutdownHandler([](TcpConnection &tcpConn){
+		tcpConn.close();
+	});
+
+	server.start();
+	serverLoops = server.getWorkersLoops();
+
+	EventLoop loop;
+	int idleConnected = 0;
+	int heavyConnected = 0;
+	int64_t heavyResponses = 0;
+	int64_t heavyBegin = 0;
+
+	std::vector<std::unique_ptr<Client>> idleClients;
+	std::vector<std::unique_ptr<Client>> heavyClients;
+
+	auto startTest = [&]{
+		heavyBegin = loop.now();
+		heavyResponses = 0;
+
+		loop.runAfter(1000 * testTimeSecs, [&]{
+			int64_t testTime = loop.now() - heavyBegin;
+			std::vector<int> heavyPerWorker(workerNum, 0);
+			for (auto &client : heavyClients)
+			{
+				if (client->worker >= 0)
+				{
+					heavyPerWorker[client->worker]++;
+				}
+			}
+
+			std::vector<int> utilizations = server.getWorkersUtilizations();
+			std::vector<int> connections = server.getTcpWorkersConnectionNums();
+
+			cout << "strategy=" << argv[1] << ", heavy requests/sec=" << heavyResponses * 1000 / testTime << endl;
+			for (int i = 0; i < workerNum; i++)
+			{
+				cout << "  worker " << i << ": connections=" << connections[i] << ", heavy connections=" << heavyPerWorker[i] 
+				     << ", utilization=" << utilizations[i] / 10.0 << "%" << endl;
+			}
+
+			for (auto &client : heavyClients)
+			{
+				client->tcpClient->close();
+			}
+			for (auto &client : idleClients)
+			{
+				client->tcpClient->close();
+			}
+			loop.quit();
+		});
+	};
+
+	auto connectHeavy = [&]{
+		std::unique_ptr<Client> client(new Client);
+		Client *c = client.get();
+		c->tcpClient.reset(new TcpClient(&loop));
+		c->tcpClient->setReadHandler([&, c](TcpConnection &tcpConn){
+			Buffer &buffer = tcpConn.getInputBuffer();
+			size_t n = buffer.size();
+			if (c->worker < 0)
+			{
+				c->worker = buffer.data()[0];
+				n--;
+				if (++heavyConnected == heavyNum)
+				{
+					startTest();
+				}
+			}
+			else
+			{
+				heavyResponses += n;
+			}
+			buffer.deleteBegin(buffer.size());
+			tcpConn.send(&kHeavyRequest, 1);
+		});
+		c->tcpClient->connect(ip, static_cast<unsigned short>(port));
+		heavyClients.push_back(std::move(client));
+	};
+
+	// the idle connections on worker 0 are closed, so it holds the fewest connections
+	auto onIdleConnected = [&]{
+		for (auto &client : idleClients)
+		{
+			if (client->worker == 0)
+			{
+				client->tcpClient->close();
+			}
+		}
+
+		for (int i = 0; i < heavyNum; i++)
+		{
+			loop.runAfter(kHeavyConnectIntervalMillis * (i + 1), connectHeavy);
+		}
+	};
+
+	for (int i = 0; i < idleNum; i++)
+	{
+		std::unique_ptr<Client> client(new Client);
+		Client *c = client.get();
+		c->tcpClient.reset(new TcpClient(&loop));
+		c->tcpClient->setReadHandler([&, c](TcpConnection &tcpConn){
+			Buffer &buffer = tcpConn.getInputBuffer();
+			c->worker = buffer.data()[0];
+			buffer.deleteBegin(buffer.size());
+			if (++idleConnected == idleNum)
+			{
+				onIdleConnected();
+			}
+		});
+		c->tcpClient->connect(ip, static_cast<unsigned short>(port));
+		idleClients.push_back(std::move(client));
+	}
+
+	loop.loop();
+	server.stop();
+}
@@ -0,0 +1,85 @@
+#include <easynet/EventLoop.h>
+#include <easynet/Timer.h>
+#include <easynet/utils/log.h>
+#include <cstdio>
+#include <vector>
+#include <random>
+#include <iostream>
+
+using namespace std;
+using namespace easynet;
+
+// every timer restarts itself after a random delay in [0, @spreadMillis),
+// like the per-connection timers of a busy server.
+int main(int argc, const char* argv[])
+{
+	if (argc < 4)
+	{
+        cout << "usage:" << argv[0] << " <timers> <slack(millis)> <test_time(seconds)> [spread(millis), 2000 by default]" << endl;
+        return 0;
+	}
+
+	Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+	Logger::getInstance().setLogFile("timer-log.txt");
+
+	int timerNum = 0;
+	int slackMillis = 0;
+	int testTimeSecs = 0;
+	int spreadMillis = 2000;
+
+	sscanf(argv[1], "%d", &timerNum);
+	sscanf(argv[2], "%d", &slackMillis);
+	sscanf(argv[3], "%d", &testTimeSecs);
+	if (argc > 4)
+	{
+		sscanf(argv[4], "%d", &spreadMillis);
+	}
+
+	LOG_INFO("to test %d timers, slack %d millis, spread %d millis, test time %d seconds", 
+		timerNum, slackMillis, spreadMillis, testTimeSecs);
+
+	uniform_int_distribution<int> u(0, spreadMillis - 1);
+	default_random_engine e(TimeUtil::now());
+
+	EventLoop loop;
+
+	int64_t totalTimeouts = 0;
+	int64_t totalLateness = 0;
+	int64_t maxLateness = 0;
+
+	std::vector<Timer*> timers(timerNum, nullptr);
+	for (int i = 0; i < timerNum; i++)
+	{
+		timers[i] = loop.runAfter(u(e), [&, i]{
+			Timer *timer = timers[i];
+			int64_t lateness = loop.now() - timer->getWhen();
+			totalTimeouts++;
+			totalLateness += lateness;
+			if (lateness > maxLateness)
+			{
+				maxLateness = lateness;
+			}
+			timer->restart(u(e));
+		}, 0, slackMillis);
+	}
+
+	uint64_t beginWakeups = loop.wakeups();
+	int64_t begin = loop.now();
+	loop.runAfter(1000 * testTimeSecs, [&]{
+		int64_t testTime = loop.now() - begin;
+		uint64_t wakeups = loop.wakeups() - beginWakeups;
+		double wakeupsPerSec = testTime > 0 ? wakeups * 1000.0 / testTime : 0;
+		double avrLateness = totalTimeouts > 0 ? static_cast<double>(totalLateness) / totalTimeouts : 0;
+
+		LOG_INFO("timers=%d, slack=%d millis, timeouts=%lld, wakeups=%llu, wakeups/sec=%.1f, avrLateness=%.2f millis, maxLateness=%lld millis", 
+			timerNum, slackMillis, totalTimeouts, wakeups, wakeupsPerSec, avrLateness, maxLateness);
+
+		cout << "timers=" << timerNum << ", slack=" << slackMillis << " millis, timeouts=" << totalTimeouts
+		     << ", wakeups=" << wakeups << ", wakeups/sec=" << wakeupsPerSec 
+		     << ", avrLateness=" << avrLateness << " millis, maxLateness=" << maxLateness << " millis" << endl;
+
+		loop.quit();
+	});
+
+	loop.loop();
+}
@@ -0,0 +1,97 @@
+#include <easynet/TraceRing.h>
+#include <cstdio>
+#include <ctime>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+using namespace easynet;
+
+namespace
+{
+
+std::string formatTime(int64_t micros)
+{
+	time_t secs = static_cast<time_t>(micros / 1000000);
+	struct tm tm;
+	::localtime_r(&secs, &tm);
+
+	char buf[64];
+	size_t n = ::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+	::snprintf(buf + n, sizeof(buf) - n, ".%06d", static_cast<int>(micros % 1000000));
+	return buf;
+}
+
+}
+
+// decodes the trace files written by EventLoop::enableTrace(), the records of all files are merged by time
+int main(int argc, const char* argv[])
+{
+	bool csv = false;
+	std::vector<std::string> fileNames;
+	for (int i = 1; i < argc; i++)
+	{
+		if (::strcmp(argv[i], "-csv") == 0)
+		{
+			csv = true;
+		}
+		else
+		{
+			fileNames.push_back(argv[i]);
+		}
+	}
+
+	if (fileNames.empty())
+	{
+		cout << "usage:" << argv[0] << " [-csv] <trace_file>..." << endl;
+		return 0;
+	}
+
+	std::vector<TraceRecord> records;
+	for (auto &fileName : fileNames)
+	{
+		std::vector<TraceRecord> v;
+		TraceFileHeader header;
+		if (TraceRing::readFile(fileName, &v, &header) != 0)
+		{
+			fprintf(stderr, "%s isn't a trace file\n", fileName.c_str());
+			return 1;
+		}
+
+		if (header.written > header.capacity)
+		{
+			fprintf(stderr, "%s: loop %u, the oldest %llu records were overwritten\n", fileName.c_str(), 
+				header.loopId, static_cast<unsigned long long>(header.written - header.capacity));
+		}
+		records.insert(records.end(), v.begin(), v.end());
+	}
+
+	// the records of a loop are in order already
+	std::stable_sort(records.begin(), records.end(), [](const TraceRecord &lhs, const TraceRecord &rhs){
+		return lhs.timeMicros < rhs.timeMicros;
+	});
+
+	if (csv)
+	{
+		printf("time_micros,loop,fd,event,arg1,arg2\n");
+	}
+
+	for (auto &r : records)
+	{
+		if (csv)
+		{
+			printf("%lld,%u,%d,%s,%lld,%lld\n", static_cast<long long>(r.timeMicros), r.loopId, r.fd, 
+				TraceRing::getEventName(r.event), static_cast<long long>(r.arg1), static_cast<long long>(r.arg2));
+		}
+		else
+		{
+			printf("%s loop:%-3u fd:%-6d %-14s %lld %lld\n", formatTime(r.timeMicros).c_str(), r.loopId, r.fd,
+				TraceRing::getEventName(r.event), static_cast<long long>(r.arg1), static_cast<long long>(r.arg2));
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,128 @@
+#include <easynet/UdpServer.h>
+#include <easynet/UdpConnection.h>
+#include <easynet/EventLoop.h>
+#include <easynet/utils/TimeUtil.h>
+#include <easynet/utils/log.h>
+#include <cstdio>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iostream>
+
+using namespace std;
+using namespace easynet;
+
+namespace
+{
+
+const int kSegmentsPerCall = 64;
+
+std::atomic<bool> stopped(false);
+std::atomic<uint64_t> numReceived(0);
+std::atomic<uint64_t> bytesReceived(0);
+std::atomic<uint64_t> numCalls(0);  // times the handler was called
+
+// sends datagrams of @payload bytes, 64 per call
+void sendDatagrams(bool gso, const std::string &ip, unsigned short port, int payload)
+{
+	EventLoop loop;
+	UdpConnection client(&loop);
+	client.connect(ip, port);
+
+	std::string data(payload * kSegmentsPerCall, 'x');
+	std::vector<UdpDatagram> datagrams;
+	for (int i = 0; i < kSegmentsPerCall; i++)
+	{
+		datagrams.push_back(UdpDatagram{data.data() + i * payload, static_cast<size_t>(payload), nullptr, false});
+	}
+
+	while (!stopped)
+	{
+		if (gso)
+		{
+			client.sendSegments(data.data(), data.size(), payload);
+		}
+		else
+		{
+			client.sendBatch(datagrams.data(), kSegmentsPerCall);
+		}
+	}
+}
+
+}
+
+// loopback udp throughput at several payload sizes, the sender sends 64 datagrams per call with sendmmsg()(mmsg)
+// or one buffer with UDP_SEGMENT(gso), the server receives them with recvmmsg(), coalesced by UDP_GRO in gro mode.
+int main(int argc, const char* argv[])
+{
+	if (argc < 2)
+	{
+        cout << "usage:" << argv[0] << " <mmsg|gso|gro> [test_time_per_payload(seconds)=3] [payloads=64,512,1200,1472] [port=12271]" << endl;
+        return 0;
+	}
+
+	std::string mode = argv[1];
+	bool gso = (mode == "gso" || mode == "gro");
+	int testTimeSecs = 3;
+	std::string payloads = "64,512,1200,1472";
+	unsigned int port = 12271;
+
+	if (argc > 2) sscanf(argv[2], "%d", &testTimeSecs);
+	if (argc > 3) payloads = argv[3];
+	if (argc > 4) sscanf(argv[4], "%u", &port);
+
+	Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_WARN);
+	Logger::getInstance().setLogFile("udpgso-log.txt");
+
+	UdpServer server(static_cast<unsigned short>(port));
+	server.setBatchMessageHandler([](UdpConnection &udpConnection, const UdpDatagram *datagrams, int num){
+		uint64_t bytes = 0;
+		for (int i = 0; i < num; i++)
+		{
+			bytes += datagrams[i].len;
+		}
+		numReceived.fetch_add(num, std::memory_order_relaxed);
+		bytesReceived.fetch_add(bytes, std::memory_order_relaxed);
+		numCalls.fetch_add(1, std::memory_order_relaxed);
+	});
+	server.setGro(mode == "gro");
+	server.start();
+
+	printf("mode:%s\n", mode.c_str());
+	printf("%10s %12s %12s %16s\n", "payload", "MB/s", "pps", "datagrams/call");
+
+	std::istringstream is(payloads);
+	std::string item;
+	while (std::getline(is, item, ','))
+	{
+		int payload = 0;
+		if (sscanf(item.c_str(), "%d", &payload) != 1 || payload <= 0)
+		{
+			continue;
+		}
+
+		stopped = false;
+		numReceived = 0;
+		bytesReceived = 0;
+		numCalls = 0;
+
+		int64_t begin = TimeUtil::currentMonoTimeMicros();
+		std::thread sender(sendDatagrams, gso, "127.0.0.1", static_cast<unsigned short>(port), payload);
+		std::this_thread::sleep_for(std::chrono::seconds(testTimeSecs));
+		stopped = true;
+		sender.join();
+		// the datagrams left in the socket's receive buffer
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		double secs = (TimeUtil::currentMonoTimeMicros() - begin) / 1000000.0;
+
+		uint64_t calls = numCalls.load();
+		printf("%10d %12.1f %12.0f %16.1f\n", payload, bytesReceived.load() / secs / (1024 * 1024),
+			numReceived.load() / secs, calls > 0 ? static_cast<double>(numReceived.load()) / calls : 0.0);
+	}
+
+	server.stop();
+	return 0;
+}
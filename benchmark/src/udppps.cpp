@@ -0,0 +1,167 @@
+#include <easynet/UdpServer.h>
+#include <easynet/UdpConnection.h>
+#include <easynet/Socket.h>
+#include <easynet/utils/TimeUtil.h>
+#include <easynet/utils/log.h>
+#include <cstdio>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include <memory>
+#include <iostream>
+
+using namespace std;
+using namespace easynet;
+
+namespace
+{
+
+const int kSendBatchSize = 64;
+const int kFlowsPerSender = 16;  // sockets of a sender, spread over the workers by the kernel
+
+std::atomic<bool> stopped(false);
+std::atomic<uint64_t> numSent(0);
+std::atomic<uint64_t> numReceived(0);
+std::atomic<uint64_t> numReads(0);  // times the handler was called
+
+// blasts datagrams of @payload bytes with sendmmsg()
+void sendDatagrams(const InetAddr &serverAddr, int payload)
+{
+	std::vector<std::unique_ptr<Socket>> sockets;
+	for (int i = 0; i < kFlowsPerSender; i++)
+	{
+		sockets.push_back(std::unique_ptr<Socket>(new Socket(Socket::SOCKET_UDP)));
+	}
+	std::string data(payload, 'x');
+
+	struct iovec iovecs[kSendBatchSize];
+	struct mmsghdr msgs[kSendBatchSize];
+	std::memset(msgs, 0, sizeof(msgs));
+	for (int i = 0; i < kSendBatchSize; i++)
+	{
+		iovecs[i].iov_base = const_cast<char*>(data.data());
+		iovecs[i].iov_len = data.size();
+		msgs[i].msg_hdr.msg_name = const_cast<struct sockaddr_in*>(&serverAddr.getSockAddr());
+		msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+		msgs[i].msg_hdr.msg_iov = &iovecs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	uint64_t sent = 0;
+	for (int i = 0; !stopped; i++)
+	{
+		int n = sockets[i % kFlowsPerSender]->sendMmsg(msgs, kSendBatchSize);
+		if (n > 0)
+		{
+			sent += n;
+		}
+	}
+	numSent += sent;
+}
+
+}
+
+// udp packets per second of the server with 1 to max_workers workers, receiving one datagram per recvfrom()(single),
+// or up to 64 datagrams per recvmmsg()(batch), or passing those one by one as views of the receive slots(view). the workers share the port with SO_REUSEPORT, and each sender
+// sends with sendmmsg() from 16 sockets in turn, so the kernel spreads the flows over the workers.
+// with steer, a datagram goes to the worker bound to the cpu handling it in the kernel.
+int main(int argc, const char* argv[])
+{
+	if (argc < 2)
+	{
+        cout << "usage:" << argv[0] << " <single|batch|view> [senders=2] [test_time(seconds)=5] [payload=64] "
+             << "[max_workers=1] [hash|steer] [port=12270]" << endl;
+        return 0;
+	}
+
+	bool batch = (std::strcmp(argv[1], "batch") == 0);
+	bool view = (std::strcmp(argv[1], "view") == 0);
+	int senderNum = 2;
+	int testTimeSecs = 5;
+	int payload = 64;
+	int maxWorkerNum = 1;
+	bool steer = false;
+	unsigned int port = 12270;
+
+	if (argc > 2) sscanf(argv[2], "%d", &senderNum);
+	if (argc > 3) sscanf(argv[3], "%d", &testTimeSecs);
+	if (argc > 4) sscanf(argv[4], "%d", &payload);
+	if (argc > 5) sscanf(argv[5], "%d", &maxWorkerNum);
+	if (argc > 6) steer = (std::strcmp(argv[6], "steer") == 0);
+	if (argc > 7) sscanf(argv[7], "%u", &port);
+
+	Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_WARN);
+	Logger::getInstance().setLogFile("udppps-log.txt");
+
+	printf("mode:%s senders:%d payload:%d bytes %s\n", argv[1], senderNum, payload, steer ? "steered by cpu" : "");
+	printf("%8s %12s %12s %8s %16s\n", "workers", "sent pps", "received pps", "lost", "datagrams/call");
+
+	for (int workerNum = 1; workerNum <= maxWorkerNum; workerNum++)
+	{
+		stopped = false;
+		numSent = 0;
+		numReceived = 0;
+		numReads = 0;
+
+		UdpServer server(static_cast<unsigned short>(port));
+		server.setWorkerNum(workerNum);
+		server.setWorkerCpuAutoPlacement(true);
+		server.setWorkerCpuSteering(steer);
+		if (batch)
+		{
+			server.setBatchMessageHandler([](UdpConnection &udpConnection, const UdpDatagram *datagrams, int num){
+				numReceived.fetch_add(num, std::memory_order_relaxed);
+				numReads.fetch_add(1, std::memory_order_relaxed);
+			});
+		}
+		else if (view)
+		{
+			server.setDatagramHandler([](UdpConnection &udpConnection, const UdpDatagram &datagram){
+				numReceived.fetch_add(1, std::memory_order_relaxed);
+				numReads.fetch_add(1, std::memory_order_relaxed);
+			});
+		}
+		else
+		{
+			server.setMessageHandler([](UdpConnection &udpConnection){
+				Buffer &buffer = udpConnection.getInputBuffer();
+				buffer.deleteBegin(buffer.size());
+				numReceived.fetch_add(1, std::memory_order_relaxed);
+				numReads.fetch_add(1, std::memory_order_relaxed);
+			});
+		}
+		server.start();
+
+		InetAddr serverAddr("127.0.0.1", static_cast<unsigned short>(port));
+		std::vector<std::thread> senders;
+		int64_t begin = TimeUtil::currentMonoTimeMicros();
+		for (int i = 0; i < senderNum; i++)
+		{
+			senders.push_back(std::thread(sendDatagrams, serverAddr, payload));
+		}
+
+		std::this_thread::sleep_for(std::chrono::seconds(testTimeSecs));
+		stopped = true;
+		for (auto &sender : senders)
+		{
+			sender.join();
+		}
+		int64_t elapsedMicros = TimeUtil::currentMonoTimeMicros() - begin;
+
+		// the datagrams left in the sockets' receive buffers
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		server.stop();
+
+		double secs = elapsedMicros / 1000000.0;
+		uint64_t sent = numSent.load();
+		uint64_t received = numReceived.load();
+		uint64_t reads = numReads.load();
+		printf("%8d %12.0f %12.0f %7.2f%% %16.1f\n", workerNum, sent / secs, received / secs,
+			sent > 0 ? 100.0 * (sent - received) / sent : 0.0,
+			reads > 0 ? static_cast<double>(received) / reads : 0.0);
+	}
+
+	return 0;
+}
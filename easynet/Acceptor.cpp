@@ -57,6 +57,8 @@ void Acceptor::onConnectionArrived()
 			acceptedConnections++;
 			LOG_TRACE("accept connection from %s on server %s, listen socket fd = %d, accepted socket fd = %d, accepted %d connections this round", 
 				peerAddr.toString().c_str(), listenAddr_.toString().c_str(), listenSocket_->fd(), socketFd, acceptedConnections);
+			loop_->trace(TRACE_EVENT_ACCEPT, socketFd, listenSocket_->fd(), acceptedConnections);
+			loop_->addMetric(METRIC_ACCEPTS, 1);
 
 			Socket socket(socketFd);
 			socket.setNoDelay(true);
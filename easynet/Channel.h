@@ -61,16 +61,19 @@ public:
 	void enableAll();
 
 	void disableRdHup() { rdHupDisabled_ = true; }
+	void enableRdHup()  { rdHupDisabled_ = false; }
 	void disableReading();
 	void disableWriting();
 	void disableAll();
 	void clear() { rdHupDisabled_ = false; disableAll(); }
 
 	void resetFd(int fd);
+	void resetLoop(EventLoop *loop) { loop_ = loop; } // only when the channel is not monitoring, see TcpConnection::attachToLoop()
 	
 	int  events() const { return events_; }
 	bool hasEvent() const { return events_ != 0; }
 	void setRevents(int revents) { revents_ = revents; }  // epoller will tell us what events have been triggered
+	int  revents() const { return revents_; }
 
 	bool monistoring() const { return monitoring_; }
 	bool writing() const { return monitoring_ && (events_ & EASYNET_POLL_WRITE); }
@@ -8,6 +8,7 @@
 #include "Epoller.h"
 #include "Channel.h"
 #include "EventLoop.h"
+#include "Probes.h"
 #include "utils/log.h"
 
 using namespace easynet;
@@ -43,6 +44,8 @@ void Epoller::poll(int timeoutMillis, ChannelArray *channels, ChannelArray *list
 
 	LOG_TRACE("returned from epoll_wait(), timeout = %d millis, epoll fd = %d, %d events triggered", 
 		timeoutMillis, epollFd_, numEvents);
+	loop_->trace(TRACE_EVENT_EPOLL_WAIT, epollFd_, timeoutMillis, numEvents < 0 ? -errno : numEvents);
+	EASYNET_PROBE2(epoll_wake, epollFd_, numEvents < 0 ? -errno : numEvents);
 
 	if (numEvents > 0)
 	{
@@ -82,6 +85,7 @@ void Epoller::getActiveChannels(int numEvents, ChannelArray *channels, ChannelAr
 		int events = 0;
 
 		LOG_TRACE("triggered %s on fd %d, epoll fd = %d", getEventsName(revents).c_str(), channel->fd(), epollFd_);
+		loop_->trace(TRACE_EVENT_EPOLL_EVENT, channel->fd(), revents);
 
 		// error occurred, or fd closed
 		if (revents & EPOLLERR)
@@ -161,6 +165,7 @@ int Epoller::update(int oper, Channel *channel)
 
 	LOG_TRACE("%s events:%s, fd = %d, epoll fd =%d", 
 		getEpollCtlOperName(oper).c_str(), getEventsName(event.events).c_str(), channel->fd(), epollFd_);
+	loop_->trace(TRACE_EVENT_EPOLL_CTL, channel->fd(), oper, event.events);
 
 	event.data.ptr = channel;
 	if (::epoll_ctl(epollFd_, oper, channel->fd(), &event) < 0)
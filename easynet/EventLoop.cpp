@@ -4,15 +4,19 @@
 
 #include <unistd.h>
 #include <cstring>
+#include <cmath>
 #include <utility>
 
 #include "EventLoop.h"
+#include "Probes.h"
 #include "utils/log.h"
 
 namespace
 {
 
 const int kMaxTimeResolution = 1000; // milli-seconds
+const int64_t kUtilizationSampleMicros = 100000;
+const double kUtilizationTauMicros = 400000.0;  // time constant of the EWMA, a 100 ms sample counts for about 1/4
 
 }
 
@@ -21,17 +25,37 @@ using namespace easynet;
 EventLoop::EventLoop(int timeResolutionMillis)
 	            : looping_(false),
 				  quit_(false),
+				  wakeups_(0),
+				  busyMicros_(0),
+				  idleMicros_(0),
+				  utilizationEnabled_(false),
+				  utilization_(0),
+				  pollingSinceMicros_(nullptr),
+				  queuedBytes_(0),
 				  timeResolutionMillis_(timeResolutionMillis),
+				  metrics_(nullptr),
 				  epoller_(this),
 				  notifier_(this),
+				  numWakeupFunctors_(0),
 				  timerHeap_(this),
+				  preciseTimerHeap_(this, true),
+				  preciseDeadline_(0),
 				  signalHandlerMgr_(this),
 				  idleTimeWheel_(nullptr)
 {
 	updateTime();
+	createdTimeMillis_ = now_;
+	lastPollEndMicros_ = nowMicros();
+	sampleBeginMicros_ = lastPollEndMicros_;
 	initTimeUpdater();
 }
 
+EventLoop::~EventLoop()
+{
+	// no loop relays a signal to this one after it returns, before any member is destroyed
+	signalHandlerMgr_.unregisterSignalListeners();
+}
+
 void EventLoop::initTimeUpdater()
 {
 	if (timeResolutionMillis_ <= 0)
@@ -49,6 +73,24 @@ void EventLoop::initTimeUpdater()
 		                        std::bind(&EventLoop::updateTime, this)));
 }
 
+// the time updater only ticks while there are timers in the loop, 
+// so an idle loop without timers isn't woken up every @timeResolutionMillis_ ms
+void EventLoop::adjustTimeUpdater()
+{
+	if (hasTimers())
+	{
+		if (!timeUpdater_->ticking())
+		{
+			updateTime();
+			timeUpdater_->start();
+		}
+	}
+	else
+	{
+		timeUpdater_->stop();
+	}
+}
+
 void EventLoop::loop()
 {
 	if (looping_)
@@ -76,12 +118,18 @@ void EventLoop::waitAndProcessEventsAndTimers(int timeoutMillis, const Functor *
 	int earliestTimersTimeoutMillis;
 	if (timeResolutionEnabled())
 	{
+		adjustTimeUpdater();
 		earliestTimersTimeoutMillis = EASYNET_TIMER_INFINITE;
 	}
 	else
 	{
 		earliestTimersTimeoutMillis = getEarliestTimersTimeout();
 	}
+
+	if (preciseTimerFd_)
+	{
+		armPreciseTimer();
+	}
 	
 	if (timeoutMillis == EASYNET_TIMER_INFINITE ||
 		(earliestTimersTimeoutMillis != EASYNET_TIMER_INFINITE && timeoutMillis > earliestTimersTimeoutMillis))
@@ -90,19 +138,41 @@ void EventLoop::waitAndProcessEventsAndTimers(int timeoutMillis, const Functor *
 	}
 
 	int64_t delta = now();
+	LoopStats *stats = loopStats_.get();  // taken once, the handlers may enable the loop stats
+	bool timed = utilizationEnabled_ || stats;
+	int64_t pollBeginNanos = timed ? TimeUtil::currentMonoTimeNanos() : 0;
+	if (pollingSinceMicros_)
+	{
+		pollingSinceMicros_->store(pollBeginNanos / 1000, std::memory_order_relaxed);
+	}
 	epoller_.poll(timeoutMillis, &activeChannels_, &activeListenChannels_);  //-1: blocking forever; 0: return immediatly
+	wakeups_++;
+	if (pollingSinceMicros_)
+	{
+		pollingSinceMicros_->store(0, std::memory_order_relaxed);
+	}
+	int64_t pollEndNanos = timed ? TimeUtil::currentMonoTimeNanos() : 0;
+	if (utilizationEnabled_)
+	{
+		updateUtilization(pollBeginNanos / 1000, pollEndNanos / 1000);
+	}
+	if (metrics_)
+	{
+		metrics_->add(METRIC_WAKEUPS, 1);
+		metrics_->set(METRIC_TIMERS, static_cast<int64_t>(timerHeap_.size() + preciseTimerHeap_.size()));
+	}
 
-	// not set @timeResolutionMillis_
-	if (!timeResolutionEnabled())
+	// not set @timeResolutionMillis_, or the time updater has been stopped since there are no timers
+	if (!timeResolutionEnabled() || !timeUpdater_->ticking())
 	{
-		// if not set @timeResolutionMillis_, update current time(@now_) every time when returned from epoll_wait()
+		// update current time(@now_) every time when returned from epoll_wait()
 		updateTime();
 	}
 
 	// for each active fd that being monitored in @epoller_, call it's event handler
 	for (auto channel : activeListenChannels_)
 	{
-		channel->handleEvent();
+		handleChannelEvent(channel);
 	}
 
 	if (!activeListenChannels_.empty() && functorRunAfterAccept)
@@ -112,16 +182,106 @@ void EventLoop::waitAndProcessEventsAndTimers(int timeoutMillis, const Functor *
 
 	for (auto channel : activeChannels_)
 	{
-		channel->handleEvent();
+		handleChannelEvent(channel);
 	}
 
+	int64_t handlersEndNanos = stats ? TimeUtil::currentMonoTimeNanos() : 0;
+
 	runWakeupFunctors(); // to run other threads' callback function
 
+	int64_t functorsEndNanos = stats ? TimeUtil::currentMonoTimeNanos() : 0;
+	int64_t timersEndNanos = functorsEndNanos;
+
 	delta = now() - delta;
 	if (delta || timeoutMillis == 0)
 	{
 		expireTimers();
+		if (stats)
+		{
+			timersEndNanos = TimeUtil::currentMonoTimeNanos();
+			stats->recordHandler(LOOP_HANDLER_TIMERS, -1, 0, timersEndNanos - functorsEndNanos);
+		}
+	}
+
+	if (stats)
+	{
+		stats->recordPhase(LOOP_PHASE_POLL, pollEndNanos - pollBeginNanos);
+		stats->recordPhase(LOOP_PHASE_HANDLERS, handlersEndNanos - pollEndNanos);
+		stats->recordPhase(LOOP_PHASE_FUNCTORS, functorsEndNanos - handlersEndNanos);
+		stats->recordPhase(LOOP_PHASE_TIMERS, timersEndNanos - functorsEndNanos);
+		stats->recordIteration(timersEndNanos - pollEndNanos, static_cast<int>(activeChannels_.size() + activeListenChannels_.size()));
+	}
+}
+
+// the channel may be destroyed by its handler, its fd and events are read before
+void EventLoop::handleChannelEvent(Channel *channel)
+{
+	if (!loopStats_)
+	{
+		channel->handleEvent();
+		return;
+	}
+
+	LoopHandlerKind kind = channel->isListenChannel() ? LOOP_HANDLER_ACCEPT : LOOP_HANDLER_CHANNEL;
+	int fd = channel->fd();
+	int events = channel->revents();
+	int64_t begin = TimeUtil::currentMonoTimeNanos();
+	channel->handleEvent();
+	loopStats_->recordHandler(kind, fd, events, TimeUtil::currentMonoTimeNanos() - begin);
+}
+
+void EventLoop::updateUtilization(int64_t pollBeginMicros, int64_t pollEndMicros)
+{
+	busyMicros_ += pollBeginMicros - lastPollEndMicros_;
+	idleMicros_ += pollEndMicros - pollBeginMicros;
+	lastPollEndMicros_ = pollEndMicros;
+
+	if (pollEndMicros - sampleBeginMicros_ < kUtilizationSampleMicros)
+	{
+		return;
+	}
+
+	// a sample that took longer, e.g. a long wait in epoll_wait(), moves the EWMA further
+	int64_t total = busyMicros_ + idleMicros_;
+	double sample = total > 0 ? busyMicros_ * 1000.0 / total : 0;
+	utilization_ += (sample - utilization_) * (1.0 - std::exp(-total / kUtilizationTauMicros));
+
+	busyMicros_ = 0;
+	idleMicros_ = 0;
+	sampleBeginMicros_ = pollEndMicros;
+}
+
+void EventLoop::enableUtilization(std::atomic<int64_t> *pollingSinceMicros)
+{
+	if (!utilizationEnabled_)
+	{
+		resetUtilization();
+		utilizationEnabled_ = true;
+	}
+
+	if (pollingSinceMicros)
+	{
+		pollingSinceMicros_ = pollingSinceMicros;
+	}
+}
+
+void EventLoop::resetUtilization()
+{
+	busyMicros_ = 0;
+	idleMicros_ = 0;
+	lastPollEndMicros_ = nowMicros();
+	sampleBeginMicros_ = lastPollEndMicros_;
+	utilization_ = 0;
+}
+
+int EventLoop::decayUtilization(int utilization, int64_t idleMicros)
+{
+	if (idleMicros <= 0)
+	{
+		return utilization;
 	}
+
+	return static_cast<int>(utilization * std::exp(-idleMicros / kUtilizationTauMicros) + 0.5);
 }
 
 void EventLoop::quit()
@@ -136,6 +296,7 @@ void EventLoop::wakeupAndRun(Functor &&func)
 	{
 		std::lock_guard<std::mutex> lock(mutex_);
 		wakeupFunctors_.push_back(std::move(func));
+		numWakeupFunctors_.store(static_cast<int>(wakeupFunctors_.size()), std::memory_order_relaxed);
 	}
 	wakeup();
 }
@@ -147,12 +308,93 @@ void EventLoop::runWakeupFunctors()
 	{
 		std::lock_guard<std::mutex> lock(mutex_);
 		functors.swap(wakeupFunctors_);
+		numWakeupFunctors_.store(0, std::memory_order_relaxed);
 	}
 
 	for (auto &functor : functors)
 	{
-		functor();
+		EASYNET_PROBE1(functor_run, functors.size());
+		if (loopStats_)
+		{
+			int64_t begin = TimeUtil::currentMonoTimeNanos();
+			functor();
+			loopStats_->recordHandler(LOOP_HANDLER_FUNCTOR, -1, 0, TimeUtil::currentMonoTimeNanos() - begin);
+		}
+		else
+		{
+			functor();
+		}
+	}
+}
+
+void EventLoop::enableStats(int64_t slowHandlerMicros)
+{
+	if (!loopStats_)
+	{
+		loopStats_.reset(new LoopStats(slowHandlerMicros));
+	}
+}
+
+bool EventLoop::getStats(LoopStatsSnapshot *snapshot) const
+{
+	if (!loopStats_)
+	{
+		return false;
 	}
+
+	loopStats_->snapshot(snapshot);
+	return true;
+}
+
+int EventLoop::enableTrace(const std::string &fileName, uint16_t loopId, size_t capacity)
+{
+	std::unique_ptr<TraceRing> traceRing(new TraceRing());
+	if (traceRing->open(fileName, loopId, capacity) != 0)
+	{
+		return -1;
+	}
+
+	traceRing_ = std::move(traceRing);
+	return 0;
+}
+
+double EventLoop::wakeupsPerSecond() const
+{
+	int64_t elapsed = TimeUtil::now() - createdTimeMillis_;
+	return elapsed > 0 ? wakeups_ * 1000.0 / elapsed : 0.0;
+}
+
+Timer* EventLoop::runAtMicros(int64_t whenMicros, TimerHandler &&handler, int64_t intervalMicros, int64_t slackMicros)
+{
+	if (!preciseTimerFd_)
+	{
+		preciseTimerFd_.reset(new TimerFdChannel(this, 0, std::bind(&EventLoop::expirePreciseTimers, this)));
+	}
+
+	// @preciseTimerFd_ will be armed before the loop waits next time
+	return preciseTimerHeap_.addTimer(whenMicros, std::move(handler), intervalMicros, slackMicros);
+}
+
+// only re-arms the timerfd when the earliest deadline has changed
+void EventLoop::armPreciseTimer()
+{
+	int64_t when = preciseTimerHeap_.getEarliestTimersDeadline();
+	if (when == EASYNET_TIMER_INFINITE)
+	{
+		when = 0;
+	}
+
+	if (when != preciseDeadline_)
+	{
+		preciseTimerFd_->setDeadline(when);
+		preciseDeadline_ = when;
+	}
+}
+
+void EventLoop::expirePreciseTimers()
+{
+	preciseDeadline_ = 0; // it's one-shot, disarmed after fired
+	addMetric(METRIC_TIMERS_EXPIRED, preciseTimerHeap_.expireTimers());
 }
 
 TimeWheel* EventLoop::addTimeWheel(int slots, int64_t intervalMillis)
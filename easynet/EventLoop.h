@@ -8,6 +8,7 @@
 #include <vector>
 #include <map>
 #include <mutex>
+#include <atomic>
 
 #include "Channel.h"
 #include "Epoller.h"
@@ -16,6 +17,9 @@
 #include "TimerHeap.h"
 #include "TimeWheel.h"
 #include "SignalHandlerMgr.h"
+#include "TraceRing.h"
+#include "LoopStats.h"
+#include "Metrics.h"
 #include "utils/TimeUtil.h"
 
 #define EASYNET_TIMER_INFINITE   -1
@@ -32,7 +36,7 @@ public:
 	using TimerHandler = TimerInHeap::TimerHandler;
 
 	explicit EventLoop(int timeResolutionMillis = 0);
-	~EventLoop() = default;
+	~EventLoop();
 
 	EventLoop(const EventLoop &rhs) = delete;
 	EventLoop& operator=(const EventLoop &rhs) = delete;
@@ -51,8 +55,32 @@ public:
     // CAN'T call this function in other thread
 	void updateChannel(Channel *channel) { epoller_.updateChannel(channel); } 
 
-	int64_t now() const { return now_; } // milliseconds, since 1970-1-1 00:00:00
+	// milliseconds, monotonic time of the loop, NOT since 1970-1-1 00:00:00.
+	// use wallTime() to convert it to wall-clock time
+	int64_t now() const { return now_; }
+	int64_t wallTime(int64_t loopTimeMillis) const { return TimeUtil::toSystemTimeMillis(loopTimeMillis); } // since 1970-1-1 00:00:00
+	// microseconds of CLOCK_MONOTONIC, read from the clock every time, NOT cached like now()
+	int64_t nowMicros() const { return TimeUtil::currentMonoTimeMicros(); }
 	bool timeResolutionEnabled() const { return timeResolutionMillis_ > 0; }
+	uint64_t wakeups() const { return wakeups_; }  // times the loop returned from waiting for events, see wakeupsPerSecond()
+	double wakeupsPerSecond() const;  // average since the loop was created
+
+	// measures utilization() from now on, at the cost of two clock reads per iteration, disabled in default.
+	// if @pollingSinceMicros is given, the loop sets it to when it begins waiting in epoll_wait() and
+	// to 0 when it returns, so other threads can account for a wait that hasn't ended, see decayUtilization().
+	void enableUtilization(std::atomic<int64_t> *pollingSinceMicros = nullptr);
+	bool utilizationEnabled() const { return utilizationEnabled_; }
+	// starts measuring over from 0, so the time a stopped loop didn't run doesn't count as busy
+	void resetUtilization();
+	// load of the loop, only valid in the loop thread, see Worker::getUtilization() for other threads.
+	// utilization() is the EWMA of the share of time spent outside epoll_wait(), in permille, 
+	// sampled every 100 ms or so, each sample weighted by the time it covers. 0 if not enabled.
+	int utilization() const { return static_cast<int>(utilization_ + 0.5); }
+	// @utilization as the EWMA would have it after @idleMicros more spent in epoll_wait()
+	static int decayUtilization(int utilization, int64_t idleMicros);
+	int64_t queuedBytes() const { return queuedBytes_; } // bytes waiting in the output buffers of the loop's connections
+	void addQueuedBytes(int64_t bytes) { queuedBytes_ += bytes; }
+	int pendingFunctors() const { return numWakeupFunctors_.load(std::memory_order_relaxed); } // functors passed to wakeupAndRun() and not run yet, can be called in other thread
 
 	// ---------------- functions runAt()  runAfter() can ONLY be called in event loop ------------------------//
 	//  ------------------------------------------------------------------------------------------------------------------------------------
@@ -69,6 +97,7 @@ public:
 	// |    it will be timed out every @intervalMillis milli seconds                                                                        |
 	//  ------------------------------------------------------------------------------------------------------------------------------------
 
+	// @whenMillis is a loop time, see now().
 	// when using time resolution(that is @timeResolutionMillis_>0), the timer's real timeout 
 	// might be delayed [0 ~ @timeResolutionMillis_) milli seconds,
 	// it means that the timer may be timedout between @whenMillis ~ @whenMillis+@timeResolutionMillis_.
@@ -76,11 +105,15 @@ public:
 	// .e.g:  
 	//     @timeResolutionMillis_ = 100 ms:
 	//       @whenMillis=141234000, than the timer will be timed out at 141234000~141234100 ms   
-	Timer* runAt(int64_t whenMillis, TimerHandler &&handler, int64_t intervalMillis = 0)      
-	{ return addTimer(whenMillis, std::move(handler), intervalMillis); }
+	//
+	// @slackMillis: the timer may be timed out up to @slackMillis later than @whenMillis,
+	// the loop coalesces the timers whose [when, when + slack] windows overlap into one wakeup.
+	// e.g. thousands of per-connection timers can share one wakeup instead of waking up the loop one by one.
+	Timer* runAt(int64_t whenMillis, TimerHandler &&handler, int64_t intervalMillis = 0, int64_t slackMillis = 0)      
+	{ return addTimer(whenMillis, std::move(handler), intervalMillis, slackMillis); }
 
-	Timer* runAt(int64_t whenMillis, const TimerHandler &handler, int64_t intervalMillis = 0) 
-	{ return runAt(whenMillis, TimerHandler(handler), intervalMillis); }
+	Timer* runAt(int64_t whenMillis, const TimerHandler &handler, int64_t intervalMillis = 0, int64_t slackMillis = 0) 
+	{ return runAt(whenMillis, TimerHandler(handler), intervalMillis, slackMillis); }
 
 	// when using time resolution(that is @timeResolutionMillis_>0):
 	//      @afterMillis <= @timeResolutionMillis_: the real timeout is between 0 ~ @timeResolutionMillis_ milli-seconds;
@@ -96,11 +129,26 @@ public:
 	//       @afterMillis = 200 ms, than the timer will be timedout after 100 ~ 200 ms;
 	//       @afterMillis = 299 ms, than the timer will be timedout after 200 ~ 300 ms;
 	//
-	Timer* runAfter(int64_t afterMillis, TimerHandler &&handler, int64_t intervalMillis = 0)      
-	{ return runAt(now() + afterMillis, std::move(handler), intervalMillis); }
+	Timer* runAfter(int64_t afterMillis, TimerHandler &&handler, int64_t intervalMillis = 0, int64_t slackMillis = 0)      
+	{ return runAt(now() + afterMillis, std::move(handler), intervalMillis, slackMillis); }
+
+	Timer* runAfter(int64_t afterMillis, const TimerHandler &handler, int64_t intervalMillis = 0, int64_t slackMillis = 0) 
+	{ return runAfter(afterMillis, TimerHandler(handler), intervalMillis, slackMillis); }
+
+	// ---------------- precise timers, can ONLY be called in event loop ------------------------//
+	// the times are microseconds, @whenMicros is based on nowMicros().
+	// they are kept in a separate heap and timed out by a timerfd armed for the earliest deadline, 
+	// so they are neither rounded to milli seconds nor delayed by @timeResolutionMillis_.
+	// restart() and remainTime() of the returned timer use microseconds as well, so does @slackMicros.
+	// restartMicros() and remainTimeMicros() take microseconds for any timer.
+	Timer* runAtMicros(int64_t whenMicros, TimerHandler &&handler, int64_t intervalMicros = 0, int64_t slackMicros = 0);
+	Timer* runAtMicros(int64_t whenMicros, const TimerHandler &handler, int64_t intervalMicros = 0, int64_t slackMicros = 0) 
+	{ return runAtMicros(whenMicros, TimerHandler(handler), intervalMicros, slackMicros); }
 
-	Timer* runAfter(int64_t afterMillis, const TimerHandler &handler, int64_t intervalMillis = 0) 
-	{ return runAfter(afterMillis, TimerHandler(handler), intervalMillis); }
+	Timer* runAfterMicros(int64_t afterMicros, TimerHandler &&handler, int64_t intervalMicros = 0, int64_t slackMicros = 0)
+	{ return runAtMicros(nowMicros() + afterMicros, std::move(handler), intervalMicros, slackMicros); }
+	Timer* runAfterMicros(int64_t afterMicros, const TimerHandler &handler, int64_t intervalMicros = 0, int64_t slackMicros = 0)
+	{ return runAfterMicros(afterMicros, TimerHandler(handler), intervalMicros, slackMicros); }
 
     // can only be called in event loop
 	TimeWheel* addTimeWheel(int slots, int64_t intervalMillis);
@@ -116,24 +164,74 @@ public:
 	
 	void signalRaised(int sig) { signalHandlerMgr_.signalRaised(sig); }
 
+	// records the events of the loop(see TraceEvent) into a ring of @capacity records in @fileName,
+	// decoded by benchmark/tracedump. called in the loop or before it runs, returns -1 on error
+	int enableTrace(const std::string &fileName, uint16_t loopId, size_t capacity);
+	void disableTrace() { traceRing_.reset(); }
+	TraceRing* getTraceRing() const { return traceRing_.get(); }
+	void trace(TraceEvent event, int fd, int64_t arg1 = 0, int64_t arg2 = 0)
+	{
+		if (traceRing_)
+		{
+			traceRing_->record(static_cast<uint16_t>(event), fd, arg1, arg2);
+		}
+	}
+
+	// measures the phases of every iteration, the channel handlers and functors, and the events per wakeup.
+	// a handler taking @slowHandlerMicros or longer is recorded with its fd and kind, never if it's 0.
+	// called in the loop or before it runs. it can't be disabled, since other threads may be reading it
+	void enableStats(int64_t slowHandlerMicros);
+	bool getStats(LoopStatsSnapshot *snapshot) const; // can be called in other thread, false if not enabled
+
+	// the loop and its connections count the built-in metrics(see BuiltinMetric) into @metrics, 
+	// which is written only by this loop. called before the loop runs, nullptr to stop counting
+	void setMetrics(MetricsShard *metrics) { metrics_ = metrics; }
+	MetricsShard* getMetrics() const { return metrics_; }
+	void addMetric(int metric, int64_t n)
+	{
+		if (metrics_)
+		{
+			metrics_->add(metric, n);
+		}
+	}
+
 private:
 	using TimeWheelContainer = std::list<std::unique_ptr<TimeWheel>> ;
 
 	void updateTime() { now_ = TimeUtil::now(); }
 	void initTimeUpdater();
+	void adjustTimeUpdater();
 	void runWakeupFunctors();
+	void handleChannelEvent(Channel *channel);
+	void updateUtilization(int64_t pollBeginMicros, int64_t pollEndMicros);
+	void armPreciseTimer();
+	void expirePreciseTimers();
 	
-	void expireTimers() { timerHeap_.expireTimers(); }
+	void expireTimers() { addMetric(METRIC_TIMERS_EXPIRED, timerHeap_.expireTimers()); }
 	int64_t getEarliestTimersTimeout() const { return timerHeap_.getEarliestTimersTimeout(); }
-	Timer* addTimer(int64_t whenMillis, TimerHandler &&handler, int64_t intervalMillis = 0)
-	{ return timerHeap_.addTimer(whenMillis, std::move(handler), intervalMillis); }
+	bool hasTimers() const { return timerHeap_.size() > 0; }
+	Timer* addTimer(int64_t whenMillis, TimerHandler &&handler, int64_t intervalMillis = 0, int64_t slackMillis = 0)
+	{ return timerHeap_.addTimer(whenMillis, std::move(handler), intervalMillis, slackMillis); }
 
 	bool looping_;
 	bool quit_;
 
-	int64_t now_;   // current time, milliseconds since 1970.1.1 0:0:0
+	int64_t now_;   // current time, monotonic milliseconds
+	int64_t createdTimeMillis_;
+	uint64_t wakeups_;
+	int64_t busyMicros_;   // time spent outside epoll_wait() in the current sample
+	int64_t idleMicros_;   // time spent in epoll_wait() in the current sample
+	int64_t lastPollEndMicros_;
+	int64_t sampleBeginMicros_;
+	bool utilizationEnabled_;
+	double utilization_;  // permille
+	std::atomic<int64_t> *pollingSinceMicros_;  // see enableUtilization()
+	int64_t queuedBytes_;
 	int timeResolutionMillis_; // ms
 
+	std::unique_ptr<LoopStats> loopStats_;
+	MetricsShard *metrics_;
+	std::unique_ptr<TraceRing> traceRing_;  // destroyed after the channels, which trace when they are removed
 	Epoller epoller_;  // io multi-selector
 	ChannelArray activeChannels_;
 	ChannelArray activeListenChannels_;
@@ -141,10 +239,16 @@ private:
 	std::mutex mutex_;    // to protect wakeupFunctors_
 	EventFdChannel notifier_; // for other thread to wake me up asynchronously
 	std::vector<Functor> wakeupFunctors_;     // callback functions that other thread want me execute in the loop 
-	std::unique_ptr<TimerFdChannel> timeUpdater_;  // to ensure the event loop will be wake up every @timeResolutionMillis_ miliseconds
+	std::atomic<int> numWakeupFunctors_;      // size of @wakeupFunctors_, to be read without @mutex_
+	std::unique_ptr<TimerFdChannel> timeUpdater_;  // to ensure the event loop will be wake up every @timeResolutionMillis_ miliseconds, stopped when there are no timers
 
 	TimerHeap timerHeap_;
+	TimerHeap preciseTimerHeap_;  // microseconds
+	std::unique_ptr<TimerFdChannel> preciseTimerFd_;  // created when the first precise timer is added
+	int64_t preciseDeadline_;  // when @preciseTimerFd_ is armed to fire, 0: disarmed
 	TimeWheelContainer timeWheels_;
+	// its signal listeners are unregistered first thing in ~EventLoop(), other loops relay signals
+	// to this one through wakeupAndRun() until then, whatever order the members are destroyed in
 	SignalHandlerMgr signalHandlerMgr_;
 
 	TimeWheel *idleTimeWheel_;
@@ -0,0 +1,152 @@
+// Copyright 2017, Shenghua Fang. All rights reserved.
+// Use of this source code is governed by a BSD 2-Clause license that can be found in the License file.
+// Author: Shenghua Fang
+
+#include <cstdio>
+#include <sstream>
+
+#include "LoopStats.h"
+#include "Channel.h"
+#include "utils/TimeUtil.h"
+
+using namespace easynet;
+
+namespace
+{
+
+std::string getEventsName(int events)
+{
+	std::string name;
+	const struct { int event; const char *name; } kEvents[] = {
+		{EASYNET_EVENT_READABLE, "read"},
+		{EASYNET_EVENT_WRITABLE, "write"},
+		{EASYNET_EVENT_PEER_SHUTDOWN, "peer_shutdown"},
+		{EASYNET_EVENT_ERROR, "error"}
+	};
+
+	for (auto &e : kEvents)
+	{
+		if (events & e.event)
+		{
+			name += name.empty() ? "" : "|";
+			name += e.name;
+		}
+	}
+
+	return name;
+}
+
+}
+
+const size_t LoopStats::kRecentSlowHandlers;
+
+std::string SlowHandlerRecord::toString() const
+{
+	char buf[128];
+	if (fd >= 0)
+	{
+		::snprintf(buf, sizeof(buf), "%s fd:%d %s %lld us", LoopStats::getHandlerKindName(kind), fd,
+			getEventsName(events).c_str(), static_cast<long long>(nanos / 1000));
+	}
+	else
+	{
+		::snprintf(buf, sizeof(buf), "%s %lld us", LoopStats::getHandlerKindName(kind), static_cast<long long>(nanos / 1000));
+	}
+
+	return buf;
+}
+
+std::string LoopStatsSnapshot::toString() const
+{
+	std::ostringstream os;
+	os << "iterations:" << iterations;
+	for (int i = 0; i < LOOP_PHASE_MAX; i++)
+	{
+		os << " " << LoopStats::getPhaseName(i) << ":" << phaseNanos[i] / 1000 << "us";
+	}
+	os << "\n  iteration nanos: " << iterationNanos.toString();
+	os << "\n  handler nanos: " << handlerNanos.toString();
+	os << "\n  events per wakeup: " << eventsPerWakeup.toString();
+	os << "\n  slow handlers: " << slowHandlers;
+	for (auto &record : recentSlowHandlers)
+	{
+		os << "\n    " << record.toString();
+	}
+
+	return os.str();
+}
+
+LoopStats::LoopStats(int64_t slowHandlerMicros)
+              : slowHandlerNanos_(slowHandlerMicros > 0 ? slowHandlerMicros * 1000 : INT64_MAX),
+                iterations_(0),
+                slowHandlers_(0)
+{
+	for (auto &nanos : phaseNanos_)
+	{
+		nanos.store(0, std::memory_order_relaxed);
+	}
+	recentSlowHandlers_.reserve(kRecentSlowHandlers);
+}
+
+void LoopStats::recordSlowHandler(LoopHandlerKind kind, int fd, int events, int64_t nanos)
+{
+	SlowHandlerRecord record{TimeUtil::currentSystemTimeMicros(), kind, fd, events, nanos};
+
+	std::lock_guard<std::mutex> lock(slowHandlersMutex_);
+	if (recentSlowHandlers_.size() < kRecentSlowHandlers)
+	{
+		recentSlowHandlers_.push_back(record);
+	}
+	else
+	{
+		recentSlowHandlers_[slowHandlers_ % kRecentSlowHandlers] = record;
+	}
+	slowHandlers_++;
+}
+
+void LoopStats::snapshot(LoopStatsSnapshot *snapshot) const
+{
+	snapshot->iterations = iterations_.load(std::memory_order_relaxed);
+	for (int i = 0; i < LOOP_PHASE_MAX; i++)
+	{
+		snapshot->phaseNanos[i] = phaseNanos_[i].load(std::memory_order_relaxed);
+	}
+	iterationNanos_.snapshot(&snapshot->iterationNanos);
+	handlerNanos_.snapshot(&snapshot->handlerNanos);
+	eventsPerWakeup_.snapshot(&snapshot->eventsPerWakeup);
+
+	std::lock_guard<std::mutex> lock(slowHandlersMutex_);
+	snapshot->slowHandlers = slowHandlers_;
+	snapshot->recentSlowHandlers.clear();
+	size_t size = recentSlowHandlers_.size();
+	for (size_t i = 0; i < size; i++)
+	{
+		// the oldest is the next one to be overwritten once the ring is full
+		size_t index = size < kRecentSlowHandlers ? i : (slowHandlers_ + i) % kRecentSlowHandlers;
+		snapshot->recentSlowHandlers.push_back(recentSlowHandlers_[index]);
+	}
+}
+
+const char* LoopStats::getPhaseName(int phase)
+{
+	switch (phase)
+	{
+	case LOOP_PHASE_POLL:     return "poll";
+	case LOOP_PHASE_HANDLERS: return "handlers";
+	case LOOP_PHASE_FUNCTORS: return "functors";
+	case LOOP_PHASE_TIMERS:   return "timers";
+	default:                  return "unknown";
+	}
+}
+
+const char* LoopStats::getHandlerKindName(int kind)
+{
+	switch (kind)
+	{
+	case LOOP_HANDLER_CHANNEL: return "channel";
+	case LOOP_HANDLER_ACCEPT:  return "accept";
+	case LOOP_HANDLER_FUNCTOR: return "functor";
+	case LOOP_HANDLER_TIMERS:  return "timers";
+	default:                   return "unknown";
+	}
+}
@@ -0,0 +1,125 @@
+// Copyright 2017, Shenghua Fang. All rights reserved.
+// Use of this source code is governed by a BSD 2-Clause license that can be found in the License file.
+// Author: Shenghua Fang
+
+#ifndef _EASYNET_LOOP_STATS_H_
+#define _EASYNET_LOOP_STATS_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "utils/Histogram.h"
+
+namespace easynet
+{
+
+// the phases of an iteration of EventLoop::waitAndProcessEventsAndTimers()
+enum LoopPhase
+{
+	LOOP_PHASE_POLL = 0,   // epoll_wait()
+	LOOP_PHASE_HANDLERS,   // the channels' handlers, including the functor run after accepting
+	LOOP_PHASE_FUNCTORS,   // the functors passed by wakeupAndRun()
+	LOOP_PHASE_TIMERS,     // the expired timers
+	LOOP_PHASE_MAX
+};
+
+enum LoopHandlerKind
+{
+	LOOP_HANDLER_CHANNEL = 0,  // the handlers of a channel, @events tells which ones
+	LOOP_HANDLER_ACCEPT,       // the handler of a listen channel
+	LOOP_HANDLER_FUNCTOR,      // a functor passed by wakeupAndRun(), without fd
+	LOOP_HANDLER_TIMERS        // the expired timers of an iteration together, without fd
+};
+
+// a handler that took longer than the threshold, see EventLoop::enableStats()
+struct SlowHandlerRecord
+{
+	int64_t timeMicros;  // wall clock when it returned
+	int kind;            // LoopHandlerKind
+	int fd;              // -1 if the handler isn't a channel's
+	int events;          // EASYNET_EVENT_* triggered on the channel, the handlers called
+	int64_t nanos;
+
+	std::string toString() const;  // such as "channel fd:12 read|write 15230 us"
+};
+
+struct LoopStatsSnapshot
+{
+	LoopStatsSnapshot() : iterations(0), slowHandlers(0)
+	{
+		for (auto &nanos : phaseNanos)
+		{
+			nanos = 0;
+		}
+	}
+
+	uint64_t iterations;
+	uint64_t phaseNanos[LOOP_PHASE_MAX];   // total time of each phase
+	HistogramSnapshot iterationNanos;      // from epoll_wait() returned to the end of the iteration
+	HistogramSnapshot handlerNanos;        // every channel handler and functor
+	HistogramSnapshot eventsPerWakeup;
+	uint64_t slowHandlers;                 // ever detected
+	std::vector<SlowHandlerRecord> recentSlowHandlers;  // the latest ones, from the oldest
+
+	std::string toString() const;
+};
+
+// the time an EventLoop spends in each phase, measured with CLOCK_MONOTONIC in nanoseconds.
+// written only by the loop, without locked instructions except for the rare slow handlers.
+// snapshot() can be called in other threads.
+class LoopStats
+{
+public:
+	static const size_t kRecentSlowHandlers = 32;
+
+	explicit LoopStats(int64_t slowHandlerMicros);
+
+	LoopStats(const LoopStats &rhs) = delete;
+	LoopStats& operator=(const LoopStats &rhs) = delete;
+
+	void recordPhase(LoopPhase phase, int64_t nanos) { increase(phaseNanos_[phase], nanos); }
+	void recordIteration(int64_t nanos, int events)
+	{
+		increase(iterations_, 1);
+		iterationNanos_.record(nanos);
+		eventsPerWakeup_.record(events);
+	}
+	void recordHandler(LoopHandlerKind kind, int fd, int events, int64_t nanos)
+	{
+		handlerNanos_.record(nanos);
+		if (nanos >= slowHandlerNanos_)
+		{
+			recordSlowHandler(kind, fd, events, nanos);
+		}
+	}
+
+	void snapshot(LoopStatsSnapshot *snapshot) const;
+	int64_t slowHandlerMicros() const { return slowHandlerNanos_ / 1000; }
+
+	static const char* getPhaseName(int phase);
+	static const char* getHandlerKindName(int kind);
+
+private:
+	static void increase(std::atomic<uint64_t> &counter, uint64_t n)
+	{ counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+
+	void recordSlowHandler(LoopHandlerKind kind, int fd, int events, int64_t nanos);
+
+	int64_t slowHandlerNanos_;
+	std::atomic<uint64_t> iterations_;
+	std::atomic<uint64_t> phaseNanos_[LOOP_PHASE_MAX];
+	Histogram iterationNanos_;
+	Histogram handlerNanos_;
+	Histogram eventsPerWakeup_;
+
+	mutable std::mutex slowHandlersMutex_;   // to protect the following
+	uint64_t slowHandlers_;
+	std::vector<SlowHandlerRecord> recentSlowHandlers_;  // a ring of kRecentSlowHandlers
+};
+
+}
+
+#endif
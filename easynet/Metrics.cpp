@@ -0,0 +1,195 @@
+// Copyright 2017, Shenghua Fang. All rights reserved.
+// Use of this source code is governed by a BSD 2-Clause license that can be found in the License file.
+// Author: Shenghua Fang
+
+#include <cstdio>
+
+#include "Metrics.h"
+#include "utils/log.h"
+
+using namespace easynet;
+
+namespace
+{
+
+const struct
+{
+	const char *name;
+	const char *help;
+	MetricType type;
+} kBuiltinMetrics[METRIC_BUILTIN_MAX] = {
+	{"easynet_accepts_total",          "Connections accepted.",                           METRIC_TYPE_COUNTER},
+	{"easynet_connections",            "Connections in use.",                             METRIC_TYPE_GAUGE},
+	{"easynet_received_bytes_total",   "Bytes read from the connections.",                METRIC_TYPE_COUNTER},
+	{"easynet_sent_bytes_total",       "Bytes written to the connections.",               METRIC_TYPE_COUNTER},
+	{"easynet_pool_hits_total",        "Connections reused from the connection pools.",   METRIC_TYPE_COUNTER},
+	{"easynet_pool_misses_total",      "Connections allocated as the pools had no free one.", METRIC_TYPE_COUNTER},
+	{"easynet_timers",                 "Timers waiting in the event loops.",              METRIC_TYPE_GAUGE},
+	{"easynet_timers_expired_total",   "Timers expired.",                                 METRIC_TYPE_COUNTER},
+	{"easynet_wakeups_total",          "Times the event loops returned from epoll_wait.", METRIC_TYPE_COUNTER}
+};
+
+const char* getTypeName(MetricType type)
+{
+	switch (type)
+	{
+	case METRIC_TYPE_COUNTER:   return "counter";
+	case METRIC_TYPE_GAUGE:     return "gauge";
+	case METRIC_TYPE_HISTOGRAM: return "histogram";
+	default:                    return "untyped";
+	}
+}
+
+std::string formatScaled(uint64_t value, double scale)
+{
+	char buf[64];
+	if (scale == 1.0)
+	{
+		::snprintf(buf, sizeof(buf), "%llu", static_cast<unsigned long long>(value));
+	}
+	else
+	{
+		::snprintf(buf, sizeof(buf), "%.9g", value * scale);
+	}
+
+	return buf;
+}
+
+}
+
+const int MetricsShard::kMaxMetrics;
+
+MetricsShard::MetricsShard()
+{
+	for (auto &value : values_)
+	{
+		value.store(0, std::memory_order_relaxed);
+	}
+}
+
+MetricsRegistry::MetricsRegistry()
+{
+	for (auto &metric : kBuiltinMetrics)
+	{
+		addMetric(metric.name, metric.help, metric.type, 1.0);
+	}
+}
+
+int MetricsRegistry::addCounter(const std::string &name, const std::string &help)
+{
+	return addMetric(name, help, METRIC_TYPE_COUNTER, 1.0);
+}
+
+int MetricsRegistry::addGauge(const std::string &name, const std::string &help)
+{
+	return addMetric(name, help, METRIC_TYPE_GAUGE, 1.0);
+}
+
+int MetricsRegistry::addHistogram(const std::string &name, const std::string &help, double scale)
+{
+	return addMetric(name, help, METRIC_TYPE_HISTOGRAM, scale);
+}
+
+int MetricsRegistry::addMetric(const std::string &name, const std::string &help, MetricType type, double scale)
+{
+	if (!shards_.empty() || metrics_.size() >= static_cast<size_t>(MetricsShard::kMaxMetrics))
+	{
+		LOG_WARN("can't add metric %s, %u metrics, %u shards", name.c_str(), metrics_.size(), shards_.size());
+		return -1;
+	}
+
+	metrics_.push_back(Metric{name, help, type, scale});
+	return static_cast<int>(metrics_.size()) - 1;
+}
+
+void MetricsRegistry::createShards(int num)
+{
+	for (int i = 0; i < num; i++)
+	{
+		std::unique_ptr<MetricsShard> shard(new MetricsShard());
+		for (size_t j = 0; j < metrics_.size(); j++)
+		{
+			if (metrics_[j].type == METRIC_TYPE_HISTOGRAM)
+			{
+				shard->histograms_[j].reset(new Histogram());
+			}
+		}
+		shards_.push_back(std::move(shard));
+	}
+}
+
+int64_t MetricsRegistry::getValue(int metric) const
+{
+	int64_t value = 0;
+	for (auto &shard : shards_)
+	{
+		value += shard->getValue(metric);
+	}
+
+	return value;
+}
+
+void MetricsRegistry::getHistogram(int metric, HistogramSnapshot *snapshot) const
+{
+	snapshot->clear();
+	for (auto &shard : shards_)
+	{
+		HistogramSnapshot s;
+		shard->getHistogram(metric, &s);
+		snapshot->merge(s);
+	}
+}
+
+std::string MetricsRegistry::toPrometheusText() const
+{
+	std::string text;
+	char buf[256];
+	for (size_t i = 0; i < metrics_.size(); i++)
+	{
+		const Metric &metric = metrics_[i];
+		text += "# HELP " + metric.name + " " + metric.help + "\n";
+		text += "# TYPE " + metric.name + " " + getTypeName(metric.type) + "\n";
+
+		if (metric.type == METRIC_TYPE_HISTOGRAM)
+		{
+			HistogramSnapshot snapshot;
+			getHistogram(static_cast<int>(i), &snapshot);
+			appendHistogram(metric, snapshot, &text);
+		}
+		else
+		{
+			::snprintf(buf, sizeof(buf), " %lld\n", static_cast<long long>(getValue(static_cast<int>(i))));
+			text += metric.name + buf;
+		}
+	}
+
+	return text;
+}
+
+// a bucket for every power of 2 up to the largest value, prometheus buckets are cumulative
+void MetricsRegistry::appendHistogram(const Metric &metric, const HistogramSnapshot &snapshot, std::string *text) const
+{
+	int last = 0;
+	for (int i = 0; i < HistogramSnapshot::kNumBuckets; i++)
+	{
+		if (snapshot.buckets[i] > 0)
+		{
+			last = i;
+		}
+	}
+
+	uint64_t count = 0;
+	for (int i = 0; i < HistogramSnapshot::kNumBuckets; i++)
+	{
+		count += snapshot.buckets[i];
+		if ((i + 1) % HistogramSnapshot::kSubBuckets == 0 && i <= last + HistogramSnapshot::kSubBuckets - 1)
+		{
+			*text += metric.name + "_bucket{le=\"" + formatScaled(HistogramSnapshot::bucketUpperBound(i), metric.scale)
+				   + "\"} " + std::to_string(count) + "\n";
+		}
+	}
+
+	*text += metric.name + "_bucket{le=\"+Inf\"} " + std::to_string(count) + "\n";
+	*text += metric.name + "_sum " + formatScaled(snapshot.sum, metric.scale) + "\n";
+	*text += metric.name + "_count " + std::to_string(count) + "\n";
+}
@@ -0,0 +1,120 @@
+// Copyright 2017, Shenghua Fang. All rights reserved.
+// Use of this source code is governed by a BSD 2-Clause license that can be found in the License file.
+// Author: Shenghua Fang
+
+#ifndef _EASYNET_METRICS_H_
+#define _EASYNET_METRICS_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "utils/Histogram.h"
+
+namespace easynet
+{
+
+enum MetricType
+{
+	METRIC_TYPE_COUNTER = 0,
+	METRIC_TYPE_GAUGE,
+	METRIC_TYPE_HISTOGRAM
+};
+
+// registered by every MetricsRegistry in this order, so their ids are known at compile time
+enum BuiltinMetric
+{
+	METRIC_ACCEPTS = 0,       // counter, connections accepted
+	METRIC_CONNECTIONS,       // gauge, connections in use
+	METRIC_BYTES_RECEIVED,    // counter, bytes read from the connections
+	METRIC_BYTES_SENT,        // counter, bytes written to the connections
+	METRIC_POOL_HITS,         // counter, connections reused from the connection pools
+	METRIC_POOL_MISSES,       // counter, connections allocated as the pools had none free
+	METRIC_TIMERS,            // gauge, timers waiting in the loops
+	METRIC_TIMERS_EXPIRED,    // counter
+	METRIC_WAKEUPS,           // counter, times the loops returned from epoll_wait()
+	METRIC_BUILTIN_MAX
+};
+
+// the values of the metrics updated by one thread, usually a worker's loop, see EventLoop::getMetrics().
+// a value is updated with a relaxed load and store instead of a locked instruction, the shards are
+// summed up when the metrics are read.
+class MetricsShard
+{
+public:
+	static const int kMaxMetrics = 64;
+
+	MetricsShard();
+
+	MetricsShard(const MetricsShard &rhs) = delete;
+	MetricsShard& operator=(const MetricsShard &rhs) = delete;
+
+	// by the owner thread only
+	void add(int metric, int64_t n)
+	{ values_[metric].store(values_[metric].load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+	void set(int metric, int64_t value) { values_[metric].store(value, std::memory_order_relaxed); }
+	void observe(int metric, uint64_t value) { histograms_[metric]->record(value); }
+
+	// by any thread
+	int64_t getValue(int metric) const { return values_[metric].load(std::memory_order_relaxed); }
+	void getHistogram(int metric, HistogramSnapshot *snapshot) const { histograms_[metric]->snapshot(snapshot); }
+
+private:
+	friend class MetricsRegistry;
+
+	char padBefore_[64];
+	std::atomic<int64_t> values_[kMaxMetrics];
+	std::unique_ptr<Histogram> histograms_[kMaxMetrics];  // of the histogram metrics only
+	char padAfter_[64];
+};
+
+// the metrics of a server, with a shard per worker. the metrics are added before createShards(),
+// and read by any thread after it, summed over the shards.
+class MetricsRegistry
+{
+public:
+	MetricsRegistry();  // with the built-in metrics
+
+	MetricsRegistry(const MetricsRegistry &rhs) = delete;
+	MetricsRegistry& operator=(const MetricsRegistry &rhs) = delete;
+
+	// @name is the prometheus metric name, such as "myapp_requests_total". returns the id of the metric
+	// used to update it in a shard, or -1 if there are kMaxMetrics already or the shards are created.
+	// the values of a histogram are multiplied by @scale when exported, e.g. 1e-6 for micros in seconds
+	int addCounter(const std::string &name, const std::string &help);
+	int addGauge(const std::string &name, const std::string &help);
+	int addHistogram(const std::string &name, const std::string &help, double scale = 1.0);
+
+	void createShards(int num);
+	int getShardsNum() const { return static_cast<int>(shards_.size()); }
+	MetricsShard* getShard(int index) { return shards_[index].get(); }
+
+	int getMetricsNum() const { return static_cast<int>(metrics_.size()); }
+	const std::string& getName(int metric) const { return metrics_[metric].name; }
+	int64_t getValue(int metric) const;
+	void getHistogram(int metric, HistogramSnapshot *snapshot) const;
+
+	// "# HELP", "# TYPE" and the samples of every metric, see https://prometheus.io/docs/instrumenting/exposition_formats/
+	std::string toPrometheusText() const;
+
+private:
+	struct Metric
+	{
+		std::string name;
+		std::string help;
+		MetricType type;
+		double scale;
+	};
+
+	int addMetric(const std::string &name, const std::string &help, MetricType type, double scale);
+	void appendHistogram(const Metric &metric, const HistogramSnapshot &snapshot, std::string *text) const;
+
+	std::vector<Metric> metrics_;
+	std::vector<std::unique_ptr<MetricsShard>> shards_;
+};
+
+}
+
+#endif
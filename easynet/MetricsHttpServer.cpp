@@ -0,0 +1,109 @@
+// Copyright 2017, Shenghua Fang. All rights reserved.
+// Use of this source code is governed by a BSD 2-Clause license that can be found in the License file.
+// Author: Shenghua Fang
+
+#include <functional>
+
+#include "MetricsHttpServer.h"
+#include "Metrics.h"
+#include "TcpServer.h"
+#include "TcpConnection.h"
+#include "utils/log.h"
+
+using namespace easynet;
+
+namespace
+{
+
+const size_t kMaxRequestBytes  = 8192;
+const int kIdleSecs            = 10;
+const int kConnectionPoolSize  = 16;
+
+std::string makeResponse(const std::string &status, const std::string &contentType, const std::string &body)
+{
+	return "HTTP/1.1 " + status + "\r\n"
+	       "Content-Type: " + contentType + "\r\n"
+	       "Content-Length: " + std::to_string(body.size()) + "\r\n"
+	       "Connection: close\r\n"
+	       "\r\n" + body;
+}
+
+// "GET /metrics HTTP/1.1", the query string is ignored
+bool isMetricsRequest(const std::string &requestLine)
+{
+	const std::string method = "GET /metrics";
+	if (requestLine.compare(0, method.size(), method) != 0)
+	{
+		return false;
+	}
+
+	return requestLine.size() == method.size() || requestLine[method.size()] == ' ' || requestLine[method.size()] == '?';
+}
+
+}
+
+MetricsHttpServer::MetricsHttpServer(const MetricsRegistry *registry, const std::string &listenIp, unsigned short listenPort)
+                     : registry_(registry),
+                       tcpServer_(new TcpServer(listenIp, listenPort))
+{
+	tcpServer_->setWorkerNum(1);
+	tcpServer_->setTcpWorkerConnectionPoolCoreSize(kConnectionPoolSize);
+	tcpServer_->setTcpWorkerConnectionPoolMaxSize(kConnectionPoolSize);
+
+	tcpServer_->setNewTcpConnectionHandler([](TcpConnection &tcpConnection){
+		tcpConnection.setIdleHandler(kIdleSecs, [&tcpConnection]{
+			tcpConnection.close();
+		});
+	});
+	tcpServer_->setReadHandler(std::bind(&MetricsHttpServer::onRequest, this, std::placeholders::_1));
+	tcpServer_->setWriteCompleteHandler([](TcpConnection &tcpConnection){
+		tcpConnection.close();
+	});
+	tcpServer_->setPeerShutdownHandler([](TcpConnection &tcpConnection){
+		tcpConnection.close();
+	});
+}
+
+MetricsHttpServer::~MetricsHttpServer()
+{
+	stop();
+}
+
+void MetricsHttpServer::start()
+{
+	tcpServer_->start();
+}
+
+void MetricsHttpServer::stop()
+{
+	tcpServer_->stop();
+}
+
+// waits for the whole request header, the body of a GET is never read
+void MetricsHttpServer::onRequest(TcpConnection &tcpConnection)
+{
+	Buffer &buffer = tcpConnection.getInputBuffer();
+	std::string request(buffer.data(), buffer.size());
+	if (request.find("\r\n\r\n") == std::string::npos)
+	{
+		if (request.size() > kMaxRequestBytes)
+		{
+			buffer.clear();
+			tcpConnection.send(makeResponse("431 Request Header Fields Too Large", "text/plain", ""));
+		}
+		return;
+	}
+
+	buffer.clear();
+	std::string requestLine = request.substr(0, request.find("\r\n"));
+	LOG_DEBUG("metrics request from %s: %s", tcpConnection.getPeerAddr().toString().c_str(), requestLine.c_str());
+
+	if (isMetricsRequest(requestLine))
+	{
+		tcpConnection.send(makeResponse("200 OK", "text/plain; version=0.0.4", registry_->toPrometheusText()));
+	}
+	else
+	{
+		tcpConnection.send(makeResponse("404 Not Found", "text/plain", "not found\n"));
+	}
+}
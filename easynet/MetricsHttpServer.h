@@ -0,0 +1,42 @@
+// Copyright 2017, Shenghua Fang. All rights reserved.
+// Use of this source code is governed by a BSD 2-Clause license that can be found in the License file.
+// Author: Shenghua Fang
+
+#ifndef _EASYNET_METRICS_HTTP_SERVER_H_
+#define _EASYNET_METRICS_HTTP_SERVER_H_
+
+#include <string>
+#include <memory>
+
+namespace easynet
+{
+
+class TcpServer;
+class TcpConnection;
+class MetricsRegistry;
+
+// answers "GET /metrics" with the metrics of @registry in prometheus text format, and 404 for
+// anything else, closing the connection after every response. it runs a TcpServer with
+// one worker of its own, so scraping never runs in the workers being measured.
+class MetricsHttpServer
+{
+public:
+	MetricsHttpServer(const MetricsRegistry *registry, const std::string &listenIp, unsigned short listenPort);
+	~MetricsHttpServer();
+
+	MetricsHttpServer(const MetricsHttpServer &rhs) = delete;
+	MetricsHttpServer& operator=(const MetricsHttpServer &rhs) = delete;
+
+	void start();
+	void stop();
+
+private:
+	void onRequest(TcpConnection &tcpConnection);
+
+	const MetricsRegistry *registry_;
+	std::unique_ptr<TcpServer> tcpServer_;
+};
+
+}
+
+#endif
@@ -0,0 +1,24 @@
+// Copyright 2017, Shenghua Fang. All rights reserved.
+// Use of this source code is governed by a BSD 2-Clause license that can be found in the License file.
+// Author: Shenghua Fang
+
+#include "Probes.h"
+
+#if EASYNET_PROBES_ENABLED
+
+#define EASYNET_DEFINE_PROBE_SEMAPHORE(name) \
+	volatile unsigned short EASYNET_PROBE_SEMAPHORE(name) __attribute__((section(".probes"))) = 0
+
+extern "C"
+{
+EASYNET_DEFINE_PROBE_SEMAPHORE(accept);
+EASYNET_DEFINE_PROBE_SEMAPHORE(connection_reset);
+EASYNET_DEFINE_PROBE_SEMAPHORE(connection_close);
+EASYNET_DEFINE_PROBE_SEMAPHORE(recv);
+EASYNET_DEFINE_PROBE_SEMAPHORE(send);
+EASYNET_DEFINE_PROBE_SEMAPHORE(epoll_wake);
+EASYNET_DEFINE_PROBE_SEMAPHORE(timer_fire);
+EASYNET_DEFINE_PROBE_SEMAPHORE(functor_run);
+}
+
+#endif
@@ -0,0 +1,118 @@
+// Copyright 2017, Shenghua Fang. All rights reserved.
+// Use of this source code is governed by a BSD 2-Clause license that can be found in the License file.
+// Author: Shenghua Fang
+
+#ifndef _EASYNET_PROBES_H_
+#define _EASYNET_PROBES_H_
+
+// static probes(USDT) of the provider "easynet", for perf, bpftrace and systemtap:
+//
+//   probe              arguments                          where
+//   accept             fd, connections in use             TcpWorker, a connection is accepted
+//   connection_reset   TcpConnection*, fd                 TcpWorker, a pooled connection is reset to the new socket
+//   connection_close   TcpConnection*, connections in use TcpWorker, a connection is closed and back to the pool
+//   recv               fd, bytes to read, recv() result   TcpConnection::recvData()
+//   send               fd, bytes to send, send() result   TcpConnection::sendData()
+//   epoll_wake         epoll fd, events or -errno         Epoller, epoll_wait() returned
+//   timer_fire         Timer*, when, interval             the handler of a timer is to be called
+//   functor_run        functors of this batch             EventLoop, a functor of wakeupAndRun() is to be run
+//
+// e.g. bpftrace -p <pid> -e 'usdt:./server:easynet:recv /arg2 > 0/ { @bytes = hist(arg2); }'
+//      perf buildid-cache --add ./server && perf probe -x ./server sdt_easynet:recv
+//
+// a probe is a nop with an ELF note(.note.stapsdt) describing where it is and where its arguments are,
+// written here the way <sys/sdt.h> does, so the build doesn't depend on systemtap's headers.
+// every probe has a semaphore, which the tracer increases when it attaches, the arguments are
+// only evaluated when it's not 0, so a probe costs a load and a not-taken branch while nobody traces.
+// build with -DEASYNET_NO_PROBES(make EASYNET_NO_PROBES=1) to remove them.
+
+#if !defined(EASYNET_NO_PROBES) && defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+#define EASYNET_PROBES_ENABLED 1
+#else
+#define EASYNET_PROBES_ENABLED 0
+#endif
+
+#if EASYNET_PROBES_ENABLED
+
+#include <type_traits>
+
+#define EASYNET_PROBE_SEMAPHORE(name) easynet_##name##_semaphore
+
+// defined in Probes.cpp, in the section ".probes" where the tracers look for them
+extern "C"
+{
+extern volatile unsigned short EASYNET_PROBE_SEMAPHORE(accept);
+extern volatile unsigned short EASYNET_PROBE_SEMAPHORE(connection_reset);
+extern volatile unsigned short EASYNET_PROBE_SEMAPHORE(connection_close);
+extern volatile unsigned short EASYNET_PROBE_SEMAPHORE(recv);
+extern volatile unsigned short EASYNET_PROBE_SEMAPHORE(send);
+extern volatile unsigned short EASYNET_PROBE_SEMAPHORE(epoll_wake);
+extern volatile unsigned short EASYNET_PROBE_SEMAPHORE(timer_fire);
+extern volatile unsigned short EASYNET_PROBE_SEMAPHORE(functor_run);
+}
+
+#define EASYNET_PROBE_ACTIVE(name) __builtin_expect(EASYNET_PROBE_SEMAPHORE(name) != 0, 0)
+
+// an argument is described as "<size>@<operand>", negative sizes for the signed ones.
+// %n prints the constant negated, so the signed ones are given positive
+#define EASYNET_PROBE_ARG_SIZE(x) \
+	((std::is_signed<typename std::decay<decltype(x)>::type>::value ? 1 : -1) * static_cast<int>(sizeof(x)))
+#define EASYNET_PROBE_ARG(n, x)   [s##n] "n" (EASYNET_PROBE_ARG_SIZE(x)), [a##n] "nor" (x)
+
+#define EASYNET_PROBE_ASM(name, args)                                              \
+	"990: nop\n"                                                                   \
+	".pushsection .note.stapsdt,\"?\",\"note\"\n"                                  \
+	".balign 4\n"                                                                  \
+	".4byte 992f-991f, 994f-993f, 3\n"                                             \
+	"991: .asciz \"stapsdt\"\n"                                                    \
+	"992: .balign 4\n"                                                             \
+	"993: .8byte 990b\n"                                                           \
+	".8byte _.stapsdt.base\n"                                                      \
+	".8byte easynet_" #name "_semaphore\n"                                         \
+	".asciz \"easynet\"\n"                                                         \
+	".asciz \"" #name "\"\n"                                                       \
+	".asciz \"" args "\"\n"                                                        \
+	"994: .balign 4\n"                                                             \
+	".popsection\n"                                                                \
+	".ifndef _.stapsdt.base\n"                                                     \
+	".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n"        \
+	".weak _.stapsdt.base\n"                                                       \
+	".hidden _.stapsdt.base\n"                                                     \
+	"_.stapsdt.base: .space 1\n"                                                   \
+	".size _.stapsdt.base, 1\n"                                                    \
+	".popsection\n"                                                                \
+	".endif\n"
+
+#define EASYNET_PROBE1(name, x1)                                                   \
+	do {                                                                           \
+		if (EASYNET_PROBE_ACTIVE(name)) {                                          \
+			__asm__ __volatile__(EASYNET_PROBE_ASM(name, "%n[s1]@%[a1]")           \
+				: : EASYNET_PROBE_ARG(1, x1));                                     \
+		}                                                                          \
+	} while (0)
+
+#define EASYNET_PROBE2(name, x1, x2)                                               \
+	do {                                                                           \
+		if (EASYNET_PROBE_ACTIVE(name)) {                                          \
+			__asm__ __volatile__(EASYNET_PROBE_ASM(name, "%n[s1]@%[a1] %n[s2]@%[a2]") \
+				: : EASYNET_PROBE_ARG(1, x1), EASYNET_PROBE_ARG(2, x2));           \
+		}                                                                          \
+	} while (0)
+
+#define EASYNET_PROBE3(name, x1, x2, x3)                                           \
+	do {                                                                           \
+		if (EASYNET_PROBE_ACTIVE(name)) {                                          \
+			__asm__ __volatile__(EASYNET_PROBE_ASM(name, "%n[s1]@%[a1] %n[s2]@%[a2] %n[s3]@%[a3]") \
+				: : EASYNET_PROBE_ARG(1, x1), EASYNET_PROBE_ARG(2, x2), EASYNET_PROBE_ARG(3, x3)); \
+		}                                                                          \
+	} while (0)
+
+#else
+
+#define EASYNET_PROBE1(name, x1)          do { } while (0)
+#define EASYNET_PROBE2(name, x1, x2)      do { } while (0)
+#define EASYNET_PROBE3(name, x1, x2, x3)  do { } while (0)
+
+#endif
+
+#endif
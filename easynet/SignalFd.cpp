@@ -0,0 +1,37 @@
+// Copyright 2017, Shenghua Fang. All rights reserved.
+// Use of this source code is governed by a BSD 2-Clause license that can be found in the License file.
+// Author: Shenghua Fang
+
+#include <cstring>
+#include "SignalFd.h"
+#include "utils/log.h"
+
+using namespace easynet;
+
+SignalFd::SignalFd(const sigset_t &mask, int flags)
+         	: fd_(create(mask, flags))
+{}
+
+int SignalFd::create(const sigset_t &mask, int flags)
+{
+	int fd = ::signalfd(-1, &mask, flags);
+	if (fd < 0)
+	{
+		int savedErrno = errno;
+		LOG_FATAL("signalfd create failed! error:%d %s", savedErrno, ::strerror(savedErrno));
+		::exit(1);
+	}
+
+	return fd;
+}
+
+int SignalFd::read(struct signalfd_siginfo *infos, int num)
+{
+	ssize_t n = ::read(fd_, infos, sizeof(struct signalfd_siginfo) * num);
+	if (n < 0)
+	{
+		return -1;
+	}
+
+	return static_cast<int>(n / sizeof(struct signalfd_siginfo));
+}
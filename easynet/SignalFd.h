@@ -0,0 +1,37 @@
+// Copyright 2017, Shenghua Fang. All rights reserved.
+// Use of this source code is governed by a BSD 2-Clause license that can be found in the License file.
+// Author: Shenghua Fang
+
+#ifndef _EASYNET_SIGNALFD_H_
+#define _EASYNET_SIGNALFD_H_
+
+#include <unistd.h>
+#include <signal.h>
+#include <sys/signalfd.h>
+
+namespace easynet {
+
+// reads the pending signals in @mask, which must be blocked in all threads
+class SignalFd
+{
+public:
+	explicit SignalFd(const sigset_t &mask, int flags = SFD_NONBLOCK | SFD_CLOEXEC);
+	~SignalFd() { close(); }
+
+	SignalFd(const SignalFd &rhs) = delete;
+	SignalFd& operator=(const SignalFd &rhs) = delete;
+
+	int fd() const { return fd_; }
+
+	// returns the number of signals read, -1 on error
+	int read(struct signalfd_siginfo *infos, int num);
+
+private:
+	int create(const sigset_t &mask, int flags);
+	void close() { ::close(fd_); }
+
+	int fd_;
+};
+
+}
+#endif
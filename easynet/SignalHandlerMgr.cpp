@@ -7,10 +7,43 @@
 #include "SignalHandlerMgr.h"
 #include "EventLoop.h"
 #include "SignalMgr.h"
+#include "SignalFd.h"
+#include "Channel.h"
 #include "utils/log.h"
 
 using namespace easynet;
 
+namespace
+{
+
+const int kMaxSignalsPerRead = 16;
+
+}
+
+SignalHandlerMgr::SignalHandlerMgr(EventLoop *loop) 
+	               : loop_(loop), 
+	                 signalHandling_(false),
+	                 curSig_(0)
+{}
+
+SignalHandlerMgr::~SignalHandlerMgr()
+{
+	unregisterSignalListeners();
+}
+
+// SignalMgr::relaySignal() calls signalRaised() of the listeners with its lock held, and
+// unregisterSignalListener() takes the lock, so no relay to @loop_ is in progress after it returns
+void SignalHandlerMgr::unregisterSignalListeners()
+{
+	if (SignalMgr::getSignalHandlingMode() == SignalMgr::SIGNAL_HANDLING_MODE_SIGNALFD)
+	{
+		for (auto &item : signalHandlers_)
+		{
+			SignalMgr::getInstance().unregisterSignalListener(item.first, loop_);
+		}
+	}
+}
+
 SignalHandler* SignalHandlerMgr::addSignalHandler(int sig, SigHandler &&handler)
 {
 	LOG_TRACE("add signalHandler for signal %d %s(%s)", 
@@ -29,11 +62,23 @@ SignalHandler* SignalHandlerMgr::addSignalHandler(int sig, SigHandler &&handler)
 		return nullptr;
 	}
 
+	if (SignalMgr::getSignalHandlingMode() == SignalMgr::SIGNAL_HANDLING_MODE_SIGNALFD &&
+		!::sigismember(&SignalMgr::getSignalFdSignals(), sig))
+	{
+		LOG_WARN("addSignalHandler for signal %d %s(%s) failed, it's not given to SignalMgr::enableSignalHandling()", 
+			sig, SignalMgr::getInstance().getSignalName(sig).c_str(), ::strsignal(sig));
+		return nullptr;
+	}
+
 	std::unique_ptr<SignalHandler> signalHandler(new SignalHandler(this, sig, std::move(handler)));
 
 	auto it = signalHandlers_.find(sig);
 	if (it == signalHandlers_.end())
 	{
+		if (SignalMgr::getSignalHandlingMode() == SignalMgr::SIGNAL_HANDLING_MODE_SIGNALFD && !signalFd_)
+		{
+			openSignalFd();
+		}
 		SignalMgr::getInstance().registerSignalListener(sig, loop_);
 		signalHandlers_[sig] = std::list<std::unique_ptr<SignalHandler>>();
 		it = signalHandlers_.find(sig);
@@ -73,6 +118,58 @@ void SignalHandlerMgr::signalRaised(int sig)
 	loop_->wakeupAndRun(std::bind(&SignalHandlerMgr::onSignal, this, sig));
 }
 
+void SignalHandlerMgr::openSignalFd()
+{
+	signalFd_.reset(new SignalFd(SignalMgr::getSignalFdSignals()));
+	signalFdChannel_.reset(new Channel(loop_, signalFd_->fd()));
+	signalFdChannel_->setReadHandler(std::bind(&SignalHandlerMgr::onSignalFdReadable, this));
+	signalFdChannel_->enableReading();
+	LOG_TRACE("signalfd %d opened", signalFd_->fd());
+}
+
+// the signals read are handled in this loop directly, and relayed to the other loops handling them
+void SignalHandlerMgr::onSignalFdReadable()
+{
+	struct signalfd_siginfo infos[kMaxSignalsPerRead];
+
+	while (true)
+	{
+		// EAGAIN if another loop has read the signals
+		int n = signalFd_->read(infos, kMaxSignalsPerRead);
+		if (n <= 0)
+		{
+			if (n < 0 && errno != EAGAIN)
+			{
+				int savedErrno = errno;
+				LOG_ERROR("read signalfd %d error, error:%d %s", signalFd_->fd(), savedErrno, ::strerror(savedErrno));
+			}
+			break;
+		}
+
+		for (int i = 0; i < n; i++)
+		{
+			int sig = static_cast<int>(infos[i].ssi_signo);
+			LOG_TRACE("signal %d %s(%s) read from signalfd", sig, SignalMgr::getSignalName(sig).c_str(), ::strsignal(sig));
+
+			size_t listeners = SignalMgr::getInstance().relaySignal(sig, loop_);
+			if (signalHandlers_.find(sig) != signalHandlers_.end())
+			{
+				onSignal(sig);
+			}
+			// a SIGPIPE raised by writing a closed socket is dropped, as it's never delivered in the relay mode
+			else if (listeners == 0 && sig != SIGPIPE)
+			{
+				SignalMgr::raiseUnhandledSignal(sig);
+			}
+		}
+
+		if (n < kMaxSignalsPerRead)
+		{
+			break;
+		}
+	}
+}
+
 void SignalHandlerMgr::onSignal(int sig)
 {
 	auto it = signalHandlers_.find(sig);
@@ -15,19 +15,16 @@ namespace easynet
 {
 
 class EventLoop;
+class Channel;
+class SignalFd;
 
 class SignalHandlerMgr
 {
 public:
 	using SigHandler = SignalHandler::SigHandler;
 	 
-	SignalHandlerMgr(EventLoop *loop) 
-	               : loop_(loop), 
-	                 signalHandling_(false),
-	                 curSig_(0)
-	{}
-	
-	~SignalHandlerMgr() = default;
+	SignalHandlerMgr(EventLoop *loop);
+	~SignalHandlerMgr();
 
 	SignalHandlerMgr(const SignalHandlerMgr &rhs) = delete;
 	SignalHandlerMgr& operator=(const SignalHandlerMgr &rhs) = delete;
@@ -37,16 +34,27 @@ public:
 	void deleteSignalHandler(SignalHandler *signalHandler);
 	void signalRaised(int sig);
 
+	// signalfd mode: stops the other loops relaying signals to @loop_, synchronously, the handlers are kept.
+	// called when @loop_ is being destroyed
+	void unregisterSignalListeners();
+
 private:
     // key: signal number
 	using SignalHandlerContainer = std::map<int, std::list<std::unique_ptr<SignalHandler>>>;
 
 	void onSignal(int sig);
+	void openSignalFd();
+	void onSignalFdReadable();
 
 	EventLoop *loop_;
 	SignalHandlerContainer signalHandlers_;
 	bool signalHandling_;
 	int  curSig_;
+
+	// signalfd mode: created with the first signal handler, reads the signals given to SignalMgr until
+	// the loop is destroyed, so the ones without handlers in any loop still get their disposition
+	std::unique_ptr<SignalFd> signalFd_;
+	std::unique_ptr<Channel> signalFdChannel_;
 };
 
 }
@@ -23,6 +23,8 @@ std::unique_ptr<Socket> kSigNotifyUnixSocket;
 }
 
 std::once_flag SignalMgr::initedFlag_;
+SignalMgr::SignalHandlingMode SignalMgr::signalHandlingMode_ = SignalMgr::SIGNAL_HANDLING_MODE_RELAY_THREAD;
+sigset_t SignalMgr::signalFdSignals_;
 
 static void sigalHandler(int sig);
 
@@ -63,13 +65,40 @@ void SignalMgr::initSignalMgrOnce(std::unique_ptr<SignalMgr> &signalMgr)
 	signalMgr.reset(new SignalMgr(fds[0]));
 }
 
-void SignalMgr::enableSignalHandling()
+void SignalMgr::enableSignalHandling(SignalHandlingMode mode)
 {
+	if (mode == SIGNAL_HANDLING_MODE_SIGNALFD)
+	{
+		LOG_WARN("signal handling enabled in signalfd mode without any signal to handle");
+		sigset_t signals;
+		::sigemptyset(&signals);
+		enableSignalHandling(mode, signals);
+		return;
+	}
+
+	signalHandlingMode_ = mode;
 	blockAllSignals();
 	getInstance().start();
 	LOG_INFO("signal handling enabled");
 }
 
+void SignalMgr::enableSignalHandling(SignalHandlingMode mode, const sigset_t &signals)
+{
+	if (mode != SIGNAL_HANDLING_MODE_SIGNALFD)
+	{
+		enableSignalHandling(mode);
+		return;
+	}
+
+	// the other signals are never blocked, so they take their disposition even when no loop reads a signalfd.
+	// SIGPIPE is always blocked, writing a closed socket fails with EPIPE as in the relay mode
+	signalHandlingMode_ = mode;
+	signalFdSignals_ = signals;
+	::sigaddset(&signalFdSignals_, SIGPIPE);
+	blockSignals(signalFdSignals_, SIG_BLOCK);
+	LOG_INFO("signal handling enabled, signals are read from signalfd");
+}
+
 void SignalMgr::start()
 {
 	std::thread(std::bind(&SignalMgr::run, this)).detach();
@@ -82,6 +111,77 @@ void SignalMgr::run()
 	loop_.loop();
 }
 
+void SignalMgr::registerSignalListener(int sig, EventLoop *listener)
+{
+	if (signalHandlingMode_ == SIGNAL_HANDLING_MODE_SIGNALFD)
+	{
+		std::lock_guard<std::mutex> lock(listenerMutex_);
+		auto &container = signalListenerMap_[sig];
+		if (std::find(container.begin(), container.end(), listener) == container.end())
+		{
+			container.push_back(listener);
+		}
+		return;
+	}
+
+	loop_.wakeupAndRun(std::bind(&SignalMgr::registerSignalListenerInLoop, this, sig, listener));
+}
+
+void SignalMgr::unregisterSignalListener(int sig, EventLoop *listener)
+{
+	if (signalHandlingMode_ == SIGNAL_HANDLING_MODE_SIGNALFD)
+	{
+		std::lock_guard<std::mutex> lock(listenerMutex_);
+		auto it = signalListenerMap_.find(sig);
+		if (it != signalListenerMap_.end())
+		{
+			it->second.remove(listener);
+			if (it->second.empty())
+			{
+				signalListenerMap_.erase(it);
+			}
+		}
+		return;
+	}
+
+	loop_.wakeupAndRun(std::bind(&SignalMgr::unregisterSignalListenerInLoop, this, sig, listener));
+}
+
+size_t SignalMgr::relaySignal(int sig, EventLoop *reader)
+{
+	std::lock_guard<std::mutex> lock(listenerMutex_);
+	auto it = signalListenerMap_.find(sig);
+	if (it == signalListenerMap_.end())
+	{
+		return 0;
+	}
+
+	auto &container = it->second;
+	for (auto loop : container)
+	{
+		if (loop != reader)
+		{
+			loop->signalRaised(sig);
+		}
+	}
+
+	return container.size();
+}
+
+void SignalMgr::raiseUnhandledSignal(int sig)
+{
+	LOG_TRACE("signal %d %s(%s) has no handlers, raise it", sig, getSignalName(sig).c_str(), ::strsignal(sig));
+
+	sigset_t set;
+	::sigemptyset(&set);
+	::sigaddset(&set, sig);
+
+	// delivered before raise() returns
+	::pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+	::raise(sig);
+	::pthread_sigmask(SIG_BLOCK, &set, NULL);
+}
+
 void SignalMgr::registerSignalListenerInLoop(int sig, EventLoop *listener)
 {
 	auto it = signalListenerMap_.find(sig);
@@ -240,8 +340,12 @@ void SignalMgr::blockAllSignals(int how)
 {
 	sigset_t set;
 	::sigfillset(&set);
+	blockSignals(set, how);
+}
 
-	if (::pthread_sigmask(how, &set, NULL) != 0)
+void SignalMgr::blockSignals(const sigset_t &signals, int how)
+{
+	if (::pthread_sigmask(how, &signals, NULL) != 0)
 	{
 		int savedErrno = errno;
 		LOG_ERROR("pthread_sigmask() error, error:%d %s", savedErrno, ::strerror(savedErrno));
@@ -14,6 +14,7 @@
 #include <memory>
 #include <utility>
 #include <thread>
+#include <mutex>
 
 #include "EventLoop.h"
 #include "Channel.h"
@@ -25,17 +26,43 @@ namespace easynet
 class SignalMgr
 {
 public:
+	enum SignalHandlingMode
+	{
+		// a thread of the SignalMgr catches the signals with sigaction() and relays them to the loops
+		SIGNAL_HANDLING_MODE_RELAY_THREAD,
+
+		// every loop with signal handlers reads the pending signals from its own signalfd, without
+		// the thread. a signal is read by one of the loops, which passes it to the other listeners
+		// of the signal, or lets it take its disposition if there are none.
+		// only the signals given to enableSignalHandling() are blocked and read.
+		SIGNAL_HANDLING_MODE_SIGNALFD
+	};
+
 	~SignalMgr() = default;
 
 	static SignalMgr& getInstance();
-	static void enableSignalHandling();
+
+	// blocks all signals, called in the main thread before any other thread is created.
+	// signalfd mode needs the signals to handle, see the one below, no signal is read without them
+	static void enableSignalHandling(SignalHandlingMode mode = SIGNAL_HANDLING_MODE_RELAY_THREAD);
+	// signalfd mode: blocks only @signals(and SIGPIPE), the ones the application adds handlers for, the others keep
+	// their disposition in every thread. a signal in @signals stays pending while no loop has a handler
+	// added, and so does one sent to a thread without a signalfd. called before any other thread is created
+	static void enableSignalHandling(SignalHandlingMode mode, const sigset_t &signals);
+	static SignalHandlingMode getSignalHandlingMode() { return signalHandlingMode_; }
+	static const sigset_t& getSignalFdSignals() { return signalFdSignals_; } // signalfd mode
 	static const std::string& getSignalName(int sig);
 
-	void registerSignalListener(int sig, EventLoop *listener) 
-	{ loop_.wakeupAndRun(std::bind(&SignalMgr::registerSignalListenerInLoop, this, sig, listener)); }
+	void registerSignalListener(int sig, EventLoop *listener);
+	void unregisterSignalListener(int sig, EventLoop *listener);
+
+	// signalfd mode: @sig was read by @reader, passes it to the other listeners.
+	// returns the number of listeners of @sig, including @reader
+	size_t relaySignal(int sig, EventLoop *reader);
 
-	void unregisterSignalListener(int sig, EventLoop *listener)
-	{ loop_.wakeupAndRun(std::bind(&SignalMgr::unregisterSignalListenerInLoop, this, sig, listener)); }
+	// signalfd mode: @sig has no listeners, it's raised in the calling thread with the signal unblocked,
+	// so it takes the disposition it would have without SignalMgr, the default one terminates the process
+	static void raiseUnhandledSignal(int sig);
   
 private:
 	using SignalListenerMap = std::map<int, std::list<EventLoop*>>;
@@ -48,6 +75,7 @@ private:
 	static void blockAllSignals();
 	static void unblockAllSignals();
 	static void blockAllSignals(int how);
+	static void blockSignals(const sigset_t &signals, int how);
 
 	SignalMgr(int fd);
 	SignalMgr(const SignalMgr &rhs) = delete;
@@ -62,14 +90,17 @@ private:
 	void restoreSignalHandler(int sig);
 	
 	static std::once_flag initedFlag_;
+	static SignalHandlingMode signalHandlingMode_;
+	static sigset_t signalFdSignals_;
 	
 	EventLoop loop_;
 
 	Socket 	sigNotifyUnixSocket_;
 	Channel sigNotifyChnl_;
 
-	SignalListenerMap signalListenerMap_;
+	SignalListenerMap signalListenerMap_;  // accessed in @loop_, or with @listenerMutex_ in signalfd mode
 	std::map<int, struct sigaction> oldSaMap_;
+	std::mutex listenerMutex_;
 };
 
 } // namespace easynet
@@ -6,6 +6,8 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
+#include <linux/filter.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <cstring>
@@ -218,6 +220,54 @@ int Socket::setRecvErr(bool on)
 				   &val, static_cast<socklen_t>(sizeof val));
 }
 
+int Socket::setUdpGro(bool on)
+{
+#ifdef UDP_GRO
+	int val = on ? 1 : 0;
+	return ::setsockopt(socketFd_, IPPROTO_UDP, UDP_GRO,
+				   &val, static_cast<socklen_t>(sizeof val));
+#else
+	LOG_ERROR("UDP_GRO not supported");
+	errno = ENOPROTOOPT;
+	return -1;
+#endif
+}
+
+int Socket::setReusePortCpuSteering(const std::vector<std::vector<int>> &socketCpus)
+{
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+	// A = the current cpu, returns the index of the socket having it. 
+	// an index out of the group makes the kernel fall back to the flow hash.
+	std::vector<struct sock_filter> code;
+	code.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_CPU)));
+	for (size_t i = 0; i < socketCpus.size(); i++)
+	{
+		for (auto cpu : socketCpus[i])
+		{
+			code.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, static_cast<uint32_t>(cpu), 0, 1));
+			code.push_back(BPF_STMT(BPF_RET | BPF_K, static_cast<uint32_t>(i)));
+		}
+	}
+	code.push_back(BPF_STMT(BPF_RET | BPF_K, static_cast<uint32_t>(socketCpus.size())));
+
+	if (code.size() > BPF_MAXINSNS)
+	{
+		LOG_ERROR("too many cpus to steer:%u", code.size());
+		errno = EINVAL;
+		return -1;
+	}
+
+	struct sock_fprog prog;
+	prog.len = static_cast<unsigned short>(code.size());
+	prog.filter = code.data();
+	return ::setsockopt(socketFd_, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
+#else
+	LOG_ERROR("SO_ATTACH_REUSEPORT_CBPF not supported");
+	errno = ENOPROTOOPT;
+	return -1;
+#endif
+}
+
 int Socket::getSocketError()
 {
 	int optval;
@@ -231,6 +281,12 @@ int Socket::getSocketError()
 	return optval;
 }
 
+int Socket::getTcpInfo(struct tcp_info *info) const
+{
+	socklen_t len = static_cast<socklen_t>(sizeof(*info));
+	return ::getsockopt(socketFd_, IPPROTO_TCP, TCP_INFO, info, &len);
+}
+
 bool Socket::isSelfConnect()
 {
 	InetAddr localAddr;
@@ -7,10 +7,13 @@
 
 #include <sys/socket.h>
 #include <string>
+#include <vector>
 #include "InetAddr.h"
 
 #define EASYNET_INVALID_SOCKET   -1
 
+struct tcp_info;
+
 namespace easynet{
 
 // just for TCP socket, for linux
@@ -67,6 +70,11 @@ public:
 
 	// just for udp
 	ssize_t recvFrom(char *buf, size_t len, InetAddr *peerAddr, int flag = 0);
+
+	// just for udp, receives or sends up to @num datagrams in one call, returns the number of datagrams
+	int recvMmsg(struct mmsghdr *msgs, unsigned int num, int flag = 0) { return ::recvmmsg(socketFd_, msgs, num, flag, nullptr); }
+	int sendMmsg(struct mmsghdr *msgs, unsigned int num, int flag = 0) { return ::sendmmsg(socketFd_, msgs, num, flag); }
+	ssize_t sendMsg(const struct msghdr *msg, int flag = 0) { return ::sendmsg(socketFd_, msg, flag); }
 	
 	int getLocalAddr(InetAddr *localAddr);
 	int getPeerAddr(InetAddr *peerAddr);
@@ -83,8 +91,15 @@ public:
 	int setRecvBuf(int size);
 	int setSendBuf(int size);
 	int setRecvErr(bool on);
+	int setUdpGro(bool on);  // just for udp, receives the datagrams coalesced by the kernel
+
+	// for a group of sockets bound to the same address with SO_REUSEPORT, steers a packet to the socket
+	// whose index in the group(the order they were bound) is i, if the cpu handling the packet is in
+	// @socketCpus[i]. the packets handled by other cpus are distributed by the flow hash.
+	int setReusePortCpuSteering(const std::vector<std::vector<int>> &socketCpus);
 
 	int getSocketError();
+	int getTcpInfo(struct tcp_info *info) const;  // just for tcp
 	bool isSelfConnect();
 
 private:
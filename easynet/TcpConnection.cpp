@@ -2,12 +2,18 @@
 // Use of this source code is governed by a BSD 2-Clause license that can be found in the License file.
 // Author: Shenghua Fang
 
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
 #include <functional>
 #include <cstring>
 
 #include "TcpConnection.h"
 #include "EventLoop.h"
+#include "TcpInfoSampler.h"
+#include "Probes.h"
 #include "utils/log.h"
+#include "utils/TimeUtil.h"
 
 using namespace easynet;
 
@@ -16,10 +22,12 @@ TcpConnection::TcpConnection(EventLoop *loop)
                      socket_(EASYNET_INVALID_SOCKET),
                      channel_(loop),
                      closed_(true),
+                     migrating_(false),
                      establishedTimeMillis_(0),
                      data_(nullptr),
                      errNo_(0),
                      idleMillis_(0),
+                     lastActiveTimeMillis_(0),
 	                 idleTimer_(nullptr)              
 {
 	setChannelHandlers();
@@ -31,10 +39,12 @@ TcpConnection::TcpConnection(EventLoop *loop, Socket &&socket)
                      socket_(std::move(socket)),
 					 channel_(loop, socket_.fd()),
 					 closed_(true),
+                     migrating_(false),
                      establishedTimeMillis_(loop_->now()),
                      data_(nullptr),
                      errNo_(0),
                      idleMillis_(0),
+                     lastActiveTimeMillis_(0),
 	                 idleTimer_(nullptr) 
 {
 	socket_.getLocalAddr(&localAddr_);
@@ -56,11 +66,13 @@ void TcpConnection::reset(Socket &&socket, const InetAddr &peerAddr)
 {
 	clear();
 	closed_ = false;
+	migrating_ = false;
 
 	establishedTimeMillis_ = loop_->now();
 	socket_ = std::move(socket);
 	socket_.getLocalAddr(&localAddr_);
 	peerAddr_ = peerAddr;
+	stats_.reset();  // enabled again by the one reusing the connection
 	channel_.resetFd(socket_.fd());
 	channel_.enableReading();
 }
@@ -69,7 +81,23 @@ void TcpConnection::onReadable()
 {
 	if (recvData() > 0)
 	{
+		if (!stats_)
+		{
+			readHandler_(*this);
+			return;
+		}
+
+		// the handler may close the connection, the stats are kept until it's reused
+		TcpConnectionStats *stats = stats_.get();
+		int64_t beginNanos = TimeUtil::currentMonoTimeNanos();
 		readHandler_(*this);
+		int64_t nanos = TimeUtil::currentMonoTimeNanos() - beginNanos;
+		stats->readHandlerCalls++;
+		stats->readHandlerNanos += nanos;
+		if (nanos > stats->maxReadHandlerNanos)
+		{
+			stats->maxReadHandlerNanos = nanos;
+		}
 	}
 
 	// n is 0 only when peer closed or peer shutdown write, 
@@ -80,11 +108,18 @@ void TcpConnection::onPeerShutdown()
 {
 	LOG_TRACE("peer shutdown, TcpConnection:%s->%s, socket fd = %d", 
 		peerAddr_.toString().c_str(), localAddr_.toString().c_str(), socket_.fd());
+	loop_->trace(TRACE_EVENT_PEER_SHUTDOWN, socket_.fd());
 
 	// peer closed socket, or peer shutdown write. we can't distinguish closing from shutingdown
 	channel_.disableRdHup();
 	// read data first
 	onReadable();
+	if (migrating_)
+	{
+		// the read handler migrated the connection, the new loop reports the shutdown again
+		channel_.enableRdHup();
+		return;
+	}
 	disableReceiving();
 
 	if (!closed() && peerShutdownHandler_)
@@ -97,6 +132,7 @@ void TcpConnection::onWritable()
 {
 	LOG_TRACE("socket writable, TcpConnection:%s->%s, socket fd = %d", 
 		localAddr_.toString().c_str(), peerAddr_.toString().c_str(), socket_.fd());
+	loop_->trace(TRACE_EVENT_WRITABLE, socket_.fd());
 
 	// most of the case is the first time when adding this socketfd to epoll.
 	if (outputBuffer_.empty() || !channel_.writing())
@@ -104,12 +140,15 @@ void TcpConnection::onWritable()
 		return;
 	}
 
+	size_t oldSize = outputBuffer_.size();
 	ssize_t nWrote = sendData(outputBuffer_.data(), outputBuffer_.size());
 	if (nWrote > 0)
 	{	
 		outputBuffer_.deleteBegin(nWrote);
+		loop_->addQueuedBytes(-nWrote);
 		if (outputBuffer_.empty())
 		{
+			updateOutputStats(oldSize);
 			channel_.disableWriting();
 			if (writeCompleteHandler_)
 			{
@@ -151,11 +190,26 @@ ssize_t TcpConnection::recvData()
 		ssize_t len = socket_.recv(inputBuffer_.end(), n);
 		LOG_TRACE("to read %u bytes from socket, readed %d bytes, TcpConnection:%s->%s, socket fd = %d", 
 		    n, len, peerAddr_.toString().c_str(), localAddr_.toString().c_str(), socket_.fd());
+		loop_->trace(TRACE_EVENT_READ, socket_.fd(), n, len < 0 ? -errno : len);
+		EASYNET_PROBE3(recv, socket_.fd(), n, len);
+		if (stats_)
+		{
+			stats_->recvCalls++;
+		}
 
 		if (len >= 0)
 		{
-			updateIdleTimer();
+			loop_->addMetric(METRIC_BYTES_RECEIVED, len);
+			updateActiveTime();
 			inputBuffer_.addSize(len);
+			if (stats_)
+			{
+				stats_->bytesReceived += len;
+				if (inputBuffer_.size() > stats_->inputBufferHighWater)
+				{
+					stats_->inputBufferHighWater = inputBuffer_.size();
+				}
+			}
 			return len;
 		}
 		else if (len < 0)
@@ -186,6 +240,15 @@ ssize_t TcpConnection::recvData()
 
 void TcpConnection::send(const char *data, size_t len)
 {
+	if (migrating_)
+	{
+		// not to poll the socket in this loop again, it's written after attachToLoop()
+		size_t oldSize = outputBuffer_.size();
+		outputBuffer_.append(data, len);
+		updateOutputStats(oldSize);
+		return;
+	}
+
 	ssize_t nWrote = 0;
 	size_t remaining = len;
 
@@ -208,7 +271,10 @@ void TcpConnection::send(const char *data, size_t len)
 
 	if (remaining > 0)
 	{
+		size_t oldSize = outputBuffer_.size();
 		outputBuffer_.append(data + nWrote, remaining);
+		loop_->addQueuedBytes(remaining);
+		updateOutputStats(oldSize);
 		if (!channel_.writing())
 		{
 			channel_.enableWriting();
@@ -224,9 +290,20 @@ ssize_t TcpConnection::sendData(const char *buf, size_t len)
 		nWrote = socket_.send(buf, len);
 		LOG_TRACE("to send %u bytes to socket, %d bytes sent, TcpConnection:%s->%s, socket fd = %d", 
 		    len, nWrote, localAddr_.toString().c_str(), peerAddr_.toString().c_str(), socket_.fd());
+		loop_->trace(TRACE_EVENT_WRITE, socket_.fd(), len, nWrote < 0 ? -errno : nWrote);
+		EASYNET_PROBE3(send, socket_.fd(), len, nWrote);
+		if (stats_)
+		{
+			stats_->sendCalls++;
+		}
 
 		if (nWrote >= 0)
 		{
+			loop_->addMetric(METRIC_BYTES_SENT, nWrote);
+			if (stats_)
+			{
+				stats_->bytesSent += nWrote;
+			}
 			break;
 		}
 		else  // nWrote < 0
@@ -289,6 +366,16 @@ void TcpConnection::close()
 {
 	if (!closed())
 	{
+		// the error is cleared with the connection
+		loop_->trace(TRACE_EVENT_CLOSE, socket_.fd(), errNo_, outputBuffer_.size());
+		if (migrating_)
+		{
+			// this loop's worker has let it go, the new one frees it, see TcpWorker::onConnectionMigrated()
+			outputBuffer_.clear();  // no longer counted in this loop's queued bytes
+			clear();
+			return;
+		}
+
 		clear();
 		if (closeHandler_)
 		{
@@ -305,10 +392,12 @@ void TcpConnection::clear()
 	socket_.close();
 	data_ = nullptr;
 	inputBuffer_.clear();
+	loop_->addQueuedBytes(-static_cast<int64_t>(outputBuffer_.size()));
 	outputBuffer_.clear();
 	closed_ = true;
 	idleMillis_ = 0;
 	closeIdleTimer();
+	idleHandler_ = nullptr;
 }
 
 void TcpConnection::setIdleHandler(int idleSecs, TimerHandler &&handler)
@@ -318,8 +407,51 @@ void TcpConnection::setIdleHandler(int idleSecs, TimerHandler &&handler)
     	return;
     }
     idleMillis_ = idleSecs * 1000;
+    idleHandler_ = std::move(handler);
+    updateActiveTime();
     closeIdleTimer();
-    idleTimer_ = loop_->addIdleTimer(idleMillis_, std::move(handler));
+    if (migrating_)
+    {
+    	return;  // started in the new loop
+    }
+    idleTimer_ = loop_->addIdleTimer(idleMillis_, std::bind(&TcpConnection::onIdleTimeout, this));
+}
+
+void TcpConnection::detachFromLoop()
+{
+	migrating_ = true;
+	channel_.disableAll();
+	loop_->addQueuedBytes(-static_cast<int64_t>(outputBuffer_.size()));
+	closeIdleTimer();  // @idleHandler_ is kept, the timer is restarted in the new loop
+}
+
+void TcpConnection::attachToLoop(EventLoop *loop)
+{
+	loop_ = loop;
+	channel_.resetLoop(loop);
+	migrating_ = false;
+	if (closed())
+	{
+		return;  // closed while migrating
+	}
+
+	channel_.enableReading();
+	if (!outputBuffer_.empty())
+	{
+		// written at once, before the events of the new loop, such as a peer shutdown that closes it
+		loop_->addQueuedBytes(outputBuffer_.size());
+		channel_.enableWriting();
+		onWritable();
+		if (closed())
+		{
+			return;
+		}
+	}
+
+	if (idleHandler_)
+	{
+		idleTimer_ = loop_->addIdleTimer(idleMillis_, std::bind(&TcpConnection::onIdleTimeout, this));
+	}
 }
 
 void TcpConnection::closeIdleTimer()
@@ -331,10 +463,86 @@ void TcpConnection::closeIdleTimer()
     }
 }
 
-void TcpConnection::updateIdleTimer()
+void TcpConnection::updateActiveTime()
 {
-    if (idleTimer_)
-    {
-    	idleTimer_->restart(idleMillis_);
-    }
+	lastActiveTimeMillis_ = loop_->now();
+}
+
+int TcpConnection::getTcpInfo(TcpInfo *info) const
+{
+	struct tcp_info tcpInfo;
+	if (closed() || socket_.getTcpInfo(&tcpInfo) < 0)
+	{
+		return -1;
+	}
+
+	info->rttMicros = tcpInfo.tcpi_rtt;
+	info->rttVarMicros = tcpInfo.tcpi_rttvar;
+	info->cwnd = tcpInfo.tcpi_snd_cwnd;
+	info->totalRetransmits = tcpInfo.tcpi_total_retrans;
+	info->unackedBytes = static_cast<uint64_t>(tcpInfo.tcpi_unacked) * tcpInfo.tcpi_snd_mss;
+	return 0;
+}
+
+void TcpConnection::enableStats()
+{
+	if (stats_)
+	{
+		stats_->clear();
+	}
+	else
+	{
+		stats_.reset(new TcpConnectionStats());
+	}
+}
+
+// called after @outputBuffer_ changed from @oldSize bytes, the clock is only read
+// when the buffer turns from empty to queued or back
+void TcpConnection::updateOutputStats(size_t oldSize)
+{
+	if (!stats_)
+	{
+		return;
+	}
+
+	if (outputBuffer_.size() > stats_->outputBufferHighWater)
+	{
+		stats_->outputBufferHighWater = outputBuffer_.size();
+	}
+
+	if (oldSize == 0 && !outputBuffer_.empty())
+	{
+		stats_->outputQueuedTimes++;
+		stats_->outputQueuedSince = loop_->nowMicros();
+	}
+	else if (outputBuffer_.empty() && stats_->outputQueuedSince > 0)
+	{
+		int64_t waitMicros = loop_->nowMicros() - stats_->outputQueuedSince;
+		stats_->outputWaitMicros += waitMicros;
+		if (waitMicros > stats_->maxOutputWaitMicros)
+		{
+			stats_->maxOutputWaitMicros = waitMicros;
+		}
+		stats_->outputQueuedSince = 0;
+	}
+}
+
+void TcpConnection::onIdleTimeout()
+{
+	int64_t idleMillis = loop_->now() - lastActiveTimeMillis_;
+	if (idleMillis < idleMillis_)
+	{
+		// data arrived after the timer was started, wait for the remaining time
+		idleTimer_->restart(idleMillis_ - idleMillis);
+		return;
+	}
+
+	// the timer is not repeatable, it will be deleted after this callback returns.
+	// the handler may close this connection or set a new idle handler
+	idleTimer_ = nullptr;
+	TimerHandler handler(std::move(idleHandler_));
+	if (handler)
+	{
+		handler();
+	}
 }
@@ -14,11 +14,13 @@
 #include "Channel.h"
 #include "InetAddr.h"
 #include "Timer.h"
+#include "TcpConnectionStats.h"
 
 namespace easynet
 {
 
 class EventLoop;
+struct TcpInfo;
 
 class TcpConnection
 {
@@ -73,23 +75,47 @@ public:
 	int getErrNo() const { return errNo_; }
 	std::string getErrMsg() const { return errMsg_; }
 
-    // can only be called in event loop
+    // can only be called in event loop. while the connection is migrating, the data is kept
+    // in the output buffer and written by the new loop
 	void send(const char *data, size_t len); 
 	void send(const std::string &data) { send(data.c_str(), data.size()); }
 
     // can only be called in event loop
     void disableReceiving() { channel_.disableReading(); }
-    void enableReceiving()  { channel_.enableReading(); }
+    void enableReceiving()  { if (!migrating_) channel_.enableReading(); } // the new loop polls it when migrating
 
     // can only be called in event loop
     void shutdown();
 	void shutdownRead(); // can only be called in event loop
 	void shutdownWrite(); // can only be called in event loop
-	void close();   // can only be called in event loop
+	void close();   // can only be called in event loop, see detachFromLoop() for a migrating connection
 
 	bool closed() const { return closed_; }
     void reset(Socket &&socket, const InetAddr &peerAddr);
 
+    // to move the connection to another loop, see TcpWorker::migrateConnection().
+    // detachFromLoop() is called in the current loop, it stops polling the socket and the idle timer,
+    // the socket, both buffers, the handlers and @data_ stay in the object.
+    // attachToLoop() is called in the new loop, it polls the socket again, data arrived in between 
+    // is reported by the edge-triggered epoll when the socket is added.
+    // in between the connection is migrating: the events left in the current round are not handled,
+    // send() only queues the data, and close() closes the socket without calling the close handler,
+    // the new loop's worker frees the closed connection when it arrives.
+    void detachFromLoop();
+    void attachToLoop(EventLoop *loop);
+    bool migrating() const { return migrating_; }
+
+    int64_t getLastActiveTime() const { return lastActiveTimeMillis_; } // last time data was read, loop time in milliseconds
+
+    // counts the traffic of this connection from now on, see TcpConnectionStats. the stats are
+    // cleared when the connection is reused, and kept when it migrates. can only be called in event loop
+    void enableStats();
+    const TcpConnectionStats* getStats() const { return stats_.get(); } // nullptr if not enabled
+
+    // queries the kernel for the rtt, congestion window and so on, a system call every time.
+    // returns -1 if the socket is closed or the query failed. see TcpInfoSampler
+    int getTcpInfo(TcpInfo *info) const;
+
 private:
 	void setChannelHandlers();
 	
@@ -104,7 +130,9 @@ private:
 	void clear();
 
 	void closeIdleTimer();
-	void updateIdleTimer();
+	void onIdleTimeout();
+	void updateActiveTime();
+	void updateOutputStats(size_t oldSize);
 
 	EventLoop *loop_;
 	Socket socket_;
@@ -117,14 +145,22 @@ private:
     InetAddr peerAddr_;
 
     bool closed_;
-    int64_t establishedTimeMillis_; // connection establised time, milliseconds since 1970-1-1 00:00:00
+    bool migrating_;  // between detachFromLoop() and attachToLoop()
+    int64_t establishedTimeMillis_; // connection establised time, loop time in milliseconds, see EventLoop::now()
 	void *data_;   // application's data related to this connection
 
 	int errNo_;
 	std::string errMsg_;
 
+	// the idle timer is not restarted on every read, only @lastActiveTimeMillis_ is updated.
+	// when the timer times out, it is restarted for the remaining time if the connection
+	// has been active since, otherwise the idle handler is called.
 	int64_t idleMillis_;
+	int64_t lastActiveTimeMillis_; // last time data was read, milliseconds
 	Timer *idleTimer_;
+	TimerHandler idleHandler_;    // application's callback, will be called when the connection is idle for @idleMillis_
+
+	std::unique_ptr<TcpConnectionStats> stats_;  // nullptr unless enableStats() is called, so it costs a check when disabled
 
 	TcpConnectionHandler readHandler_;            // application's callback, will be called when data is read from the socket
 	TcpConnectionHandler writeCompleteHandler_;   // application's callback, will be called when all data is wroted to the socket
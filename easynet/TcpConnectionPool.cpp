@@ -63,11 +63,13 @@ TcpConnection* TcpConnectionPool::pop()
 		numFreeConnections_--;
 		tcpConnection.reset(tcpConnections_.front().release());
 		tcpConnections_.pop_front();
+		loop_->addMetric(METRIC_POOL_HITS, 1);
 	}
 	else if (numAllocatedConnections_ < maxPoolSize_)
 	{
 		numAllocatedConnections_++;
 		tcpConnection.reset(new TcpConnection(loop_));
+		loop_->addMetric(METRIC_POOL_MISSES, 1);
 	}
 
 	return tcpConnection.release();
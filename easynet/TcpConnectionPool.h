@@ -30,6 +30,11 @@ public:
 	TcpConnection* pop();
 	void push(TcpConnection *tcpConnection);
 
+	// a connection in use migrates from one pool to another, see TcpWorker::migrateConnection().
+	// the adopting pool may hold more than @maxPoolSize_ connections for a while
+	void release(TcpConnection *tcpConnection) { numAllocatedConnections_--; }
+	void adopt(TcpConnection *tcpConnection)   { numAllocatedConnections_++; }
+
 	unsigned int getFreeConnectionsNum() const { return numFreeConnections_; }
 	unsigned int getAllocatiedConnectionsNum() const { return numAllocatedConnections_; }
 
@@ -0,0 +1,56 @@
+// Copyright 2017, Shenghua Fang. All rights reserved.
+// Use of this source code is governed by a BSD 2-Clause license that can be found in the License file.
+// Author: Shenghua Fang
+
+#include "TcpConnectionStats.h"
+
+using namespace easynet;
+
+void TcpConnectionStats::clear()
+{
+	bytesReceived = 0;
+	bytesSent = 0;
+	recvCalls = 0;
+	sendCalls = 0;
+	inputBufferHighWater = 0;
+	outputBufferHighWater = 0;
+	readHandlerCalls = 0;
+	readHandlerNanos = 0;
+	maxReadHandlerNanos = 0;
+	outputQueuedTimes = 0;
+	outputWaitMicros = 0;
+	maxOutputWaitMicros = 0;
+	outputQueuedSince = 0;
+}
+
+uint64_t TcpConnectionStats::get(TcpConnectionStatsKey key) const
+{
+	switch (key)
+	{
+	case TCP_CONNECTION_STATS_BYTES_RECEIVED:    return bytesReceived;
+	case TCP_CONNECTION_STATS_BYTES_SENT:        return bytesSent;
+	case TCP_CONNECTION_STATS_RECV_CALLS:        return recvCalls;
+	case TCP_CONNECTION_STATS_SEND_CALLS:        return sendCalls;
+	case TCP_CONNECTION_STATS_INPUT_HIGH_WATER:  return inputBufferHighWater;
+	case TCP_CONNECTION_STATS_OUTPUT_HIGH_WATER: return outputBufferHighWater;
+	case TCP_CONNECTION_STATS_READ_HANDLER_TIME: return readHandlerNanos;
+	case TCP_CONNECTION_STATS_OUTPUT_WAIT_TIME:  return outputWaitMicros;
+	default:                                     return 0;
+	}
+}
+
+const char* TcpConnectionStats::getKeyName(int key)
+{
+	static const char *names[TCP_CONNECTION_STATS_KEY_MAX] = {
+		"bytes_received",
+		"bytes_sent",
+		"recv_calls",
+		"send_calls",
+		"input_high_water",
+		"output_high_water",
+		"read_handler_nanos",
+		"output_wait_micros"
+	};
+
+	return key >= 0 && key < TCP_CONNECTION_STATS_KEY_MAX ? names[key] : "unknown";
+}
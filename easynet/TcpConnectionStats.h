@@ -0,0 +1,57 @@
+// Copyright 2017, Shenghua Fang. All rights reserved.
+// Use of this source code is governed by a BSD 2-Clause license that can be found in the License file.
+// Author: Shenghua Fang
+
+#ifndef _EASYNET_TCP_CONNECTION_STATS_H_
+#define _EASYNET_TCP_CONNECTION_STATS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace easynet
+{
+
+// the keys to rank the connections by, see TcpWorker::getTopConnections()
+enum TcpConnectionStatsKey
+{
+	TCP_CONNECTION_STATS_BYTES_RECEIVED = 0,
+	TCP_CONNECTION_STATS_BYTES_SENT,
+	TCP_CONNECTION_STATS_RECV_CALLS,
+	TCP_CONNECTION_STATS_SEND_CALLS,
+	TCP_CONNECTION_STATS_INPUT_HIGH_WATER,
+	TCP_CONNECTION_STATS_OUTPUT_HIGH_WATER,
+	TCP_CONNECTION_STATS_READ_HANDLER_TIME,
+	TCP_CONNECTION_STATS_OUTPUT_WAIT_TIME,
+	TCP_CONNECTION_STATS_KEY_MAX
+};
+
+// the traffic of a connection since it was established, see TcpConnection::enableStats()
+struct TcpConnectionStats
+{
+	TcpConnectionStats() { clear(); }
+	void clear();
+
+	uint64_t bytesReceived;
+	uint64_t bytesSent;
+	uint64_t recvCalls;              // recv() system calls, including the ones returned EAGAIN
+	uint64_t sendCalls;
+	size_t inputBufferHighWater;     // the most bytes the input buffer held
+	size_t outputBufferHighWater;
+	uint64_t readHandlerCalls;
+	int64_t readHandlerNanos;        // total time spent in the read handler
+	int64_t maxReadHandlerNanos;
+
+	// the output buffer is queued from when bytes are appended to it empty, until the socket takes
+	// all of it, which is the longest time any byte of that period waited for the kernel
+	uint64_t outputQueuedTimes;
+	int64_t outputWaitMicros;        // total time the output buffer was queued
+	int64_t maxOutputWaitMicros;
+	int64_t outputQueuedSince;       // microseconds of EventLoop::nowMicros(), 0 if the buffer is empty
+
+	uint64_t get(TcpConnectionStatsKey key) const;
+	static const char* getKeyName(int key);
+};
+
+}
+
+#endif
@@ -0,0 +1,147 @@
+// Copyright 2017, Shenghua Fang. All rights reserved.
+// Use of this source code is governed by a BSD 2-Clause license that can be found in the License file.
+// Author: Shenghua Fang
+
+#include <cstdio>
+#include <functional>
+#include <algorithm>
+
+#include "TcpInfoSampler.h"
+#include "TcpConnection.h"
+#include "EventLoop.h"
+#include "Timer.h"
+#include "utils/log.h"
+
+using namespace easynet;
+
+namespace
+{
+
+// the most buckets of the hash set a round visits, as many times of the connections it samples.
+// the set never gives back its buckets, after a peak most of them are empty
+const size_t kBucketsPerConnection = 4;
+
+}
+
+std::string TcpInfo::toString() const
+{
+	char buf[128];
+	::snprintf(buf, sizeof(buf), "rtt:%uus rttvar:%uus cwnd:%u retrans:%u unacked:%llu",
+		rttMicros, rttVarMicros, cwnd, totalRetransmits, static_cast<unsigned long long>(unackedBytes));
+	return buf;
+}
+
+void TcpInfoSnapshot::clear()
+{
+	failures = 0;
+	rttMicros.clear();
+	rttVarMicros.clear();
+	cwnd.clear();
+	totalRetransmits.clear();
+	unackedBytes.clear();
+}
+
+void TcpInfoSnapshot::merge(const TcpInfoSnapshot &rhs)
+{
+	failures += rhs.failures;
+	rttMicros.merge(rhs.rttMicros);
+	rttVarMicros.merge(rhs.rttVarMicros);
+	cwnd.merge(rhs.cwnd);
+	totalRetransmits.merge(rhs.totalRetransmits);
+	unackedBytes.merge(rhs.unackedBytes);
+}
+
+std::string TcpInfoSnapshot::toString() const
+{
+	return "rtt(us) " + rttMicros.toString() + "\n"
+	       "rttvar(us) " + rttVarMicros.toString() + "\n"
+	       "cwnd " + cwnd.toString() + "\n"
+	       "retrans " + totalRetransmits.toString() + "\n"
+	       "unacked " + unackedBytes.toString() + "\n"
+	       "failures " + std::to_string(failures) + "\n";
+}
+
+TcpInfoSampler::TcpInfoSampler(EventLoop *loop, const Connections *connections)
+                   : loop_(loop),
+                     connections_(connections),
+                     timer_(nullptr),
+                     connectionsPerRound_(0),
+                     nextBucket_(0),
+                     failures_(0)
+{}
+
+void TcpInfoSampler::start(int64_t intervalMillis, int connectionsPerRound)
+{
+	stop();
+	if (intervalMillis <= 0 || connectionsPerRound <= 0)
+	{
+		return;
+	}
+
+	connectionsPerRound_ = connectionsPerRound;
+	timer_ = loop_->runAfter(intervalMillis, std::bind(&TcpInfoSampler::onSampleTimer, this), intervalMillis);
+}
+
+void TcpInfoSampler::stop()
+{
+	if (timer_)
+	{
+		timer_->cancel();
+		timer_ = nullptr;
+	}
+}
+
+void TcpInfoSampler::snapshot(TcpInfoSnapshot *snapshot) const
+{
+	snapshot->failures = failures_.load(std::memory_order_relaxed);
+	rttMicros_.snapshot(&snapshot->rttMicros);
+	rttVarMicros_.snapshot(&snapshot->rttVarMicros);
+	cwnd_.snapshot(&snapshot->cwnd);
+	totalRetransmits_.snapshot(&snapshot->totalRetransmits);
+	unackedBytes_.snapshot(&snapshot->unackedBytes);
+}
+
+// walks the buckets of the hash set instead of iterators, which don't survive the insertions
+// and deletions between rounds. a round may take a few more than @connectionsPerRound_ to finish
+// its last bucket, and a connection added behind the cursor waits for the next pass.
+// a round stops after kBucketsPerConnection * @connectionsPerRound_ buckets as well, so its cost is
+// bounded when the set is sparse after a peak, and a pass over the connections takes more rounds then.
+void TcpInfoSampler::onSampleTimer()
+{
+	if (connections_->empty())
+	{
+		return;
+	}
+
+	size_t buckets = connections_->bucket_count();
+	size_t maxBuckets = std::min(buckets, kBucketsPerConnection * connectionsPerRound_);
+	int sampled = 0;
+	for (size_t i = 0; i < maxBuckets && sampled < connectionsPerRound_; i++)
+	{
+		size_t bucket = nextBucket_ % buckets;
+		for (auto it = connections_->begin(bucket); it != connections_->end(bucket); ++it)
+		{
+			sample(*it);
+			sampled++;
+		}
+		nextBucket_ = bucket + 1;
+	}
+
+	LOG_TRACE("TcpInfoSampler sampled %d of %u connections", sampled, connections_->size());
+}
+
+void TcpInfoSampler::sample(TcpConnection *tcpConnection)
+{
+	TcpInfo info;
+	if (tcpConnection->getTcpInfo(&info) < 0)
+	{
+		failures_.store(failures_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		return;
+	}
+
+	rttMicros_.record(info.rttMicros);
+	rttVarMicros_.record(info.rttVarMicros);
+	cwnd_.record(info.cwnd);
+	totalRetransmits_.record(info.totalRetransmits);
+	unackedBytes_.record(info.unackedBytes);
+}
@@ -0,0 +1,94 @@
+// Copyright 2017, Shenghua Fang. All rights reserved.
+// Use of this source code is governed by a BSD 2-Clause license that can be found in the License file.
+// Author: Shenghua Fang
+
+#ifndef _EASYNET_TCP_INFO_SAMPLER_H_
+#define _EASYNET_TCP_INFO_SAMPLER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <string>
+#include <unordered_set>
+
+#include "utils/Histogram.h"
+
+namespace easynet
+{
+
+class EventLoop;
+class TcpConnection;
+class Timer;
+
+// the kernel's view of a connection, from getsockopt(TCP_INFO), see TcpConnection::getTcpInfo()
+struct TcpInfo
+{
+	uint32_t rttMicros;         // smoothed round trip time
+	uint32_t rttVarMicros;      // round trip time variation
+	uint32_t cwnd;              // congestion window, segments
+	uint32_t totalRetransmits;  // segments retransmitted since the connection was established
+	uint64_t unackedBytes;      // sent and not acknowledged yet, unacked segments * mss
+
+	std::string toString() const;
+};
+
+// the distributions of the samples a TcpInfoSampler took since it started
+struct TcpInfoSnapshot
+{
+	TcpInfoSnapshot() { clear(); }
+
+	void clear();
+	void merge(const TcpInfoSnapshot &rhs);
+	std::string toString() const;
+
+	uint64_t failures;  // connections the getsockopt() failed on
+	HistogramSnapshot rttMicros;
+	HistogramSnapshot rttVarMicros;
+	HistogramSnapshot cwnd;
+	HistogramSnapshot totalRetransmits;
+	HistogramSnapshot unackedBytes;
+};
+
+// samples TCP_INFO of a worker's connections in rounds: every @intervalMillis it queries at most
+// @connectionsPerRound of them, continuing from where the last round stopped, so every connection
+// is sampled in turn. a round also visits a bounded number of buckets of the hash set, so its cost
+// doesn't grow with the number of connections, nor with the empty buckets left after a peak.
+// it runs in @loop, snapshot() can be called in any thread. see TcpWorker::enableTcpInfoSampling()
+class TcpInfoSampler
+{
+public:
+	using Connections = std::unordered_set<TcpConnection*>;
+
+	TcpInfoSampler(EventLoop *loop, const Connections *connections);
+	~TcpInfoSampler() { stop(); }
+
+	TcpInfoSampler(const TcpInfoSampler &rhs) = delete;
+	TcpInfoSampler& operator=(const TcpInfoSampler &rhs) = delete;
+
+	// can only be called in @loop_, or before it starts
+	void start(int64_t intervalMillis, int connectionsPerRound);
+	void stop();
+
+	void snapshot(TcpInfoSnapshot *snapshot) const;
+
+private:
+	void onSampleTimer();
+	void sample(TcpConnection *tcpConnection);
+
+	EventLoop *loop_;
+	const Connections *connections_;
+	Timer *timer_;
+	int connectionsPerRound_;
+	size_t nextBucket_;  // the bucket of @connections_ the next round starts from
+
+	std::atomic<uint64_t> failures_;
+	Histogram rttMicros_;
+	Histogram rttVarMicros_;
+	Histogram cwnd_;
+	Histogram totalRetransmits_;
+	Histogram unackedBytes_;
+};
+
+}
+
+#endif
@@ -6,11 +6,14 @@
 
 #include <thread>
 #include <functional>
+#include <algorithm>
 
 #include "TcpServer.h"
 #include "EventLoop.h"
 #include "Acceptor.h"
+#include "MetricsHttpServer.h"
 #include "utils/rlimit.h"
+#include "utils/cpu.h"
 #include "utils/log.h"
 
 using namespace easynet;
@@ -43,7 +46,22 @@ TcpServer::TcpServer()
 				 tcpWorkerConnectionPoolMaxSize_(kTcpWorkerConnectionPoolMaxSizeDeault),
 	     		 tcpWorkerConnectionPoolLivingTimeSecs_(kTcpWorkerConnectionPoolLivingTimeSecsDeault),
 	     		 minAcceptsPerCall_(kMinAcceptsPerCallDefault),
-				 maxAcceptsPerCall_(kMaxAcceptsPerCallDefault)			 
+				 maxAcceptsPerCall_(kMaxAcceptsPerCallDefault),
+				 rebalanceSkewPermille_(0),
+				 rebalanceSustainedSecs_(0),
+				 workerUtilization_(false),
+				 workerCpuAutoPlacement_(false),
+				 workerMaxNum_(0),
+				 workerScaleUpPermille_(0),
+				 workerScaleDownPermille_(0),
+				 workerScaleSustainedSecs_(0),
+				 traceRecordsPerLoop_(0),
+				 workerLoopStats_(false),
+				 slowHandlerMicros_(0),
+				 connectionStats_(false),
+				 tcpInfoIntervalMillis_(0),
+				 tcpInfoConnectionsPerRound_(0),
+				 metricsHttpPort_(0)
 {}
 
 TcpServer::TcpServer(const std::string &listenIp, unsigned short listenPort)
@@ -52,15 +70,49 @@ TcpServer::TcpServer(const std::string &listenIp, unsigned short listenPort)
 	addListenAddr(listenIp, listenPort);
 }
 
+TcpServer::~TcpServer()
+{
+	stop();
+}
+
 void TcpServer::start()
 {
 	setNofileLimit();
 	initListenSockets();
 
 	createWorkerGroup();
+	if (metricsRegistry_)
+	{
+		metricsRegistry_->createShards(getTotalWorkerNum());
+	}
 	createTcpWorkers();
 
 	startWorkers();
+
+	if (metricsHttpPort_ > 0)
+	{
+		metricsHttpServer_.reset(new MetricsHttpServer(metricsRegistry_.get(), metricsHttpIp_, metricsHttpPort_));
+		metricsHttpServer_->start();
+	}
+}
+
+void TcpServer::stop()
+{
+	if (metricsHttpServer_)
+	{
+		metricsHttpServer_->stop();
+	}
+	workerGroup_->stop();
+}
+
+MetricsRegistry* TcpServer::enableMetrics()
+{
+	if (!metricsRegistry_)
+	{
+		metricsRegistry_.reset(new MetricsRegistry());
+	}
+
+	return metricsRegistry_.get();
 }
 
 void TcpServer::setNofileLimit()
@@ -77,7 +129,7 @@ void TcpServer::setNofileLimit()
 
 	LOG_INFO("current process's soft limit:%ld, hard limit:%ld", softLimit, hardLimit);
 
-	size_t required = workerNum_ * tcpWorkerConnectionPoolMaxSize_;
+	size_t required = getTotalWorkerNum() * tcpWorkerConnectionPoolMaxSize_;
 	
 	if (required > softLimit)
 	{
@@ -127,10 +179,46 @@ void TcpServer::initListenSockets()
 
 void TcpServer::createWorkerGroup()
 {
+	placeWorkers();
     workerGroup_.reset(new WorkerGroup(workerLoadBalanceStrategy_,
     	                               workerNum_,
     	                               workerTimeResolutionMillis_,
-    	                               workerDelayMillisRetryAquireToken_));
+    	                               workerDelayMillisRetryAquireToken_,
+    	                               workerCpuSets_));
+
+    if (workerMaxNum_ > workerNum_)
+    {
+    	workerGroup_->enableElasticScaling(workerMaxNum_, 
+    		                               workerScaleUpPermille_, 
+    		                               workerScaleDownPermille_, 
+    		                               workerScaleSustainedSecs_);
+    	workerGroup_->setWorkersChangedHandler(std::bind(&TcpServer::onWorkersChanged, this,
+    		std::placeholders::_1, std::placeholders::_2));
+    	workerGroup_->setWorkerRetiringHandler(std::bind(&TcpServer::onWorkerRetiring, this,
+    		std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    }
+}
+
+void TcpServer::placeWorkers()
+{
+	if (workerCpuSets_.empty() && workerCpuAutoPlacement_)
+	{
+		std::vector<int> cpus = getCpusSpreadOverCores(getTotalWorkerNum());
+		for (auto cpu : cpus)
+		{
+			workerCpuSets_.push_back(std::vector<int>(1, cpu));
+		}
+	}
+
+	for (size_t i = 0; i < workerCpuSets_.size() && i < static_cast<size_t>(getTotalWorkerNum()); i++)
+	{
+		const std::vector<int> &cpus = workerCpuSets_[i];
+		if (!cpus.empty())
+		{
+			LOG_INFO("tcp server worker %u placed on cpus:%s, numa node:%d", 
+				i, cpusToString(cpus).c_str(), getCpuNumaNode(cpus[0]));
+		}
+	}
 }
 
 void TcpServer::createTcpWorkers()
@@ -141,9 +229,30 @@ void TcpServer::createTcpWorkers()
 		listenSockets.push_back(socket.get());
 	}
 	
-	std::vector<Worker*> workers = workerGroup_->getWorkers();
-	for (auto worker : workers)
+	// including the standby workers of elastic scaling
+	std::vector<Worker*> workers = workerGroup_->getAllWorkers();
+	for (size_t i = 0; i < workers.size(); i++)
 	{
+		Worker *worker = workers[i];
+		// the acceptors and the connection pool are allocated on the worker's numa node
+		ScopedCpuBinding binding(worker->getCpus());
+		if (!tracePathPrefix_.empty())
+		{
+			std::string fileName = tracePathPrefix_ + "." + std::to_string(i);
+			if (worker->getLoop()->enableTrace(fileName, static_cast<uint16_t>(i), traceRecordsPerLoop_) != 0)
+			{
+				LOG_WARN("TcpServer: enable trace of worker %u to %s failed", i, fileName.c_str());
+			}
+		}
+		if (workerLoopStats_)
+		{
+			worker->getLoop()->enableStats(slowHandlerMicros_);
+		}
+		if (metricsRegistry_)
+		{
+			worker->getLoop()->setMetrics(metricsRegistry_->getShard(static_cast<int>(i)));
+		}
+
 		std::unique_ptr<TcpWorker> tcpWorker(new TcpWorker(listenSockets,
 		                                          minAcceptsPerCall_, 
 												  maxAcceptsPerCall_, 
@@ -157,9 +266,84 @@ void TcpServer::createTcpWorkers()
 		tcpWorker->setWriteCompleteHandler(writeCompleteHandler_);
 		tcpWorker->setPeerShutdownHandler(peerShutdownHandler_);
 		tcpWorker->setDisconnectedHandler(disconnectedHandler_);
+		tcpWorker->setMigratedHandler(migratedHandler_);
+		tcpWorker->setConnectionStats(connectionStats_);
 
 		tcpWorkers_.push_back(std::move(tcpWorker));
 	}
+
+	std::vector<TcpWorker*> tcpWorkers = getTcpWorkers(workerGroup_->getWorkers());
+
+	// the workers haven't started yet, it's safe to touch their loops here
+	for (auto &tcpWorker : tcpWorkers_)
+	{
+		tcpWorker->setBuddies(tcpWorkers);
+		if (workerUtilization_)
+		{
+			tcpWorker->getWorker()->enableUtilization();
+		}
+		tcpWorker->enableRebalancing(rebalanceSkewPermille_, rebalanceSustainedSecs_);
+		if (tcpInfoIntervalMillis_ > 0 && tcpInfoConnectionsPerRound_ > 0)
+		{
+			tcpWorker->enableTcpInfoSampling(tcpInfoIntervalMillis_, tcpInfoConnectionsPerRound_);
+		}
+	}
+}
+
+TcpWorker* TcpServer::getTcpWorker(EventLoop *loop) const
+{
+	for (auto &tcpWorker : tcpWorkers_)
+	{
+		if (tcpWorker->getLoop() == loop)
+		{
+			return tcpWorker.get();
+		}
+	}
+	return nullptr;
+}
+
+std::vector<TcpWorker*> TcpServer::getTcpWorkers(const std::vector<Worker*> &workers) const
+{
+	std::vector<TcpWorker*> v;
+	for (auto worker : workers)
+	{
+		v.push_back(getTcpWorker(worker->getLoop()));
+	}
+	return v;
+}
+
+void TcpServer::onWorkersChanged(Worker *worker, const std::vector<Worker*> &activeWorkers)
+{
+	getTcpWorker(worker->getLoop())->setBuddies(getTcpWorkers(activeWorkers));
+}
+
+void TcpServer::onWorkerRetiring(Worker *worker, const std::vector<Worker*> &activeWorkers, const Worker::Functor &retired)
+{
+	getTcpWorker(worker->getLoop())->retire(getTcpWorkers(activeWorkers), retired);
+}
+
+bool TcpServer::migrateConnection(TcpConnection &tcpConnection, EventLoop *targetLoop)
+{
+	std::vector<EventLoop*> loops = getWorkersLoops();
+	TcpWorker *source = getTcpWorker(tcpConnection.getLoop());
+	TcpWorker *target = getTcpWorker(targetLoop);
+	if (source == nullptr || target == nullptr || std::find(loops.begin(), loops.end(), targetLoop) == loops.end())
+	{
+		return false;
+	}
+
+	return source->migrateConnection(&tcpConnection, target);
+}
+
+void TcpServer::dumpTopConnections(size_t n, TopConnectionsHandler &&handler) const
+{
+	auto sharedHandler = std::make_shared<TopConnectionsHandler>(std::move(handler));
+	for (auto tcpWorker : getTcpWorkers(workerGroup_->getWorkers()))
+	{
+		tcpWorker->getLoop()->wakeupAndRun([tcpWorker, n, sharedHandler]{
+			(*sharedHandler)(tcpWorker->getLoop(), tcpWorker->dumpTopConnections(n));
+		});
+	}
 }
 
 std::vector<EventLoop*> TcpServer::getWorkersLoops() const
@@ -177,9 +361,42 @@ std::vector<EventLoop*> TcpServer::getWorkersLoops() const
 std::vector<int> TcpServer::getTcpWorkersConnectionNums() const
 {
 	std::vector<int> v;
-	for (auto &tcpWorker : tcpWorkers_)
+	for (auto tcpWorker : getTcpWorkers(workerGroup_->getWorkers()))
 	{
-		v.push_back(tcpWorker->getConnectionsNum());		
+		v.push_back(tcpWorker->getWorkerStats().metric.load(std::memory_order_relaxed));
 	}
 	return std::move(v);
 }
+
+std::vector<TcpInfoSnapshot> TcpServer::getWorkersTcpInfo() const
+{
+	std::vector<TcpInfoSnapshot> v;
+	for (auto tcpWorker : getTcpWorkers(workerGroup_->getWorkers()))
+	{
+		v.emplace_back();
+		tcpWorker->getTcpInfoSnapshot(&v.back());
+	}
+	return v;
+}
+
+std::vector<std::vector<int>> TcpServer::getWorkersCpuSets() const
+{
+	std::vector<std::vector<int>> v;
+	std::vector<Worker*> workers = workerGroup_->getWorkers();
+	for (auto worker : workers)
+	{
+		v.push_back(worker->getCpus());
+	}
+	return v;
+}
+
+std::vector<int> TcpServer::getWorkersUtilizations() const
+{
+	std::vector<int> v;
+	std::vector<Worker*> workers = workerGroup_->getWorkers();
+	for (auto worker : workers)
+	{
+		v.push_back(worker->getUtilization());
+	}
+	return v;
+}
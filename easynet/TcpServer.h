@@ -15,16 +15,19 @@
 #include "InetAddr.h"
 #include "ListenAddrMgr.h"
 #include "TcpConnection.h"
+#include "Metrics.h"
 
 namespace easynet
 {
 
 class EventLoop;
+class MetricsHttpServer;
 
 class TcpServer
 {
 public:
 	using TcpConnectionHandler = TcpConnection::TcpConnectionHandler;
+	using TopConnectionsHandler = std::function<void (EventLoop *loop, const std::string &report)>;
 
 	TcpServer();
 	explicit TcpServer(unsigned short listenPort)
@@ -32,7 +35,7 @@ public:
 	{}
 
 	TcpServer(const std::string &listenIp, unsigned short listenPort);
-	~TcpServer() { stop(); }
+	~TcpServer();
 
 	TcpServer(const TcpServer &rhs) = delete;
 	TcpServer& operator=(const TcpServer &rhs) = delete;
@@ -47,6 +50,24 @@ public:
 	void setWorkerNum(int num) { workerNum_ = num; }
 	void setWorkerTimeResultion(int millis)  { workerTimeResolutionMillis_ = millis; }
 	void setWorkerDelayMillisRetryAquireToken(int millis) { workerDelayMillisRetryAquireToken_ = millis;}
+
+	// the i-th worker's thread is bound to @cpuSets[i], the workers without a cpu set are not bound.
+	// see WorkerGroup
+	void setWorkerCpuSets(const std::vector<std::vector<int>> &cpuSets) { workerCpuSets_ = cpuSets; }
+	// binds every worker to its own physical core when no cpu set is given, see getCpusSpreadOverCores()
+	void setWorkerCpuAutoPlacement(bool enabled) { workerCpuAutoPlacement_ = enabled; }
+
+	// adds workers up to @maxWorkerNum when the average utilization of the workers stays above 
+	// @scaleUpPermille for @sustainedSecs, and retires them down to the worker number set by setWorkerNum()
+	// when it stays below @scaleDownPermille. a retired worker's connections migrate to the others.
+	// see WorkerGroup::enableElasticScaling(), disabled in default
+	void setWorkerElasticScaling(int maxWorkerNum, int scaleUpPermille, int scaleDownPermille, int sustainedSecs)
+	{ 
+		workerMaxNum_ = maxWorkerNum; 
+		workerScaleUpPermille_ = scaleUpPermille; 
+		workerScaleDownPermille_ = scaleDownPermille; 
+		workerScaleSustainedSecs_ = sustainedSecs; 
+	}
 	
 	void setTcpWorkerConnectionPoolCoreSize(int size)    { tcpWorkerConnectionPoolCoreSize_ = size; }
 	void setTcpWorkerConnectionPoolMaxSize(int size)     { tcpWorkerConnectionPoolMaxSize_ = size; }
@@ -54,11 +75,60 @@ public:
 	void setMinAcceptsPerCall(int minAcceptsPerCall)  { minAcceptsPerCall_ = minAcceptsPerCall; }
 	void setMaxAcceptsPerCall(int maxAcceptsPerCall)  { maxAcceptsPerCall_ = maxAcceptsPerCall; }
 
+	// automatic connection migration, see TcpWorker::enableRebalancing(), disabled in default
+	void setConnectionRebalancing(int skewPermille, int sustainedSecs) 
+	{ rebalanceSkewPermille_ = skewPermille; rebalanceSustainedSecs_ = sustainedSecs; }
+
+	// the workers measure their utilization, see getWorkersUtilizations(). it's always on with the
+	// utilization load balance strategy, connection rebalancing or elastic scaling, disabled otherwise
+	void setWorkerUtilization(bool enabled) { workerUtilization_ = enabled; }
+
+	// every worker's loop records its events into the file @pathPrefix.<worker index>, 
+	// keeping the last @recordsPerLoop of them, see EventLoop::enableTrace(). disabled in default
+	void setTraceFile(const std::string &pathPrefix, size_t recordsPerLoop) 
+	{ tracePathPrefix_ = pathPrefix; traceRecordsPerLoop_ = recordsPerLoop; }
+
+	// every worker's loop measures itself, read by EventLoop::getStats() of getWorkersLoops().
+	// see EventLoop::enableStats(), disabled in default
+	void setWorkerLoopStats(int64_t slowHandlerMicros) { workerLoopStats_ = true; slowHandlerMicros_ = slowHandlerMicros; }
+
+	// every connection counts its own traffic, see TcpConnection::enableStats(), disabled in default
+	void setConnectionStats(bool enabled) { connectionStats_ = enabled; }
+	// @handler is called in the loop of every active worker with the report of its top @n connections
+	// by each stats key, see TcpWorker::dumpTopConnections(), so it may run in several threads at once.
+	// the connection stats must be enabled
+	void dumpTopConnections(size_t n, TopConnectionsHandler &&handler) const;
+	void dumpTopConnections(size_t n, const TopConnectionsHandler &handler) const
+	{ dumpTopConnections(n, TopConnectionsHandler(handler)); }
+
+	// every worker samples TCP_INFO of at most @connectionsPerRound of its connections every @intervalMillis,
+	// see TcpWorker::enableTcpInfoSampling(), disabled in default
+	void setTcpInfoSampling(int64_t intervalMillis, int connectionsPerRound) 
+	{ tcpInfoIntervalMillis_ = intervalMillis; tcpInfoConnectionsPerRound_ = connectionsPerRound; }
+	// the samples of the active workers, empty ones if the sampling is disabled
+	std::vector<TcpInfoSnapshot> getWorkersTcpInfo() const;
+
+	// counts the built-in metrics(see BuiltinMetric) in a shard per worker, and returns the registry
+	// to add the application's own metrics, which are updated by EventLoop::getMetrics() of the workers.
+	// must be called before start()
+	MetricsRegistry* enableMetrics();
+	const MetricsRegistry* getMetricsRegistry() const { return metricsRegistry_.get(); } // nullptr if not enabled
+	// serves the metrics at http://@ip:@port/metrics in prometheus text format, enables the metrics as well
+	void setMetricsHttpListenAddr(const std::string &ip, unsigned short port) 
+	{ enableMetrics(); metricsHttpIp_ = ip; metricsHttpPort_ = port; }
+
 	void start();
-	void stop()  { workerGroup_->stop(); }
+	void stop();
 
+	// of the active workers, they may change with elastic scaling
 	std::vector<EventLoop*> getWorkersLoops() const;
-	std::vector<int> getTcpWorkersConnectionNums() const;
+	std::vector<int> getTcpWorkersConnectionNums() const;  // published by the workers after every loop iteration
+	std::vector<int> getWorkersUtilizations() const; // permille, see Worker::getUtilization()
+	std::vector<std::vector<int>> getWorkersCpuSets() const; // empty for the workers not bound to cpus
+
+	// moves @tcpConnection to the worker running @targetLoop(see getWorkersLoops()),
+	// can only be called in @tcpConnection's loop. see TcpWorker::migrateConnection()
+	bool migrateConnection(TcpConnection &tcpConnection, EventLoop *targetLoop);
 
     void setNewTcpConnectionHandler(TcpConnectionHandler &&handler) { newConnectionHandler_ = std::move(handler); }
 	void setNewTcpConnectionHandler(const TcpConnectionHandler &handler)
@@ -80,12 +150,23 @@ public:
 	void setDisconnectedHandler(const TcpConnectionHandler &handler)
 	{ setDisconnectedHandler(TcpConnectionHandler(handler)); }
 
+	// called in the new loop after a connection migrated to another worker
+	void setMigratedHandler(TcpConnectionHandler &&handler) { migratedHandler_ = std::move(handler); }
+	void setMigratedHandler(const TcpConnectionHandler &handler)
+	{ setMigratedHandler(TcpConnectionHandler(handler)); }
+
 private:
 	void initListenSockets();
 	void setNofileLimit();
 	
 	void createWorkerGroup();
+	void placeWorkers();
     void createTcpWorkers();
+    TcpWorker* getTcpWorker(EventLoop *loop) const;
+    std::vector<TcpWorker*> getTcpWorkers(const std::vector<Worker*> &workers) const;
+    int getTotalWorkerNum() const { return workerMaxNum_ > workerNum_ ? workerMaxNum_ : workerNum_; }
+    void onWorkersChanged(Worker *worker, const std::vector<Worker*> &activeWorkers);
+    void onWorkerRetiring(Worker *worker, const std::vector<Worker*> &activeWorkers, const Worker::Functor &retired);
     void startWorkers() { workerGroup_->start(); }
 
     Worker::LoadBalanceStrategy workerLoadBalanceStrategy_;
@@ -97,6 +178,26 @@ private:
 	int tcpWorkerConnectionPoolLivingTimeSecs_;
 	int minAcceptsPerCall_;
 	int maxAcceptsPerCall_;
+	int rebalanceSkewPermille_;
+	int rebalanceSustainedSecs_;
+	bool workerUtilization_;
+	bool workerCpuAutoPlacement_;
+	int workerMaxNum_;
+	int workerScaleUpPermille_;
+	int workerScaleDownPermille_;
+	int workerScaleSustainedSecs_;
+	std::vector<std::vector<int>> workerCpuSets_;
+	std::string tracePathPrefix_;
+	size_t traceRecordsPerLoop_;
+	bool workerLoopStats_;
+	int64_t slowHandlerMicros_;
+	bool connectionStats_;
+	int64_t tcpInfoIntervalMillis_;
+	int tcpInfoConnectionsPerRound_;
+	std::unique_ptr<MetricsRegistry> metricsRegistry_;
+	std::unique_ptr<MetricsHttpServer> metricsHttpServer_;
+	std::string metricsHttpIp_;
+	unsigned short metricsHttpPort_;
 	
 	// key: listen port
 	ListenAddrMgr listenAddrMgr_;
@@ -110,6 +211,7 @@ private:
 	TcpConnectionHandler writeCompleteHandler_;   // application's callback, will be called when all data have been written to socket
 	TcpConnectionHandler peerShutdownHandler_;    // application's callback, will be called when peer shutdown this connection
 	TcpConnectionHandler disconnectedHandler_;    // application's callback, will be called when this connection is disconnected(such as connection is hup, or error occurred)
+	TcpConnectionHandler migratedHandler_;        // application's callback, will be called when a connection has migrated to another worker
 };
 
 } // namespace easynet
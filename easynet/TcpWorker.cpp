@@ -3,19 +3,30 @@
 // Author: Shenghua Fang
 
 #include <unistd.h>
+#include <cstdio>
 
 #include <string>
 #include <memory>
 #include <functional>
+#include <algorithm>
 
 #include "TcpWorker.h"
 #include "Worker.h"
 #include "Channel.h"
 #include "Socket.h"
+#include "Probes.h"
 #include "utils/log.h"
 
 using namespace easynet;
 
+namespace
+{
+
+const int64_t kRebalanceCheckIntervalMillis = 1000;
+const int kMaxMigrationsPerRound = 64;
+
+}
+
 TcpWorker::TcpWorker(Socket *listenSocket, 
 	                 int minAcceptsPerCall, 
 	                 int maxAcceptsPerCall,
@@ -46,7 +57,13 @@ TcpWorker::TcpWorker(const std::vector<Socket*> &listenSockets,
                     tcpConnectionPool_(loop_, 
                     	connectionPoolCoreSize,
                     	connectionPoolMaxSize,
-                    	connectionPoolLivingTimeSecs)
+                    	connectionPoolLivingTimeSecs),
+                    rebalanceTimer_(nullptr),
+                    rebalanceSkewPermille_(0),
+                    rebalanceSustainedRounds_(0),
+                    skewedRounds_(0),
+                    retiring_(false),
+                    connectionStats_(false)
 {
 	numConnectionsLoadBalancingLine_ = connectionPoolCoreSize * 7 / 8;
 	cntDisableAquireListenToken_ = numCurConnections_ - (connectionPoolMaxSize_ * 7) / 8;
@@ -133,6 +150,9 @@ int TcpWorker::onNewConnection(Socket &&socket, const InetAddr &peerAddr)
 	}
 
 	numCurConnections_++;
+	loop_->addMetric(METRIC_CONNECTIONS, 1);
+	connections_.insert(tcpConnection);
+	EASYNET_PROBE2(accept, socket.fd(), numCurConnections_);
 	cntDisableAquireListenToken_ = numCurConnections_ - (connectionPoolMaxSize_ * 7) / 8;
 
 	LOG_TRACE("worker[0x%x] accepted connection, socket fd = %d, holds %d connections", 
@@ -159,6 +179,12 @@ int TcpWorker::onNewConnection(Socket &&socket, const InetAddr &peerAddr)
 	}
 
 	tcpConnection->reset(std::move(socket), peerAddr);
+	EASYNET_PROBE2(connection_reset, tcpConnection, tcpConnection->fd());
+	if (connectionStats_)
+	{
+		tcpConnection->enableStats();
+	}
+
 	if (newConnectionHandler_)
 	{
 		newConnectionHandler_(*tcpConnection);   // call the application's callback
@@ -169,6 +195,250 @@ int TcpWorker::onNewConnection(Socket &&socket, const InetAddr &peerAddr)
 
 void TcpWorker::onConnectionClosed(TcpConnection &tcpConnection)
 {
+	connections_.erase(&tcpConnection);
 	freeTcpConnection(&tcpConnection);
 	numCurConnections_--;
+	loop_->addMetric(METRIC_CONNECTIONS, -1);
+	EASYNET_PROBE2(connection_close, &tcpConnection, numCurConnections_);
+}
+
+void TcpWorker::setBuddies(const std::vector<TcpWorker*> &buddies)
+{
+	retiring_ = false;
+	buddies_.clear();
+	for (auto buddy : buddies)
+	{
+		if (buddy != this)
+		{
+			buddies_.push_back(buddy);
+		}
+	}
+}
+
+bool TcpWorker::migrateConnection(TcpConnection *tcpConnection, TcpWorker *target)
+{
+	if (target == this || tcpConnection->closed() || tcpConnection->migrating() || connections_.erase(tcpConnection) == 0)
+	{
+		return false;
+	}
+
+	LOG_TRACE("worker[0x%x] migrates connection from %s to worker[0x%x]", 
+		worker_, tcpConnection->getPeerAddr().toString().c_str(), target->worker_);
+
+	tcpConnection->detachFromLoop();
+	tcpConnectionPool_.release(tcpConnection);
+	numCurConnections_--;
+	loop_->addMetric(METRIC_CONNECTIONS, -1);
+
+	// the connection's channel may still be in the active channels of this round, 
+	// so hand it over after this loop has finished the round
+	EventLoop *targetLoop = target->getLoop();
+	loop_->wakeupAndRun([tcpConnection, target, targetLoop]{
+		targetLoop->wakeupAndRun(std::bind(&TcpWorker::onConnectionMigrated, target, tcpConnection));
+	});
+
+	return true;
+}
+
+void TcpWorker::retire(const std::vector<TcpWorker*> &buddies, const Worker::Functor &retired)
+{
+	setBuddies(buddies);
+	retiring_ = true;
+
+	LOG_INFO("worker[0x%x] retiring, to migrate %d connections", worker_, numCurConnections_);
+	if (!buddies_.empty())
+	{
+		std::vector<TcpConnection*> v(connections_.begin(), connections_.end());
+		for (size_t i = 0; i < v.size(); i++)
+		{
+			migrateConnection(v[i], buddies_[i % buddies_.size()]);
+		}
+	}
+
+	// runs after the hand-overs queued by migrateConnection()
+	loop_->wakeupAndRun(retired);
+}
+
+void TcpWorker::onConnectionMigrated(TcpConnection *tcpConnection)
+{
+	if (retiring_ && !buddies_.empty())
+	{
+		// handed over before the source worker knew this one was retiring
+		TcpWorker *target = buddies_[0];
+		target->getLoop()->wakeupAndRun(std::bind(&TcpWorker::onConnectionMigrated, target, tcpConnection));
+		return;
+	}
+
+	tcpConnectionPool_.adopt(tcpConnection);
+	if (tcpConnection->closed())
+	{
+		// closed by the application while it was migrating, see TcpConnection::close()
+		setTcpConntionsHandlers(tcpConnection);
+		tcpConnection->attachToLoop(loop_);
+		freeTcpConnection(tcpConnection);
+		return;
+	}
+
+	numCurConnections_++;
+	loop_->addMetric(METRIC_CONNECTIONS, 1);
+	connections_.insert(tcpConnection);
+
+	setTcpConntionsHandlers(tcpConnection);
+	tcpConnection->attachToLoop(loop_);
+
+	if (migratedHandler_ && !tcpConnection->closed())  // may fail to write the queued data
+	{
+		migratedHandler_(*tcpConnection);
+	}
+}
+
+void TcpWorker::enableRebalancing(int skewPermille, int sustainedSecs)
+{
+	if (rebalanceTimer_)
+	{
+		rebalanceTimer_->cancel();
+		rebalanceTimer_ = nullptr;
+	}
+
+	rebalanceSkewPermille_ = skewPermille;
+	rebalanceSustainedRounds_ = sustainedSecs * 1000 / kRebalanceCheckIntervalMillis;
+	skewedRounds_ = 0;
+	if (skewPermille > 0)   // buddies may join later
+	{
+		worker_->enableUtilization();
+		rebalanceTimer_ = loop_->runAfter(kRebalanceCheckIntervalMillis, 
+			std::bind(&TcpWorker::onRebalanceCheck, this), kRebalanceCheckIntervalMillis);
+	}
+}
+
+void TcpWorker::onRebalanceCheck()
+{
+	TcpWorker *target = nullptr;
+	int targetUtilization = 0;
+	for (auto buddy : buddies_)
+	{
+		int utilization = buddy->worker_->getUtilization();
+		if (target == nullptr || utilization < targetUtilization)
+		{
+			target = buddy;
+			targetUtilization = utilization;
+		}
+	}
+
+	if (target == nullptr || retiring_)
+	{
+		return;
+	}
+
+	int utilization = loop_->utilization();
+	int skew = utilization - targetUtilization;
+	if (skew < rebalanceSkewPermille_ || numCurConnections_ <= 1)
+	{
+		skewedRounds_ = 0;
+		return;
+	}
+
+	if (++skewedRounds_ < rebalanceSustainedRounds_)
+	{
+		return;
+	}
+	skewedRounds_ = 0;
+
+	// moves about the share of the connections that evens out the utilization,
+	// assuming the most recently active connections carry the load
+	int num = static_cast<int>(static_cast<int64_t>(numCurConnections_) * skew / (2 * utilization));
+	num = std::max(1, std::min(num, kMaxMigrationsPerRound));
+
+	LOG_INFO("worker[0x%x] utilization %d permille, worker[0x%x] %d permille, to migrate %d connections", 
+		worker_, utilization, target->worker_, targetUtilization, num);
+	migrateActiveConnections(target, num);
+}
+
+std::vector<TcpConnection*> TcpWorker::getTopConnections(TcpConnectionStatsKey key, size_t n) const
+{
+	std::vector<TcpConnection*> v;
+	for (auto tcpConnection : connections_)
+	{
+		if (tcpConnection->getStats())
+		{
+			v.push_back(tcpConnection);
+		}
+	}
+
+	n = std::min(n, v.size());
+	std::partial_sort(v.begin(), v.begin() + n, v.end(), [key](TcpConnection *lhs, TcpConnection *rhs){
+		return lhs->getStats()->get(key) > rhs->getStats()->get(key);
+	});
+	v.resize(n);
+
+	return v;
+}
+
+// a section for every key, a line for every connection:
+// <peer addr> fd=<fd> <key>=<value> in=<bytes>/<calls> out=<bytes>/<calls> hw=<input>/<output>
+//     read_handler=<calls>/<total nanos>/<max nanos> output_wait=<times>/<total micros>/<max micros>
+std::string TcpWorker::dumpTopConnections(size_t n) const
+{
+	std::string text;
+	char buf[512];
+	for (int key = 0; key < TCP_CONNECTION_STATS_KEY_MAX; key++)
+	{
+		text += std::string("top connections by ") + TcpConnectionStats::getKeyName(key) + ":\n";
+		for (auto tcpConnection : getTopConnections(static_cast<TcpConnectionStatsKey>(key), n))
+		{
+			const TcpConnectionStats *stats = tcpConnection->getStats();
+			::snprintf(buf, sizeof(buf), "  %s fd=%d %s=%llu in=%llu/%llu out=%llu/%llu hw=%zu/%zu "
+				"read_handler=%llu/%lld/%lld output_wait=%llu/%lld/%lld\n",
+				tcpConnection->getPeerAddr().toString().c_str(), tcpConnection->fd(),
+				TcpConnectionStats::getKeyName(key), 
+				static_cast<unsigned long long>(stats->get(static_cast<TcpConnectionStatsKey>(key))),
+				static_cast<unsigned long long>(stats->bytesReceived), static_cast<unsigned long long>(stats->recvCalls),
+				static_cast<unsigned long long>(stats->bytesSent), static_cast<unsigned long long>(stats->sendCalls),
+				stats->inputBufferHighWater, stats->outputBufferHighWater,
+				static_cast<unsigned long long>(stats->readHandlerCalls), 
+				static_cast<long long>(stats->readHandlerNanos), static_cast<long long>(stats->maxReadHandlerNanos),
+				static_cast<unsigned long long>(stats->outputQueuedTimes),
+				static_cast<long long>(stats->outputWaitMicros), static_cast<long long>(stats->maxOutputWaitMicros));
+			text += buf;
+		}
+	}
+
+	return text;
+}
+
+void TcpWorker::enableTcpInfoSampling(int64_t intervalMillis, int connectionsPerRound)
+{
+	if (!tcpInfoSampler_)
+	{
+		tcpInfoSampler_.reset(new TcpInfoSampler(loop_, &connections_));
+	}
+	tcpInfoSampler_->start(intervalMillis, connectionsPerRound);
+}
+
+bool TcpWorker::getTcpInfoSnapshot(TcpInfoSnapshot *snapshot) const
+{
+	if (!tcpInfoSampler_)
+	{
+		return false;
+	}
+
+	tcpInfoSampler_->snapshot(snapshot);
+	return true;
+}
+
+void TcpWorker::migrateActiveConnections(TcpWorker *target, int num)
+{
+	std::vector<TcpConnection*> v(connections_.begin(), connections_.end());
+	if (num < static_cast<int>(v.size()))
+	{
+		std::partial_sort(v.begin(), v.begin() + num, v.end(), [](TcpConnection *lhs, TcpConnection *rhs){
+			return lhs->getLastActiveTime() > rhs->getLastActiveTime();
+		});
+		v.resize(num);
+	}
+
+	for (auto tcpConnection : v)
+	{
+		migrateConnection(tcpConnection, target);
+	}
 }
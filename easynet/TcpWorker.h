@@ -13,6 +13,7 @@
 #include <list>
 #include <vector>
 #include <map>
+#include <unordered_set>
 
 #include "Acceptor.h"
 #include "Channel.h"
@@ -21,6 +22,7 @@
 #include "TcpConnectionPool.h"
 #include "InetAddr.h"
 #include "Worker.h"
+#include "TcpInfoSampler.h"
 
 namespace easynet
 {
@@ -55,12 +57,50 @@ public:
 
 	EventLoop* getLoop() { return loop_; }
 	int getConnectionsNum() const { return numCurConnections_; }
+	const WorkerStats& getWorkerStats() const { return worker_->getStats(); }
+	Worker* getWorker() { return worker_; }
+
+	// @buddies are the active tcp workers of the server, this one is skipped if included.
+	// a retired worker takes part in the server again after it's given its buddies.
+	// can only be called in this worker's loop, or before it starts
+	void setBuddies(const std::vector<TcpWorker*> &buddies);
+
+	// migrates all the connections to @buddies, and calls @retired in this loop after they're
+	// handed over. the connections handed over to this worker later are passed on to @buddies.
+	// it's called after the worker left the token ring, so no new connections are accepted. see WorkerGroup
+	void retire(const std::vector<TcpWorker*> &buddies, const Worker::Functor &retired);
+
+	// moves @tcpConnection to @target's loop, can only be called in this worker's loop.
+	// the connection object, its socket, buffers, handlers and data are kept, so are the 
+	// references the application holds, but it belongs to @target's loop once this returns.
+	// the migrated handler is called in @target's loop after the connection is attached.
+	bool migrateConnection(TcpConnection *tcpConnection, TcpWorker *target);
+
+	// migrates the most recently active connections to the least utilized buddy, when this worker's
+	// utilization exceeds the buddy's by @skewPermille for @sustainedSecs seconds in a row.
+	// @skewPermille <= 0 disables it. can only be called in this worker's loop
+	void enableRebalancing(int skewPermille, int sustainedSecs);
+
+	// the stats are enabled on every connection accepted afterwards, see TcpConnection::enableStats()
+	void setConnectionStats(bool enabled) { connectionStats_ = enabled; }
+	// the @n connections in use with the largest @key, the ones without stats are skipped.
+	// can only be called in this worker's loop
+	std::vector<TcpConnection*> getTopConnections(TcpConnectionStatsKey key, size_t n) const;
+	// the top @n connections by every key as text, can only be called in this worker's loop
+	std::string dumpTopConnections(size_t n) const;
+
+	// samples TCP_INFO of at most @connectionsPerRound connections every @intervalMillis, 
+	// see TcpInfoSampler. <= 0 disables it. can only be called in this worker's loop, or before it starts
+	void enableTcpInfoSampling(int64_t intervalMillis, int connectionsPerRound);
+	// the samples taken since it was enabled, can be called in other thread. false if it's not enabled
+	bool getTcpInfoSnapshot(TcpInfoSnapshot *snapshot) const;
 	
 	void setNewConnectionHandler(const TcpConnectionHandler &handler) { newConnectionHandler_ = handler; }
 	void setReadHandler(const TcpConnectionHandler &handler)          { readHandler_ = handler; }
 	void setWriteCompleteHandler(const TcpConnectionHandler &handler) { writeCompleteHandler_ = handler; }
 	void setPeerShutdownHandler(const TcpConnectionHandler &handler)  { peerShutdownHandler_ = handler; }
 	void setDisconnectedHandler(const TcpConnectionHandler &handler)  { disconnectedHandler_ = handler; }
+	void setMigratedHandler(const TcpConnectionHandler &handler)      { migratedHandler_ = handler; }
 
 private:
 	void init();
@@ -79,6 +119,9 @@ private:
 	
 	int  onNewConnection(Socket &&socket, const InetAddr &peerAddr);
 	void onConnectionClosed(TcpConnection &tcpConnection);
+	void onConnectionMigrated(TcpConnection *tcpConnection);
+	void onRebalanceCheck();
+	void migrateActiveConnections(TcpWorker *target, int num);
 
 	TcpConnection* getTcpConnection() { return tcpConnectionPool_.pop(); }
 	void freeTcpConnection(TcpConnection* tcpConnection) {  tcpConnectionPool_.push(tcpConnection); }
@@ -95,12 +138,23 @@ private:
 	
 	std::vector<std::unique_ptr<Acceptor>> acceptors_;
 	TcpConnectionPool tcpConnectionPool_;
+	std::unordered_set<TcpConnection*> connections_;  // connections in use
+	std::unique_ptr<TcpInfoSampler> tcpInfoSampler_;
+
+	std::vector<TcpWorker*> buddies_;  // other tcp workers of the server
+	Timer *rebalanceTimer_;
+	int rebalanceSkewPermille_;
+	int rebalanceSustainedRounds_;
+	int skewedRounds_;
+	bool retiring_;
+	bool connectionStats_;
 
 	TcpConnectionHandler newConnectionHandler_;   // application's callback, will be called when new connection is accepted
 	TcpConnectionHandler readHandler_;            // application's callback, will be called when data is read from the socket
 	TcpConnectionHandler writeCompleteHandler_;   // application's callback, will be called when all data is wroted to the socket
 	TcpConnectionHandler peerShutdownHandler_;    // application's callback, will be called when peer shutdown this connect
 	TcpConnectionHandler disconnectedHandler_;    // application's callback, will be called when this connection is disconnected(such as connection is hup, or error occurred)
+	TcpConnectionHandler migratedHandler_;        // application's callback, will be called when a connection has migrated to this worker
 };
 
 } // namespace easynet
@@ -16,9 +16,9 @@ void TimerInWheel::cancel()
 	timeWheel_->cancelTimer(this);
 }
 
-void TimerInWheel::restart(int64_t afterMillis, int64_t intervalMillis)
+void TimerInWheel::restart(int64_t after, int64_t interval)
 {
-	timeWheel_->restartTimer(this, afterMillis, intervalMillis);
+	timeWheel_->restartTimer(this, after, interval);
 }
 
 int64_t TimerInWheel::remainTime() const
@@ -27,7 +27,7 @@ public:
 	virtual ~TimerInWheel() = default;
 	int64_t remainTime() const override;
 	void cancel() override;
-	void restart(int64_t afterMillis, int64_t intervalMillis = 0) override;
+	void restart(int64_t after, int64_t interval = 0) override;
 
 private:
 	using TimerPos = std::list<std::unique_ptr<TimerInWheel>>::iterator;
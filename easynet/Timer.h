@@ -6,6 +6,9 @@
 #define _EASYNET_TIMER_H_
 
 #include <utility>
+#include <functional>
+
+#include "Probes.h"
 
 namespace easynet
 {
@@ -33,21 +36,45 @@ public:
 	int64_t getInterval() const { return interval_; }
 	bool repeatable() const { return interval_ > 0; }
 
+	// @after, @interval and the remaining time are in the unit of the timer's creator: milliseconds for
+	// EventLoop::runAt(), runAfter() and TimeWheel, microseconds for EventLoop::runAtMicros() and runAfterMicros()
 	virtual int64_t remainTime() const = 0;
 	virtual void cancel() = 0;
-	virtual void restart(int64_t afterMillis, int64_t intervalMillis = 0) = 0;
+	virtual void restart(int64_t after, int64_t interval = 0) = 0;
+	virtual bool precise() const { return false; }  // true if the times of the timer are microseconds
+
+	// always microseconds, whoever created the timer.
+	// a millisecond timer rounds them up, so it never times out earlier than asked.
+	void restartMicros(int64_t afterMicros, int64_t intervalMicros = 0)
+	{
+		if (precise())
+		{
+			restart(afterMicros, intervalMicros);
+		}
+		else
+		{
+			restart(roundUpToMillis(afterMicros), roundUpToMillis(intervalMicros));
+		}
+	}
+	int64_t remainTimeMicros() const { return precise() ? remainTime() : remainTime() * 1000; }
 
 	virtual ~Timer() = default;
 
 protected:
-	void onTimeout() { if (handler_) handler_(); }
+	static int64_t roundUpToMillis(int64_t micros) { return micros > 0 ? (micros + 999) / 1000 : micros; }
+
+	void onTimeout()
+	{
+		EASYNET_PROBE3(timer_fire, this, when_, interval_);
+		if (handler_) handler_();
+	}
 	void resetWhen(int64_t when) { when_ = when; }
 	void resetInterval(int64_t interval) { interval_ = interval; }
 	void setExpiring(bool on) { expiring_ = on; }
 	bool expiring() const { return expiring_; }
 	
 	bool expiring_;
-	int64_t when_;     // this timer will be timedout in @when, ms, since 1970.1.1 0:0:0
+	int64_t when_;     // this timer will be timedout in @when, loop time in ms, see EventLoop::now()
 	int64_t interval_;
 	TimerHandler handler_;
 };
@@ -12,13 +12,11 @@ using namespace easynet;
 
 TimerFd::TimerFd(int intervalMillis) : fd_(-1)
 {
-	if (intervalMillis <= 0)
+	fd_ = create();
+	if (intervalMillis > 0)
 	{
-		return;
+		setTime(intervalMillis);
 	}
-
-	fd_ = create();
-	setTime(intervalMillis);	
 }
 
 int TimerFd::create()
@@ -52,6 +50,27 @@ void TimerFd::setTime(int intervalMillis)
 	}
 }
 
+void TimerFd::setDeadline(int64_t monoMicros)
+{
+	struct itimerspec newValue;
+	std::memset(&newValue, 0, sizeof(newValue));
+
+	int flags = 0;
+	if (monoMicros > 0)
+	{
+		newValue.it_value.tv_sec = monoMicros / 1000000;
+		newValue.it_value.tv_nsec = (monoMicros % 1000000) * 1000;
+		flags = TFD_TIMER_ABSTIME;
+	}
+
+	int ret = ::timerfd_settime(fd_, flags, &newValue, NULL);
+	if (ret < 0)
+	{
+		LOG_FATAL("timerfd_settime() failed");
+		::exit(1);
+	}
+}
+
 void TimerFd::close() 
 { 
 	if (fd_ != -1 )
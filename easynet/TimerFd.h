@@ -14,16 +14,21 @@ namespace easynet {
 class TimerFd
 {
 public:
-	explicit TimerFd(int intervalMillis);
+	explicit TimerFd(int intervalMillis); // @intervalMillis <= 0: created disarmed
 	TimerFd(const TimerFd &rhs) = delete;
 	~TimerFd() { close(); }
 
 	int fd() const { return fd_; }
 	ssize_t read(uint64_t &val) { return ::read(fd_, &val, sizeof(uint64_t)); }
 
+	void setTime(int intervalMillis); // @intervalMillis == 0: disarm the timer
+
+	// one-shot, fires at @monoMicros of CLOCK_MONOTONIC(see TimeUtil::currentMonoTimeMicros()).
+	// @monoMicros <= 0: disarm the timer
+	void setDeadline(int64_t monoMicros);
+
 private:
 	int  create();
-	void setTime(int intervalMillis);
 	void close();
 
 	int fd_;
@@ -14,6 +14,8 @@ TimerFdChannel::TimerFdChannel(EventLoop *loop,
 	                 int intervalMillis, 
 	                 TimerHandler &&handler)
                     : loop_(loop),
+                      intervalMillis_(intervalMillis),
+                      ticking_(intervalMillis > 0),
                       timerFd_(intervalMillis),
                       channel_(loop_, timerFd_.fd()),
                       handler_(std::move(handler))
@@ -22,6 +24,24 @@ TimerFdChannel::TimerFdChannel(EventLoop *loop,
 	channel_.enableReading();
 }
 
+void TimerFdChannel::start()
+{
+	if (!ticking_ && intervalMillis_ > 0)
+	{
+		timerFd_.setTime(intervalMillis_);
+		ticking_ = true;
+	}
+}
+
+void TimerFdChannel::stop()
+{
+	if (ticking_)
+	{
+		timerFd_.setTime(0);
+		ticking_ = false;
+	}
+}
+
 void TimerFdChannel::onTimer()
 {
 	uint64_t one = 0;
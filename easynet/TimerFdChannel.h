@@ -28,10 +28,20 @@ public:
 	TimerFdChannel(const TimerFdChannel &rhs) = delete;
 	TimerFdChannel& operator=(const TimerFdChannel &rhs) = delete;
 
+	// stop() disarms the timer, start() re-arms it with the interval given in the constructor
+	void start();
+	void stop();
+	bool ticking() const { return ticking_; }
+
+	// for the channels created with @intervalMillis == 0: fires once at @monoMicros, see TimerFd::setDeadline()
+	void setDeadline(int64_t monoMicros) { timerFd_.setDeadline(monoMicros); }
+
 private:
 	void onTimer();
 
 	EventLoop *loop_;
+	int intervalMillis_;
+	bool ticking_;
 	TimerFd timerFd_;
 	Channel channel_;
 	TimerHandler handler_;
@@ -2,6 +2,7 @@
 // Use of this source code is governed by a BSD 2-Clause license that can be found in the License file.
 // Author: Shenghua Fang
 
+#include <new>
 #include <utility>
 
 #include "TimerHeap.h"
@@ -9,6 +10,18 @@
 
 using namespace easynet;
 
+namespace
+{
+
+const size_t kInitTimersPerSlab = 64;
+const size_t kMaxTimersPerSlab  = 4096;
+
+}
+
+const int TimerInHeap::kNotInHeap;
+const int TimerHeap::kArity;
+const int TimerHeap::kMaxCoalescingVisits;
+
 int64_t TimerInHeap::remainTime() const
 {
 	return timerHeap_->remainTime(this);
@@ -19,66 +32,150 @@ void TimerInHeap::cancel()
 	timerHeap_->cancelTimer(this);
 }
 
-void TimerInHeap::restart(int64_t afterMillis, int64_t intervalMillis)
+void TimerInHeap::restart(int64_t after, int64_t interval)
 {
-	timerHeap_->restartTimer(this, afterMillis, intervalMillis);
+	timerHeap_->restartTimer(this, after, interval);
+}
+
+bool TimerInHeap::precise() const
+{
+	return timerHeap_->precise();
+}
+
+TimerHeap::~TimerHeap()
+{
+	for (auto timer : heap_)
+	{
+		timer->~TimerInHeap();
+	}
+}
+
+int64_t TimerHeap::now() const
+{
+	return precise_ ? loop_->nowMicros() : loop_->now();
 }
 
 int64_t TimerHeap::getEarliestTimersTimeout() const
 {
-	if (!timers_.empty())
+	if (!heap_.empty())
 	{
-		int64_t earlistTimeoutMillis = (timers_.begin())->first - loop_->now();
+		int64_t earlistTimeoutMillis = getEarliestTimersDeadline() - now();
 		return earlistTimeoutMillis > 0 ? earlistTimeoutMillis : 0;
 	}
 
 	return EASYNET_TIMER_INFINITE;
 }
 
-void TimerHeap::expireTimers()
+// the loop may sleep until the earliest @when + @slack of the timers that are due before it,
+// then all of them will be expired in one wakeup. a child is never earlier than its parent,
+// so only the timers due before the deadline are visited, at most @kMaxCoalescingVisits of them.
+int64_t TimerHeap::getEarliestTimersDeadline() const
 {
-	auto it = timers_.begin();
-	while (it != timers_.end())
+	if (heap_.empty())
+	{
+		return EASYNET_TIMER_INFINITE;
+	}
+
+	if (deadlineValid_)
+	{
+		return deadline_;
+	}
+
+	int64_t deadline = heap_[0]->getWhen() + heap_[0]->slack_;
+	if (heap_[0]->slack_ == 0)
+	{
+		return deadline;
+	}
+
+	int size = static_cast<int>(heap_.size());
+	int visits = 0;
+	pendingIndexes_.clear();
+	pendingIndexes_.push_back(0);
+	while (!pendingIndexes_.empty())
 	{
-		// the earliest timer is not timedout yet, so we don't need to check other timers 
-		if (it->first > loop_->now())
+		int index = pendingIndexes_.back();
+		pendingIndexes_.pop_back();
+
+		const TimerInHeap *timer = heap_[index];
+		if (timer->getWhen() >= deadline)
+		{
+			continue;
+		}
+
+		if (++visits > kMaxCoalescingVisits)
 		{
-			return;
+			// too many timers in the window, don't look at its slack and children
+			deadline = timer->getWhen();
+			continue;
 		}
 
-        auto jt = it;
-		++it;
+		if (timer->getWhen() + timer->slack_ < deadline)
+		{
+			deadline = timer->getWhen() + timer->slack_;
+		}
 
-		TimerInHeap *timer = (jt->second).get();
-		timer->setExpiring(true);
-		timer->onTimeout();          // call its callback
-		timer->setExpiring(false);
-        timer = (jt->second).get();
-		if (timer && timer->repeatable())
+		int first = index * kArity + 1;
+		int last = first + kArity < size ? first + kArity : size;
+		for (int i = first; i < last; i++)
 		{
-			timer->resetWhen(loop_->now() + timer->getInterval());
-		    insertTimer(std::move(jt->second));
+			pendingIndexes_.push_back(i);
 		}
-		
-		timers_.erase(jt);
-		//it = timers_.begin();
 	}
+
+	deadline_ = deadline;
+	deadlineValid_ = true;
+	return deadline;
 }
 
-Timer* TimerHeap::addTimer(int64_t when, TimerHandler &&handler, int64_t interval)
+int TimerHeap::expireTimers()
 {
-	std::unique_ptr<TimerInHeap> timer(new TimerInHeap(this, when, interval, std::move(handler)));
-	TimerInHeap *p = timer.get();
-	insertTimer(std::move(timer));
+	// timers added or restarted by the callbacks below will be expired in the next round,
+	// even if they are already timed out.
+	uint64_t sequence = nextSequence_;
+	int64_t current = now();
+	int expired = 0;
 
-	return p;
+	// the earliest timer is not timedout yet, so we don't need to check other timers
+	while (!heap_.empty() && heap_[0]->getWhen() <= current && heap_[0]->sequence_ < sequence)
+	{
+		TimerInHeap *timer = heap_[0];
+		eraseTimer(timer);
+		expired++;
+
+		timer->setExpiring(true);
+		timer->onTimeout();          // call its callback
+		timer->setExpiring(false);
+
+		// cancelTimer() or restartTimer() may be called in the timer's callback
+		if (timer->cancelled_)
+		{
+			freeTimer(timer);
+		}
+		else if (timer->inHeap())
+		{
+			// restarted in its callback, already in the heap
+		}
+		else if (timer->repeatable())
+		{
+			timer->resetWhen(now() + timer->getInterval());
+			insertTimer(timer);
+		}
+		else
+		{
+			freeTimer(timer);
+		}
+	}
+
+	deadlineValid_ = false;
+	return expired;
 }
 
-void TimerHeap::insertTimer(std::unique_ptr<TimerInHeap> &&timer)
+Timer* TimerHeap::addTimer(int64_t when, TimerHandler &&handler, int64_t interval, int64_t slack)
 {
-	TimerInHeap *p = timer.get();
-	auto it = timers_.insert(std::make_pair(timer->getWhen(), std::move(timer)));
-	p->setPos(it);
+	TimerInHeap *timer = allocTimer(when, interval, slack, std::move(handler));
+	insertTimer(timer);
+
+	return timer;
 }
 
 void TimerHeap::cancelTimer(TimerInHeap *timer)
@@ -90,12 +187,18 @@ void TimerHeap::cancelTimer(TimerInHeap *timer)
 
     if (timer->expiring())
     {
-    	// called cancelTimer() in the timer's callback
-    	std::unique_ptr<TimerInHeap> t(std::move(timer->getPos()->second));
+    	// called cancelTimer() in the timer's callback, the handler is still running,
+    	// it will be freed in expireTimers()
+    	if (timer->inHeap())
+    	{
+    		eraseTimer(timer);
+    	}
+    	timer->cancelled_ = true;
     }
 	else
 	{
-		timers_.erase(timer->getPos());
+		eraseTimer(timer);
+		freeTimer(timer);
 	}
 }
 
@@ -106,18 +209,149 @@ void TimerHeap::restartTimer(TimerInHeap *timer, int64_t after, int64_t interval
 		return;
 	}
 
-	std::unique_ptr<TimerInHeap> t(std::move(timer->getPos()->second));
-	timer->resetWhen(after + loop_->now());
+	if (timer->inHeap())
+	{
+		eraseTimer(timer);
+	}
+
+	timer->cancelled_ = false;
+	timer->resetWhen(after + now());
 	timer->resetInterval(interval);
-	if (!(timer->expiring()))
+	insertTimer(timer);
+}
+
+int64_t TimerHeap::remainTime(const TimerInHeap *timer) const
+{
+	return timer->getWhen() - now();
+}
+
+void TimerHeap::insertTimer(TimerInHeap *timer)
+{
+	timer->sequence_ = nextSequence_++;
+	if (heap_.empty())
+	{
+		deadlineValid_ = false;
+	}
+	else if (deadlineValid_ && timer->getWhen() + timer->slack_ < deadline_)
+	{
+		deadline_ = timer->getWhen() + timer->slack_;
+	}
+
+	heap_.push_back(timer);
+	timer->heapIndex_ = static_cast<int>(heap_.size()) - 1;
+	siftUp(timer->heapIndex_);
+}
+
+void TimerHeap::eraseTimer(TimerInHeap *timer)
+{
+	int index = timer->heapIndex_;
+	int last  = static_cast<int>(heap_.size()) - 1;
+	timer->heapIndex_ = TimerInHeap::kNotInHeap;
+
+	if (index != last)
+	{
+		placeTimer(heap_[last], index);
+		heap_.pop_back();
+
+		if (index > 0 && earlier(heap_[index], heap_[(index - 1) / kArity]))
+		{
+			siftUp(index);
+		}
+		else
+		{
+			siftDown(index);
+		}
+	}
+	else
+	{
+		heap_.pop_back();
+	}
+}
+
+void TimerHeap::siftUp(int index)
+{
+	TimerInHeap *timer = heap_[index];
+	while (index > 0)
+	{
+		int parent = (index - 1) / kArity;
+		if (!earlier(timer, heap_[parent]))
+		{
+			break;
+		}
+
+		placeTimer(heap_[parent], index);
+		index = parent;
+	}
+	placeTimer(timer, index);
+}
+
+void TimerHeap::siftDown(int index)
+{
+	TimerInHeap *timer = heap_[index];
+	int size = static_cast<int>(heap_.size());
+	while (true)
 	{
-		timers_.erase(timer->getPos());
+		int first = index * kArity + 1;
+		if (first >= size)
+		{
+			break;
+		}
+
+		// find the earliest child
+		int last = first + kArity < size ? first + kArity : size;
+		int child = first;
+		for (int i = first + 1; i < last; i++)
+		{
+			if (earlier(heap_[i], heap_[child]))
+			{
+				child = i;
+			}
+		}
+
+		if (!earlier(heap_[child], timer))
+		{
+			break;
+		}
+
+		placeTimer(heap_[child], index);
+		index = child;
 	}
+	placeTimer(timer, index);
+}
 
-	insertTimer(std::move(t));
+TimerInHeap* TimerHeap::allocTimer(int64_t when, int64_t interval, int64_t slack, TimerHandler &&handler)
+{
+	if (freeSlots_.empty())
+	{
+		growSlab();
+	}
+
+	TimerStorage *slot = freeSlots_.back();
+	freeSlots_.pop_back();
+
+	return new (slot) TimerInHeap(this, when, interval, slack, std::move(handler));
+}
+
+void TimerHeap::freeTimer(TimerInHeap *timer)
+{
+	timer->~TimerInHeap();
+	freeSlots_.push_back(reinterpret_cast<TimerStorage*>(timer));
 }
 
-int64_t TimerHeap::remainTime(const TimerInHeap *timer) const 
+// every new slab is twice as large as the previous one, up to @kMaxTimersPerSlab timers
+void TimerHeap::growSlab()
 {
-	return timer->getWhen() - loop_->now();
-}
\ No newline at end of file
+	size_t n = kInitTimersPerSlab;
+	for (size_t i = 0; i < slabs_.size() && n < kMaxTimersPerSlab; i++)
+	{
+		n <<= 1;
+	}
+
+	std::unique_ptr<TimerStorage[]> slab(new TimerStorage[n]);
+	freeSlots_.reserve(freeSlots_.size() + n);
+	for (size_t i = n; i > 0; i--)
+	{
+		freeSlots_.push_back(&slab[i - 1]);
+	}
+	slabs_.push_back(std::move(slab));
+}
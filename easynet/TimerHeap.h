@@ -5,8 +5,9 @@
 #ifndef _EASYNET_TIMER_HEAP_H_
 #define _EASYNET_TIMER_HEAP_H_
 
-#include <map>
+#include <vector>
 #include <memory>
+#include <type_traits>
 
 #include "Timer.h"
 
@@ -25,36 +26,52 @@ public:
 
 	int64_t remainTime() const override;
 	void cancel() override;
-	void restart(int64_t afterMillis, int64_t intervalMillis = 0) override;
+	void restart(int64_t after, int64_t interval = 0) override;
+	bool precise() const override;
 
 private:
-	using TimerPos = std::multimap<int64_t, std::unique_ptr<TimerInHeap>>::iterator;
+	static const int kNotInHeap = -1;
 
-	TimerInHeap(TimerHeap *timerHeap, int64_t when, int64_t interval, const TimerHandler &handler)
-		: TimerInHeap(timerHeap, when, interval, TimerHandler(handler))
+	TimerInHeap(TimerHeap *timerHeap, int64_t when, int64_t interval, int64_t slack, const TimerHandler &handler)
+		: TimerInHeap(timerHeap, when, interval, slack, TimerHandler(handler))
 	{}
 
-	TimerInHeap(TimerHeap *timerHeap, int64_t when, int64_t interval, TimerHandler &&handler) 
+	TimerInHeap(TimerHeap *timerHeap, int64_t when, int64_t interval, int64_t slack, TimerHandler &&handler)
 		: Timer(when, interval, std::move(handler)),
-		  timerHeap_(timerHeap)
+		  timerHeap_(timerHeap),
+		  heapIndex_(kNotInHeap),
+		  sequence_(0),
+		  slack_(slack > 0 ? slack : 0),
+		  cancelled_(false)
 	{}
 
-	void setPos(const TimerPos &it) { pos_ = it; }
-	const TimerPos& getPos() const { return pos_; }
+	bool inHeap() const { return heapIndex_ != kNotInHeap; }
 
 	TimerHeap *timerHeap_;
-	TimerPos pos_; // position(iterator) in the timer map
+	int heapIndex_;      // position in the heap array, kNotInHeap when it is not in the heap
+	uint64_t sequence_;  // insertion order, to keep timers with the same @when_ in FIFO order
+	int64_t slack_;      // the timer may be timed out up to @slack_ late, kept when restarted
+	bool cancelled_;     // cancel() called in the timer's own callback
 };
 
 class EventLoop;
 
+// an array-backed 4-ary min-heap ordered by (@when, insertion order).
+// every timer records its own index in the heap, so cancel and restart
+// cost O(log n) without searching. the timers are allocated from a slab
+// owned by the heap, the slots are reused after the timers are freed.
+// a precise heap keeps its times in microseconds(see EventLoop::nowMicros()),
+// otherwise in milliseconds of the loop time(see EventLoop::now()).
+// timers with slack are coalesced: the loop sleeps until the earliest @when + @slack
+// among the timers that are due by then, and expires all of them in one wakeup.
 class TimerHeap
 {
 public:
 	using TimerHandler = TimerInHeap::TimerHandler;
-	
-	TimerHeap(EventLoop *loop) : loop_(loop) {}
-	~TimerHeap() = default;
+
+	explicit TimerHeap(EventLoop *loop, bool precise = false) 
+		: loop_(loop), precise_(precise), nextSequence_(0), deadline_(0), deadlineValid_(false) {}
+	~TimerHeap();
 
 	TimerHeap(const TimerHeap &rhs) = delete;
 	TimerHeap& operator=(const TimerHeap &rhs) = delete;
@@ -63,19 +80,51 @@ public:
 	void restartTimer(TimerInHeap *timer, int64_t after, int64_t interval = 0); // can be called in the timer's callback
 	int64_t remainTime(const TimerInHeap *timer) const; // can be called in the timer's callback
 
-	void expireTimers();
+	int expireTimers();  // returns the number of timers timed out
 	int64_t getEarliestTimersTimeout() const;
-	Timer* addTimer(int64_t when, TimerHandler &&handler, int64_t interval = 0);
-	void insertTimer(std::unique_ptr<TimerInHeap> &&timer);
+	int64_t getEarliestTimersDeadline() const;  // when to wake up, with the slack of the timers considered
+	Timer* addTimer(int64_t when, TimerHandler &&handler, int64_t interval = 0, int64_t slack = 0);
+
+	size_t size() const { return heap_.size(); }
+	bool precise() const { return precise_; }
 
 private:
-	// the timers' container, key: when this timer will timeout, in miliseconds, since 1970-1-1 00:00:00 
-	using TimerContainer = std::multimap<int64_t, std::unique_ptr<TimerInHeap>>;
+	using TimerStorage = std::aligned_storage<sizeof(TimerInHeap), alignof(TimerInHeap)>::type;
+
+	static const int kArity = 4;
+	static const int kMaxCoalescingVisits = 1024;  // timers checked when computing the deadline
+
+	int64_t now() const;
+	void insertTimer(TimerInHeap *timer);
+	void eraseTimer(TimerInHeap *timer);
+	void siftUp(int index);
+	void siftDown(int index);
+	void placeTimer(TimerInHeap *timer, int index) { heap_[index] = timer; timer->heapIndex_ = index; }
+	bool earlier(const TimerInHeap *lhs, const TimerInHeap *rhs) const
+	{
+		return lhs->getWhen() < rhs->getWhen() ||
+		       (lhs->getWhen() == rhs->getWhen() && lhs->sequence_ < rhs->sequence_);
+	}
+
+	TimerInHeap* allocTimer(int64_t when, int64_t interval, int64_t slack, TimerHandler &&handler);
+	void freeTimer(TimerInHeap *timer);
+	void growSlab();
 
     EventLoop *loop_;
-	TimerContainer timers_;
+    bool precise_;
+    uint64_t nextSequence_;
+	std::vector<TimerInHeap*> heap_;
+	mutable std::vector<int> pendingIndexes_;  // scratch of getEarliestTimersDeadline()
+
+	// cached result of getEarliestTimersDeadline(). inserting a timer lowers it in place,
+	// erasing a timer leaves it no later than needed, expireTimers() invalidates it.
+	mutable int64_t deadline_;
+	mutable bool deadlineValid_;
+
+	std::vector<std::unique_ptr<TimerStorage[]>> slabs_;  // memory of the timers, never shrinks
+	std::vector<TimerStorage*> freeSlots_;                // free timer slots in @slabs_
 };
 
 }
 
-#endif
\ No newline at end of file
+#endif
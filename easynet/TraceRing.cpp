@@ -0,0 +1,179 @@
+// Copyright 2017, Shenghua Fang. All rights reserved.
+// Use of this source code is governed by a BSD 2-Clause license that can be found in the License file.
+// Author: Shenghua Fang
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <cstring>
+#include <algorithm>
+
+#include "TraceRing.h"
+#include "utils/TimeUtil.h"
+#include "utils/log.h"
+
+using namespace easynet;
+
+namespace
+{
+
+const char kTraceMagic[8] = {'E', 'Z', 'T', 'R', 'A', 'C', 'E', '1'};
+const size_t kMinTraceCapacity = 16;
+
+const char* kTraceEventNames[TRACE_EVENT_MAX] = {
+	"UNKNOWN",
+	"EPOLL_WAIT",
+	"EPOLL_EVENT",
+	"EPOLL_CTL",
+	"ACCEPT",
+	"READ",
+	"WRITE",
+	"WRITABLE",
+	"PEER_SHUTDOWN",
+	"CLOSE"
+};
+
+}
+
+TraceRing::TraceRing()
+              : loopId_(0),
+                mappedSize_(0),
+                header_(nullptr),
+                records_(nullptr),
+                mask_(0),
+                written_(0)
+{}
+
+int TraceRing::open(const std::string &fileName, uint16_t loopId, size_t capacity)
+{
+	close();
+
+	size_t n = kMinTraceCapacity;
+	while (n < capacity)
+	{
+		n *= 2;
+	}
+	size_t size = sizeof(TraceFileHeader) + n * sizeof(TraceRecord);
+
+	int fd = ::open(fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, DEFFILEMODE);
+	if (fd < 0)
+	{
+		int savedErrno = errno;
+		LOG_ERROR("open trace file %s failed, error:%d %s", fileName.c_str(), savedErrno, ::strerror(savedErrno));
+		return -1;
+	}
+
+	if (::ftruncate(fd, static_cast<off_t>(size)) != 0)
+	{
+		int savedErrno = errno;
+		LOG_ERROR("resize trace file %s to %u bytes failed, error:%d %s", fileName.c_str(), size, savedErrno, ::strerror(savedErrno));
+		::close(fd);
+		return -1;
+	}
+
+	void *p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED)
+	{
+		int savedErrno = errno;
+		LOG_ERROR("mmap trace file %s failed, error:%d %s", fileName.c_str(), savedErrno, ::strerror(savedErrno));
+		return -1;
+	}
+
+	fileName_ = fileName;
+	loopId_ = loopId;
+	mappedSize_ = size;
+	header_ = static_cast<TraceFileHeader*>(p);
+	records_ = reinterpret_cast<TraceRecord*>(header_ + 1);
+	mask_ = n - 1;
+	written_ = 0;
+
+	::memcpy(header_->magic, kTraceMagic, sizeof(kTraceMagic));
+	header_->recordSize = sizeof(TraceRecord);
+	header_->loopId = loopId;
+	header_->capacity = n;
+	header_->written = 0;
+
+	LOG_INFO("loop %d traces to %s, %u records", loopId, fileName.c_str(), n);
+	return 0;
+}
+
+void TraceRing::close()
+{
+	if (header_)
+	{
+		::munmap(header_, mappedSize_);
+		header_ = nullptr;
+		records_ = nullptr;
+	}
+}
+
+void TraceRing::record(uint16_t event, int fd, int64_t arg1, int64_t arg2)
+{
+	TraceRecord &r = records_[written_ & mask_];
+	r.timeMicros = TimeUtil::currentSystemTimeMicros();
+	r.loopId = loopId_;
+	r.event = event;
+	r.fd = fd;
+	r.arg1 = arg1;
+	r.arg2 = arg2;
+
+	// published after the record, a reader of the file never sees a half written one below @written
+	__atomic_store_n(&header_->written, ++written_, __ATOMIC_RELEASE);
+}
+
+int TraceRing::readFile(const std::string &fileName, std::vector<TraceRecord> *records, TraceFileHeader *header)
+{
+	int fd = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		return -1;
+	}
+
+	struct stat st;
+	TraceFileHeader h;
+	if (::fstat(fd, &st) != 0 
+		|| static_cast<size_t>(st.st_size) < sizeof(h)
+		|| ::pread(fd, &h, sizeof(h), 0) != static_cast<ssize_t>(sizeof(h))
+		|| ::memcmp(h.magic, kTraceMagic, sizeof(kTraceMagic)) != 0
+		|| h.recordSize != sizeof(TraceRecord)
+		|| static_cast<size_t>(st.st_size) < sizeof(h) + h.capacity * sizeof(TraceRecord))
+	{
+		::close(fd);
+		return -1;
+	}
+
+	// from the oldest record kept
+	uint64_t num = std::min(h.written, h.capacity);
+	uint64_t first = h.written - num;
+	std::vector<TraceRecord> ring(h.capacity);
+	ssize_t size = static_cast<ssize_t>(h.capacity * sizeof(TraceRecord));
+	if (::pread(fd, ring.data(), size, sizeof(h)) != size)
+	{
+		::close(fd);
+		return -1;
+	}
+	::close(fd);
+
+	for (uint64_t i = first; i < h.written; i++)
+	{
+		records->push_back(ring[i & (h.capacity - 1)]);
+	}
+
+	if (header)
+	{
+		*header = h;
+	}
+	return 0;
+}
+
+const char* TraceRing::getEventName(int event)
+{
+	if (event <= 0 || event >= TRACE_EVENT_MAX)
+	{
+		return kTraceEventNames[0];
+	}
+	return kTraceEventNames[event];
+}
@@ -0,0 +1,89 @@
+// Copyright 2017, Shenghua Fang. All rights reserved.
+// Use of this source code is governed by a BSD 2-Clause license that can be found in the License file.
+// Author: Shenghua Fang
+
+#ifndef _EASYNET_TRACE_RING_H_
+#define _EASYNET_TRACE_RING_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace easynet
+{
+
+// the events traced at the LOG_TRACE points of the loop, see TraceRecord for the arguments
+enum TraceEvent
+{
+	TRACE_EVENT_EPOLL_WAIT = 1,  // fd: epoll fd, arg1: timeout millis, arg2: events returned, -errno on error
+	TRACE_EVENT_EPOLL_EVENT,     // fd: the fd triggered, arg1: epoll events
+	TRACE_EVENT_EPOLL_CTL,       // fd: the fd updated, arg1: EPOLL_CTL_ADD/MOD/DEL, arg2: epoll events
+	TRACE_EVENT_ACCEPT,          // fd: the accepted socket, arg1: the listen socket, arg2: accepted this round
+	TRACE_EVENT_READ,            // fd: the socket, arg1: bytes readable, arg2: bytes read, -errno on error
+	TRACE_EVENT_WRITE,           // fd: the socket, arg1: bytes to send, arg2: bytes sent, -errno on error
+	TRACE_EVENT_WRITABLE,        // fd: the socket
+	TRACE_EVENT_PEER_SHUTDOWN,   // fd: the socket
+	TRACE_EVENT_CLOSE,           // fd: the socket, arg1: the error closing it, 0 if closed normally, arg2: bytes unsent
+	TRACE_EVENT_MAX
+};
+
+// 32 bytes
+struct TraceRecord
+{
+	int64_t timeMicros;  // wall clock
+	uint16_t loopId;
+	uint16_t event;      // TraceEvent
+	int32_t fd;
+	int64_t arg1;
+	int64_t arg2;
+};
+
+// at the beginning of the file, followed by @capacity records
+struct TraceFileHeader
+{
+	char magic[8];        // "EZTRACE1"
+	uint32_t recordSize;  // sizeof(TraceRecord)
+	uint32_t loopId;
+	uint64_t capacity;    // a power of 2
+	uint64_t written;     // records ever written, the next one goes to @written % @capacity
+	char reserved[32];
+};
+
+// the trace records of one loop, kept in a file mapped into memory, so they survive a crash of the process.
+// the file holds the latest @capacity records, overwriting the oldest ones. it's written in the loop only,
+// a record costs a clock read and a 32 bytes store, no formatting, no system call.
+class TraceRing
+{
+public:
+	TraceRing();
+	~TraceRing() { close(); }
+
+	TraceRing(const TraceRing &rhs) = delete;
+	TraceRing& operator=(const TraceRing &rhs) = delete;
+
+	// creates or truncates @fileName, @capacity is rounded up to a power of 2. returns -1 on error
+	int open(const std::string &fileName, uint16_t loopId, size_t capacity);
+	void close();
+
+	void record(uint16_t event, int fd, int64_t arg1, int64_t arg2);
+
+	uint64_t written() const { return written_; }
+	const std::string& getFileName() const { return fileName_; }
+
+	// the records of a trace file from the oldest, returns -1 if it's not a trace file
+	static int readFile(const std::string &fileName, std::vector<TraceRecord> *records, TraceFileHeader *header = nullptr);
+	static const char* getEventName(int event);
+
+private:
+	std::string fileName_;
+	uint16_t loopId_;
+	size_t mappedSize_;
+	TraceFileHeader *header_;
+	TraceRecord *records_;
+	uint64_t mask_;
+	uint64_t written_;
+};
+
+}
+
+#endif
@@ -2,17 +2,57 @@
 // Use of this source code is governed by a BSD 2-Clause license that can be found in the License file.
 // Author: Shenghua Fang
 
+#include <netinet/in.h>
+#include <netinet/udp.h>
 #include <cstring>
+#include <algorithm>
 
 #include "UdpConnection.h"
 #include "utils/log.h"
 
 using namespace easynet;
 
+namespace
+{
+
+const int kBatchSizeDefault   = 64;
+const size_t kSlotSizeDefault = 2048;  // larger than the ethernet MTU
+
+const int kGroBatchSize       = 16;
+const size_t kGroSlotSize     = 65536; // the largest coalesced datagram
+const size_t kGroControlSize  = CMSG_SPACE(sizeof(int));
+
+const size_t kGsoMaxSegments  = 64;    // UDP_MAX_SEGMENTS of the kernel
+const size_t kGsoMaxBytes     = 65507; // 65535 - ip header - udp header
+
+// segment size of a datagram coalesced by GRO, 0 if not coalesced
+size_t getGroSegmentSize(struct msghdr *hdr)
+{
+#ifdef UDP_GRO
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(hdr, cmsg))
+	{
+		if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO)
+		{
+			int size = 0;
+			std::memcpy(&size, CMSG_DATA(cmsg), sizeof(size));
+			return static_cast<size_t>(size);
+		}
+	}
+#endif
+	return 0;
+}
+
+}
+
 UdpConnection::UdpConnection(EventLoop *loop)
                    : loop_(loop),
 	                 socket_(Socket::SOCKET_UDP),
-	                 channel_(loop_, socket_.fd())
+	                 channel_(loop_, socket_.fd()),
+	                 sessionTable_(nullptr),
+	                 batchSize_(kBatchSizeDefault),
+	                 slotSize_(kSlotSizeDefault),
+	                 gro_(false),
+	                 gsoSupported_(true)
 {
 	socket_.setNonBlocking(true);
 	socket_.setCloseOnExec(true);
@@ -28,6 +68,7 @@ int UdpConnection::bind(const InetAddr &addr)
 	if (socket_.bind(addr) == 0)
 	{
 		listenAddr_ = addr;
+		socket_.getLocalAddr(&localAddr_);
 		return 0;
 	}
 	else
@@ -45,6 +86,7 @@ int UdpConnection::connect(const InetAddr &addr)
 	if (socket_.connect(addr) == 0)
 	{
 		foreignAddr_ = addr;
+		socket_.getLocalAddr(&localAddr_);
 		return 0;
 	}
 	else
@@ -56,9 +98,17 @@ int UdpConnection::connect(const InetAddr &addr)
 	return -1;
 }
 
+// @localAddr_ is got when bound or connected, or lazily by updateLocalAddr() after an implicit bind,
+// it doesn't change after that
 void UdpConnection::onReadable()
 {
-	socket_.getLocalAddr(&localAddr_);
+	updateLocalAddr();
+	if (batchMessageHandler_ || datagramHandler_)
+	{
+		onReadableBatch();
+		return;
+	}
+
 	while (readData() > 0)
 	{
 		if (messageHandler_)
@@ -110,9 +160,338 @@ ssize_t UdpConnection::readData()
 	}
 }
 
+void UdpConnection::setBatchSize(int batchSize, size_t slotSize)
+{
+	if (batchSize > 0 && slotSize > 0)
+	{
+		batchSize_ = batchSize;
+		slotSize_ = slotSize;
+	}
+}
+
+void UdpConnection::setGro(bool on)
+{
+	gro_ = on;
+	if (gro_)
+	{
+		batchSize_ = std::min(batchSize_, kGroBatchSize);
+		slotSize_ = std::max(slotSize_, kGroSlotSize);
+	}
+}
+
+void UdpConnection::allocSlots()
+{
+	if (gro_ && socket_.setUdpGro(true) < 0)
+	{
+		int savedErrno = errno;
+		LOG_WARN("udp socket enable GRO failed, socket fd = %d, error:%d %s", 
+			socket_.fd(), savedErrno, ::strerror(savedErrno));
+		gro_ = false;
+	}
+
+	if (gro_)
+	{
+		slotSize_ = std::max(slotSize_, kGroSlotSize);
+		slotControls_.reset(new char[batchSize_ * kGroControlSize]);
+	}
+
+	slots_.reset(new char[batchSize_ * slotSize_]);
+	slotIovecs_.resize(batchSize_);
+	slotMsgs_.resize(batchSize_);
+	slotPeerAddrs_.resize(batchSize_);
+	datagrams_.reserve(batchSize_);
+
+	for (int i = 0; i < batchSize_; i++)
+	{
+		slotIovecs_[i].iov_base = slots_.get() + i * slotSize_;
+		slotIovecs_[i].iov_len = slotSize_;
+
+		struct msghdr &hdr = slotMsgs_[i].msg_hdr;
+		std::memset(&hdr, 0, sizeof(hdr));
+		hdr.msg_name = &(slotPeerAddrs_[i].getSockAddr());
+		hdr.msg_iov = &slotIovecs_[i];
+		hdr.msg_iovlen = 1;
+		if (gro_)
+		{
+			hdr.msg_control = slotControls_.get() + i * kGroControlSize;
+		}
+	}
+}
+
+void UdpConnection::onReadableBatch()
+{
+	if (!slots_)
+	{
+		allocSlots();
+	}
+
+	while (true)
+	{
+		for (int i = 0; i < batchSize_; i++)
+		{
+			slotMsgs_[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+			if (gro_)
+			{
+				slotMsgs_[i].msg_hdr.msg_controllen = kGroControlSize;
+			}
+		}
+
+		int n = socket_.recvMmsg(slotMsgs_.data(), batchSize_);
+		LOG_TRACE("recvmmsg() %d datagrams from udp socket, socket fd = %d", n, socket_.fd());
+		if (n < 0)
+		{
+			int savedErrno = errno;
+			if (savedErrno == EINTR)
+			{
+				continue;
+			}
+			else if (savedErrno != EAGAIN)
+			{
+				LOG_WARN("udp socket recvmmsg() error, socket fd = %d, error:%d %s", 
+					socket_.fd(), savedErrno, ::strerror(savedErrno));
+			}
+			return;
+		}
+
+		datagrams_.clear();
+		for (int i = 0; i < n; i++)
+		{
+			struct msghdr &hdr = slotMsgs_[i].msg_hdr;
+			const char *data = static_cast<const char*>(slotIovecs_[i].iov_base);
+			size_t len = slotMsgs_[i].msg_len;
+			bool truncated = (hdr.msg_flags & MSG_TRUNC) != 0;
+
+			size_t segmentSize = gro_ ? getGroSegmentSize(&hdr) : 0;
+			if (segmentSize == 0 || segmentSize >= len)
+			{
+				datagrams_.push_back(UdpDatagram{data, len, &slotPeerAddrs_[i], truncated});
+				continue;
+			}
+
+			// coalesced by GRO, every segment is @segmentSize bytes except the last one
+			for (size_t offset = 0; offset < len; offset += segmentSize)
+			{
+				size_t segmentLen = std::min(segmentSize, len - offset);
+				datagrams_.push_back(UdpDatagram{data + offset, segmentLen, &slotPeerAddrs_[i], 
+				                                 truncated && offset + segmentLen == len});
+			}
+		}
+
+		if (batchMessageHandler_)
+		{
+			if (!datagrams_.empty())
+			{
+				batchMessageHandler_(*this, datagrams_.data(), static_cast<int>(datagrams_.size()));
+			}
+		}
+		else
+		{
+			for (auto &datagram : datagrams_)
+			{
+				datagramHandler_(*this, datagram);
+			}
+		}
+
+		// the socket's receive buffer has been drained
+		if (n < batchSize_)
+		{
+			return;
+		}
+	}
+}
+
+int UdpConnection::sendBatch(const UdpDatagram *datagrams, int num)
+{
+	if (static_cast<int>(sendMsgs_.size()) < num)
+	{
+		sendMsgs_.resize(num);
+		sendIovecs_.resize(num);
+	}
+
+	for (int i = 0; i < num; i++)
+	{
+		sendIovecs_[i].iov_base = const_cast<char*>(datagrams[i].data);
+		sendIovecs_[i].iov_len = datagrams[i].len;
+
+		struct msghdr &hdr = sendMsgs_[i].msg_hdr;
+		std::memset(&hdr, 0, sizeof(hdr));
+		if (datagrams[i].peerAddr)
+		{
+			hdr.msg_name = const_cast<struct sockaddr_in*>(&(datagrams[i].peerAddr->getSockAddr()));
+			hdr.msg_namelen = sizeof(struct sockaddr_in);
+		}
+		hdr.msg_iov = &sendIovecs_[i];
+		hdr.msg_iovlen = 1;
+	}
+
+	int sent = 0;
+	while (sent < num)
+	{
+		int n = socket_.sendMmsg(sendMsgs_.data() + sent, num - sent);
+		if (n >= 0)
+		{
+			sent += n;
+			continue;
+		}
+
+		int savedErrno = errno;
+		if (savedErrno == EINTR)
+		{
+			continue;
+		}
+		else if (savedErrno == EAGAIN)
+		{
+			break;
+		}
+
+		LOG_WARN("udp socket sendmmsg() error, socket fd = %d, error:%d %s", 
+			socket_.fd(), savedErrno, ::strerror(savedErrno));
+		return sent > 0 ? sent : -1;
+	}
+
+	updateLocalAddr();
+	return sent;
+}
+
+ssize_t UdpConnection::sendSegments(const char *buf, size_t len, size_t segmentSize, const InetAddr &dstAddr)
+{
+	if (segmentSize == 0 || segmentSize > kGsoMaxBytes)
+	{
+		LOG_ERROR("invalid udp segment size %u, socket fd = %d", segmentSize, socket_.fd());
+		errno = EINVAL;
+		return -1;
+	}
+
+	// the most segments one sendmsg() can carry
+	size_t maxChunk = std::min(kGsoMaxSegments, kGsoMaxBytes / segmentSize) * segmentSize;
+	size_t sent = 0;
+	while (sent < len)
+	{
+		size_t chunk = std::min(maxChunk, len - sent);
+		ssize_t n = -1;
+		if (gsoSupported_)
+		{
+			n = sendGso(buf + sent, chunk, segmentSize, dstAddr);
+		}
+		// also when sendGso() just found GSO not supported
+		if (!gsoSupported_)
+		{
+			n = sendSegmentsBatch(buf + sent, chunk, segmentSize, dstAddr);
+		}
+
+		if (n < 0)
+		{
+			return sent > 0 ? sent : -1;
+		}
+
+		sent += n;
+		if (static_cast<size_t>(n) < chunk)
+		{
+			break;
+		}
+	}
+
+	updateLocalAddr();
+	return sent;
+}
+
+// the segments are sent all or none
+ssize_t UdpConnection::sendGso(const char *buf, size_t len, size_t segmentSize, const InetAddr &dstAddr)
+{
+	struct iovec iov;
+	iov.iov_base = const_cast<char*>(buf);
+	iov.iov_len = len;
+
+	struct msghdr hdr;
+	std::memset(&hdr, 0, sizeof(hdr));
+	hdr.msg_name = const_cast<struct sockaddr_in*>(&(dstAddr.getSockAddr()));
+	hdr.msg_namelen = sizeof(struct sockaddr_in);
+	hdr.msg_iov = &iov;
+	hdr.msg_iovlen = 1;
+
+	union
+	{
+		char buf[CMSG_SPACE(sizeof(uint16_t))];
+		struct cmsghdr align;
+	} control;
+
+#ifdef UDP_SEGMENT
+	// a single datagram needs no segmentation
+	if (len > segmentSize)
+	{
+		std::memset(&control, 0, sizeof(control));
+		hdr.msg_control = control.buf;
+		hdr.msg_controllen = sizeof(control.buf);
+
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+		cmsg->cmsg_level = IPPROTO_UDP;
+		cmsg->cmsg_type = UDP_SEGMENT;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+		uint16_t size = static_cast<uint16_t>(segmentSize);
+		std::memcpy(CMSG_DATA(cmsg), &size, sizeof(size));
+	}
+#else
+	if (len > segmentSize)
+	{
+		gsoSupported_ = false;
+		return -1;
+	}
+#endif
+
+	while (true)
+	{
+		ssize_t n = socket_.sendMsg(&hdr);
+		if (n >= 0)
+		{
+			return n;
+		}
+
+		int savedErrno = errno;
+		if (savedErrno == EINTR)
+		{
+			continue;
+		}
+		else if (savedErrno == EAGAIN)
+		{
+			return 0;
+		}
+		else if (len > segmentSize && (savedErrno == EIO || savedErrno == EINVAL || 
+		                               savedErrno == ENOPROTOOPT || savedErrno == EOPNOTSUPP))
+		{
+			// the kernel doesn't know UDP_SEGMENT, or the nic can't checksum the segments
+			LOG_WARN("udp socket GSO not supported, falls back to sendmmsg(), socket fd = %d, error:%d %s", 
+				socket_.fd(), savedErrno, ::strerror(savedErrno));
+			gsoSupported_ = false;
+			return -1;
+		}
+
+		LOG_WARN("udp socket sendmsg() error, socket fd = %d, error:%d %s", 
+			socket_.fd(), savedErrno, ::strerror(savedErrno));
+		return -1;
+	}
+}
+
+ssize_t UdpConnection::sendSegmentsBatch(const char *buf, size_t len, size_t segmentSize, const InetAddr &dstAddr)
+{
+	segments_.clear();
+	for (size_t offset = 0; offset < len; offset += segmentSize)
+	{
+		segments_.push_back(UdpDatagram{buf + offset, std::min(segmentSize, len - offset), &dstAddr, false});
+	}
+
+	int n = sendBatch(segments_.data(), static_cast<int>(segments_.size()));
+	if (n < 0)
+	{
+		return -1;
+	}
+
+	return n == static_cast<int>(segments_.size()) ? len : n * segmentSize;
+}
+
 void UdpConnection::onPollError()
 {
     int errNo = socket_.getSocketError();
+	updateLocalAddr();
 	std::string errMsg = ::strerror(errNo);
 	LOG_WARN("udp socket %s->%s error occured, socket fd = %d, error:%d %s ", 
 			localAddr_.toString().c_str(), peerAddr_.toString().c_str(), socket_.fd(), errNo, errMsg.c_str());
@@ -6,6 +6,8 @@
 #define _UDP_CONNECTION_H_
 
 #include <string>
+#include <vector>
+#include <memory>
 #include <functional>
 #include <utility>
 
@@ -13,17 +15,31 @@
 #include "Socket.h"
 #include "Channel.h"
 #include "Buffer.h"
+#include "UdpSessionTable.h"
 
 namespace easynet
 {
 
 class EventLoop;
 
+// a datagram of the batch or view mode. a received one points into the connection's receive slots 
+// and is valid until the handler returns, @peerAddr is where it came from.
+// to send, @peerAddr is the destination, nullptr for the connected address
+struct UdpDatagram
+{
+	const char *data;
+	size_t len;
+	const InetAddr *peerAddr;
+	bool truncated;   // longer than a receive slot, the rest was discarded
+};
+
 class UdpConnection
 {
 public:
 	using UdpConnectionHandler = std::function<void (UdpConnection &udpConnection)>;
 	using ErrorHandler = std::function<void (UdpConnection &udpConnection, int errNo, const std::string& errMsg)>;
+	using BatchMessageHandler = std::function<void (UdpConnection &udpConnection, const UdpDatagram *datagrams, int num)>;
+	using DatagramHandler = std::function<void (UdpConnection &udpConnection, const UdpDatagram &datagram)>;
 
 	UdpConnection(EventLoop *loop);
 	~UdpConnection() { channel_.disableAll(); }
@@ -35,17 +51,41 @@ public:
 	int connect(const InetAddr &addr);
 	int connect(const std::string &ip, unsigned short port) { return connect(InetAddr(ip, port)); }
 
+	// before bind(), lets several connections bind to the same address, and the kernel spreads 
+	// the flows over them
+	int setReusePort(bool on) { return socket_.setReusePort(on); }
+	// after bind(), see Socket::setReusePortCpuSteering()
+	int setReusePortCpuSteering(const std::vector<std::vector<int>> &socketCpus) 
+	{ return socket_.setReusePortCpuSteering(socketCpus); }
+
 
     ssize_t sendTo(const std::string &msg, const std::string &dstIp, unsigned short dstPort)
     { return sendTo(msg, InetAddr(dstIp, dstPort)); }
     ssize_t sendTo(const std::string &msg, const InetAddr &dstAddr) { return sendTo(msg.c_str(), msg.size(), dstAddr); }
-    ssize_t sendTo(const char *buf, size_t len, const InetAddr &dstAddr) { return socket_.sendTo(buf, len, dstAddr); }
+    ssize_t sendTo(const char *buf, size_t len, const InetAddr &dstAddr)
+	{
+		ssize_t n = socket_.sendTo(buf, len, dstAddr);
+		updateLocalAddr();
+		return n;
+	}
 	ssize_t sendTo(const char *buf, size_t len, const std::string &dstIp, unsigned short dstPort)
 	{ return sendTo(buf, len, InetAddr(dstIp, dstPort)); }
 
 	ssize_t send(const char *buf, size_t len) { return sendTo(buf, len, foreignAddr_); }
 	ssize_t send(const std::string &msg) { return send(msg.c_str(), msg.size()); }
 
+	// sends the datagrams with sendmmsg(), returns how many were sent, 
+	// less than @num when the socket's send buffer is full, or -1 on error
+	int sendBatch(const UdpDatagram *datagrams, int num);
+
+	// sends @buf as datagrams of @segmentSize bytes(the last one may be shorter), up to 64 of them 
+	// are passed to the kernel in one sendmsg() with UDP_SEGMENT(GSO) and split by the kernel or the nic.
+	// falls back to sendmmsg() if GSO is not supported. returns the bytes sent, less than @len when 
+	// the socket's send buffer is full, or -1 on error
+	ssize_t sendSegments(const char *buf, size_t len, size_t segmentSize, const InetAddr &dstAddr);
+	ssize_t sendSegments(const char *buf, size_t len, size_t segmentSize) 
+	{ return sendSegments(buf, len, segmentSize, foreignAddr_); }
+
 	const InetAddr& getListenAddr() const { return listenAddr_; }
 	const InetAddr& getPeerAddr() const { return peerAddr_; }
 	const InetAddr& getLocalAddr() const { return localAddr_; }
@@ -57,10 +97,41 @@ public:
 	void setErrorHandler(ErrorHandler &&handler) { errorHandler_ = std::move(handler); }
 	void setErrorHandler(const ErrorHandler &handler) { setErrorHandler(ErrorHandler(handler)); }
 
+	// batch mode, used instead of the message handler when set: up to @batchSize datagrams are received 
+	// with one recvmmsg() into preallocated slots of @slotSize bytes, and passed to the handler together,
+	// without going through the input buffer.
+	void setBatchMessageHandler(BatchMessageHandler &&handler) { batchMessageHandler_ = std::move(handler); }
+	void setBatchMessageHandler(const BatchMessageHandler &handler) { setBatchMessageHandler(BatchMessageHandler(handler)); }
+	void setBatchSize(int batchSize, size_t slotSize);  // before any datagram received
+
+	// view mode, used instead of the message handler when set and no batch handler: the datagrams are 
+	// received as in the batch mode, but passed to the handler one by one, each as a read-only view 
+	// of its receive slot. neither the input buffer nor @peerAddr_ is touched.
+	void setDatagramHandler(DatagramHandler &&handler) { datagramHandler_ = std::move(handler); }
+	void setDatagramHandler(const DatagramHandler &handler) { setDatagramHandler(DatagramHandler(handler)); }
+
+	// the sessions of the peers, may be shared by the connections in the same loop, not owned.
+	// getSession() finds or creates the session of @peerAddr and marks it active, nullptr without a table
+	// or if the table is full. call it on every datagram, as in the handler, see UdpSessionTable
+	void setSessionTable(UdpSessionTable *sessionTable) { sessionTable_ = sessionTable; }
+	UdpSessionTable* getSessionTable() const { return sessionTable_; }
+	UdpSession* getSession(const InetAddr &peerAddr) { return sessionTable_ ? sessionTable_->touch(peerAddr) : nullptr; }
+
+	// batch or view mode only, before any datagram received: lets the kernel coalesce the datagrams of a flow
+	// with UDP_GRO, and splits them back into UdpDatagram pointing into the receive slot without copying.
+	// the slots are enlarged to 64KB and the batch size is reduced to 16, call setBatchSize() after it to change.
+	void setGro(bool on);
+
 private:
 	void onReadable();
+	void onReadableBatch();
 	void onPollError();
 	ssize_t readData();
+	// the kernel binds an unbound socket implicitly on the first send, get the address once then
+	void updateLocalAddr() { if (localAddr_.port() == 0) socket_.getLocalAddr(&localAddr_); }
+	void allocSlots();
+	ssize_t sendGso(const char *buf, size_t len, size_t segmentSize, const InetAddr &dstAddr);
+	ssize_t sendSegmentsBatch(const char *buf, size_t len, size_t segmentSize, const InetAddr &dstAddr);
 
 	EventLoop *loop_;
 	Socket socket_;
@@ -76,6 +147,26 @@ private:
 
 	UdpConnectionHandler messageHandler_;
 	ErrorHandler errorHandler_;
+	BatchMessageHandler batchMessageHandler_;
+	DatagramHandler datagramHandler_;
+
+	UdpSessionTable *sessionTable_;
+
+	// batch and view mode, allocated in the loop at the first read
+	int batchSize_;
+	size_t slotSize_;
+	std::unique_ptr<char[]> slots_;
+	std::vector<struct iovec> slotIovecs_;
+	std::vector<struct mmsghdr> slotMsgs_;
+	std::vector<InetAddr> slotPeerAddrs_;
+	std::vector<UdpDatagram> datagrams_;
+	bool gro_;
+	std::unique_ptr<char[]> slotControls_;   // cmsg of the GRO segment size
+
+	std::vector<struct iovec> sendIovecs_;   // scratch of sendBatch()
+	std::vector<struct mmsghdr> sendMsgs_;
+	std::vector<UdpDatagram> segments_;      // scratch of sendSegments() without GSO
+	bool gsoSupported_;
 };
 
 }
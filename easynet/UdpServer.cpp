@@ -4,20 +4,80 @@
 
 #include <cstring>
 #include "UdpServer.h"
+#include "utils/cpu.h"
 #include "utils/log.h"
 
 using namespace easynet;
 
 void UdpServer::start()
+{
+	placeWorkers();
+	workerGroup_.reset(new WorkerGroup(Worker::LOAD_BALANCE_STRATEGY_ROUND_ROBIN, workerNum_, 0, 0, workerCpuSets_));
+
+	bindUdpConnections();
+	workerGroup_->start();
+}
+
+void UdpServer::placeWorkers()
+{
+	if (workerCpuSets_.empty() && (workerCpuAutoPlacement_ || workerCpuSteering_))
+	{
+		std::vector<int> cpus = getCpusSpreadOverCores(workerNum_);
+		for (auto cpu : cpus)
+		{
+			workerCpuSets_.push_back(std::vector<int>(1, cpu));
+		}
+	}
+
+	for (size_t i = 0; i < workerCpuSets_.size() && i < static_cast<size_t>(workerNum_); i++)
+	{
+		const std::vector<int> &cpus = workerCpuSets_[i];
+		if (!cpus.empty())
+		{
+			LOG_INFO("udp server worker %u placed on cpus:%s, numa node:%d",
+				i, cpusToString(cpus).c_str(), getCpuNumaNode(cpus[0]));
+		}
+	}
+}
+
+// the sockets of an address join its reuseport group in the order of the workers
+void UdpServer::bindUdpConnections()
 {
     std::vector<InetAddr> listenAddrs = listenAddrMgr_.getListenAddrs();
-    std::vector<Worker*> workers = workerGroup_.getWorkers();
+    std::vector<Worker*> workers = workerGroup_->getWorkers();
+
+    if (sessionMemoryLimitBytes_ > 0)
+    {
+    	for (auto worker : workers)
+    	{
+    		ScopedCpuBinding binding(worker->getCpus());
+    		std::unique_ptr<UdpSessionTable> sessionTable(new UdpSessionTable(worker->getLoop(), 
+    			                                                              sessionIdleMillis_, 
+    			                                                              sessionMemoryLimitBytes_));
+    		sessionTable->setExpiredHandler(sessionExpiredHandler_);
+    		sessionTables_.push_back(std::move(sessionTable));
+    	}
+    }
 
-    for (auto worker : workers)
+	for (auto &addr : listenAddrs)
     {
-    	for (auto &addr : listenAddrs)
+    	UdpConnection *first = nullptr;
+	    for (size_t i = 0; i < workers.size(); i++)
 	    {
+	    	Worker *worker = workers[i];
+	    	// the connection and its input buffer are allocated on the worker's numa node
+	    	ScopedCpuBinding binding(worker->getCpus());
 	    	std::unique_ptr<UdpConnection> udpChannel(new UdpConnection(worker->getLoop()));
+	    	if (i < sessionTables_.size())
+	    	{
+	    		udpChannel->setSessionTable(sessionTables_[i].get());
+	    	}
+	    	if (udpChannel->setReusePort(true) < 0)
+	    	{
+	    		int savedErrno = errno;
+	    		LOG_WARN("udp server set SO_REUSEPORT failed, error:%d %s", savedErrno, ::strerror(savedErrno));
+	    	}
+
 	    	if (udpChannel->bind(addr) == 0)
 	    	{
 	    		LOG_INFO("udp server bind at %s", addr.toString().c_str());
@@ -30,9 +90,58 @@ void UdpServer::start()
 	    	}
 	    	udpChannel->setMessageHandler(messageHandler_);
 	    	udpChannel->setErrorHandler(errorHandler_);
+	    	if (batchMessageHandler_ || datagramHandler_)
+	    	{
+	    		udpChannel->setBatchMessageHandler(batchMessageHandler_);
+	    		udpChannel->setDatagramHandler(datagramHandler_);
+	    		udpChannel->setGro(gro_);
+	    		udpChannel->setBatchSize(batchSize_, slotSize_);
+	    	}
+
+	    	if (first == nullptr)
+	    	{
+	    		first = udpChannel.get();
+	    	}
 	    	udpChannels_.push_back(std::move(udpChannel));
 	    }
+
+	    // the program is shared by the whole group
+	    if (workerCpuSteering_ && first != nullptr)
+	    {
+	    	if (first->setReusePortCpuSteering(getWorkersCpuSets()) == 0)
+	    	{
+	    		LOG_INFO("udp server steers the datagrams at %s by cpu", addr.toString().c_str());
+	    	}
+	    	else
+	    	{
+	    		int savedErrno = errno;
+	    		LOG_WARN("udp server steers the datagrams at %s by cpu failed, error:%d %s",
+	    			addr.toString().c_str(), savedErrno, ::strerror(savedErrno));
+	    	}
+	    }
     }
-    
-    workerGroup_.start();
-}
\ No newline at end of file
+}
+
+std::vector<EventLoop*> UdpServer::getWorkersLoops() const
+{
+	std::vector<EventLoop*> v;
+	std::vector<Worker*> workers = workerGroup_->getWorkers();
+	for (auto worker : workers)
+	{
+		v.push_back(worker->getLoop());
+	}
+
+	return v;
+}
+
+std::vector<std::vector<int>> UdpServer::getWorkersCpuSets() const
+{
+	std::vector<std::vector<int>> v;
+	std::vector<Worker*> workers = workerGroup_->getWorkers();
+	for (auto worker : workers)
+	{
+		v.push_back(worker->getCpus());
+	}
+
+	return v;
+}
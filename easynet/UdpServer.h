@@ -5,6 +5,9 @@
 #ifndef _UDP_SERVER_H_
 #define _UDP_SERVER_H_
 
+#include <memory>
+#include <vector>
+
 #include "WorkerGroup.h"
 #include "UdpConnection.h"
 #include "ListenAddrMgr.h"
@@ -17,12 +20,40 @@ class UdpServer
 public:
 	using UdpConnectionHandler = UdpConnection::UdpConnectionHandler;
 	using ErrorHandler = UdpConnection::ErrorHandler;
+	using BatchMessageHandler = UdpConnection::BatchMessageHandler;
+	using DatagramHandler = UdpConnection::DatagramHandler;
+	using SessionHandler = UdpSessionTable::SessionHandler;
 
-	UdpServer(unsigned short port) { addListenAddr(port); }
+	UdpServer(unsigned short port) 
+	    : workerNum_(1), workerCpuAutoPlacement_(false), workerCpuSteering_(false),
+	      batchSize_(0), slotSize_(0), gro_(false), sessionIdleMillis_(0), sessionMemoryLimitBytes_(0)
+	{ addListenAddr(port); }
 	~UdpServer() { stop(); }
 
 	void start();
-	void stop() { workerGroup_.stop(); }
+	void stop() { if (workerGroup_) workerGroup_->stop(); }
+
+	// every worker binds its own socket to each listen address with SO_REUSEPORT, 
+	// the kernel spreads the flows over them by the hash of the addresses and ports
+	void setWorkerNum(int num) { workerNum_ = num; }
+	// see TcpServer::setWorkerCpuSets() and setWorkerCpuAutoPlacement()
+	void setWorkerCpuSets(const std::vector<std::vector<int>> &cpuSets) { workerCpuSets_ = cpuSets; }
+	void setWorkerCpuAutoPlacement(bool enabled) { workerCpuAutoPlacement_ = enabled; }
+	// instead of the flow hash, a datagram goes to the worker bound to the cpu handling it in the kernel,
+	// so it's received on the cpu where it's already in cache. the workers are placed automatically if no 
+	// cpu set is given. the datagrams handled by the cpus of no worker are still spread by the hash.
+	void setWorkerCpuSteering(bool enabled) { workerCpuSteering_ = enabled; }
+
+	// every worker keeps the sessions of its peers in its own table, shared by its connections.
+	// a peer's datagrams go to the same worker as long as the workers don't change, 
+	// call UdpConnection::getSession() in the handlers. see UdpSessionTable, disabled in default
+	void setSessionTable(int64_t idleMillis, size_t memoryLimitBytesPerWorker)
+	{ sessionIdleMillis_ = idleMillis; sessionMemoryLimitBytes_ = memoryLimitBytesPerWorker; }
+	void setSessionExpiredHandler(SessionHandler &&handler) { sessionExpiredHandler_ = std::move(handler); }
+	void setSessionExpiredHandler(const SessionHandler &handler) { setSessionExpiredHandler(SessionHandler(handler)); }
+
+	std::vector<EventLoop*> getWorkersLoops() const;
+	std::vector<std::vector<int>> getWorkersCpuSets() const;
 	
 	void setMessageHandler(UdpConnectionHandler &&handler) { messageHandler_ = std::move(handler); }
 	void setMessageHandler(const UdpConnectionHandler &handler) { setMessageHandler(UdpConnectionHandler(handler)); }
@@ -30,6 +61,16 @@ public:
 	void setErrorHandler(ErrorHandler &&handler) { errorHandler_ = std::move(handler); }
 	void setErrorHandler(const ErrorHandler &handler) { setErrorHandler(ErrorHandler(handler)); }
 
+	// see UdpConnection::setBatchMessageHandler()
+	void setBatchMessageHandler(BatchMessageHandler &&handler) { batchMessageHandler_ = std::move(handler); }
+	void setBatchMessageHandler(const BatchMessageHandler &handler) { setBatchMessageHandler(BatchMessageHandler(handler)); }
+	void setBatchSize(int batchSize, size_t slotSize) { batchSize_ = batchSize; slotSize_ = slotSize; }
+	void setGro(bool on) { gro_ = on; }  // see UdpConnection::setGro()
+
+	// see UdpConnection::setDatagramHandler(), setBatchSize() and setGro() also apply to it
+	void setDatagramHandler(DatagramHandler &&handler) { datagramHandler_ = std::move(handler); }
+	void setDatagramHandler(const DatagramHandler &handler) { setDatagramHandler(DatagramHandler(handler)); }
+
 	bool addListenAddr(unsigned short port) 
     { return listenAddrMgr_.addListenAddr(InetAddr(port)); }
     bool addListenAddr(const std::string &ip, unsigned short port) 
@@ -37,13 +78,29 @@ public:
     bool addListenAddr(const InetAddr &addr) { return listenAddrMgr_.addListenAddr(addr); }
 
 private:
+	void placeWorkers();
+	void bindUdpConnections();
+
+	int workerNum_;
+	std::vector<std::vector<int>> workerCpuSets_;
+	bool workerCpuAutoPlacement_;
+	bool workerCpuSteering_;
 
-    WorkerGroup workerGroup_;
+    std::unique_ptr<WorkerGroup> workerGroup_;
     ListenAddrMgr listenAddrMgr_;
+    std::vector<std::unique_ptr<UdpSessionTable>> sessionTables_;  // one per worker
     std::vector<std::unique_ptr<UdpConnection>> udpChannels_;
 
 	UdpConnectionHandler messageHandler_;
 	ErrorHandler errorHandler_;	
+	BatchMessageHandler batchMessageHandler_;
+	DatagramHandler datagramHandler_;
+	int batchSize_;
+	size_t slotSize_;
+	bool gro_;
+	int64_t sessionIdleMillis_;
+	size_t sessionMemoryLimitBytes_;
+	SessionHandler sessionExpiredHandler_;
 };
 
 }
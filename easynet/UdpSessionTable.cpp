@@ -0,0 +1,231 @@
+// Copyright 2017, Shenghua Fang. All rights reserved.
+// Use of this source code is governed by a BSD 2-Clause license that can be found in the License file.
+// Author: Shenghua Fang
+
+#include <algorithm>
+
+#include "UdpSessionTable.h"
+#include "EventLoop.h"
+#include "Timer.h"
+#include "utils/log.h"
+
+using namespace easynet;
+
+namespace
+{
+
+const size_t kInitialCapacity     = 1024;
+const size_t kMinCapacity         = 16;
+const int64_t kSweepIntervalMillis = 1000;  // the tick of the loop's idle TimeWheel
+const size_t kMinSweepSlots       = 64;
+const uint64_t kUsedKeyBit        = 1ull << 48;
+
+}
+
+InetAddr UdpSession::getPeerAddr() const
+{
+	struct sockaddr_in addr;
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = static_cast<uint32_t>(key >> 16);
+	addr.sin_port = static_cast<uint16_t>(key);
+	return InetAddr(addr);
+}
+
+// 0.0.0.0:0 is still a used key with the bit
+uint64_t UdpSession::makeKey(const InetAddr &peerAddr)
+{
+	const struct sockaddr_in &addr = peerAddr.getSockAddr();
+	return kUsedKeyBit | (static_cast<uint64_t>(addr.sin_addr.s_addr) << 16) | addr.sin_port;
+}
+
+UdpSessionTable::UdpSessionTable(EventLoop *loop, int64_t idleMillis, size_t memoryLimitBytes)
+                     : loop_(loop),
+                       idleMillis_(idleMillis),
+                       maxCapacity_(kMinCapacity),
+                       size_(0),
+                       rejected_(0),
+                       sweepPos_(0),
+                       sweepTimer_(nullptr)
+{
+	while (maxCapacity_ * 2 * sizeof(UdpSession) <= memoryLimitBytes)
+	{
+		maxCapacity_ *= 2;
+	}
+
+	size_t capacity = std::min(kInitialCapacity, maxCapacity_);
+	slots_.resize(capacity);
+	mask_ = capacity - 1;
+	bits_ = 0;
+	while ((static_cast<size_t>(1) << bits_) < capacity)
+	{
+		bits_++;
+	}
+
+	scheduleSweep();
+}
+
+UdpSessionTable::~UdpSessionTable()
+{
+	if (sweepTimer_)
+	{
+		sweepTimer_->cancel();
+	}
+
+	if (expiredHandler_)
+	{
+		for (auto &session : slots_)
+		{
+			if (session.used())
+			{
+				expiredHandler_(session);
+			}
+		}
+	}
+}
+
+// fibonacci hashing, the high bits of the product are mixed from all bits of the key
+size_t UdpSessionTable::homeOf(uint64_t key) const
+{
+	return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> (64 - bits_));
+}
+
+size_t UdpSessionTable::findSlot(uint64_t key) const
+{
+	size_t i = homeOf(key);
+	while (slots_[i].used() && slots_[i].key != key)
+	{
+		i = (i + 1) & mask_;
+	}
+
+	return i;
+}
+
+UdpSession* UdpSessionTable::touch(const InetAddr &peerAddr)
+{
+	uint64_t key = UdpSession::makeKey(peerAddr);
+	size_t i = findSlot(key);
+	if (!slots_[i].used())
+	{
+		// at most 3/4 full
+		if (size_ + 1 > slots_.size() - slots_.size() / 4)
+		{
+			if (!grow())
+			{
+				rejected_++;
+				return nullptr;
+			}
+			i = findSlot(key);
+		}
+
+		slots_[i].key = key;
+		slots_[i].data = nullptr;
+		size_++;
+	}
+
+	slots_[i].lastActive = loop_->now();
+	return &slots_[i];
+}
+
+UdpSession* UdpSessionTable::find(const InetAddr &peerAddr)
+{
+	size_t i = findSlot(UdpSession::makeKey(peerAddr));
+	return slots_[i].used() ? &slots_[i] : nullptr;
+}
+
+void UdpSessionTable::erase(const InetAddr &peerAddr)
+{
+	size_t i = findSlot(UdpSession::makeKey(peerAddr));
+	if (slots_[i].used())
+	{
+		eraseAt(i);
+	}
+}
+
+// shifts the following sessions of the probe back, instead of leaving a tombstone
+void UdpSessionTable::eraseAt(size_t index)
+{
+	size_t i = index;
+	size_t j = index;
+	while (true)
+	{
+		j = (j + 1) & mask_;
+		if (!slots_[j].used())
+		{
+			break;
+		}
+
+		// the session at j can fill the hole at i if i is between its home and j
+		size_t home = homeOf(slots_[j].key);
+		if (((j - home) & mask_) >= ((j - i) & mask_))
+		{
+			slots_[i] = slots_[j];
+			i = j;
+		}
+	}
+
+	slots_[i].key = 0;
+	slots_[i].data = nullptr;
+	size_--;
+}
+
+bool UdpSessionTable::grow()
+{
+	if (slots_.size() * 2 > maxCapacity_)
+	{
+		return false;
+	}
+
+	std::vector<UdpSession> old(slots_.size() * 2);
+	old.swap(slots_);
+	mask_ = slots_.size() - 1;
+	bits_++;
+	sweepPos_ = 0;
+
+	for (auto &session : old)
+	{
+		if (session.used())
+		{
+			slots_[findSlot(session.key)] = session;
+		}
+	}
+
+	LOG_DEBUG("udp session table grew to %u slots, %u sessions", slots_.size(), size_);
+	return true;
+}
+
+void UdpSessionTable::scheduleSweep()
+{
+	if (idleMillis_ > 0)
+	{
+		sweepTimer_ = loop_->addIdleTimer(kSweepIntervalMillis, [this]{
+			sweepTimer_ = nullptr;  // the timer is deleted after it
+			sweep();
+			scheduleSweep();
+		});
+	}
+}
+
+// checks enough slots every tick to cover the whole array in @idleMillis_
+void UdpSessionTable::sweep()
+{
+	int64_t expireBefore = loop_->now() - idleMillis_;
+	size_t steps = std::max(kMinSweepSlots, static_cast<size_t>(slots_.size() * kSweepIntervalMillis / idleMillis_) + 1);
+	steps = std::min(steps, slots_.size());
+
+	for (size_t n = 0; n < steps; n++)
+	{
+		UdpSession &session = slots_[sweepPos_];
+		if (session.used() && session.lastActive <= expireBefore)
+		{
+			if (expiredHandler_)
+			{
+				expiredHandler_(session);
+			}
+			// another session may be shifted into the slot, checks it again
+			eraseAt(sweepPos_);
+			continue;
+		}
+
+		sweepPos_ = (sweepPos_ + 1) & mask_;
+	}
+}
@@ -0,0 +1,93 @@
+// Copyright 2017, Shenghua Fang. All rights reserved.
+// Use of this source code is governed by a BSD 2-Clause license that can be found in the License file.
+// Author: Shenghua Fang
+
+#ifndef _EASYNET_UDP_SESSION_TABLE_H_
+#define _EASYNET_UDP_SESSION_TABLE_H_
+
+#include <stdint.h>
+#include <vector>
+#include <functional>
+#include <utility>
+
+#include "InetAddr.h"
+
+namespace easynet
+{
+
+class EventLoop;
+class Timer;
+
+// the state of a udp peer, 24 bytes
+struct UdpSession
+{
+	uint64_t key;        // 1 << 48 | ipv4 << 16 | port, both in network byte order. 0 for a free slot
+	int64_t lastActive;  // EventLoop::now() when the peer was last seen
+	void *data;          // user data, nullptr for a new session
+
+	bool used() const { return key != 0; }
+	InetAddr getPeerAddr() const;
+	static uint64_t makeKey(const InetAddr &peerAddr);
+};
+
+// sessions keyed by the peer address, in one array probed linearly, so a lookup touches
+// one or two cache lines. it's used in one loop, not thread safe.
+//
+// a session idle for @idleMillis is expired by a sweep driven by the loop's idle TimeWheel,
+// which checks a part of the array every second, so the whole array in @idleMillis, and
+// a session is expired between @idleMillis and 2 * @idleMillis after it was last seen.
+// the array grows by doubling, but never beyond @memoryLimitBytes.
+class UdpSessionTable
+{
+public:
+	using SessionHandler = std::function<void (UdpSession &session)>;
+
+	// never expires the sessions if @idleMillis <= 0
+	UdpSessionTable(EventLoop *loop, int64_t idleMillis, size_t memoryLimitBytes);
+	~UdpSessionTable();  // the expired handler is called for the remaining sessions
+
+	UdpSessionTable(const UdpSessionTable &rhs) = delete;
+	UdpSessionTable& operator=(const UdpSessionTable &rhs) = delete;
+
+	// finds the session of @peerAddr, or creates it, and marks it active. returns nullptr if
+	// the table is full. the session may move when the table is changed, don't keep the pointer
+	UdpSession* touch(const InetAddr &peerAddr);
+	UdpSession* find(const InetAddr &peerAddr);
+	void erase(const InetAddr &peerAddr);  // without calling the expired handler
+
+	// called before an idle session is removed, to release its data. it must not change the table
+	void setExpiredHandler(SessionHandler &&handler) { expiredHandler_ = std::move(handler); }
+	void setExpiredHandler(const SessionHandler &handler) { setExpiredHandler(SessionHandler(handler)); }
+
+	size_t size() const { return size_; }
+	size_t capacity() const { return slots_.size(); }
+	size_t maxSize() const { return maxCapacity_ - maxCapacity_ / 4; }
+	size_t memoryBytes() const { return slots_.size() * sizeof(UdpSession); }
+	uint64_t rejected() const { return rejected_; }  // new peers turned away as the table was full
+
+private:
+	size_t homeOf(uint64_t key) const;
+	size_t findSlot(uint64_t key) const;  // the slot of @key, or the free slot ending its probe
+	void eraseAt(size_t index);
+	bool grow();
+	void sweep();
+	void scheduleSweep();
+
+	EventLoop *loop_;
+	int64_t idleMillis_;
+	size_t maxCapacity_;
+
+	std::vector<UdpSession> slots_;   // the size is a power of 2
+	int bits_;
+	size_t mask_;
+	size_t size_;
+	uint64_t rejected_;
+
+	size_t sweepPos_;
+	Timer *sweepTimer_;
+	SessionHandler expiredHandler_;
+};
+
+}
+
+#endif
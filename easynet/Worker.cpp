@@ -3,10 +3,35 @@
 // Author: Shenghua Fang
 
 #include "Worker.h"
+#include "utils/cpu.h"
 #include "utils/log.h"
 
 using namespace easynet;
 
+namespace
+{
+
+const int kQueuedBytesPerScore     = 4096;  // 1MB queued bytes count as 256 permille utilization
+const int kPendingFunctorScore     = 10;
+const int kMaxLoadScore            = 2000;
+const int kLoadScoreBalancingMargin = 100;   // to keep the token from bouncing between equally loaded workers
+
+}
+
+void Worker::start()
+{
+	quit_ = false;
+	exited_ = false;
+	retiring_ = false;
+	heldToken_ = false;
+	relayed_ = false;
+	started_ = true;
+	// a worker started again is measured afresh, not busy for the time it was stopped
+	loop_.resetUtilization();
+	stats_.utilization.store(0, std::memory_order_relaxed);
+	std::thread(std::bind(&Worker::run, this)).detach();
+}
+
 void Worker::rearrangeBuddies()
 {
 	// assume there are 4 workers, after re-arrange, worker's buddies are:
@@ -15,10 +40,7 @@ void Worker::rearrangeBuddies()
 	// worker 3: 4, 1, 2
 	// worker 4: 1, 2, 3
 	auto it = buddies_.begin();
-	if (*it == this)
-	{
-		isHeadWorker_ = true;
-	}
+	isHeadWorker_ = (*it == this);
 
     while (it != buddies_.end())
     {
@@ -55,6 +77,10 @@ void Worker::initLoadBalancer()
 	case LOAD_BALANCE_STRATEGY_TOKEN_RING_BY_METRIC_LARGER:
 	    loadBalancer_ = std::bind(&Worker::loadBalanceTokenRingByMetricLarger, this);
 	    break;
+
+	case LOAD_BALANCE_STRATEGY_TOKEN_RING_BY_UTILIZATION:
+	    loadBalancer_ = std::bind(&Worker::loadBalanceTokenRingByUtilization, this);
+	    break;
 	}
 }
 
@@ -69,41 +95,95 @@ void Worker::initTokenAcquirer()
 	case LOAD_BALANCE_STRATEGY_ROUND_ROBIN:
 	case LOAD_BALANCE_STRATEGY_TOKEN_RING_BY_METRIC_SMALLER:
 	case LOAD_BALANCE_STRATEGY_TOKEN_RING_BY_METRIC_LARGER:
+	case LOAD_BALANCE_STRATEGY_TOKEN_RING_BY_UTILIZATION:
 	    tokenAcquirer_ = std::bind(&Worker::acquireTokenByTokenRing, this);
 	    break;
 	}
 }
 
+void Worker::bindCpus()
+{
+	if (cpus_.empty())
+	{
+		return;
+	}
+
+	if (setThreadCpus(cpus_) == 0)
+	{
+		LOG_INFO("worker[0x%x] bound to cpus:%s", this, cpusToString(cpus_).c_str());
+	}
+	else
+	{
+		LOG_WARN("worker[0x%x] can't be bound to cpus:%s", this, cpusToString(cpus_).c_str());
+	}
+}
+
 void Worker::init()
 {
 	rearrangeBuddies();
 	initLoadBalancer();
 	initTokenAcquirer();
 	
-	if (isSingleWorker() || (isHeadWorker_ && strategy_ != LOAD_BALANCE_STRATEGY_BY_LOCK))
+	// with the lock strategy, the token is acquired with the lock in acquireToken(), 
+	// even by a single worker, as buddies may join later
+	if (strategy_ != LOAD_BALANCE_STRATEGY_BY_LOCK && (isSingleWorker() || isHeadWorker_))
 	{
 		tokenAcquired();
 	}
 }
 
+void Worker::resetBuddies(const std::vector<Worker*> &buddies)
+{
+	buddies_ = buddies;
+	rearrangeBuddies();
+}
+
+void Worker::retire(const std::vector<Worker*> &buddies)
+{
+	retiring_ = true;
+	buddies_ = buddies;
+
+	bool hadToken = heldToken() || relayed_;
+	relayed_ = false;
+	if (heldToken())
+	{
+		yieldToken();
+		if (strategy_ == LOAD_BALANCE_STRATEGY_BY_LOCK)
+		{
+			unLock();
+		}
+	}
+
+	if (hadToken && strategy_ != LOAD_BALANCE_STRATEGY_BY_LOCK && !buddies_.empty())
+	{
+		buddies_[0]->relay();
+	}
+}
+
 void Worker::run()
 {
+	// before the loop allocates anything in this thread
+	bindCpus();
 	LOG_INFO("worker starting........................................");
 	init();
 
 	Functor loadBalancer(std::bind(&Worker::loadBalance, this));
-	Functor *functorRunAfterAccept = isSingleWorker() ? nullptr : &loadBalancer;
+	Functor *functorRunAfterAccept = nullptr;
 	int timeoutMillis = EASYNET_TIMER_INFINITE;
   
 	while (!quit_)
 	{
 		acquireToken();
 		timeoutMillis = EASYNET_TIMER_INFINITE;
-		if (!heldToken() && strategy_ == LOAD_BALANCE_STRATEGY_BY_LOCK)
+		if (!heldToken() && !retiring_ && strategy_ == LOAD_BALANCE_STRATEGY_BY_LOCK)
 		{
 			timeoutMillis = delayMillisRetryAcquireToken_;
 		}
+
+		// buddies may join or retire at runtime, see resetBuddies()
+		functorRunAfterAccept = isSingleWorker() ? nullptr : &loadBalancer;
 		loop_.waitAndProcessEventsAndTimers(timeoutMillis, functorRunAfterAccept);	
+		publishStats();
 	}
 
 	yieldToken();
@@ -113,12 +193,14 @@ void Worker::run()
 
 void Worker::acquireToken()
 {
-	if (isSingleWorker() || heldToken())
+	// a single worker keeps the token once acquired, it may be relayed by a retired buddy
+	if (retiring_ || heldToken())
 	{
 		return;
 	}
 
 	if (LOAD_BALANCE_STRATEGY_BY_LOCK == strategy_ &&
+		!isSingleWorker() &&
 		beforeAcquireTokenHandler_ && 
 		!(beforeAcquireTokenHandler_()))
 	{
@@ -148,7 +230,7 @@ void Worker::acquireTokenByTokenRing()
 
 void Worker::loadBalance()
 {
-	if (!heldToken())
+	if (!heldToken() || isSingleWorker())
 	{
 		return;
 	}
@@ -178,7 +260,7 @@ void Worker::loadBalanceTokenRingByMetricSmaller()
 {
 	for (auto worker : buddies_)
 	{
-		if (worker->getLoadBalanceMetric() < getLoadBalanceMetric())
+		if (getBuddyLoadBalanceMetric(worker) < getLoadBalanceMetric())
 		{	
 			yieldToken();
 			worker->relay();
@@ -191,7 +273,7 @@ void Worker::loadBalanceTokenRingByMetricLarger()
 {
 	for (auto worker : buddies_)
 	{
-		if (worker->getLoadBalanceMetric() > getLoadBalanceMetric())
+		if (getBuddyLoadBalanceMetric(worker) > getLoadBalanceMetric())
 		{
 			yieldToken();
 			worker->relay();
@@ -200,6 +282,92 @@ void Worker::loadBalanceTokenRingByMetricLarger()
 	}
 }
 
+// relays the token to the least loaded buddy if it is clearly less loaded than this worker,
+// otherwise the workers are balanced by the metric(the number of connections for TcpWorker)
+void Worker::loadBalanceTokenRingByUtilization()
+{
+	Worker *target = nullptr;
+	int targetScore = getLoadScore() - kLoadScoreBalancingMargin;
+	for (auto worker : buddies_)
+	{
+		int score = getBuddyLoadScore(worker);
+		if (score < targetScore)
+		{
+			target = worker;
+			targetScore = score;
+		}
+	}
+
+	if (target == nullptr)
+	{
+		loadBalanceTokenRingByMetricSmaller();
+		return;
+	}
+
+	yieldToken();
+	target->relay();
+}
+
+int Worker::getLoadScore() const
+{
+	return computeLoadScore(loop_.utilization(), loop_.queuedBytes(), loop_.pendingFunctors());
+}
+
+int Worker::getUtilization() const
+{
+	int utilization = stats_.utilization.load(std::memory_order_relaxed);
+	int64_t pollingSinceMicros = stats_.pollingSinceMicros.load(std::memory_order_relaxed);
+	if (pollingSinceMicros > 0 && utilization > 0)
+	{
+		utilization = EventLoop::decayUtilization(utilization, TimeUtil::currentMonoTimeMicros() - pollingSinceMicros);
+	}
+
+	return utilization;
+}
+
+int Worker::getBuddyLoadScore(const Worker *buddy)
+{
+	const WorkerStats &stats = buddy->stats_;
+	return computeLoadScore(buddy->getUtilization(),
+		                    stats.queuedBytes.load(std::memory_order_relaxed),
+		                    stats.pendingFunctors.load(std::memory_order_relaxed));
+}
+
+// the utilization dominates, the queued bytes and pending functors show a worker that falls behind
+int Worker::computeLoadScore(int utilization, int64_t queuedBytes, int pendingFunctors)
+{
+	int64_t score = utilization + queuedBytes / kQueuedBytesPerScore + pendingFunctors * kPendingFunctorScore;
+	return score < kMaxLoadScore ? static_cast<int>(score) : kMaxLoadScore;
+}
+
+// only stores the changed values, so the buddies' cached copies stay valid
+void Worker::publishStats()
+{
+	int metric = getLoadBalanceMetric();
+	if (stats_.metric.load(std::memory_order_relaxed) != metric)
+	{
+		stats_.metric.store(metric, std::memory_order_relaxed);
+	}
+
+	int utilization = loop_.utilization();
+	if (stats_.utilization.load(std::memory_order_relaxed) != utilization)
+	{
+		stats_.utilization.store(utilization, std::memory_order_relaxed);
+	}
+
+	int64_t queuedBytes = loop_.queuedBytes();
+	if (stats_.queuedBytes.load(std::memory_order_relaxed) != queuedBytes)
+	{
+		stats_.queuedBytes.store(queuedBytes, std::memory_order_relaxed);
+	}
+
+	int pendingFunctors = loop_.pendingFunctors();
+	if (stats_.pendingFunctors.load(std::memory_order_relaxed) != pendingFunctors)
+	{
+		stats_.pendingFunctors.store(pendingFunctors, std::memory_order_relaxed);
+	}
+}
+
 void Worker::yieldToken()
 {
 	LOG_TRACE("worker[0x%x] yield token", this);
@@ -10,12 +10,31 @@
 #include <functional>
 #include <thread>
 #include <mutex>
+#include <atomic>
 
 #include "EventLoop.h"
 
+#define EASYNET_CACHE_LINE_SIZE   64
+
 namespace easynet
 {
 
+// load of a worker, published by the worker itself after every loop iteration,
+// read by the other workers for load balancing. 
+// padded on both sides so that each worker's stats sit on their own cache lines.
+struct WorkerStats
+{
+	WorkerStats() : metric(0), utilization(0), pollingSinceMicros(0), queuedBytes(0), pendingFunctors(0) {}
+
+	char padBefore[EASYNET_CACHE_LINE_SIZE];
+	std::atomic<int> metric;           // see Worker::setLoadBalanceMetricGetter(), number of connections for TcpWorker
+	std::atomic<int> utilization;      // permille, see EventLoop::utilization(), read it by Worker::getUtilization()
+	std::atomic<int64_t> pollingSinceMicros;  // see EventLoop::enableUtilization(), 0 if the loop isn't waiting
+	std::atomic<int64_t> queuedBytes;  // see EventLoop::queuedBytes()
+	std::atomic<int> pendingFunctors;  // see EventLoop::pendingFunctors()
+	char padAfter[EASYNET_CACHE_LINE_SIZE];
+};
+
 class Worker
 {
 public:
@@ -24,7 +43,8 @@ public:
 		LOAD_BALANCE_STRATEGY_BY_LOCK = 0,
 		LOAD_BALANCE_STRATEGY_ROUND_ROBIN,
 		LOAD_BALANCE_STRATEGY_TOKEN_RING_BY_METRIC_SMALLER,
-		LOAD_BALANCE_STRATEGY_TOKEN_RING_BY_METRIC_LARGER
+		LOAD_BALANCE_STRATEGY_TOKEN_RING_BY_METRIC_LARGER,
+		LOAD_BALANCE_STRATEGY_TOKEN_RING_BY_UTILIZATION   // by the loop utilization, queued bytes and pending functors
 	};
 
 	using AcquireTokenHandler = std::function<bool ()>;
@@ -37,7 +57,9 @@ public:
 		   LoadBalanceStrategy strategy,
 		   std::mutex *lock)
          : quit_(false),
+           started_(false),
            exited_(false),
+           retiring_(false),
            heldToken_(false),
            relayed_(false),
            isHeadWorker_(false),
@@ -45,21 +67,50 @@ public:
            delayMillisRetryAcquireToken_(delayMillisRetryAcquireToken),
            lock_(lock),
            loop_(timeResolutionMillis)
-	{}
+	{
+		if (strategy_ == LOAD_BALANCE_STRATEGY_TOKEN_RING_BY_UTILIZATION)
+		{
+			enableUtilization();
+		}
+	}
 
 	~Worker() = default;
 	Worker(const Worker &rhs) = delete;
 	Worker& operator=(const Worker &rhs) = delete;
 
 	EventLoop* getLoop() { return &loop_; }
-
-	void start() { std::thread(std::bind(&Worker::run, this)).detach(); }
+	const std::vector<int>& getCpus() const { return cpus_; }
+	const WorkerStats& getStats() const { return stats_; } // can be called in other thread
+
+	// the loop measures its utilization, must be called before start() or in the worker's thread. enabled by the utilization
+	// load balance strategy, TcpWorker::enableRebalancing() and WorkerGroup::enableElasticScaling()
+	void enableUtilization() { loop_.enableUtilization(&stats_.pollingSinceMicros); }
+	// the published utilization, decayed by the time the loop has been waiting in epoll_wait() since.
+	// can be called in other thread, 0 if not enabled
+	int getUtilization() const;
+
+	// the worker's thread is bound to @cpus before it runs the loop, must be called before start().
+	// see WorkerGroup for placing the loop's own memory on the cpus' numa node
+	void setCpus(const std::vector<int> &cpus) { cpus_ = cpus; }
+
+	// a retired and exited worker can be started again
+	void start();
 	void quit() { quit_ = true; loop_.wakeup();}
+	bool started() const { return started_; }
 	bool exited() const { return exited_; }
 
 	bool isSingleWorker() const { return buddies_.empty(); }
 	bool heldToken() const { return heldToken_; }
-	void setBuddies(const std::vector<Worker*> &buddies) { buddies_ = buddies; }
+	void setBuddies(const std::vector<Worker*> &buddies) { buddies_ = buddies; } // before the worker starts
+
+	// the workers taking turns on the token(including this one) changed, it must be called in the 
+	// worker's thread. a worker joins the token ring when it is in every buddy's @buddies.
+	void resetBuddies(const std::vector<Worker*> &buddies);
+
+	// the worker leaves the token ring: it gives the token(held or relayed to it) to @buddies, 
+	// and never acquires the token again until it's restarted. it must be called in the worker's thread,
+	// after every worker in @buddies has called resetBuddies() without this one. see WorkerGroup
+	void retire(const std::vector<Worker*> &buddies);
 
     void setBeforeAcquireTokenHandler(AcquireTokenHandler &&handler) 
     { beforeAcquireTokenHandler_ = std::move(handler); }
@@ -86,6 +137,7 @@ private:
 	void run();
 
 	void init();
+	void bindCpus();
 	void rearrangeBuddies();
 	void initLoadBalancer();
 	void initTokenAcquirer();
@@ -102,13 +154,21 @@ private:
 	void loadBalanceRoundRobin();
 	void loadBalanceTokenRingByMetricSmaller();
 	void loadBalanceTokenRingByMetricLarger();
+	void loadBalanceTokenRingByUtilization();
 	int  getLoadBalanceMetric() const { return loadBalanceMetricGetter_ ? loadBalanceMetricGetter_() : 0; }
+	int  getBuddyLoadBalanceMetric(const Worker *buddy) const { return buddy->stats_.metric.load(std::memory_order_relaxed); }
+	int  getLoadScore() const;
+	static int getBuddyLoadScore(const Worker *buddy);
+	static int computeLoadScore(int utilization, int64_t queuedBytes, int pendingFunctors);
+	void publishStats();
 	
 	bool tryLock() { return lock_->try_lock(); }
 	void unLock()  { lock_->unlock(); }
 
 	bool quit_;
-	bool exited_;
+	bool started_;
+	std::atomic<bool> exited_;
+	bool retiring_;
 
 	bool heldToken_;
 	bool relayed_;
@@ -130,6 +190,9 @@ private:
 	Functor tokenYieldedHandler_; // will be called after this worker yieled token
 
 	std::vector<Worker*> buddies_; // other workers
+	std::vector<int> cpus_;        // cpus the worker's thread is bound to, not bound if empty
+
+	WorkerStats stats_;
 };
 
 } // namespace easynet
@@ -3,18 +3,37 @@
 // Author: Shenghua Fang
 
 #include <utility>
+#include <algorithm>
 #include "WorkerGroup.h"
+#include "utils/cpu.h"
+#include "utils/log.h"
 
 using namespace easynet;
 
+namespace
+{
+
+const int kScalerCheckIntervalMillis = 1000;
+const int kScalerSleepMillis         = 100;   // to notice stop() in time
+const int kWaitMillis                = 1;
+
+}
+
 WorkerGroup::WorkerGroup(Worker::LoadBalanceStrategy strategy,
                          int workerNum,
                          int timeResolutionMillis,
-                         int delayMillisRetryAcquireTocken)
+                         int delayMillisRetryAcquireTocken,
+                         const std::vector<std::vector<int>> &cpuSets)
                        : loadBalanceStrategy_(strategy),
                          workerNum_(workerNum),
                          timeResolutionMillis_(timeResolutionMillis),
-                         delayMillisRetryAcquireTocken_(delayMillisRetryAcquireTocken)
+                         delayMillisRetryAcquireTocken_(delayMillisRetryAcquireTocken),
+                         cpuSets_(cpuSets),
+                         maxWorkerNum_(workerNum),
+                         scaleUpPermille_(0),
+                         scaleDownPermille_(0),
+                         scaleSustainedSecs_(0),
+                         scalerQuit_(false)
 {
 	init();
 }
@@ -23,32 +42,75 @@ void WorkerGroup::initWorkers()
 {
 	for (int i = 0; i < workerNum_; i++)
 	{
-		std::unique_ptr<Worker> worker(new Worker(timeResolutionMillis_,
-		                                          delayMillisRetryAcquireTocken_, 
-			                                      loadBalanceStrategy_,
-			                                      &loadBalanceLock_));
-		workers_.push_back(std::move(worker));
+		createWorker(i);
 	}
 
-	std::vector<Worker*> buddies = getWorkers();
+	activeWorkers_ = getAllWorkers();
 	for (auto &worker : workers_)
 	{
-		worker->setBuddies(buddies);
+		worker->setBuddies(activeWorkers_);
 	}
 }
 
-void WorkerGroup::startWorkers()
+void WorkerGroup::createWorker(int index)
 {
+	std::vector<int> cpus;
+	if (index < static_cast<int>(cpuSets_.size()))
+	{
+		cpus = cpuSets_[index];
+	}
+
+	ScopedCpuBinding binding(cpus);
+	std::unique_ptr<Worker> worker(new Worker(timeResolutionMillis_,
+	                                          delayMillisRetryAcquireTocken_,
+		                                      loadBalanceStrategy_,
+		                                      &loadBalanceLock_));
+	worker->setCpus(cpus);
+	workers_.push_back(std::move(worker));
+}
+
+void WorkerGroup::enableElasticScaling(int maxWorkerNum, int scaleUpPermille, int scaleDownPermille, int sustainedSecs)
+{
+	for (int i = static_cast<int>(workers_.size()); i < maxWorkerNum; i++)
+	{
+		createWorker(i);
+	}
+
+	// the scaler reads the workers' utilization, see runScaler()
 	for (auto &worker : workers_)
+	{
+		worker->enableUtilization();
+	}
+
+	maxWorkerNum_ = static_cast<int>(workers_.size());
+	scaleUpPermille_ = scaleUpPermille;
+	scaleDownPermille_ = scaleDownPermille;
+	scaleSustainedSecs_ = sustainedSecs > 0 ? sustainedSecs : 1;
+}
+
+void WorkerGroup::startWorkers()
+{
+	for (auto worker : getWorkers())
 	{
 		worker->start();
 	}
+
+	if (maxWorkerNum_ > workerNum_ && !scaler_.joinable())
+	{
+		scalerQuit_ = false;
+		scaler_ = std::thread(std::bind(&WorkerGroup::runScaler, this));
+	}
 }
 
 void WorkerGroup::stopWorkers()
 {
 	for (auto &worker : workers_)
 	{
+		if (!worker->started())
+		{
+			continue;
+		}
+
 		worker->quit();
 		while (!(worker->exited()))
 		{
@@ -59,6 +121,12 @@ void WorkerGroup::stopWorkers()
 }
 
 std::vector<Worker*> WorkerGroup::getWorkers() const
+{
+	std::lock_guard<std::mutex> lock(activeWorkersLock_);
+	return activeWorkers_;
+}
+
+std::vector<Worker*> WorkerGroup::getAllWorkers() const
 {
 	std::vector<Worker*> v;
 	for (auto &worker : workers_)
@@ -68,3 +136,193 @@ std::vector<Worker*> WorkerGroup::getWorkers() const
 
 	return std::move(v);
 }
+
+// resets the buddies of @activeWorkers except @joined(it got them before starting) in their threads.
+// when @acks is given, it's increased by every worker after the functors queued in its loop 
+// before the reset have run, such as the connection migrations decided with the old buddies.
+void WorkerGroup::notifyWorkersChanged(const std::vector<Worker*> &activeWorkers, const Worker *joined, std::atomic<int> *acks)
+{
+	for (auto worker : activeWorkers)
+	{
+		if (worker == joined)
+		{
+			continue;
+		}
+
+		EventLoop *loop = worker->getLoop();
+		loop->wakeupAndRun([this, worker, loop, activeWorkers, acks]{
+			worker->resetBuddies(activeWorkers);
+			if (workersChangedHandler_)
+			{
+				workersChangedHandler_(worker, activeWorkers);
+			}
+
+			if (acks)
+			{
+				loop->wakeupAndRun([acks]{ (*acks)++; });
+			}
+		});
+	}
+}
+
+bool WorkerGroup::addWorker()
+{
+	std::lock_guard<std::mutex> guard(scalingLock_);
+
+	Worker *standby = nullptr;
+	for (auto &worker : workers_)
+	{
+		if (!worker->started() || worker->exited())
+		{
+			standby = worker.get();
+			break;
+		}
+	}
+
+	if (standby == nullptr)
+	{
+		return false;
+	}
+
+	std::vector<Worker*> activeWorkers = getWorkers();
+	activeWorkers.push_back(standby);   // not the head of the token ring, it waits for the token
+
+	standby->setBuddies(activeWorkers);
+	if (workersChangedHandler_)
+	{
+		workersChangedHandler_(standby, activeWorkers);
+	}
+	standby->start();
+
+	{
+		std::lock_guard<std::mutex> lock(activeWorkersLock_);
+		activeWorkers_ = activeWorkers;
+	}
+	notifyWorkersChanged(activeWorkers, standby, nullptr);
+
+	LOG_INFO("worker group added worker[0x%x], %u workers active", standby, activeWorkers.size());
+	return true;
+}
+
+bool WorkerGroup::retireWorker(Worker *worker)
+{
+	std::lock_guard<std::mutex> guard(scalingLock_);
+
+	std::vector<Worker*> activeWorkers;
+	{
+		std::lock_guard<std::mutex> lock(activeWorkersLock_);
+		auto it = std::find(activeWorkers_.begin(), activeWorkers_.end(), worker);
+		if (it == activeWorkers_.end() || activeWorkers_.size() <= 1)
+		{
+			return false;
+		}
+
+		activeWorkers_.erase(it);
+		activeWorkers = activeWorkers_;
+	}
+
+	// 1. after this, no one relays the token to @worker or hands connections over to it
+	std::atomic<int> acks(0);
+	notifyWorkersChanged(activeWorkers, nullptr, &acks);
+	while (acks.load() < static_cast<int>(activeWorkers.size()))
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(kWaitMillis));
+	}
+
+	// 2. gives up the token and moves the work away
+	std::atomic<bool> retired(false);
+	worker->getLoop()->wakeupAndRun([this, worker, activeWorkers, &retired]{
+		worker->retire(activeWorkers);
+
+		Functor onRetired([&retired]{ retired = true; });
+		if (workerRetiringHandler_)
+		{
+			workerRetiringHandler_(worker, activeWorkers, onRetired);
+		}
+		else
+		{
+			onRetired();
+		}
+	});
+
+	while (!retired.load())
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(kWaitMillis));
+	}
+
+	// 3.
+	worker->quit();
+	while (!(worker->exited()))
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(kWaitMillis));
+	}
+
+	LOG_INFO("worker group retired worker[0x%x], %u workers active", worker, activeWorkers.size());
+	return true;
+}
+
+Worker* WorkerGroup::getLeastLoadedWorker(const std::vector<Worker*> &workers) const
+{
+	Worker *leastLoaded = nullptr;
+	int leastMetric = 0;
+	for (auto worker : workers)
+	{
+		int metric = worker->getStats().metric.load(std::memory_order_relaxed);
+		if (leastLoaded == nullptr || metric < leastMetric)
+		{
+			leastLoaded = worker;
+			leastMetric = metric;
+		}
+	}
+
+	return leastLoaded;
+}
+
+void WorkerGroup::runScaler()
+{
+	int roundsAbove = 0;
+	int roundsBelow = 0;
+	int sustainedRounds = scaleSustainedSecs_ * 1000 / kScalerCheckIntervalMillis;
+
+	while (!scalerQuit_)
+	{
+		for (int i = 0; i < kScalerCheckIntervalMillis / kScalerSleepMillis && !scalerQuit_; i++)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(kScalerSleepMillis));
+		}
+
+		std::vector<Worker*> workers = getWorkers();
+		int num = static_cast<int>(workers.size());
+		int64_t total = 0;
+		for (auto worker : workers)
+		{
+			total += worker->getUtilization();
+		}
+
+		int average = static_cast<int>(total / num);
+		roundsAbove = (average > scaleUpPermille_ && num < maxWorkerNum_) ? roundsAbove + 1 : 0;
+		// the remaining workers should not exceed @scaleUpPermille_ after one retired
+		roundsBelow = (average < scaleDownPermille_ && num > workerNum_ && total / (num - 1) < scaleUpPermille_) ?
+		              roundsBelow + 1 : 0;
+
+		if (roundsAbove >= sustainedRounds)
+		{
+			roundsAbove = 0;
+			addWorker();
+		}
+		else if (roundsBelow >= sustainedRounds)
+		{
+			roundsBelow = 0;
+			retireWorker(getLeastLoadedWorker(workers));
+		}
+	}
+}
+
+void WorkerGroup::stopScaler()
+{
+	if (scaler_.joinable())
+	{
+		scalerQuit_ = true;
+		scaler_.join();
+	}
+}
@@ -9,44 +9,107 @@
 #include <memory>
 #include <atomic>
 #include <mutex>
+#include <thread>
+#include <functional>
 
 #include "Worker.h"
 
 namespace easynet
 {
 
+// with elastic scaling enabled, the group keeps up to @maxWorkerNum workers, the ones beyond the
+// active workers are created but not started. a worker is added when the average utilization of
+// the active workers stays above @scaleUpPermille, and the least loaded one is retired when it stays
+// below @scaleDownPermille, but never below the initial @workerNum workers.
+//
+// a worker joins by being started after its buddies, then the others reset their buddies in their 
+// own threads to relay the token to it. a worker retires in three steps:
+// 1. it's removed from the buddies of the others, in their threads, so no one relays the token to it,
+// 2. it hands the token, held or being relayed to it, over to the others, then the retiring handler
+//    moves its work away(TcpServer migrates its connections) and tells when done,
+// 3. its thread quits. it stays in the group, and may be started again later.
+// so there is only one token in the ring at any time.
 class WorkerGroup
 {
 public:
+	using Functor = Worker::Functor;
+	// called in @worker's thread, or before it starts, when the active workers changed
+	using WorkersChangedHandler = std::function<void (Worker *worker, const std::vector<Worker*> &activeWorkers)>;
+	// called in @worker's thread after it left the token ring, @retired must be called(in any thread) when
+	// the worker has nothing left to do
+	using WorkerRetiringHandler = std::function<void (Worker *worker, const std::vector<Worker*> &activeWorkers, 
+		                                              const Functor &retired)>;
+
 	WorkerGroup()
 	     : WorkerGroup(Worker::LOAD_BALANCE_STRATEGY_ROUND_ROBIN, 1, 0, 0)
 	{}
 
+	// the i-th worker is bound to @cpuSets[i], see Worker::setCpus(). 
+	// it is constructed with the calling thread bound to the same cpus, 
+	// so the memory of its loop is first touched on their numa node.
 	WorkerGroup(Worker::LoadBalanceStrategy strategy,
                 int workerNum,
                 int timeResolutionMillis,
-                int delayMillisRetryAcquireTocken);
+                int delayMillisRetryAcquireTocken,
+                const std::vector<std::vector<int>> &cpuSets = std::vector<std::vector<int>>());
 	~WorkerGroup() { stop(); }
 	WorkerGroup(const WorkerGroup &rhs) = delete;
 	WorkerGroup& operator=(const WorkerGroup &rhs) = delete;
 
+	// must be called before start(), creates the standby workers at once
+	void enableElasticScaling(int maxWorkerNum, int scaleUpPermille, int scaleDownPermille, int sustainedSecs);
+
+	void setWorkersChangedHandler(WorkersChangedHandler &&handler) { workersChangedHandler_ = std::move(handler); }
+	void setWorkersChangedHandler(const WorkersChangedHandler &handler) 
+	{ setWorkersChangedHandler(WorkersChangedHandler(handler)); }
+
+	void setWorkerRetiringHandler(WorkerRetiringHandler &&handler) { workerRetiringHandler_ = std::move(handler); }
+	void setWorkerRetiringHandler(const WorkerRetiringHandler &handler) 
+	{ setWorkerRetiringHandler(WorkerRetiringHandler(handler)); }
+
 	void start() { startWorkers(); }
-	void stop()  { stopWorkers(); }
+	void stop()  { stopScaler(); stopWorkers(); }
 
-	std::vector<Worker*> getWorkers() const;
+	std::vector<Worker*> getWorkers() const;    // the active workers, can be called in any thread
+	std::vector<Worker*> getAllWorkers() const; // including the standby ones
+
+	// can be called in any thread except the workers', the calls are serialized.
+	// addWorker() starts a standby worker, retireWorker() returns after @worker's thread exited.
+	bool addWorker();
+	bool retireWorker(Worker *worker);
 
 private:
 	void init() { initWorkers(); }
 	void initWorkers();
+	void createWorker(int index);
 	void startWorkers();
 	void stopWorkers();
+	void notifyWorkersChanged(const std::vector<Worker*> &activeWorkers, const Worker *joined, std::atomic<int> *acks);
+	void runScaler();
+	void stopScaler();
+	Worker* getLeastLoadedWorker(const std::vector<Worker*> &workers) const;
 
 	Worker::LoadBalanceStrategy loadBalanceStrategy_;
 	int workerNum_;
 	int timeResolutionMillis_;
 	int delayMillisRetryAcquireTocken_;
+	std::vector<std::vector<int>> cpuSets_;
     std::mutex loadBalanceLock_;
-	std::vector<std::unique_ptr<Worker>> workers_;
+	std::vector<std::unique_ptr<Worker>> workers_;  // created before start(), never changed after that
+
+	mutable std::mutex activeWorkersLock_;
+	std::vector<Worker*> activeWorkers_;
+	std::mutex scalingLock_;                        // serializes addWorker() and retireWorker()
+
+	int maxWorkerNum_;
+	int scaleUpPermille_;
+	int scaleDownPermille_;
+	int scaleSustainedSecs_;
+	std::atomic<bool> scalerQuit_;
+	std::thread scaler_;
+
+	WorkersChangedHandler workersChangedHandler_;
+	WorkerRetiringHandler workerRetiringHandler_;
 };
 
 }
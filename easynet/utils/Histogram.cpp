@@ -0,0 +1,122 @@
+// Copyright 2017, Shenghua Fang. All rights reserved.
+// Use of this source code is governed by a BSD 2-Clause license that can be found in the License file.
+// Author: Shenghua Fang
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include "Histogram.h"
+
+using namespace easynet;
+
+const int HistogramSnapshot::kSubBucketBits;
+const int HistogramSnapshot::kSubBuckets;
+const int HistogramSnapshot::kNumBuckets;
+
+void HistogramSnapshot::clear()
+{
+	count = 0;
+	sum = 0;
+	max = 0;
+	::memset(buckets, 0, sizeof(buckets));
+}
+
+void HistogramSnapshot::merge(const HistogramSnapshot &rhs)
+{
+	count += rhs.count;
+	sum += rhs.sum;
+	max = std::max(max, rhs.max);
+	for (int i = 0; i < kNumBuckets; i++)
+	{
+		buckets[i] += rhs.buckets[i];
+	}
+}
+
+uint64_t HistogramSnapshot::bucketLowerBound(int bucket)
+{
+	if (bucket < kSubBuckets)
+	{
+		return static_cast<uint64_t>(bucket);
+	}
+
+	int shift = (bucket >> kSubBucketBits) - 1;
+	return static_cast<uint64_t>(kSubBuckets + (bucket & (kSubBuckets - 1))) << shift;
+}
+
+uint64_t HistogramSnapshot::bucketUpperBound(int bucket)
+{
+	if (bucket < kSubBuckets)
+	{
+		return static_cast<uint64_t>(bucket);
+	}
+
+	int shift = (bucket >> kSubBucketBits) - 1;
+	return bucketLowerBound(bucket) + ((static_cast<uint64_t>(1) << shift) - 1);
+}
+
+// counts by the buckets rather than @count, which may be off by a few in a snapshot
+uint64_t HistogramSnapshot::percentile(double percentile) const
+{
+	uint64_t total = 0;
+	for (int i = 0; i < kNumBuckets; i++)
+	{
+		total += buckets[i];
+	}
+
+	if (total == 0)
+	{
+		return 0;
+	}
+
+	uint64_t rank = static_cast<uint64_t>(std::ceil(total * std::min(std::max(percentile, 0.0), 100.0) / 100.0));
+	rank = std::max(rank, static_cast<uint64_t>(1));
+
+	uint64_t seen = 0;
+	for (int i = 0; i < kNumBuckets; i++)
+	{
+		seen += buckets[i];
+		if (seen >= rank)
+		{
+			return std::min(bucketUpperBound(i), max);
+		}
+	}
+
+	return max;
+}
+
+std::string HistogramSnapshot::toString() const
+{
+	char buf[256];
+	::snprintf(buf, sizeof(buf), "count:%llu mean:%.1f p50:%llu p90:%llu p99:%llu p999:%llu max:%llu",
+		static_cast<unsigned long long>(count), mean(),
+		static_cast<unsigned long long>(percentile(50)),
+		static_cast<unsigned long long>(percentile(90)),
+		static_cast<unsigned long long>(percentile(99)),
+		static_cast<unsigned long long>(percentile(99.9)),
+		static_cast<unsigned long long>(max));
+	return buf;
+}
+
+void Histogram::snapshot(HistogramSnapshot *snapshot) const
+{
+	snapshot->count = count_.load(std::memory_order_relaxed);
+	snapshot->sum = sum_.load(std::memory_order_relaxed);
+	snapshot->max = max_.load(std::memory_order_relaxed);
+	for (int i = 0; i < HistogramSnapshot::kNumBuckets; i++)
+	{
+		snapshot->buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+	}
+}
+
+void Histogram::clear()
+{
+	count_.store(0, std::memory_order_relaxed);
+	sum_.store(0, std::memory_order_relaxed);
+	max_.store(0, std::memory_order_relaxed);
+	for (auto &bucket : buckets_)
+	{
+		bucket.store(0, std::memory_order_relaxed);
+	}
+}
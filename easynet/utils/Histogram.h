@@ -0,0 +1,92 @@
+// Copyright 2017, Shenghua Fang. All rights reserved.
+// Use of this source code is governed by a BSD 2-Clause license that can be found in the License file.
+// Author: Shenghua Fang
+
+#ifndef _EASYNET_HISTOGRAM_H_
+#define _EASYNET_HISTOGRAM_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+namespace easynet
+{
+
+// a copy of a Histogram's counters, see Histogram
+struct HistogramSnapshot
+{
+	static const int kSubBucketBits = 3;
+	static const int kSubBuckets    = 1 << kSubBucketBits;
+	static const int kNumBuckets    = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+	HistogramSnapshot() { clear(); }
+
+	void clear();
+	void merge(const HistogramSnapshot &rhs);
+
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+	uint64_t buckets[kNumBuckets];
+
+	double mean() const { return count > 0 ? static_cast<double>(sum) / count : 0.0; }
+	// the upper bound of the bucket holding the @percentile(0~100)th value, at most @max
+	uint64_t percentile(double percentile) const;
+	std::string toString() const;  // such as "count:100 mean:12.3 p50:11 p90:15 p99:23 p999:31 max:31"
+
+	static int bucketOf(uint64_t value)
+	{
+		if (value < static_cast<uint64_t>(kSubBuckets))
+		{
+			return static_cast<int>(value);
+		}
+
+		int shift = 63 - __builtin_clzll(value) - kSubBucketBits;
+		return ((shift + 1) << kSubBucketBits) + static_cast<int>((value >> shift) & (kSubBuckets - 1));
+	}
+	static uint64_t bucketLowerBound(int bucket);
+	static uint64_t bucketUpperBound(int bucket);
+};
+
+// a log-linear histogram: the values below 8 are counted exactly, the larger ones by power of 2,
+// each power split into 8 linear buckets, so a value is known within 12.5% with 496 buckets for
+// the whole uint64_t range. record() is a handful of instructions and never allocates.
+//
+// it has a single writer, which updates the counters with relaxed loads and stores instead of
+// locked instructions. other threads can take a snapshot() at any time, it may be a few records
+// behind, and @count may disagree slightly with the buckets.
+class Histogram
+{
+public:
+	Histogram() { clear(); }
+
+	Histogram(const Histogram &rhs) = delete;
+	Histogram& operator=(const Histogram &rhs) = delete;
+
+	void record(uint64_t value)
+	{
+		increase(buckets_[HistogramSnapshot::bucketOf(value)], 1);
+		increase(count_, 1);
+		increase(sum_, value);
+		if (value > max_.load(std::memory_order_relaxed))
+		{
+			max_.store(value, std::memory_order_relaxed);
+		}
+	}
+
+	void snapshot(HistogramSnapshot *snapshot) const;
+	void clear();  // by the writer
+
+private:
+	static void increase(std::atomic<uint64_t> &counter, uint64_t n)
+	{ counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+
+	std::atomic<uint64_t> count_;
+	std::atomic<uint64_t> sum_;
+	std::atomic<uint64_t> max_;
+	std::atomic<uint64_t> buckets_[HistogramSnapshot::kNumBuckets];
+};
+
+}
+
+#endif
@@ -10,6 +10,7 @@
 #include <utility>
 #include <chrono>
 #include <ctime>
+#include <time.h>
 
 namespace easynet
 {
@@ -19,8 +20,25 @@ class TimeUtil
 public:
 	// using c++11 chrono instead of gettimeofday()
 
-    static int64_t now() { return currentSystemTimeMillis(); }
-   // static int64_t now() { return currentMonoTimeMillis(); }
+    // monotonic time in milliseconds, NOT since 1970-1-1 00:00:00.
+    // it is not affected by NTP steps or manual clock changes, use toSystemTimeMillis()
+    // to convert it to wall-clock time
+    static int64_t now() { return currentMonoCoarseTimeMillis(); }
+
+    // reads CLOCK_MONOTONIC_COARSE if its resolution is 1 ms or better, otherwise CLOCK_MONOTONIC
+    static int64_t currentMonoCoarseTimeMillis()
+    {
+        static const clockid_t clockId = getMonoCoarseClockId();
+        struct timespec ts;
+        ::clock_gettime(clockId, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+    }
+
+    // converts a time returned by now() to milliseconds since 1970-1-1 00:00:00
+    static int64_t toSystemTimeMillis(int64_t monoMillis)
+    {
+        return monoMillis + currentSystemTimeMillis() - currentMonoCoarseTimeMillis();
+    }
 
     static int64_t currentSystemTimeMillis()
     {
@@ -46,6 +64,24 @@ public:
         return std::chrono::duration_cast<std::chrono::microseconds>(p.time_since_epoch()).count(); 
     }
 
+    static int64_t currentMonoTimeNanos()
+    {
+        std::chrono::time_point<std::chrono::steady_clock> p = std::chrono::steady_clock::now();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(p.time_since_epoch()).count(); 
+    }
+
+    static clockid_t getMonoCoarseClockId()
+    {
+#ifdef CLOCK_MONOTONIC_COARSE
+        struct timespec res;
+        if (::clock_getres(CLOCK_MONOTONIC_COARSE, &res) == 0 && res.tv_sec == 0 && res.tv_nsec <= 1000000)
+        {
+            return CLOCK_MONOTONIC_COARSE;
+        }
+#endif
+        return CLOCK_MONOTONIC;
+    }
+
     static void getCurrentSystemTime(char *buf, size_t len)
     {
         std::time_t tt = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
@@ -0,0 +1,221 @@
+// Copyright 2017, Shenghua Fang. All rights reserved.
+// Use of this source code is governed by a BSD 2-Clause license that can be found in the License file.
+// Author: Shenghua Fang
+
+#include <sched.h>
+#include <pthread.h>
+#include <dirent.h>
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <map>
+#include <tuple>
+
+#include "cpu.h"
+#include "log.h"
+
+namespace easynet
+{
+
+namespace
+{
+
+const char *kSysCpuDir = "/sys/devices/system/cpu";
+
+int readIntFromFile(const std::string &path, int defaultValue)
+{
+	FILE *fp = ::fopen(path.c_str(), "r");
+	if (fp == nullptr)
+	{
+		return defaultValue;
+	}
+
+	int value = defaultValue;
+	if (::fscanf(fp, "%d", &value) != 1)
+	{
+		value = defaultValue;
+	}
+	::fclose(fp);
+
+	return value;
+}
+
+std::string cpuDir(int cpu)
+{
+	return std::string(kSysCpuDir) + "/cpu" + std::to_string(cpu);
+}
+
+}
+
+int getThreadCpus(std::vector<int> &cpus)
+{
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+
+	int ret = ::pthread_getaffinity_np(::pthread_self(), sizeof(cpuSet), &cpuSet);
+	if (ret != 0)
+	{
+		LOG_ERROR("pthread_getaffinity_np error, errno:%d %s", ret, ::strerror(ret));
+		return -1;
+	}
+
+	cpus.clear();
+	for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+	{
+		if (CPU_ISSET(cpu, &cpuSet))
+		{
+			cpus.push_back(cpu);
+		}
+	}
+
+	return 0;
+}
+
+int setThreadCpus(const std::vector<int> &cpus)
+{
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	for (auto cpu : cpus)
+	{
+		if (cpu < 0 || cpu >= CPU_SETSIZE)
+		{
+			LOG_ERROR("invalid cpu:%d", cpu);
+			return -1;
+		}
+		CPU_SET(cpu, &cpuSet);
+	}
+
+	int ret = ::pthread_setaffinity_np(::pthread_self(), sizeof(cpuSet), &cpuSet);
+	if (ret != 0)
+	{
+		LOG_ERROR("pthread_setaffinity_np to cpus:%s error, errno:%d %s", cpusToString(cpus).c_str(), ret, ::strerror(ret));
+		return -1;
+	}
+
+	return 0;
+}
+
+int getCpuNumaNode(int cpu)
+{
+	// the cpu's directory has a link named nodeN to its numa node
+	DIR *dir = ::opendir(cpuDir(cpu).c_str());
+	if (dir == nullptr)
+	{
+		return 0;
+	}
+
+	int node = 0;
+	struct dirent *entry = nullptr;
+	while ((entry = ::readdir(dir)) != nullptr)
+	{
+		if (::strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9')
+		{
+			node = ::atoi(entry->d_name + 4);
+			break;
+		}
+	}
+	::closedir(dir);
+
+	return node;
+}
+
+std::vector<int> getCpusSpreadOverCores(int num)
+{
+	std::vector<int> result;
+	std::vector<int> allowed;
+	if (num <= 0 || getThreadCpus(allowed) != 0 || allowed.empty())
+	{
+		return result;
+	}
+
+	// key: (numa node, package, core), value: the core's hyper-threads
+	using CoreKey = std::tuple<int, int, int>;
+	std::map<CoreKey, std::vector<int>> cores;
+	for (auto cpu : allowed)
+	{
+		std::string topology = cpuDir(cpu) + "/topology/";
+		int package = readIntFromFile(topology + "physical_package_id", 0);
+		int core = readIntFromFile(topology + "core_id", cpu);
+		cores[CoreKey(getCpuNumaNode(cpu), package, core)].push_back(cpu);
+	}
+
+	// key: numa node, value: the node's cores
+	std::map<int, std::vector<const std::vector<int>*>> nodes;
+	size_t maxThreadsPerCore = 0;
+	for (auto &core : cores)
+	{
+		nodes[std::get<0>(core.first)].push_back(&core.second);
+		if (core.second.size() > maxThreadsPerCore)
+		{
+			maxThreadsPerCore = core.second.size();
+		}
+	}
+
+	// the i-th hyper-thread of all cores, taking the numa nodes in turn
+	std::vector<int> order;
+	for (size_t thread = 0; thread < maxThreadsPerCore; thread++)
+	{
+		bool more = true;
+		for (size_t i = 0; more; i++)
+		{
+			more = false;
+			for (auto &node : nodes)
+			{
+				if (i >= node.second.size())
+				{
+					continue;
+				}
+
+				more = true;
+				const std::vector<int> &threads = *(node.second[i]);
+				if (thread < threads.size())
+				{
+					order.push_back(threads[thread]);
+				}
+			}
+		}
+	}
+
+	for (int i = 0; i < num; i++)
+	{
+		result.push_back(order[i % order.size()]);
+	}
+
+	return result;
+}
+
+std::string cpusToString(const std::vector<int> &cpus)
+{
+	std::string s;
+	for (auto cpu : cpus)
+	{
+		if (!s.empty())
+		{
+			s += ",";
+		}
+		s += std::to_string(cpu);
+	}
+
+	return s;
+}
+
+ScopedCpuBinding::ScopedCpuBinding(const std::vector<int> &cpus)
+	                 : bound_(false)
+{
+	if (!cpus.empty() && getThreadCpus(savedCpus_) == 0)
+	{
+		bound_ = (setThreadCpus(cpus) == 0);
+	}
+}
+
+ScopedCpuBinding::~ScopedCpuBinding()
+{
+	if (bound_)
+	{
+		setThreadCpus(savedCpus_);
+	}
+}
+
+}
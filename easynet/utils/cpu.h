@@ -0,0 +1,47 @@
+// Copyright 2017, Shenghua Fang. All rights reserved.
+// Use of this source code is governed by a BSD 2-Clause license that can be found in the License file.
+// Author: Shenghua Fang
+
+#ifndef _EASYNET_CPU_H_
+#define _EASYNET_CPU_H_
+
+#include <vector>
+#include <string>
+
+namespace easynet
+{
+
+// cpu affinity of the calling thread
+int getThreadCpus(std::vector<int> &cpus);
+int setThreadCpus(const std::vector<int> &cpus);
+
+// numa node of @cpu read from sysfs, 0 if the kernel doesn't report it
+int getCpuNumaNode(int cpu);
+
+// @num cpus the process is allowed to run on, one per physical core and taking the numa nodes
+// in turn, the hyper-threads of the cores are used only after every core got one.
+// cpus are reused from the beginning if @num is larger than the number of cpus.
+std::vector<int> getCpusSpreadOverCores(int num);
+
+std::string cpusToString(const std::vector<int> &cpus);  // such as "0,2,4"
+
+// binds the calling thread to @cpus in its scope, and restores the previous affinity when leaving.
+// memory first touched in the scope is allocated on the numa node of @cpus by the kernel,
+// does nothing if @cpus is empty.
+class ScopedCpuBinding
+{
+public:
+	explicit ScopedCpuBinding(const std::vector<int> &cpus);
+	~ScopedCpuBinding();
+
+	ScopedCpuBinding(const ScopedCpuBinding &rhs) = delete;
+	ScopedCpuBinding& operator=(const ScopedCpuBinding &rhs) = delete;
+
+private:
+	bool bound_;
+	std::vector<int> savedCpus_;
+};
+
+} // namespace easynet
+
+#endif
@@ -7,6 +7,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/syscall.h>
+#include <sys/uio.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <fcntl.h>
 #include <time.h>
@@ -17,6 +19,9 @@
 #include <iostream>
 #include <sstream>
 #include <thread>
+#include <chrono>
+#include <algorithm>
+#include <functional>
 
 #include "TimeUtil.h"
 
@@ -27,6 +32,115 @@ namespace
 
 const long kRotateIntervalDefault = 24 * 60 * 60;
 
+const size_t kMaxMessageLen = 4000;             // the whole line is at most 4KB in the sync mode
+const size_t kMinRingBytes  = 16 * 1024;        // holds a few records of the longest message
+const int kMaxBatchRecords  = 256;              // 3 iovecs for each, below IOV_MAX
+const size_t kMaxHeaderLen  = 512;
+const int kAsyncFlushIntervalMillis = 10;       // the background thread sleeps at most this long with records pending
+const int32_t kPaddingRecord = -1;
+
+// the fixed part of a record in a ring, followed by the message, the size is aligned to 8 bytes
+struct AsyncLogRecord
+{
+    uint32_t size;       // with the message and the padding
+    int32_t level;       // kPaddingRecord: skips to the beginning of the ring
+    int64_t timeMicros;  // wall clock
+    unsigned long tid;   // what std::thread::id prints
+    const char *file;    // __FILE__ and __func__, never freed
+    const char *func;
+    int32_t line;
+    uint32_t msgLen;
+};
+
+size_t alignRecordSize(size_t size)
+{
+    return (size + 7) & ~static_cast<size_t>(7);
+}
+
+}
+
+namespace easynet
+{
+
+// single producer(the owner thread), single consumer(the thread holding Logger::drainMutex_)
+class AsyncLogRing
+{
+public:
+    explicit AsyncLogRing(size_t capacity) 
+                    : buffer_(capacity), 
+                      mask_(capacity - 1),
+                      owned_(true),
+                      head_(0), 
+                      tail_(0)
+    {}
+
+    size_t capacity() const { return buffer_.size(); }
+    char* at(uint64_t pos) { return &buffer_[pos & mask_]; }
+
+    std::vector<char> buffer_;
+    size_t mask_;
+    std::atomic<bool> owned_;  // false after the owner thread exits, then it's taken by a new thread
+    char pad0_[64];
+    std::atomic<uint64_t> head_;  // advanced by the consumer
+    char pad1_[64];
+    std::atomic<uint64_t> tail_;  // advanced by the producer
+    char pad2_[64];
+};
+
+}
+
+namespace
+{
+
+struct ThreadRingHolder
+{
+    AsyncLogRing *ring = nullptr;
+    ~ThreadRingHolder() 
+    { 
+        if (ring) 
+        {
+            ring->owned_.store(false, std::memory_order_release);
+        } 
+    }
+};
+
+thread_local ThreadRingHolder tRingHolder;
+
+// "YYYY-MM-DD HH:MM:SS" of the last second formatted by the thread, localtime_r() once a second
+struct DateTimeCache
+{
+    time_t second = -1;
+    char text[64];
+
+    const char* format(time_t seconds)
+    {
+        if (seconds != second)
+        {
+            struct tm t;
+            localtime_r(&seconds, &t);
+            snprintf(text, sizeof(text), "%04d-%02d-%02d %02d:%02d:%02d",
+                t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec);
+            second = seconds;
+        }
+        return text;
+    }
+};
+
+thread_local DateTimeCache tDateTimeCache;
+
+// what std::thread::id prints, formatted once for each thread
+const char* threadIdString()
+{
+    static thread_local std::string tid;
+    if (tid.empty())
+    {
+        std::stringstream ss;
+        ss << std::this_thread::get_id();
+        tid = ss.str();
+    }
+    return tid.c_str();
+}
+
 }
 
 const char* Logger::logLevelStrings[LOG_LEVEL_FATAL + 1] = {
@@ -43,11 +157,25 @@ Logger::Logger()
               fd_(-1),
               realRotate_(time(nullptr)),
               lastRotate_(realRotate_),
-              rotateInterval_(kRotateIntervalDefault)
+              rotateInterval_(kRotateIntervalDefault),
+              async_(false),
+              ringBytesPerThread_(0),
+              overflowPolicy_(ASYNC_OVERFLOW_DROP),
+              droppedRecords_(0),
+              reportedDroppedRecords_(0),
+              stopping_(false)
 {}
 
 Logger::~Logger() 
 {
+    disableAsync();
+
+    // the threads still running at exit may touch their rings
+    for (auto &ring : rings_)
+    {
+        ring.release();
+    }
+
     if (fd_ != -1) 
     {
         ::close(fd_);
@@ -131,15 +259,17 @@ void Logger::rotateLogFile()
 
 void Logger::log(int level, const char* file, int line, const char* func, const char* fmt ...)
 {
-    static thread_local std::thread::id threadIdNone = std::thread::id();
-    static thread_local std::thread::id tid = threadIdNone;
-    if (tid == threadIdNone) 
+    if (level < logLevel_) 
     {
-        tid = std::this_thread::get_id();;
+        return;
     }
 
-    if (level < logLevel_) 
+    if (async_)
     {
+        va_list args;
+        va_start(args, fmt);
+        logAsync(level, file, line, func, fmt, args);
+        va_end(args);
         return;
     }
 
@@ -151,21 +281,11 @@ void Logger::log(int level, const char* file, int line, const char* func, const
 
     struct timeval now_tv;
     gettimeofday(&now_tv, NULL);
-    const time_t seconds = now_tv.tv_sec;
-    struct tm t;
-    localtime_r(&seconds, &t);
-    std::stringstream ss;
-    ss << tid;
     p += snprintf(p, limit - p,
-        "%04d-%02d-%02d %02d:%02d:%02d %06d %s %s %s:%d [%s]",
-        t.tm_year + 1900,
-        t.tm_mon + 1,
-        t.tm_mday,
-        t.tm_hour,
-        t.tm_min,
-        t.tm_sec,
+        "%s %06d %s %s %s:%d [%s]",
+        tDateTimeCache.format(now_tv.tv_sec),
         static_cast<int>(now_tv.tv_usec),
-        ss.str().c_str(),
+        threadIdString(),
         logLevelStrings[level],
         file,
         line,
@@ -187,3 +307,294 @@ void Logger::log(int level, const char* file, int line, const char* func, const
     }
 }
 
+
+void Logger::enableAsync(size_t ringBytesPerThread, AsyncOverflowPolicy policy)
+{
+    if (async_)
+    {
+        return;
+    }
+
+    size_t capacity = kMinRingBytes;
+    while (capacity < ringBytesPerThread)
+    {
+        capacity *= 2;
+    }
+    ringBytesPerThread_ = capacity;
+    overflowPolicy_ = policy;
+
+    static std::once_flag atforkFlag;
+    std::call_once(atforkFlag, []{
+        ::pthread_atfork(nullptr, nullptr, &Logger::onForkChild);
+    });
+
+    {
+        std::lock_guard<std::mutex> lock(wakeupMutex_);
+        stopping_ = false;
+    }
+    writerThread_.reset(new std::thread(std::bind(&Logger::runAsyncWriter, this)));
+    async_ = true;
+}
+
+// the records of the parent left in the rings are dropped
+void Logger::onForkChild()
+{
+    Logger &logger = getInstance();
+    if (logger.async_)
+    {
+        logger.async_ = false;
+        logger.writerThread_.release();
+    }
+}
+
+// the records logged by other threads at the same time may be left in their rings
+void Logger::disableAsync()
+{
+    if (!async_)
+    {
+        return;
+    }
+
+    async_ = false;
+    {
+        std::lock_guard<std::mutex> lock(wakeupMutex_);
+        stopping_ = true;
+    }
+    wakeupCond_.notify_one();
+    writerThread_->join();
+    writerThread_.reset();
+}
+
+void Logger::flush()
+{
+    if (async_)
+    {
+        drainRings();
+    }
+}
+
+AsyncLogRing* Logger::getThreadRing()
+{
+    if (tRingHolder.ring == nullptr || tRingHolder.ring->capacity() < ringBytesPerThread_)
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex_);
+        if (tRingHolder.ring)
+        {
+            tRingHolder.ring->owned_.store(false, std::memory_order_release);
+        }
+
+        AsyncLogRing *found = nullptr;
+        for (auto &ring : rings_)
+        {
+            if (!ring->owned_.load(std::memory_order_acquire) && ring->capacity() >= ringBytesPerThread_)
+            {
+                ring->owned_ = true;
+                found = ring.get();
+                break;
+            }
+        }
+
+        if (found == nullptr)
+        {
+            rings_.emplace_back(new AsyncLogRing(ringBytesPerThread_));
+            found = rings_.back().get();
+        }
+        tRingHolder.ring = found;
+    }
+
+    return tRingHolder.ring;
+}
+
+void Logger::logAsync(int level, const char* file, int line, const char* func, const char* fmt, va_list args)
+{
+    static thread_local unsigned long tid = static_cast<unsigned long>(::pthread_self());
+
+    struct timeval now_tv;
+    gettimeofday(&now_tv, NULL);
+
+    char msg[kMaxMessageLen];
+    int n = vsnprintf(msg, sizeof(msg), fmt, args);
+    size_t msgLen = n < 0 ? 0 : std::min(static_cast<size_t>(n), sizeof(msg) - 1);
+
+    AsyncLogRing *ring = getThreadRing();
+    size_t size = alignRecordSize(sizeof(AsyncLogRecord) + msgLen);
+
+    uint64_t tail = ring->tail_.load(std::memory_order_relaxed);
+    size_t contiguous = ring->capacity() - (tail & ring->mask_);
+    size_t needed = size <= contiguous ? size : contiguous + size;  // the end of the ring is skipped
+
+    while (ring->capacity() - (tail - ring->head_.load(std::memory_order_acquire)) < needed)
+    {
+        // never drops a FATAL record, the process is going to exit
+        if (overflowPolicy_ == ASYNC_OVERFLOW_DROP && level != LOG_LEVEL_FATAL)
+        {
+            droppedRecords_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        wakeupCond_.notify_one();
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+
+    if (size > contiguous)
+    {
+        AsyncLogRecord *padding = reinterpret_cast<AsyncLogRecord*>(ring->at(tail));
+        padding->size = static_cast<uint32_t>(contiguous);
+        padding->level = kPaddingRecord;
+        tail += contiguous;
+    }
+
+    AsyncLogRecord *record = reinterpret_cast<AsyncLogRecord*>(ring->at(tail));
+    record->size = static_cast<uint32_t>(size);
+    record->level = level;
+    record->timeMicros = static_cast<int64_t>(now_tv.tv_sec) * 1000000 + now_tv.tv_usec;
+    record->tid = tid;
+    record->file = file;
+    record->func = func;
+    record->line = line;
+    record->msgLen = static_cast<uint32_t>(msgLen);
+    ::memcpy(record + 1, msg, msgLen);
+
+    uint64_t head = ring->head_.load(std::memory_order_relaxed);
+    ring->tail_.store(tail + size, std::memory_order_release);
+
+    if (level == LOG_LEVEL_FATAL)
+    {
+        flush();
+    }
+    // wakes the background thread early before the ring fills up
+    else if (tail + size - head > ring->capacity() / 2)
+    {
+        wakeupCond_.notify_one();
+    }
+}
+
+void Logger::runAsyncWriter()
+{
+    while (true)
+    {
+        bool drained = drainRings();
+
+        std::unique_lock<std::mutex> lock(wakeupMutex_);
+        if (stopping_)
+        {
+            break;
+        }
+        if (!drained)
+        {
+            wakeupCond_.wait_for(lock, std::chrono::milliseconds(kAsyncFlushIntervalMillis));
+        }
+    }
+
+    drainRings();
+}
+
+// formats the headers, the messages are written from the rings directly
+bool Logger::drainRings()
+{
+    static char headers[kMaxBatchRecords][kMaxHeaderLen];
+    static struct iovec iov[kMaxBatchRecords * 3];
+    static char crlf[] = "\r\n";
+
+    std::lock_guard<std::mutex> lock(drainMutex_);
+    rotateLogFile();
+
+    std::vector<AsyncLogRing*> rings;
+    {
+        std::lock_guard<std::mutex> ringsLock(ringsMutex_);
+        for (auto &ring : rings_)
+        {
+            rings.push_back(ring.get());
+        }
+    }
+
+    bool drained = false;
+    for (auto ring : rings)
+    {
+        uint64_t head = ring->head_.load(std::memory_order_relaxed);
+        uint64_t tail = ring->tail_.load(std::memory_order_acquire);
+        while (head < tail)
+        {
+            int num = 0;
+            int iovcnt = 0;
+            uint64_t pos = head;
+            while (pos < tail && num < kMaxBatchRecords)
+            {
+                AsyncLogRecord *record = reinterpret_cast<AsyncLogRecord*>(ring->at(pos));
+                pos += record->size;
+                if (record->level == kPaddingRecord)
+                {
+                    continue;
+                }
+
+                int n = snprintf(headers[num], kMaxHeaderLen, "%s %06d %lu %s %s:%d [%s]",
+                    tDateTimeCache.format(static_cast<time_t>(record->timeMicros / 1000000)),
+                    static_cast<int>(record->timeMicros % 1000000),
+                    record->tid,
+                    logLevelStrings[record->level],
+                    record->file,
+                    record->line,
+                    record->func);
+                iov[iovcnt].iov_base = headers[num];
+                iov[iovcnt++].iov_len = std::min(static_cast<size_t>(std::max(n, 0)), kMaxHeaderLen - 1);
+                iov[iovcnt].iov_base = record + 1;
+                iov[iovcnt++].iov_len = record->msgLen;
+                iov[iovcnt].iov_base = crlf;
+                iov[iovcnt++].iov_len = 2;
+                num++;
+            }
+
+            if (iovcnt > 0)
+            {
+                writeRecords(iov, iovcnt);
+                drained = true;
+            }
+            head = pos;
+            ring->head_.store(head, std::memory_order_release);
+        }
+    }
+
+    uint64_t dropped = droppedRecords_.load(std::memory_order_relaxed);
+    if (dropped != reportedDroppedRecords_)
+    {
+        char notice[128];
+        int n = snprintf(notice, sizeof(notice), "%llu log records dropped, the rings were full\r\n",
+            static_cast<unsigned long long>(dropped - reportedDroppedRecords_));
+        iov[0].iov_base = notice;
+        iov[0].iov_len = static_cast<size_t>(n);
+        writeRecords(iov, 1);
+        reportedDroppedRecords_ = dropped;
+    }
+
+    return drained;
+}
+
+void Logger::writeRecords(struct iovec *iov, int iovcnt)
+{
+    int fd = fd_ == -1 ? 1 : fd_;
+    while (iovcnt > 0)
+    {
+        ssize_t n = ::writev(fd, iov, iovcnt);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            fprintf(stderr, "write log file %s failed. errmsg: %s\n", fileName_.c_str(), strerror(errno));
+            return;
+        }
+
+        // a partial write, skips what was written
+        while (iovcnt > 0 && static_cast<size_t>(n) >= iov->iov_len)
+        {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0)
+        {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + n;
+            iov->iov_len -= n;
+        }
+    }
+}
@@ -1,9 +1,17 @@
 #ifndef _EASYNET_LOG_H_
 #define _EASYNET_LOG_H_
 
+#include <sys/uio.h>
+
 #include <cstdlib>
+#include <cstdarg>
 #include <string>
 #include <atomic>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 
 #define KLOG(level, ...) \
 	do {  \
@@ -12,15 +20,57 @@
 		}  \
 	} while(0);
 
+// the LOG_* macros below EASYNET_MIN_LOG_LEVEL compile to nothing, neither the level is checked
+// nor the arguments are evaluated. 0:TRACE 1:DEBUG 2:INFO 3:WARN 4:ERROR 5:FATAL
+#ifndef EASYNET_MIN_LOG_LEVEL
+#define EASYNET_MIN_LOG_LEVEL 0
+#endif
+
+// still compiled to check the format and use the arguments, then removed as dead code
+#define KLOG_ELIDED(level, ...) \
+	do {  \
+		if (0) {  \
+			easynet::Logger::getInstance().log(level, __FILE__, __LINE__, __func__, __VA_ARGS__);  \
+		}  \
+	} while(0);
+
+#if EASYNET_MIN_LOG_LEVEL <= 0
 #define LOG_TRACE(...) KLOG(easynet::Logger::LOG_LEVEL_TRACE, __VA_ARGS__)
+#else
+#define LOG_TRACE(...) KLOG_ELIDED(easynet::Logger::LOG_LEVEL_TRACE, __VA_ARGS__)
+#endif
+
+#if EASYNET_MIN_LOG_LEVEL <= 1
 #define LOG_DEBUG(...) KLOG(easynet::Logger::LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) KLOG_ELIDED(easynet::Logger::LOG_LEVEL_DEBUG, __VA_ARGS__)
+#endif
+
+#if EASYNET_MIN_LOG_LEVEL <= 2
 #define LOG_INFO(...) KLOG(easynet::Logger::LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) KLOG_ELIDED(easynet::Logger::LOG_LEVEL_INFO, __VA_ARGS__)
+#endif
+
+#if EASYNET_MIN_LOG_LEVEL <= 3
 #define LOG_WARN(...) KLOG(easynet::Logger::LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) KLOG_ELIDED(easynet::Logger::LOG_LEVEL_WARN, __VA_ARGS__)
+#endif
+
+#if EASYNET_MIN_LOG_LEVEL <= 4
 #define LOG_ERROR(...) KLOG(easynet::Logger::LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) KLOG_ELIDED(easynet::Logger::LOG_LEVEL_ERROR, __VA_ARGS__)
+#endif
+
+// FATAL is never elided, it's followed by exiting
 #define LOG_FATAL(...) KLOG(easynet::Logger::LOG_LEVEL_FATAL, __VA_ARGS__)
 
 namespace easynet {
 
+class AsyncLogRing;
+
 class Logger
 {
 public:
@@ -34,6 +84,13 @@ public:
 		LOG_LEVEL_FATAL
 	};
 
+	// what a thread does when its ring is full in the async mode
+	enum AsyncOverflowPolicy
+	{
+		ASYNC_OVERFLOW_DROP,   // drops the record and counts it, see getDroppedRecords()
+		ASYNC_OVERFLOW_BLOCK   // waits for the background thread to make room
+	};
+
 	static Logger& getInstance();	
 
 	Logger(const Logger &rhs) = delete;
@@ -49,10 +106,26 @@ public:
 
 	void log(int level, const char* file, int line, const char* func, const char* fmt ...);
 
+	// the calling thread only formats the message into its own ring of @ringBytesPerThread,
+	// a background thread adds the time and the other fields, and writes the records in batches.
+	// a FATAL record is written with all the records before it when log() returns.
+	void enableAsync(size_t ringBytesPerThread = 1024 * 1024, AsyncOverflowPolicy policy = ASYNC_OVERFLOW_DROP);
+	void disableAsync();  // writes the remaining records and stops the background thread
+	bool isAsync() const { return async_; }
+	void flush();         // writes all the records logged before it, in the async mode
+	uint64_t getDroppedRecords() const { return droppedRecords_; }
+
 private:
 	Logger();
 	void rotateLogFile();
 
+	AsyncLogRing* getThreadRing();
+	void logAsync(int level, const char* file, int line, const char* func, const char* fmt, va_list args);
+	void runAsyncWriter();
+	bool drainRings();  // with @drainMutex_, returns false if there are no records
+	void writeRecords(struct iovec *iov, int iovcnt);
+	static void onForkChild();  // the child has no background thread, logs synchronously
+
 	static const char* logLevelStrings[LOG_LEVEL_FATAL + 1];
 
 	LogLeveL logLevel_;
@@ -61,6 +134,20 @@ private:
     std::atomic<int64_t> realRotate_;
     long lastRotate_;
     long rotateInterval_;
+
+    std::atomic<bool> async_;
+    size_t ringBytesPerThread_;
+    AsyncOverflowPolicy overflowPolicy_;
+    std::atomic<uint64_t> droppedRecords_;
+    uint64_t reportedDroppedRecords_;
+
+    std::mutex ringsMutex_;  // guards @rings_
+    std::vector<std::unique_ptr<AsyncLogRing>> rings_;  // one for each thread, reused after the thread exits
+    std::mutex drainMutex_;  // only one thread reads the rings at a time
+    std::mutex wakeupMutex_;
+    std::condition_variable wakeupCond_;
+    bool stopping_;
+    std::unique_ptr<std::thread> writerThread_;
 };
 
 }
@@ -1,10 +1,13 @@
 #include <unistd.h>
+#include <sys/socket.h>
 
 #include <string>
 #include <thread>
+#include <atomic>
 #include <iostream>
 
 #include "EventLoop.h"
+#include "Channel.h"
 #include "Timer.h"
 #include "utils/TimeUtil.h"
 #include "utils/log.h"
@@ -62,3 +65,206 @@ TEST(EventLoop, testTimeResolution)
     testTimeResolution(20);
     testTimeResolution(120);  
 }
+
+TEST(EventLoop, testTimeResolutionAfterIdle)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+    LOG_INFO("-----------------------------------------------------");
+    LOG_INFO("EventLoop-testTimeResolutionAfterIdle");
+    LOG_INFO("-----------------------------------------------------");
+
+    int64_t timeResolution = 20;
+    EventLoop loop(timeResolution);
+
+    int cnt = 0;
+    int64_t addTime = 0;
+    std::thread t([&]{
+        // the loop has no timers during the first 300 ms, its time updater is stopped
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        loop.wakeupAndRun([&]{
+            addTime = TimeUtil::now();
+            LOG_INFO("to add timer after idle, loop time lags %lld millis", addTime - loop.now());
+            ASSERT_LE(addTime - loop.now(), timeResolution);
+            loop.runAfter(100, [&]{
+                cnt++;
+                int64_t realAfter = TimeUtil::now() - addTime;
+                LOG_INFO("timer timedout after %lld millis", realAfter);
+                ASSERT_GE(realAfter, 100 - timeResolution);
+                ASSERT_LE(realAfter, 100 + timeResolution * 2);
+                loop.quit();
+            });
+        });
+    });
+
+    loop.loop();
+    t.join();
+    EXPECT_EQ(1, cnt);
+}
+
+TEST(EventLoop, testMicrosTimer)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+    LOG_INFO("-----------------------------------------------------");
+    LOG_INFO("EventLoop-testMicrosTimer");
+    LOG_INFO("-----------------------------------------------------");
+
+    // the time resolution should not delay the precise timers
+    EventLoop loop(100);
+
+    int64_t start = loop.nowMicros();
+    int oneShotCnt = 0;
+    loop.runAfterMicros(300, [&]{
+        oneShotCnt++;
+        int64_t realAfter = loop.nowMicros() - start;
+        LOG_INFO("one shot timer timedout after %lld micros", realAfter);
+        ASSERT_GE(realAfter, 300);
+        ASSERT_LE(realAfter, 20000);
+    });
+
+    Timer *cancelled = loop.runAfterMicros(100, [&]{
+        ASSERT_TRUE(false);
+    });
+    cancelled->cancel();
+
+    int repeatCnt = 0;
+    int64_t last = start;
+    loop.runAfterMicros(500, [&]{
+        int64_t current = loop.nowMicros();
+        ASSERT_GE(current - last, 500);
+        last = current;
+        if (++repeatCnt == 10)
+        {
+            LOG_INFO("repeated timer timedout 10 times in %lld micros", current - start);
+            loop.quit();
+        }
+    }, 500);
+
+    loop.loop();
+    EXPECT_EQ(1, oneShotCnt);
+    EXPECT_EQ(10, repeatCnt);
+}
+
+TEST(EventLoop, testUtilization)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+    LOG_INFO("-----------------------------------------------------");
+    LOG_INFO("EventLoop-testUtilization");
+    LOG_INFO("-----------------------------------------------------");
+
+    // a long idle wait decays the utilization as much as many short ones
+    EXPECT_EQ(800, EventLoop::decayUtilization(800, 0));
+    EXPECT_LT(EventLoop::decayUtilization(800, 100000), 800);
+    EXPECT_LE(EventLoop::decayUtilization(800, 1000000), 100);
+    EXPECT_EQ(0, EventLoop::decayUtilization(800, 5000000));
+
+    EventLoop loop;
+    EXPECT_FALSE(loop.utilizationEnabled());
+    loop.enableUtilization();
+    Timer *busyTimer = nullptr;
+
+    // idle for 500 ms
+    loop.runAfter(500, [&]{
+        LOG_INFO("utilization of the idle loop: %d permille", loop.utilization());
+        ASSERT_LE(loop.utilization(), 100);
+
+        // busy 8 ms, then waits 10 ms for the next round
+        busyTimer = loop.runAfter(0, [&]{
+            int64_t end = TimeUtil::currentMonoTimeMicros() + 8000;
+            while (TimeUtil::currentMonoTimeMicros() < end)
+            {}
+        }, 10);
+    });
+
+    loop.runAfter(2000, [&]{
+        LOG_INFO("utilization of the busy loop: %d permille", loop.utilization());
+        ASSERT_GE(loop.utilization(), 300);
+        busyTimer->cancel();
+    });
+
+    // idle again for 1 s, in a single wait or not
+    loop.runAfter(3000, [&]{
+        LOG_INFO("utilization of the loop idle again: %d permille", loop.utilization());
+        ASSERT_LE(loop.utilization(), 100);
+        loop.quit();
+    });
+
+    loop.loop();
+}
+
+TEST(EventLoop, testStats)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+    LOG_INFO("-----------------------------------------------------");
+    LOG_INFO("EventLoop-testStats");
+    LOG_INFO("-----------------------------------------------------");
+
+    EventLoop loop;
+    LoopStatsSnapshot snapshot;
+    EXPECT_FALSE(loop.getStats(&snapshot));
+    loop.enableStats(10000);
+
+    int fds[2];
+    ASSERT_EQ(0, ::socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+
+    // a read handler busy for 15 ms
+    Channel channel(&loop, fds[0]);
+    channel.setReadHandler([&]{
+        char buf[16];
+        ASSERT_EQ(1, static_cast<int>(::read(fds[0], buf, sizeof(buf))));
+        int64_t end = TimeUtil::currentMonoTimeMicros() + 15000;
+        while (TimeUtil::currentMonoTimeMicros() < end)
+        {}
+    });
+    channel.enableReading();
+
+    std::atomic<bool> stopped(false);
+    std::thread other([&]{
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        ASSERT_EQ(1, static_cast<int>(::write(fds[1], "x", 1)));
+        loop.wakeupAndRun([]{
+            std::this_thread::sleep_for(std::chrono::milliseconds(15));
+        });
+
+        // reads the stats while the loop is running
+        while (!stopped)
+        {
+            LoopStatsSnapshot running;
+            loop.getStats(&running);
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    });
+
+    loop.runAfter(10, []{}, 10);
+    loop.runAfter(500, [&]{
+        loop.quit();
+    });
+    loop.loop();
+    stopped = true;
+    other.join();
+
+    ASSERT_TRUE(loop.getStats(&snapshot));
+    LOG_INFO("loop stats: %s", snapshot.toString().c_str());
+
+    EXPECT_GT(snapshot.iterations, 10u);
+    EXPECT_EQ(snapshot.iterations, snapshot.iterationNanos.count);
+    EXPECT_EQ(snapshot.iterations, snapshot.eventsPerWakeup.count);
+    EXPECT_GT(snapshot.phaseNanos[LOOP_PHASE_POLL], 200u * 1000 * 1000);
+    EXPECT_GE(snapshot.phaseNanos[LOOP_PHASE_HANDLERS], 15u * 1000 * 1000);
+    EXPECT_GE(snapshot.phaseNanos[LOOP_PHASE_FUNCTORS], 15u * 1000 * 1000);
+    EXPECT_GE(snapshot.iterationNanos.max, 15u * 1000 * 1000);
+
+    // the read handler and the functor
+    ASSERT_EQ(2u, snapshot.slowHandlers);
+    ASSERT_EQ(2u, snapshot.recentSlowHandlers.size());
+    const SlowHandlerRecord &read = snapshot.recentSlowHandlers[0];
+    EXPECT_EQ(static_cast<int>(LOOP_HANDLER_CHANNEL), read.kind);
+    EXPECT_EQ(fds[0], read.fd);
+    EXPECT_EQ(EASYNET_EVENT_READABLE, read.events);
+    EXPECT_GE(read.nanos, 15 * 1000 * 1000);
+    EXPECT_EQ(static_cast<int>(LOOP_HANDLER_FUNCTOR), snapshot.recentSlowHandlers[1].kind);
+    EXPECT_EQ(-1, snapshot.recentSlowHandlers[1].fd);
+
+    channel.disableAll();
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
@@ -0,0 +1,127 @@
+#include <stdint.h>
+
+#include <thread>
+#include <atomic>
+
+#include "utils/Histogram.h"
+#include "utils/log.h"
+
+#include <test_harness.h>
+
+using namespace std;
+using namespace easynet;
+
+TEST(Histogram, testBuckets)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+    LOG_INFO("-----------------------------------------------------");
+    LOG_INFO("Histogram-testBuckets");
+    LOG_INFO("-----------------------------------------------------");
+
+	// exact below 8
+	for (int i = 0; i < 8; i++)
+	{
+		EXPECT_EQ(i, HistogramSnapshot::bucketOf(i));
+		EXPECT_EQ(static_cast<uint64_t>(i), HistogramSnapshot::bucketLowerBound(i));
+		EXPECT_EQ(static_cast<uint64_t>(i), HistogramSnapshot::bucketUpperBound(i));
+	}
+
+	// every bucket starts right after the previous one, up to the whole uint64_t range
+	for (int i = 1; i < HistogramSnapshot::kNumBuckets; i++)
+	{
+		EXPECT_EQ(HistogramSnapshot::bucketUpperBound(i - 1) + 1, HistogramSnapshot::bucketLowerBound(i));
+		EXPECT_EQ(i, HistogramSnapshot::bucketOf(HistogramSnapshot::bucketLowerBound(i)));
+		EXPECT_EQ(i, HistogramSnapshot::bucketOf(HistogramSnapshot::bucketUpperBound(i)));
+	}
+	EXPECT_EQ(UINT64_MAX, HistogramSnapshot::bucketUpperBound(HistogramSnapshot::kNumBuckets - 1));
+	EXPECT_EQ(HistogramSnapshot::kNumBuckets - 1, HistogramSnapshot::bucketOf(UINT64_MAX));
+
+	// within 12.5%
+	for (uint64_t v = 8; v < 1000000; v = v * 3 / 2 + 1)
+	{
+		int bucket = HistogramSnapshot::bucketOf(v);
+		uint64_t width = HistogramSnapshot::bucketUpperBound(bucket) - HistogramSnapshot::bucketLowerBound(bucket) + 1;
+		EXPECT_LE(width * 8, HistogramSnapshot::bucketLowerBound(bucket));
+	}
+}
+
+TEST(Histogram, testPercentile)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+    LOG_INFO("-----------------------------------------------------");
+    LOG_INFO("Histogram-testPercentile");
+    LOG_INFO("-----------------------------------------------------");
+
+	Histogram histogram;
+	HistogramSnapshot snapshot;
+	histogram.snapshot(&snapshot);
+	EXPECT_EQ(0u, snapshot.count);
+	EXPECT_EQ(0u, snapshot.percentile(99));
+
+	for (uint64_t v = 1; v <= 10000; v++)
+	{
+		histogram.record(v);
+	}
+	histogram.snapshot(&snapshot);
+	LOG_INFO("histogram: %s", snapshot.toString().c_str());
+
+	EXPECT_EQ(10000u, snapshot.count);
+	EXPECT_EQ(10000u, snapshot.max);
+	EXPECT_EQ(50005000u, snapshot.sum);
+	EXPECT_DOUBLE_EQ(5000.5, snapshot.mean());
+
+	uint64_t p50 = snapshot.percentile(50);
+	uint64_t p99 = snapshot.percentile(99);
+	EXPECT_GE(p50, 5000u);
+	EXPECT_LE(p50, 5000u + 5000u / 8);
+	EXPECT_GE(p99, 9900u);
+	EXPECT_LE(p99, 10000u);
+	EXPECT_EQ(10000u, snapshot.percentile(100));
+	EXPECT_EQ(1u, snapshot.percentile(0));
+
+	HistogramSnapshot merged;
+	merged.merge(snapshot);
+	merged.merge(snapshot);
+	EXPECT_EQ(20000u, merged.count);
+	EXPECT_EQ(p50, merged.percentile(50));
+
+	histogram.clear();
+	histogram.snapshot(&snapshot);
+	EXPECT_EQ(0u, snapshot.count);
+	EXPECT_EQ(0u, snapshot.max);
+}
+
+TEST(Histogram, testConcurrentSnapshot)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+    LOG_INFO("-----------------------------------------------------");
+    LOG_INFO("Histogram-testConcurrentSnapshot");
+    LOG_INFO("-----------------------------------------------------");
+
+	Histogram histogram;
+	std::atomic<bool> done(false);
+	uint64_t total = 2000000;
+
+	std::thread writer([&]{
+		for (uint64_t i = 0; i < total; i++)
+		{
+			histogram.record(i & 1023);
+		}
+		done = true;
+	});
+
+	uint64_t last = 0;
+	while (!done)
+	{
+		HistogramSnapshot snapshot;
+		histogram.snapshot(&snapshot);
+		EXPECT_GE(snapshot.count, last);
+		EXPECT_LE(snapshot.max, 1023u);
+		last = snapshot.count;
+	}
+	writer.join();
+
+	HistogramSnapshot snapshot;
+	histogram.snapshot(&snapshot);
+	EXPECT_EQ(total, snapshot.count);
+}
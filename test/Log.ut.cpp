@@ -0,0 +1,173 @@
+// LOG_TRACE and LOG_DEBUG are elided in this file
+#define EASYNET_MIN_LOG_LEVEL 2
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <fstream>
+#include <sstream>
+
+#include "utils/log.h"
+
+#include <test_harness.h>
+
+using namespace std;
+using namespace easynet;
+
+namespace
+{
+
+const char *kAsyncLogFile = "log-async-test.txt";
+
+// the lines of the log file with @marker
+int countLines(const std::string &marker)
+{
+	std::ifstream in(kAsyncLogFile);
+	std::string line;
+	int n = 0;
+	while (std::getline(in, line))
+	{
+		if (line.find(marker) != std::string::npos)
+		{
+			n++;
+		}
+	}
+	return n;
+}
+
+void logInThreads(int threadNum, int linesPerThread, const char *marker)
+{
+	std::vector<std::thread> threads;
+	for (int i = 0; i < threadNum; i++)
+	{
+		threads.emplace_back([=]{
+			for (int j = 0; j < linesPerThread; j++)
+			{
+				LOG_INFO("%s thread %d line %d", marker, i, j);
+			}
+		});
+	}
+	for (auto &t : threads)
+	{
+		t.join();
+	}
+}
+
+}
+
+TEST(Logger, testAsync)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+    LOG_INFO("-----------------------------------------------------");
+    LOG_INFO("Logger-testAsync");
+    LOG_INFO("-----------------------------------------------------");
+
+	::unlink(kAsyncLogFile);
+	Logger &logger = Logger::getInstance();
+	logger.setLogFile(kAsyncLogFile);
+
+	// nothing is lost if the threads wait for room
+	logger.enableAsync(16 * 1024, Logger::ASYNC_OVERFLOW_BLOCK);
+	logInThreads(4, 5000, "async-block");
+	logger.flush();
+	EXPECT_EQ(4 * 5000, countLines("async-block"));
+	EXPECT_EQ(0u, logger.getDroppedRecords());
+	logger.disableAsync();
+
+	// the records not written are counted
+	logger.enableAsync(16 * 1024, Logger::ASYNC_OVERFLOW_DROP);
+	logInThreads(4, 5000, "async-drop");
+	logger.flush();
+	uint64_t dropped = logger.getDroppedRecords();
+	LOG_INFO("%llu records dropped", static_cast<unsigned long long>(dropped));
+	EXPECT_EQ(4 * 5000, countLines("async-drop") + static_cast<int>(dropped));
+
+	// a FATAL record is written before log() returns, after the records before it
+	LOG_INFO("async-fatal before");
+	LOG_FATAL("async-fatal record");
+	EXPECT_EQ(1, countLines("async-fatal before"));
+	EXPECT_EQ(1, countLines("async-fatal record"));
+	logger.disableAsync();
+
+	logger.setLogFile("log-test.txt");
+	::unlink(kAsyncLogFile);
+}
+
+// the child logs synchronously, without the background thread of the parent
+TEST(Logger, testAsyncFork)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+    LOG_INFO("-----------------------------------------------------");
+    LOG_INFO("Logger-testAsyncFork");
+    LOG_INFO("-----------------------------------------------------");
+
+	::unlink(kAsyncLogFile);
+	Logger &logger = Logger::getInstance();
+	logger.setLogFile(kAsyncLogFile);
+	logger.enableAsync();
+
+	pid_t pid = ::fork();
+	if (pid == 0) { // child
+		LOG_INFO("async-fork child");
+		::exit(logger.isAsync() ? 1 : 0);
+	}
+
+	int status = 0;
+	::waitpid(pid, &status, 0);
+	EXPECT_TRUE(WIFEXITED(status));
+	EXPECT_EQ(0, WEXITSTATUS(status));
+	EXPECT_EQ(1, countLines("async-fork child"));
+	logger.disableAsync();
+
+	logger.setLogFile("log-test.txt");
+	::unlink(kAsyncLogFile);
+}
+
+TEST(Logger, testMinLogLevel)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_TRACE);
+    LOG_INFO("-----------------------------------------------------");
+    LOG_INFO("Logger-testMinLogLevel");
+    LOG_INFO("-----------------------------------------------------");
+
+	::unlink(kAsyncLogFile);
+	Logger &logger = Logger::getInstance();
+	logger.setLogFile(kAsyncLogFile);
+
+	// the arguments of an elided macro are not evaluated
+	int evaluated = 0;
+	LOG_TRACE("min-level trace %d", ++evaluated);
+	LOG_DEBUG("min-level debug %d", ++evaluated);
+	LOG_INFO("min-level info %d", ++evaluated);
+	EXPECT_EQ(1, evaluated);
+	EXPECT_EQ(0, countLines("min-level trace"));
+	EXPECT_EQ(0, countLines("min-level debug"));
+	EXPECT_EQ(1, countLines("min-level info"));
+
+	// the cached date and thread id are the same as formatted for every line
+	LOG_INFO("min-level format");
+	std::ifstream in(kAsyncLogFile);
+	std::string line;
+	std::string last;
+	while (std::getline(in, line))
+	{
+		if (line.find("min-level format") != std::string::npos)
+		{
+			last = line;
+		}
+	}
+	std::stringstream ss;
+	ss << std::this_thread::get_id();
+	int year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0, micros = 0;
+	char tid[64] = {0};
+	EXPECT_EQ(8, sscanf(last.c_str(), "%4d-%2d-%2d %2d:%2d:%2d %6d %63s", &year, &month, &day, &hour, &minute, &second, &micros, tid));
+	EXPECT_TRUE(year >= 2017 && month >= 1 && month <= 12 && day >= 1 && day <= 31);
+	EXPECT_EQ(ss.str(), std::string(tid));
+
+	logger.setLogLevel(Logger::LOG_LEVEL_INFO);
+	logger.setLogFile("log-test.txt");
+	::unlink(kAsyncLogFile);
+}
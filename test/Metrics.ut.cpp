@@ -0,0 +1,199 @@
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Metrics.h"
+#include "TcpServer.h"
+#include "TcpClient.h"
+#include "TcpConnection.h"
+#include "EventLoop.h"
+#include "utils/log.h"
+
+#include <test_harness.h>
+
+using namespace std;
+using namespace easynet;
+
+namespace
+{
+
+// the value of a sample line "@name value" in @text, -1 if not found
+int64_t getSample(const std::string &text, const std::string &name)
+{
+	size_t pos = text.find("\n" + name + " ");
+	if (pos == std::string::npos)
+	{
+		return -1;
+	}
+
+	return std::stoll(text.substr(pos + name.size() + 2));
+}
+
+}
+
+TEST(Metrics, testRegistry)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+    LOG_INFO("-----------------------------------------------------");
+    LOG_INFO("Metrics-testRegistry");
+    LOG_INFO("-----------------------------------------------------");
+
+	MetricsRegistry registry;
+	EXPECT_EQ(static_cast<int>(METRIC_BUILTIN_MAX), registry.getMetricsNum());
+
+	int requests = registry.addCounter("test_requests_total", "Requests handled.");
+	int inflight = registry.addGauge("test_inflight_requests", "Requests in flight.");
+	int latency = registry.addHistogram("test_request_seconds", "Request latency.", 1e-6);
+	EXPECT_EQ(static_cast<int>(METRIC_BUILTIN_MAX), requests);
+	EXPECT_EQ(requests + 1, inflight);
+	EXPECT_EQ(requests + 2, latency);
+
+	int shards = 4;
+	int perShard = 100000;
+	registry.createShards(shards);
+	EXPECT_EQ(-1, registry.addCounter("test_late_total", "Added after the shards."));
+
+	std::vector<std::thread> threads;
+	for (int i = 0; i < shards; i++)
+	{
+		threads.emplace_back([&registry, i, perShard, requests, inflight, latency]{
+			MetricsShard *shard = registry.getShard(i);
+			for (int j = 0; j < perShard; j++)
+			{
+				shard->add(requests, 1);
+				shard->observe(latency, j % 1000);
+			}
+			shard->set(inflight, i);
+		});
+	}
+
+	// reads while they're written
+	for (int i = 0; i < 100; i++)
+	{
+		registry.toPrometheusText();
+	}
+	for (auto &thread : threads)
+	{
+		thread.join();
+	}
+
+	EXPECT_EQ(static_cast<int64_t>(shards * perShard), registry.getValue(requests));
+	EXPECT_EQ(static_cast<int64_t>(0 + 1 + 2 + 3), registry.getValue(inflight));
+
+	HistogramSnapshot snapshot;
+	registry.getHistogram(latency, &snapshot);
+	EXPECT_EQ(static_cast<uint64_t>(shards * perShard), snapshot.count);
+	EXPECT_EQ(999u, snapshot.max);
+
+	std::string text = registry.toPrometheusText();
+	LOG_INFO("metrics:\n%s", text.c_str());
+	EXPECT_TRUE(text.find("# HELP test_requests_total Requests handled.\n") != std::string::npos);
+	EXPECT_TRUE(text.find("# TYPE test_requests_total counter\n") != std::string::npos);
+	EXPECT_TRUE(text.find("# TYPE test_inflight_requests gauge\n") != std::string::npos);
+	EXPECT_TRUE(text.find("# TYPE test_request_seconds histogram\n") != std::string::npos);
+	EXPECT_TRUE(text.find("# TYPE easynet_accepts_total counter\n") != std::string::npos);
+	EXPECT_EQ(static_cast<int64_t>(shards * perShard), getSample(text, "test_requests_total"));
+	EXPECT_EQ(6, getSample(text, "test_inflight_requests"));
+	EXPECT_EQ(0, getSample(text, "easynet_accepts_total"));
+
+	// cumulative buckets in seconds, the largest bucket below 1024 micros holds all
+	EXPECT_TRUE(text.find("test_request_seconds_bucket{le=\"0.001023\"} 400000\n") != std::string::npos);
+	EXPECT_TRUE(text.find("test_request_seconds_bucket{le=\"+Inf\"} 400000\n") != std::string::npos);
+	EXPECT_EQ(static_cast<int64_t>(shards * perShard), getSample(text, "test_request_seconds_count"));
+}
+
+TEST(Metrics, testTcpServerMetrics)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+    LOG_INFO("-----------------------------------------------------");
+    LOG_INFO("Metrics-testTcpServerMetrics");
+    LOG_INFO("-----------------------------------------------------");
+
+	std::string ip = "127.0.0.1";
+	unsigned short port = 12259;
+	unsigned short metricsPort = 12261;
+
+	EventLoop loop;
+	TcpServer tcpServer(port);
+	tcpServer.setWorkerNum(2);
+	tcpServer.setMetricsHttpListenAddr(ip, metricsPort);
+	tcpServer.setReadHandler([&](TcpConnection &tcpConnection){
+		Buffer &buffer = tcpConnection.getInputBuffer();
+		tcpConnection.send(buffer.data(), buffer.size());
+		buffer.clear();
+	});
+	tcpServer.setPeerShutdownHandler([&](TcpConnection &tcpConnection){
+		tcpConnection.close();
+	});
+	tcpServer.start();
+	ASSERT_TRUE(tcpServer.getMetricsRegistry() != nullptr);
+
+	// an echo, kept open
+	TcpClient client(&loop);
+	std::string echoed;
+	client.setConnectedHandler([&](TcpConnection &tcpConnection){
+		tcpConnection.send("hello");
+	});
+	client.setReadHandler([&](TcpConnection &tcpConnection){
+		Buffer &buffer = tcpConnection.getInputBuffer();
+		echoed.append(buffer.data(), buffer.size());
+		buffer.clear();
+	});
+	client.connect(ip, port, 5);
+
+	// then scrapes the metrics, and an unknown path
+	std::vector<std::string> paths = {"/metrics", "/unknown"};
+	std::vector<std::string> responses(paths.size());
+	std::vector<std::unique_ptr<TcpClient>> scrapers;
+	for (size_t i = 0; i < paths.size(); i++)
+	{
+		std::unique_ptr<TcpClient> scraper(new TcpClient(&loop));
+		std::string path = paths[i];
+		std::string &response = responses[i];
+		scraper->setConnectedHandler([path](TcpConnection &tcpConnection){
+			tcpConnection.send("GET " + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n");
+		});
+		scraper->setReadHandler([&response](TcpConnection &tcpConnection){
+			Buffer &buffer = tcpConnection.getInputBuffer();
+			response.append(buffer.data(), buffer.size());
+			buffer.clear();
+		});
+		scraper->setPeerShutdownHandler([](TcpConnection &tcpConnection){
+			tcpConnection.close();
+		});
+		scrapers.push_back(std::move(scraper));
+	}
+
+	loop.runAfter(500, [&]{
+		for (auto &scraper : scrapers)
+		{
+			scraper->connect(ip, metricsPort, 5);
+		}
+	});
+	loop.runAfter(1500, [&]{
+		loop.quit();
+	});
+	loop.loop();
+
+	EXPECT_EQ(std::string("hello"), echoed);
+	LOG_INFO("scraped:\n%s", responses[0].c_str());
+
+	const std::string &metrics = responses[0];
+	EXPECT_TRUE(metrics.compare(0, 15, "HTTP/1.1 200 OK") == 0);
+	EXPECT_TRUE(metrics.find("Content-Type: text/plain; version=0.0.4\r\n") != std::string::npos);
+	EXPECT_EQ(1, getSample(metrics, "easynet_accepts_total"));
+	EXPECT_EQ(1, getSample(metrics, "easynet_connections"));
+	EXPECT_EQ(5, getSample(metrics, "easynet_received_bytes_total"));
+	EXPECT_EQ(5, getSample(metrics, "easynet_sent_bytes_total"));
+	EXPECT_EQ(1, getSample(metrics, "easynet_pool_misses_total"));
+	EXPECT_GE(getSample(metrics, "easynet_wakeups_total"), 2);
+	EXPECT_TRUE(responses[1].compare(0, 22, "HTTP/1.1 404 Not Found") == 0);
+
+	// the same numbers in the registry
+	const MetricsRegistry *registry = tcpServer.getMetricsRegistry();
+	EXPECT_EQ(5, registry->getValue(METRIC_BYTES_RECEIVED));
+	std::vector<int> nums = tcpServer.getTcpWorkersConnectionNums();
+	EXPECT_EQ(1, nums[0] + nums[1]);
+
+	tcpServer.stop();
+}
@@ -0,0 +1,99 @@
+#include <string>
+
+#include "Probes.h"
+#include "TcpServer.h"
+#include "TcpClient.h"
+#include "TcpConnection.h"
+#include "EventLoop.h"
+#include "utils/log.h"
+
+#include <test_harness.h>
+
+using namespace std;
+using namespace easynet;
+
+#if EASYNET_PROBES_ENABLED
+
+namespace
+{
+
+volatile unsigned short* const kSemaphores[] = {
+	&EASYNET_PROBE_SEMAPHORE(accept),
+	&EASYNET_PROBE_SEMAPHORE(connection_reset),
+	&EASYNET_PROBE_SEMAPHORE(connection_close),
+	&EASYNET_PROBE_SEMAPHORE(recv),
+	&EASYNET_PROBE_SEMAPHORE(send),
+	&EASYNET_PROBE_SEMAPHORE(epoll_wake),
+	&EASYNET_PROBE_SEMAPHORE(timer_fire),
+	&EASYNET_PROBE_SEMAPHORE(functor_run)
+};
+
+void setSemaphores(unsigned short value)
+{
+	for (auto semaphore : kSemaphores)
+	{
+		*semaphore = value;
+	}
+}
+
+}
+
+// as if a tracer attached, every probe runs with its arguments evaluated
+TEST(Probes, testActiveProbes)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+    LOG_INFO("-----------------------------------------------------");
+    LOG_INFO("Probes-testActiveProbes");
+    LOG_INFO("-----------------------------------------------------");
+
+	std::string ip = "127.0.0.1";
+	unsigned short port = 12267;
+
+	setSemaphores(1);
+
+	EventLoop loop;
+	TcpServer tcpServer(port);
+	tcpServer.setWorkerNum(1);
+	tcpServer.setReadHandler([&](TcpConnection &tcpConnection){
+		Buffer &buffer = tcpConnection.getInputBuffer();
+		tcpConnection.send(buffer.data(), buffer.size());
+		buffer.clear();
+	});
+	tcpServer.setPeerShutdownHandler([&](TcpConnection &tcpConnection){
+		tcpConnection.close();
+	});
+	tcpServer.start();
+
+	std::string echoed;
+	TcpClient client(&loop);
+	client.setConnectedHandler([](TcpConnection &tcpConnection){
+		tcpConnection.send("hello");
+	});
+	client.setReadHandler([&](TcpConnection &tcpConnection){
+		Buffer &buffer = tcpConnection.getInputBuffer();
+		echoed.append(buffer.data(), buffer.size());
+		buffer.clear();
+		tcpConnection.shutdown();
+	});
+	client.connect(ip, port, 5);
+
+	int timers = 0;
+	int functors = 0;
+	loop.runAfter(100, [&]{ timers++; }, 100);
+	loop.runAfter(300, [&]{
+		loop.wakeupAndRun([&]{ functors++; });
+	});
+	loop.runAfter(600, [&]{
+		loop.quit();
+	});
+	loop.loop();
+
+	setSemaphores(0);
+	tcpServer.stop();
+
+	EXPECT_EQ(std::string("hello"), echoed);
+	EXPECT_GE(timers, 4);
+	EXPECT_EQ(1, functors);
+}
+
+#endif
@@ -21,7 +21,7 @@
 using namespace std;
 using namespace easynet;
 
-int testAddAndCloseInLoop(int sig)
+int testAddAndCloseInLoop(int sig, SignalMgr::SignalHandlingMode mode = SignalMgr::SIGNAL_HANDLING_MODE_RELAY_THREAD)
 {
 	Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
 	LOG_INFO("-----------------------------------------");
@@ -36,7 +36,14 @@ int testAddAndCloseInLoop(int sig)
         
         LOG_INFO("child starting----");
     
-        SignalMgr::enableSignalHandling();
+        if (mode == SignalMgr::SIGNAL_HANDLING_MODE_SIGNALFD) {
+        	sigset_t signals;
+        	sigemptyset(&signals);
+        	sigaddset(&signals, sig);
+        	SignalMgr::enableSignalHandling(mode, signals);
+        } else {
+        	SignalMgr::enableSignalHandling(mode);
+        }
 		EventLoop loop;
 
 		SignalHandler *handler1 = nullptr;
@@ -177,6 +184,164 @@ TEST(SignalHandlerMgr, testAddAndCloseInLoop)
 	}
 }
 
+// the signals are read from the loop's signalfd, and still terminate the child once their handlers are closed
+TEST(SignalHandlerMgr, testAddAndCloseInLoopSignalFd)
+{
+	LOG_INFO("-----------------------------------------------------");
+	LOG_INFO("SignalHandlerMgr-testAddAndCloseInLoopSignalFd");
+	LOG_INFO("-----------------------------------------------------");
+
+	int sigs[] = {SIGHUP, SIGINT, SIGUSR1, SIGTERM, SIGRTMIN, SIGRTMAX};
+	for (auto sig : sigs)
+	{
+		int status = testAddAndCloseInLoop(sig, SignalMgr::SIGNAL_HANDLING_MODE_SIGNALFD);
+		EXPECT_EQ(sig, status);
+	}
+}
+
+// two loops handle SIGUSR1 and SIGRTMIN, a signal read by one of them is relayed to the other one
+TEST(SignalHandlerMgr, testSignalFdRelay)
+{
+	LOG_INFO("-----------------------------------------------------");
+	LOG_INFO("SignalHandlerMgr-testSignalFdRelay");
+	LOG_INFO("-----------------------------------------------------");
+
+	pid_t pid = ::fork();
+	if (pid < 0) {
+		LOG_ERROR("fork error");
+	} else if (pid == 0) { // child
+		sigset_t signals;
+		sigemptyset(&signals);
+		sigaddset(&signals, SIGUSR1);
+		sigaddset(&signals, SIGRTMIN);
+		SignalMgr::enableSignalHandling(SignalMgr::SIGNAL_HANDLING_MODE_SIGNALFD, signals);
+
+		auto runLoop = [](int threadNum){
+			EventLoop loop;
+			int usr1Cnt = 0;
+			int rtCnt = 0;
+			loop.addSignalHandler(SIGUSR1, [&]{
+				usr1Cnt++;
+				LOG_INFO("thread %d caught SIGUSR1", threadNum);
+			});
+			loop.addSignalHandler(SIGRTMIN, [&]{
+				rtCnt++;
+				LOG_INFO("thread %d caught SIGRTMIN %d times", threadNum, rtCnt);
+				if (rtCnt == 3) {
+					loop.quit();
+				}
+			});
+			loop.runAfter(3000, [&]{ loop.quit(); });
+			loop.loop();
+			return usr1Cnt == 1 && rtCnt == 3;
+		};
+
+		auto f1 = std::async(std::launch::async, runLoop, 1);
+		auto f2 = std::async(std::launch::async, runLoop, 2);
+		bool ok1 = f1.get();
+		bool ok2 = f2.get();
+		exit(ok1 && ok2 ? 0 : 1);
+	} else {    // parent
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		kill(pid, SIGUSR1);
+		for (int i = 0; i < 3; i++) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			kill(pid, SIGRTMIN);
+		}
+
+		int status = 0;
+		pid_t ret = ::waitpid(pid, &status, 0);
+		LOG_INFO("child %d exited,  exit status = %d", ret, status);
+		EXPECT_TRUE(WIFEXITED(status));
+		EXPECT_EQ(0, WEXITSTATUS(status));
+	}
+}
+
+// one of two loops handling SIGUSR1 is destroyed after the first one, the other loop keeps reading
+// the signal, and never relays it to the destroyed loop
+TEST(SignalHandlerMgr, testSignalFdRelayAfterLoopDestroyed)
+{
+	LOG_INFO("-----------------------------------------------------");
+	LOG_INFO("SignalHandlerMgr-testSignalFdRelayAfterLoopDestroyed");
+	LOG_INFO("-----------------------------------------------------");
+
+	pid_t pid = ::fork();
+	if (pid < 0) {
+		LOG_ERROR("fork error");
+	} else if (pid == 0) { // child
+		sigset_t signals;
+		sigemptyset(&signals);
+		sigaddset(&signals, SIGUSR1);
+		SignalMgr::enableSignalHandling(SignalMgr::SIGNAL_HANDLING_MODE_SIGNALFD, signals);
+
+		auto runLoop = [](int threadNum, int quitCnt){
+			EventLoop loop;
+			int usr1Cnt = 0;
+			loop.addSignalHandler(SIGUSR1, [&]{
+				usr1Cnt++;
+				LOG_INFO("thread %d caught SIGUSR1 %d times", threadNum, usr1Cnt);
+				if (usr1Cnt == quitCnt) {
+					loop.quit();
+				}
+			});
+			loop.runAfter(3000, [&]{ loop.quit(); });
+			loop.loop();
+			return usr1Cnt == quitCnt;
+		};
+
+		auto f1 = std::async(std::launch::async, runLoop, 1, 3);
+		auto f2 = std::async(std::launch::async, runLoop, 2, 1);
+		bool ok2 = f2.get();
+		bool ok1 = f1.get();
+		exit(ok1 && ok2 ? 0 : 1);
+	} else {    // parent
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		kill(pid, SIGUSR1);
+		for (int i = 0; i < 2; i++) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(200));
+			kill(pid, SIGUSR1);
+		}
+
+		int status = 0;
+		pid_t ret = ::waitpid(pid, &status, 0);
+		LOG_INFO("child %d exited,  exit status = %d", ret, status);
+		EXPECT_TRUE(WIFEXITED(status));
+		EXPECT_EQ(0, WEXITSTATUS(status));
+	}
+}
+
+// SIGTERM is not among the signals to handle, it terminates the child though no loop reads a signalfd
+TEST(SignalHandlerMgr, testSignalFdUnhandledSignalNotBlocked)
+{
+	LOG_INFO("-----------------------------------------------------");
+	LOG_INFO("SignalHandlerMgr-testSignalFdUnhandledSignalNotBlocked");
+	LOG_INFO("-----------------------------------------------------");
+
+	pid_t pid = ::fork();
+	if (pid < 0) {
+		LOG_ERROR("fork error");
+	} else if (pid == 0) { // child
+		sigset_t signals;
+		sigemptyset(&signals);
+		sigaddset(&signals, SIGUSR1);
+		SignalMgr::enableSignalHandling(SignalMgr::SIGNAL_HANDLING_MODE_SIGNALFD, signals);
+
+		EventLoop loop;
+		loop.runAfter(3000, [&]{ loop.quit(); });
+		loop.loop();
+		exit(0);
+	} else {    // parent
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		kill(pid, SIGTERM);
+
+		int status = 0;
+		pid_t ret = ::waitpid(pid, &status, 0);
+		LOG_INFO("child %d exited,  exit status = %d", ret, status);
+		EXPECT_TRUE(WIFSIGNALED(status));
+		EXPECT_EQ(SIGTERM, WTERMSIG(status));
+	}
+}
+
 int testAddAndCloseInHandler(int sig)
 {
 	Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
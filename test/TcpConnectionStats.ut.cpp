@@ -0,0 +1,124 @@
+#include <string>
+#include <mutex>
+#include <vector>
+#include <memory>
+
+#include "TcpConnectionStats.h"
+#include "TcpServer.h"
+#include "TcpClient.h"
+#include "TcpConnection.h"
+#include "EventLoop.h"
+#include "utils/log.h"
+
+#include <test_harness.h>
+
+using namespace std;
+using namespace easynet;
+
+TEST(TcpConnectionStats, testTopConnections)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+    LOG_INFO("-----------------------------------------------------");
+    LOG_INFO("TcpConnectionStats-testTopConnections");
+    LOG_INFO("-----------------------------------------------------");
+
+	std::string ip = "127.0.0.1";
+	unsigned short port = 12265;
+
+	EventLoop loop;
+	TcpServer tcpServer(port);
+	tcpServer.setWorkerNum(1);
+	tcpServer.setConnectionStats(true);
+	tcpServer.setReadHandler([&](TcpConnection &tcpConnection){
+		Buffer &buffer = tcpConnection.getInputBuffer();
+		tcpConnection.send(buffer.data(), buffer.size());
+		buffer.clear();
+	});
+	tcpServer.setPeerShutdownHandler([&](TcpConnection &tcpConnection){
+		tcpConnection.close();
+	});
+	tcpServer.start();
+
+	// 2 clients of different sizes, the larger one counts its own stats
+	std::vector<size_t> sizes = {5, 1000};
+	std::vector<size_t> echoed(sizes.size(), 0);
+	std::vector<std::unique_ptr<TcpClient>> clients;
+	bool statsDisabled = true;
+	for (size_t i = 0; i < sizes.size(); i++)
+	{
+		std::unique_ptr<TcpClient> client(new TcpClient(&loop));
+		size_t size = sizes[i];
+		size_t &n = echoed[i];
+		client->setConnectedHandler([size, &statsDisabled](TcpConnection &tcpConnection){
+			if (size > 5)
+			{
+				tcpConnection.enableStats();
+			}
+			else
+			{
+				statsDisabled = tcpConnection.getStats() == nullptr;
+			}
+			tcpConnection.send(std::string(size, 'x'));
+		});
+		client->setReadHandler([&n](TcpConnection &tcpConnection){
+			Buffer &buffer = tcpConnection.getInputBuffer();
+			n += buffer.size();
+			buffer.clear();
+		});
+		client->connect(ip, port, 5);
+		clients.push_back(std::move(client));
+	}
+
+	std::mutex mutex;
+	std::string report;
+	loop.runAfter(500, [&]{
+		tcpServer.dumpTopConnections(2, [&](EventLoop *workerLoop, const std::string &text){
+			std::lock_guard<std::mutex> guard(mutex);
+			report = text;
+		});
+	});
+	loop.runAfter(1000, [&]{
+		loop.quit();
+	});
+	loop.loop();
+
+	EXPECT_TRUE(statsDisabled);
+	EXPECT_EQ(sizes[0], echoed[0]);
+	EXPECT_EQ(sizes[1], echoed[1]);
+
+	// the client's own stats
+	const TcpConnectionStats *stats = clients[1]->getTcpConnection().getStats();
+	ASSERT_TRUE(stats != nullptr);
+	EXPECT_EQ(1000u, stats->bytesSent);
+	EXPECT_EQ(1000u, stats->bytesReceived);
+	EXPECT_GE(stats->sendCalls, 1u);
+	EXPECT_GE(stats->recvCalls, 1u);
+	EXPECT_GE(stats->readHandlerCalls, 1u);
+	EXPECT_GE(stats->inputBufferHighWater, 1u);
+
+	// both connections of the server count stats, ranked by every key, the larger one first
+	std::lock_guard<std::mutex> guard(mutex);
+	LOG_INFO("top connections:\n%s", report.c_str());
+	size_t byReceived = report.find("top connections by bytes_received:\n");
+	size_t bySent = report.find("top connections by bytes_sent:\n");
+	ASSERT_TRUE(byReceived != std::string::npos);
+	ASSERT_TRUE(bySent != std::string::npos);
+	EXPECT_TRUE(report.find("top connections by output_wait_micros:\n") != std::string::npos);
+
+	std::string receivedRanking = report.substr(byReceived, bySent - byReceived);
+	size_t larger = receivedRanking.find("bytes_received=1000 ");
+	size_t smaller = receivedRanking.find("bytes_received=5 ");
+	EXPECT_TRUE(larger != std::string::npos);
+	EXPECT_TRUE(smaller != std::string::npos);
+	EXPECT_TRUE(larger < smaller);
+
+	size_t afterSent = report.find("top connections by", bySent + 1);
+	std::string sentRanking = report.substr(bySent, afterSent - bySent);
+	larger = sentRanking.find("bytes_sent=1000 ");
+	smaller = sentRanking.find("bytes_sent=5 ");
+	EXPECT_TRUE(larger != std::string::npos);
+	EXPECT_TRUE(smaller != std::string::npos);
+	EXPECT_TRUE(larger < smaller);
+
+	tcpServer.stop();
+}
@@ -0,0 +1,90 @@
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "TcpInfoSampler.h"
+#include "TcpServer.h"
+#include "TcpClient.h"
+#include "TcpConnection.h"
+#include "EventLoop.h"
+#include "utils/log.h"
+
+#include <test_harness.h>
+
+using namespace std;
+using namespace easynet;
+
+TEST(TcpInfoSampler, testSampling)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+    LOG_INFO("-----------------------------------------------------");
+    LOG_INFO("TcpInfoSampler-testSampling");
+    LOG_INFO("-----------------------------------------------------");
+
+	std::string ip = "127.0.0.1";
+	unsigned short port = 12266;
+
+	EventLoop loop;
+	TcpServer tcpServer(port);
+	tcpServer.setWorkerNum(1);
+	tcpServer.setTcpInfoSampling(100, 1);  // a connection every round
+	tcpServer.setReadHandler([&](TcpConnection &tcpConnection){
+		Buffer &buffer = tcpConnection.getInputBuffer();
+		tcpConnection.send(buffer.data(), buffer.size());
+		buffer.clear();
+	});
+	tcpServer.setPeerShutdownHandler([&](TcpConnection &tcpConnection){
+		tcpConnection.close();
+	});
+	tcpServer.start();
+
+	const int kClients = 3;
+	std::vector<std::unique_ptr<TcpClient>> clients;
+	int echoed = 0;
+	for (int i = 0; i < kClients; i++)
+	{
+		std::unique_ptr<TcpClient> client(new TcpClient(&loop));
+		client->setConnectedHandler([](TcpConnection &tcpConnection){
+			tcpConnection.send("hello");
+		});
+		client->setReadHandler([&echoed](TcpConnection &tcpConnection){
+			Buffer &buffer = tcpConnection.getInputBuffer();
+			echoed += buffer.size();
+			buffer.clear();
+		});
+		client->connect(ip, port, 5);
+		clients.push_back(std::move(client));
+	}
+
+	// on demand, for a single connection
+	int ret = -1;
+	TcpInfo info;
+	loop.runAfter(300, [&]{
+		ret = clients[0]->getTcpConnection().getTcpInfo(&info);
+	});
+	loop.runAfter(1050, [&]{
+		loop.quit();
+	});
+	loop.loop();
+
+	EXPECT_EQ(5 * kClients, echoed);
+	EXPECT_EQ(0, ret);
+	LOG_INFO("tcp info of a client: %s", info.toString().c_str());
+	EXPECT_GT(info.cwnd, 0u);
+	EXPECT_EQ(0u, info.unackedBytes);
+
+	std::vector<TcpInfoSnapshot> snapshots = tcpServer.getWorkersTcpInfo();
+	ASSERT_EQ(1u, snapshots.size());
+	LOG_INFO("tcp info of the worker:\n%s", snapshots[0].toString().c_str());
+	// about 10 rounds of 1 connection each, or 2 if they're in the same bucket of the hash set
+	EXPECT_GE(snapshots[0].rttMicros.count, 5u);
+	EXPECT_LE(snapshots[0].rttMicros.count, 20u);
+	EXPECT_EQ(snapshots[0].rttMicros.count, snapshots[0].cwnd.count);
+	EXPECT_EQ(0u, snapshots[0].failures);
+
+	// a closed connection
+	TcpConnection closed(&loop);
+	EXPECT_EQ(-1, closed.getTcpInfo(&info));
+
+	tcpServer.stop();
+}
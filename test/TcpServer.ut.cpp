@@ -8,6 +8,8 @@
 #include <memory>
 #include <utility>
 #include <functional>
+#include <algorithm>
+#include <atomic>
 
 #include <signal.h>
 #include <sys/types.h>
@@ -24,6 +26,7 @@
 
 #include "utils/TimeUtil.h"
 #include "utils/rlimit.h"
+#include "utils/cpu.h"
 #include "utils/log.h"
 
 #include <test_harness.h>
@@ -249,6 +252,90 @@ TEST(TcpServer, testUpdateIdle)
 	LOG_INFO("exiting");
 }
 
+TEST(TcpServer, testIdleLazyRearm)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+	LOG_INFO("-----------------------------------------------------");
+	LOG_INFO("TcpServer-testIdleLazyRearm");
+	LOG_INFO("-----------------------------------------------------");
+
+    std::string ip = "127.0.0.1";
+    unsigned short port = 12268;
+    const int idleSecs = 5;
+
+	EventLoop loop;
+	TcpServer tcpServer(port);
+	tcpServer.setWorkerNum(1);
+
+	// the first connection reads once 2s after it's established, its idle timer times out 5~6s
+	// after it started, and is restarted for the remaining 1~2s instead of a whole period.
+	// the idle handler closes the connection, which mustn't cancel the timer being expired,
+	// the next connection gets the same object from the pool and its idle timer of 1s must still work
+	int accepted = 0;
+	int idleCalls = 0;
+	std::vector<int64_t> idleSinceEstablished;
+	std::vector<int64_t> idleSinceRead;
+	int64_t lastReadTime = 0;
+	tcpServer.setNewTcpConnectionHandler([&](TcpConnection &tcpConnection){
+		lastReadTime = tcpConnection.getEstablishmentTime();
+		tcpConnection.setIdleHandler(accepted++ == 0 ? idleSecs : 1, [&](){
+			idleCalls++;
+			int64_t now = tcpConnection.getLoop()->now();
+			idleSinceEstablished.push_back(now - tcpConnection.getEstablishmentTime());
+			idleSinceRead.push_back(now - lastReadTime);
+			LOG_INFO("---Server: connection from %s idle, %lld millis after established, %lld millis after the last read",
+				tcpConnection.getPeerAddr().toString().c_str(), idleSinceEstablished.back(), idleSinceRead.back());
+			tcpConnection.close(); // must be the last statement in the idle handler
+		});
+	});
+	tcpServer.setReadHandler([&](TcpConnection &tcpConnection){
+		lastReadTime = tcpConnection.getLoop()->now();
+		tcpConnection.getInputBuffer().clear();
+	});
+	tcpServer.start();
+
+	std::vector<std::unique_ptr<TcpClient>> clients;
+	for (int i = 0; i < 2; i++)
+	{
+		std::unique_ptr<TcpClient> client(new TcpClient(&loop));
+		client->setPeerShutdownHandler([&, i](TcpConnection &tcpConnection){
+			LOG_INFO("---client %d: server closed the idle connection", i);
+			tcpConnection.close();
+			if (i == 0)
+			{
+				clients[1]->connect(ip, port, 5);
+			}
+			else
+			{
+				loop.quit();
+			}
+		});
+		clients.push_back(std::move(client));
+	}
+	clients[0]->setConnectedHandler([&](TcpConnection &tcpConnection){
+		loop.runAfter(2000, [&]{
+			clients[0]->getTcpConnection().send("hello easynet!");
+		});
+	});
+	clients[0]->connect(ip, port, 5);
+
+	// give up well after a whole idle period following the first expiry
+	loop.runAfter(4 * idleSecs * 1000, [&]{
+		loop.quit();
+	});
+	loop.loop();
+	tcpServer.stop();
+
+	ASSERT_EQ(2, idleCalls);
+	// not at the first expiry, nor before @idleSecs since the read, nor a whole period after the first expiry
+	EXPECT_GE(idleSinceRead[0], idleSecs * 1000);
+	EXPECT_GE(idleSinceEstablished[0], (idleSecs + 2) * 1000);
+	EXPECT_LT(idleSinceEstablished[0], 2 * idleSecs * 1000 - 500);
+	// the connection without reads, from the pool
+	EXPECT_GE(idleSinceRead[1], 1000);
+	EXPECT_LT(idleSinceEstablished[1], 3000);
+}
+
 TEST(TcpServer, testLoadbalance)
 {
     Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
@@ -394,3 +481,488 @@ TEST(TcpServer, testLoadbalance)
 
 	LOG_INFO("exiting");
 }
+
+TEST(TcpServer, testMigrateConnection)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+	LOG_INFO("-----------------------------------------------------");
+	LOG_INFO("TcpServer-testMigrateConnection");
+	LOG_INFO("-----------------------------------------------------");
+
+    std::string ip = "127.0.0.1";
+    unsigned short port = 12262;
+    size_t bigSize = 4 * 1024 * 1024;
+    std::string big(bigSize, 'x');
+
+    TcpServer tcpServer(ip, port);
+    tcpServer.setWorkerNum(2);
+
+    std::vector<EventLoop*> loops;
+    EventLoop *sourceLoop = nullptr;
+    EventLoop *targetLoop = nullptr;
+    EventLoop *secondReadLoop = nullptr;
+    EventLoop *migratedLoop = nullptr;
+    int migratedCnt = 0;
+    std::string received;
+
+    tcpServer.setReadHandler([&](TcpConnection &tcpConnection){
+    	Buffer &buffer = tcpConnection.getInputBuffer();
+    	received.append(buffer.data(), buffer.size());
+    	buffer.deleteBegin(buffer.size());
+
+    	if (received == "1")
+    	{
+    		// most of the data is left in the output buffer, it should be sent by the target loop
+    		sourceLoop = tcpConnection.getLoop();
+    		targetLoop = (sourceLoop == loops[0]) ? loops[1] : loops[0];
+    		tcpConnection.send(big);
+    		tcpServer.migrateConnection(tcpConnection, targetLoop);
+    	}
+    	else if (received == "12")
+    	{
+    		secondReadLoop = tcpConnection.getLoop();
+    		tcpConnection.send("ok");
+    	}
+    });
+
+    tcpServer.setMigratedHandler([&](TcpConnection &tcpConnection){
+    	migratedCnt++;
+    	migratedLoop = tcpConnection.getLoop();
+    });
+
+    tcpServer.start();
+    loops = tcpServer.getWorkersLoops();
+
+    EventLoop loop;
+    size_t clientReceived = 0;
+    TcpClient client(&loop);
+    client.setConnectedHandler([&](TcpConnection &tcpConnection){
+    	tcpConnection.send("1");
+    });
+
+    client.setReadHandler([&](TcpConnection &tcpConnection){
+    	Buffer &buffer = tcpConnection.getInputBuffer();
+    	size_t n = buffer.size();
+    	buffer.deleteBegin(n);
+
+    	bool gotBig = clientReceived >= bigSize;
+    	clientReceived += n;
+    	if (!gotBig && clientReceived >= bigSize)
+    	{
+    		tcpConnection.send("2");
+    	}
+
+    	if (clientReceived == bigSize + 2)
+    	{
+    		loop.quit();
+    	}
+    });
+    client.connect(ip, port);
+
+    loop.runAfter(5000, [&]{
+    	loop.quit();
+    });
+    loop.loop();
+    client.close();
+    tcpServer.stop();
+
+    EXPECT_EQ(bigSize + 2, clientReceived);
+    EXPECT_EQ(1, migratedCnt);
+    EXPECT_TRUE(sourceLoop != targetLoop);
+    EXPECT_TRUE(migratedLoop == targetLoop);
+    EXPECT_TRUE(secondReadLoop == targetLoop);
+}
+
+TEST(TcpServer, testMigrateWithPeerShutdown)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+	LOG_INFO("-----------------------------------------------------");
+	LOG_INFO("TcpServer-testMigrateWithPeerShutdown");
+	LOG_INFO("-----------------------------------------------------");
+
+    std::string ip = "127.0.0.1";
+    unsigned short port = 12271;
+
+    TcpServer tcpServer(ip, port);
+    tcpServer.setWorkerNum(2);
+
+    std::vector<EventLoop*> loops;
+    std::atomic<EventLoop*> targetLoop(nullptr);
+    std::atomic<EventLoop*> peerShutdownLoop(nullptr);
+    std::atomic<int> peerShutdownCnt(0);
+    std::atomic<int> migratedCnt(0);
+
+    // the worker is busy when the data and FIN arrive, so they are reported in the same round
+    tcpServer.setNewTcpConnectionHandler([&](TcpConnection &tcpConnection){
+    	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    });
+
+    tcpServer.setReadHandler([&](TcpConnection &tcpConnection){
+    	Buffer &buffer = tcpConnection.getInputBuffer();
+    	std::string data(buffer.data(), buffer.size());
+    	buffer.deleteBegin(buffer.size());
+
+    	EventLoop *target = (tcpConnection.getLoop() == loops[0]) ? loops[1] : loops[0];
+    	if (data == "1")
+    	{
+    		// the peer shutdown is handled in the target loop, and so is the data sent here
+    		targetLoop = target;
+    		tcpServer.migrateConnection(tcpConnection, target);
+    		tcpConnection.send("a");
+    	}
+    	else if (data == "c")
+    	{
+    		// closed before the target loop gets it
+    		tcpServer.migrateConnection(tcpConnection, target);
+    		tcpConnection.close();
+    	}
+    });
+
+    tcpServer.setPeerShutdownHandler([&](TcpConnection &tcpConnection){
+    	peerShutdownCnt++;
+    	peerShutdownLoop = tcpConnection.getLoop();
+    	tcpConnection.close();
+    });
+
+    tcpServer.setMigratedHandler([&](TcpConnection &tcpConnection){
+    	migratedCnt++;
+    });
+
+    tcpServer.start();
+    loops = tcpServer.getWorkersLoops();
+
+    EventLoop loop;
+    std::string received;
+    int closedByServer = 0;
+    std::vector<std::unique_ptr<TcpClient>> clients;
+    for (auto message : {"1", "c"})
+    {
+    	std::string data(message);
+    	std::unique_ptr<TcpClient> client(new TcpClient(&loop));
+    	client->setConnectedHandler([&, data](TcpConnection &tcpConnection){
+    		tcpConnection.send(data);
+    		if (data == "1")
+    		{
+    			tcpConnection.shutdownWrite();
+    		}
+    	});
+    	client->setReadHandler([&](TcpConnection &tcpConnection){
+    		Buffer &buffer = tcpConnection.getInputBuffer();
+    		received.append(buffer.data(), buffer.size());
+    		buffer.deleteBegin(buffer.size());
+    	});
+    	client->setPeerShutdownHandler([&](TcpConnection &tcpConnection){
+    		if (++closedByServer == 2)
+    		{
+    			loop.quit();
+    		}
+    	});
+    	client->connect(ip, port);
+    	clients.push_back(std::move(client));
+    }
+
+    loop.runAfter(5000, [&]{
+    	loop.quit();
+    });
+    loop.loop();
+
+    // the workers publish the numbers after their next round
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    loops[0]->wakeup();
+    loops[1]->wakeup();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    std::vector<int> nums = tcpServer.getTcpWorkersConnectionNums();
+    for (auto &client : clients)
+    {
+    	client->close();
+    }
+    tcpServer.stop();
+
+    EXPECT_EQ(2, closedByServer);
+    EXPECT_EQ("a", received);
+    EXPECT_EQ(1, peerShutdownCnt.load());
+    EXPECT_TRUE(peerShutdownLoop.load() == targetLoop.load());
+    EXPECT_EQ(1, migratedCnt.load());
+    ASSERT_EQ(2u, nums.size());
+    EXPECT_EQ(0, nums[0]);
+    EXPECT_EQ(0, nums[1]);
+}
+
+TEST(TcpServer, testWorkerCpuAutoPlacement)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+	LOG_INFO("-----------------------------------------------------");
+	LOG_INFO("TcpServer-testWorkerCpuAutoPlacement");
+	LOG_INFO("-----------------------------------------------------");
+
+    std::vector<int> allowed;
+    ASSERT_EQ(0, getThreadCpus(allowed));
+
+    int workerNum = 3;
+    TcpServer tcpServer("127.0.0.1", 12263);
+    tcpServer.setWorkerNum(workerNum);
+    tcpServer.setWorkerCpuAutoPlacement(true);
+    tcpServer.start();
+
+    std::vector<std::vector<int>> cpuSets = tcpServer.getWorkersCpuSets();
+    ASSERT_EQ(workerNum, static_cast<int>(cpuSets.size()));
+
+    std::vector<EventLoop*> loops = tcpServer.getWorkersLoops();
+    std::vector<std::vector<int>> threadCpus(workerNum);
+    std::atomic<int> done(0);
+    for (int i = 0; i < workerNum; i++)
+    {
+    	loops[i]->wakeupAndRun([&, i]{
+    		getThreadCpus(threadCpus[i]);
+    		done++;
+    	});
+    }
+
+    for (int i = 0; i < 500 && done < workerNum; i++)
+    {
+    	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    tcpServer.stop();
+
+    ASSERT_EQ(workerNum, done.load());
+    for (int i = 0; i < workerNum; i++)
+    {
+    	ASSERT_EQ(1, static_cast<int>(cpuSets[i].size()));
+    	EXPECT_TRUE(std::find(allowed.begin(), allowed.end(), cpuSets[i][0]) != allowed.end());
+    	EXPECT_TRUE(threadCpus[i] == cpuSets[i]);
+    }
+
+    // different physical cores are used first
+    if (allowed.size() >= static_cast<size_t>(workerNum))
+    {
+    	EXPECT_TRUE(cpuSets[0] != cpuSets[1]);
+    }
+
+    // the calling thread's affinity is restored after the workers are created
+    std::vector<int> after;
+    getThreadCpus(after);
+    EXPECT_TRUE(after == allowed);
+}
+
+TEST(TcpServer, testIdleWorkerUtilization)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+	LOG_INFO("-----------------------------------------------------");
+	LOG_INFO("TcpServer-testIdleWorkerUtilization");
+	LOG_INFO("-----------------------------------------------------");
+
+    TcpServer tcpServer("127.0.0.1", 12269);
+    tcpServer.setWorkerNum(1);
+    tcpServer.setWorkerUtilization(true);
+    tcpServer.start();
+
+    // busy for 900 ms, then a wakeup 200 ms later ends the sample
+    EventLoop *workerLoop = tcpServer.getWorkersLoops()[0];
+    workerLoop->wakeupAndRun([]{
+    	int64_t end = TimeUtil::currentMonoTimeMicros() + 900000;
+    	while (TimeUtil::currentMonoTimeMicros() < end)
+    	{}
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    workerLoop->wakeupAndRun([]{});
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    int busyUtilization = tcpServer.getWorkersUtilizations()[0];
+    LOG_INFO("utilization of the busy worker: %d permille", busyUtilization);
+
+    // the worker waits in epoll_wait() without a new sample, its utilization decays all the same
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    int idleUtilization = tcpServer.getWorkersUtilizations()[0];
+    LOG_INFO("utilization of the idle worker: %d permille", idleUtilization);
+    tcpServer.stop();
+
+    EXPECT_GE(busyUtilization, 300);
+    EXPECT_LE(idleUtilization, 100);
+}
+
+TEST(TcpServer, testElasticScaling)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+	LOG_INFO("-----------------------------------------------------");
+	LOG_INFO("TcpServer-testElasticScaling");
+	LOG_INFO("-----------------------------------------------------");
+
+    std::string ip = "127.0.0.1";
+    unsigned short port = 12264;
+
+    TcpServer tcpServer(ip, port);
+    tcpServer.setWorkerNum(1);
+    tcpServer.setWorkerElasticScaling(2, 500, 100, 1);
+    tcpServer.setConnectionRebalancing(300, 1);
+
+    std::atomic<bool> busy(true);
+    tcpServer.setReadHandler([&](TcpConnection &tcpConnection){
+    	Buffer &buffer = tcpConnection.getInputBuffer();
+    	std::string data(buffer.data(), buffer.size());
+    	buffer.deleteBegin(buffer.size());
+
+    	int64_t begin = TimeUtil::currentMonoTimeMicros();
+    	while (busy && TimeUtil::currentMonoTimeMicros() - begin < 20000)
+    	{}
+    	tcpConnection.send(data);
+    });
+    tcpServer.start();
+
+    // phase 0: ping-pong keeps the only worker busy until a worker is added and a connection migrated to it
+    // phase 1: idle until the added worker retired
+    // phase 2: both connections still work
+    EventLoop loop;
+    int phase = 0;
+    bool scaledUp = false;
+    bool scaledDown = false;
+    int repliesAfterRetired = 0;
+    int connectionsAfterRetired = 0;
+    std::vector<std::unique_ptr<TcpClient>> clients;
+    std::vector<TcpConnection*> connections;
+    for (int i = 0; i < 2; i++)
+    {
+    	std::unique_ptr<TcpClient> client(new TcpClient(&loop));
+    	client->setConnectedHandler([&](TcpConnection &tcpConnection){
+    		connections.push_back(&tcpConnection);
+    		tcpConnection.send("x");
+    	});
+    	client->setReadHandler([&](TcpConnection &tcpConnection){
+    		Buffer &buffer = tcpConnection.getInputBuffer();
+    		buffer.deleteBegin(buffer.size());
+    		if (phase == 0)
+    		{
+    			tcpConnection.send("x");
+    		}
+    		else if (phase == 2 && ++repliesAfterRetired == 2)
+    		{
+    			loop.quit();
+    		}
+    	});
+    	client->connect(ip, port);
+    	clients.push_back(std::move(client));
+    }
+
+    loop.runAfter(100, [&]{
+    	std::vector<int> nums = tcpServer.getTcpWorkersConnectionNums();
+    	if (phase == 0 && nums.size() == 2 && nums[0] == 1 && nums[1] == 1)
+    	{
+    		scaledUp = true;
+    		busy = false;
+    		phase = 1;
+    	}
+    	else if (phase == 1 && nums.size() == 1 && nums[0] == 2)   // after the hand-over of the retired worker's connection
+    	{
+    		scaledDown = true;
+    		connectionsAfterRetired = nums[0];
+    		phase = 2;
+    		for (auto tcpConnection : connections)
+    		{
+    			tcpConnection->send("y");
+    		}
+    	}
+    }, 100);
+
+    loop.runAfter(20000, [&]{
+    	loop.quit();
+    });
+    loop.loop();
+    busy = false;
+    for (auto &client : clients)
+    {
+    	client->close();
+    }
+    tcpServer.stop();
+
+    EXPECT_TRUE(scaledUp);
+    EXPECT_TRUE(scaledDown);
+    EXPECT_EQ(2, connectionsAfterRetired);
+    EXPECT_EQ(2, repliesAfterRetired);
+}
+
+TEST(TcpServer, testElasticScalingBackToIdle)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+	LOG_INFO("-----------------------------------------------------");
+	LOG_INFO("TcpServer-testElasticScalingBackToIdle");
+	LOG_INFO("-----------------------------------------------------");
+
+    std::string ip = "127.0.0.1";
+    unsigned short port = 12272;
+    int workerNum = 1;
+    int maxWorkerNum = 3;
+    int clientNum = 4;
+
+    TcpServer tcpServer(ip, port);
+    tcpServer.setWorkerNum(workerNum);
+    tcpServer.setWorkerElasticScaling(maxWorkerNum, 500, 100, 1);
+    tcpServer.setConnectionRebalancing(300, 1);
+
+    tcpServer.setReadHandler([&](TcpConnection &tcpConnection){
+    	Buffer &buffer = tcpConnection.getInputBuffer();
+    	std::string data(buffer.data(), buffer.size());
+    	buffer.deleteBegin(buffer.size());
+
+    	int64_t begin = TimeUtil::currentMonoTimeMicros();
+    	while (TimeUtil::currentMonoTimeMicros() - begin < 20000)
+    	{}
+    	tcpConnection.send(data);
+    });
+    tcpServer.start();
+
+    // phase 0: ping-pong on every connection until the workers are scaled up to @maxWorkerNum
+    // phase 1: the connections stay open without traffic until the workers are retired down to @workerNum
+    EventLoop loop;
+    int phase = 0;
+    int maxWorkersSeen = 0;
+    std::vector<int> numsAfterIdle;
+    std::vector<int> utilizationsAfterIdle;
+    std::vector<std::unique_ptr<TcpClient>> clients;
+    for (int i = 0; i < clientNum; i++)
+    {
+    	std::unique_ptr<TcpClient> client(new TcpClient(&loop));
+    	client->setConnectedHandler([&](TcpConnection &tcpConnection){
+    		tcpConnection.send("x");
+    	});
+    	client->setReadHandler([&](TcpConnection &tcpConnection){
+    		Buffer &buffer = tcpConnection.getInputBuffer();
+    		buffer.deleteBegin(buffer.size());
+    		if (phase == 0)
+    		{
+    			tcpConnection.send("x");
+    		}
+    	});
+    	client->connect(ip, port);
+    	clients.push_back(std::move(client));
+    }
+
+    loop.runAfter(100, [&]{
+    	int num = static_cast<int>(tcpServer.getWorkersLoops().size());
+    	maxWorkersSeen = std::max(maxWorkersSeen, num);
+    	if (phase == 0 && num == maxWorkerNum)
+    	{
+    		phase = 1;
+    	}
+    	else if (phase == 1 && num == workerNum)
+    	{
+    		numsAfterIdle = tcpServer.getTcpWorkersConnectionNums();
+    		utilizationsAfterIdle = tcpServer.getWorkersUtilizations();
+    		loop.quit();
+    	}
+    }, 100);
+
+    loop.runAfter(30000, [&]{
+    	loop.quit();
+    });
+    loop.loop();
+    for (auto &client : clients)
+    {
+    	client->close();
+    }
+    tcpServer.stop();
+
+    EXPECT_EQ(maxWorkerNum, maxWorkersSeen);
+    ASSERT_EQ(static_cast<size_t>(workerNum), numsAfterIdle.size());
+    EXPECT_EQ(clientNum, numsAfterIdle[0]);
+    ASSERT_EQ(static_cast<size_t>(workerNum), utilizationsAfterIdle.size());
+    EXPECT_LE(utilizationsAfterIdle[0], 100);
+}
@@ -3,6 +3,8 @@
 #include <thread>
 #include <future>
 #include <functional>
+#include <vector>
+#include <random>
 
 #include "TimerHeap.h"
 #include "EventLoop.h"
@@ -380,3 +382,193 @@ TEST(TimerInHeap, testCancelInLoop)
 
 	EXPECT_EQ(3, cnt1);
 }
+
+TEST(TimerInHeap, testManyTimersInOrder)
+{
+	Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+	LOG_INFO("----------------------------------------------");
+	LOG_INFO("TimerInHeap-testManyTimersInOrder");
+	LOG_INFO("----------------------------------------------");
+
+	const int kTimers = 1000;
+	EventLoop loop;
+
+	std::vector<Timer*> timers;
+	std::vector<int> fired(kTimers, 0);
+	int64_t lastWhen = 0;
+	int outOfOrder = 0;
+	int total = 0;
+
+	std::default_random_engine e(301);
+	std::uniform_int_distribution<int> u(0, 200);
+	LOG_INFO("----to add %d timers, timed out between 0~200 millis", kTimers);
+	for (int i = 0; i < kTimers; i++)
+	{
+		timers.push_back(loop.runAfter(u(e), [&, i]{
+			Timer *timer = timers[i];
+			if (timer->getWhen() < lastWhen)
+			{
+				outOfOrder++;
+			}
+			lastWhen = timer->getWhen();
+			fired[i]++;
+			total++;
+		}));
+	}
+
+	LOG_INFO("----to cancel every 3rd timer, restart every 3rd+1 timer after 250 millis");
+	for (int i = 0; i < kTimers; i += 3)
+	{
+		timers[i]->cancel();
+		if (i + 1 < kTimers)
+		{
+			timers[i + 1]->restart(250);
+		}
+	}
+
+	loop.runAfter(400, [&]{
+		LOG_INFO("----to stop test, %d timers timed out", total);
+		loop.quit();
+	});
+
+	loop.loop();
+
+	EXPECT_EQ(0, outOfOrder);
+	EXPECT_EQ(kTimers - (kTimers + 2) / 3, total);
+	for (int i = 0; i < kTimers; i++)
+	{
+		EXPECT_EQ(i % 3 == 0 ? 0 : 1, fired[i]);
+	}
+}
+
+TEST(TimerInHeap, testCancelAndRestartInCallback)
+{
+	Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+	LOG_INFO("----------------------------------------------");
+	LOG_INFO("TimerInHeap-testCancelAndRestartInCallback");
+	LOG_INFO("----------------------------------------------");
+
+	EventLoop loop;
+
+	int cnt1 = 0;
+	Timer *t1 = nullptr;
+	LOG_INFO("----to add timer1, it cancels itself in the 2nd timeout");
+	t1 = loop.runAfter(50, [&]{
+		cnt1++;
+		if (cnt1 == 2)
+		{
+			t1->cancel();
+		}
+	}, 50);
+
+	int cnt2 = 0;
+	Timer *t2 = nullptr;
+	LOG_INFO("----to add timer2, it restarts itself twice");
+	t2 = loop.runAfter(50, [&]{
+		cnt2++;
+		if (cnt2 < 3)
+		{
+			t2->restart(50);
+		}
+	});
+
+	loop.runAfter(400, [&]{
+		LOG_INFO("----to stop test");
+		loop.quit();
+	});
+
+	loop.loop();
+	EXPECT_EQ(2, cnt1);
+	EXPECT_EQ(3, cnt2);
+}
+
+TEST(TimerInHeap, testSlackCoalescing)
+{
+	Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+	LOG_INFO("----------------------------------------------");
+	LOG_INFO("TimerInHeap-testSlackCoalescing");
+	LOG_INFO("----------------------------------------------");
+
+	const int timerNum = 100;
+	const int64_t slack = 200;
+
+	EventLoop loop;
+	int cnt = 0;
+	int64_t ts = loop.now();
+	for (int i = 0; i < timerNum; i++)
+	{
+		// due every 2 millis from 100 ms, all within the first timer's window
+		int64_t after = 100 + i * 2;
+		loop.runAfter(after, [&, after]{
+			cnt++;
+			int64_t realAfter = loop.now() - ts;
+			ASSERT_GE(realAfter, after);
+			ASSERT_LE(realAfter, after + slack + 20);
+		}, 0, slack);
+	}
+
+	// a timer without slack is not delayed by the others
+	loop.runAfter(150, [&]{
+		int64_t realAfter = loop.now() - ts;
+		LOG_INFO("----timer without slack timedout after %lld millis", realAfter);
+		ASSERT_LE(realAfter, 170);
+	});
+
+	loop.runAfter(600, [&]{
+		loop.quit();
+	});
+
+	uint64_t wakeups = loop.wakeups();
+	loop.loop();
+	wakeups = loop.wakeups() - wakeups;
+	LOG_INFO("----%d timers timedout in %llu wakeups", cnt, wakeups);
+	EXPECT_EQ(timerNum, cnt);
+	ASSERT_LE(wakeups, 6u);
+}
+
+TEST(TimerInHeap, testRestartMicros)
+{
+	Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+	LOG_INFO("----------------------------------------------");
+	LOG_INFO("TimerInHeap-testRestartMicros");
+	LOG_INFO("----------------------------------------------");
+
+	EventLoop loop;
+
+	// a millisecond timer rounds the microseconds up
+	int64_t ts = loop.now();
+	int64_t realAfterMillis = -1;
+	Timer *t1 = loop.runAfter(1000, [&]{
+		realAfterMillis = loop.now() - ts;
+	});
+	ASSERT_FALSE(t1->precise());
+	t1->restartMicros(30500);
+	int64_t remainMicros = t1->remainTimeMicros();
+	LOG_INFO("----millisecond timer remains %lld micros", remainMicros);
+	EXPECT_EQ(0, remainMicros % 1000);
+	EXPECT_GE(remainMicros, 30000);
+	EXPECT_LE(remainMicros, 31000);
+
+	// a precise timer takes them as they are
+	int64_t tsMicros = loop.nowMicros();
+	int64_t realAfterMicros = -1;
+	Timer *t2 = loop.runAfterMicros(1000000, [&]{
+		realAfterMicros = loop.nowMicros() - tsMicros;
+	});
+	ASSERT_TRUE(t2->precise());
+	t2->restartMicros(20000);
+	EXPECT_LE(t2->remainTimeMicros(), 20000);
+	EXPECT_EQ(t2->remainTime(), t2->remainTimeMicros());
+
+	loop.runAfter(200, [&]{
+		loop.quit();
+	});
+
+	loop.loop();
+	LOG_INFO("----millisecond timer timedout after %lld millis, precise timer after %lld micros", 
+		realAfterMillis, realAfterMicros);
+	EXPECT_GE(realAfterMillis, 30);
+	EXPECT_LE(realAfterMillis, 100);
+	EXPECT_GE(realAfterMicros, 20000);
+	EXPECT_LE(realAfterMicros, 100000);
+}
@@ -0,0 +1,140 @@
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+#include <set>
+
+#include "TraceRing.h"
+#include "TcpServer.h"
+#include "TcpClient.h"
+#include "TcpConnection.h"
+#include "EventLoop.h"
+#include "utils/log.h"
+
+#include <test_harness.h>
+
+using namespace std;
+using namespace easynet;
+
+TEST(TraceRing, testWrapAround)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+    LOG_INFO("-----------------------------------------------------");
+    LOG_INFO("TraceRing-testWrapAround");
+    LOG_INFO("-----------------------------------------------------");
+
+	std::string fileName = "trace-test.0";
+	TraceRing ring;
+	ASSERT_EQ(0, ring.open(fileName, 3, 10));  // rounded up to 16
+
+	int total = 40;
+	for (int i = 0; i < total; i++)
+	{
+		ring.record(TRACE_EVENT_READ, i, i * 10, -i);
+	}
+	EXPECT_EQ(static_cast<uint64_t>(total), ring.written());
+
+	std::vector<TraceRecord> records;
+	TraceFileHeader header;
+	ASSERT_EQ(0, TraceRing::readFile(fileName, &records, &header));
+	EXPECT_EQ(16u, static_cast<unsigned>(header.capacity));
+	EXPECT_EQ(3u, header.loopId);
+	EXPECT_EQ(static_cast<uint64_t>(total), header.written);
+	ASSERT_EQ(16u, static_cast<unsigned>(records.size()));
+
+	// the last 16 from the oldest
+	for (size_t i = 0; i < records.size(); i++)
+	{
+		int n = total - 16 + static_cast<int>(i);
+		EXPECT_EQ(n, records[i].fd);
+		EXPECT_EQ(3, static_cast<int>(records[i].loopId));
+		EXPECT_EQ(static_cast<int>(TRACE_EVENT_READ), static_cast<int>(records[i].event));
+		EXPECT_EQ(static_cast<int64_t>(n * 10), records[i].arg1);
+		EXPECT_EQ(static_cast<int64_t>(-n), records[i].arg2);
+		if (i > 0)
+		{
+			EXPECT_LE(records[i - 1].timeMicros, records[i].timeMicros);
+		}
+	}
+
+	EXPECT_EQ(std::string("READ"), std::string(TraceRing::getEventName(TRACE_EVENT_READ)));
+	ring.close();
+	::unlink(fileName.c_str());
+
+	// not a trace file
+	EXPECT_EQ(-1, TraceRing::readFile(fileName, &records));
+}
+
+TEST(TraceRing, testTcpServerTrace)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+    LOG_INFO("-----------------------------------------------------");
+    LOG_INFO("TraceRing-testTcpServerTrace");
+    LOG_INFO("-----------------------------------------------------");
+
+	std::string ip = "127.0.0.1";
+	unsigned short port = 12257;
+	std::string prefix = "trace-server";
+
+	EventLoop loop;
+	std::string echoed;
+
+	TcpServer tcpServer(port);
+	tcpServer.setTraceFile(prefix, 1024);
+	tcpServer.setReadHandler([&](TcpConnection &tcpConnection){
+		Buffer &buffer = tcpConnection.getInputBuffer();
+		tcpConnection.send(buffer.data(), buffer.size());
+		buffer.clear();
+	});
+	tcpServer.start();
+
+	TcpClient client(&loop);
+	client.setConnectedHandler([&](TcpConnection &tcpConnection){
+		tcpConnection.send("hello");
+	});
+	client.setReadHandler([&](TcpConnection &tcpConnection){
+		Buffer &buffer = tcpConnection.getInputBuffer();
+		echoed.append(buffer.data(), buffer.size());
+		buffer.clear();
+		if (echoed.size() >= 5)
+		{
+			tcpConnection.close();
+		}
+	});
+	client.connect(ip, port, 5);
+
+	loop.runAfter(1000, [&]{
+		loop.quit();
+	});
+	loop.loop();
+	tcpServer.stop();
+	EXPECT_EQ(std::string("hello"), echoed);
+
+	std::vector<TraceRecord> records;
+	ASSERT_EQ(0, TraceRing::readFile(prefix + ".0", &records));
+
+	std::set<int> events;
+	int acceptedFd = -1;
+	for (auto &r : records)
+	{
+		EXPECT_EQ(0, static_cast<int>(r.loopId));
+		events.insert(r.event);
+		if (r.event == TRACE_EVENT_ACCEPT)
+		{
+			acceptedFd = r.fd;
+		}
+		if (r.event == TRACE_EVENT_WRITE && r.fd == acceptedFd)
+		{
+			EXPECT_EQ(5, static_cast<int>(r.arg2));
+		}
+	}
+
+	EXPECT_TRUE(acceptedFd >= 0);
+	EXPECT_TRUE(events.count(TRACE_EVENT_EPOLL_WAIT) == 1);
+	EXPECT_TRUE(events.count(TRACE_EVENT_ACCEPT) == 1);
+	EXPECT_TRUE(events.count(TRACE_EVENT_READ) == 1);
+	EXPECT_TRUE(events.count(TRACE_EVENT_WRITE) == 1);
+	EXPECT_TRUE(events.count(TRACE_EVENT_PEER_SHUTDOWN) == 1 || events.count(TRACE_EVENT_CLOSE) == 1);
+
+	::unlink((prefix + ".0").c_str());
+}
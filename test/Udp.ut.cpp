@@ -9,6 +9,9 @@
 #include <thread>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <map>
+#include <atomic>
 #include <utility>
 #include <functional>
 
@@ -344,6 +347,7 @@ TEST(UdpConnection, testErrorHandler)
     unsigned short port = 12252;
     std::string msg("hello easynet!");
     bool errorOccurred = false;
+    unsigned short errorLocalPort = 0;
 
     EventLoop loop;
     UdpConnection udpConnection(&loop);
@@ -361,10 +365,13 @@ TEST(UdpConnection, testErrorHandler)
 		LOG_INFO("----udp from %s at %s error:%d %s",  udpConnection.getPeerAddr().toString().c_str()
 			, udpConnection.getLocalAddr().toString().c_str(), errNo, errMsg.c_str());
 		errorOccurred = true;
+		errorLocalPort = udpConnection.getLocalAddr().port();
 		loop.quit();
 	});
 
 	udpConnection.sendTo(msg, ip, port);
+	// bound implicitly by the kernel on the first send
+	EXPECT_NE(0, udpConnection.getLocalAddr().port());
 
     loop.runAfter(2000, [&]{
     	loop.quit();
@@ -372,4 +379,250 @@ TEST(UdpConnection, testErrorHandler)
 
     loop.loop();
     ASSERT_TRUE(errorOccurred);
+    EXPECT_NE(0, errorLocalPort);
+}
+
+TEST(UdpConnection, testBatchMode)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+	LOG_INFO("----------------------------------------------");
+	LOG_INFO("UdpConnection-testBatchMode");
+	LOG_INFO("----------------------------------------------");
+
+    std::string ip = "127.0.0.1";
+    unsigned short port = 12253;
+    int total = 100;
+
+    EventLoop loop;
+    UdpConnection udpConnection(&loop);
+    ASSERT_EQ(0, udpConnection.bind(ip, port));
+    udpConnection.setBatchSize(8, 16);
+
+    std::vector<std::string> received;
+    int batches = 0;
+    bool truncated = false;
+    InetAddr peerAddr;
+    udpConnection.setBatchMessageHandler([&](UdpConnection &udpConnection, const UdpDatagram *datagrams, int num){
+    	batches++;
+    	for (int i = 0; i < num; i++)
+    	{
+    		received.push_back(std::string(datagrams[i].data, datagrams[i].len));
+    		truncated = truncated || datagrams[i].truncated;
+    		peerAddr = *(datagrams[i].peerAddr);
+    	}
+
+    	if (static_cast<int>(received.size()) >= total + 1)
+    	{
+    		loop.quit();
+    	}
+    });
+
+    Socket client(Socket::SocketType::SOCKET_UDP);
+    for (int i = 0; i < total; i++)
+    {
+    	std::string msg = "msg-" + std::to_string(i);
+    	client.sendTo(msg.data(), msg.size(), ip, port);
+    }
+    // longer than a slot
+    std::string longMsg(32, 'x');
+    client.sendTo(longMsg.data(), longMsg.size(), ip, port);
+
+    loop.runAfter(2000, [&]{
+    	loop.quit();
+    });
+    loop.loop();
+
+    ASSERT_EQ(total + 1, static_cast<int>(received.size()));
+    for (int i = 0; i < total; i++)
+    {
+    	EXPECT_EQ("msg-" + std::to_string(i), received[i]);
+    }
+    EXPECT_EQ(std::string(16, 'x'), received[total]);
+    EXPECT_TRUE(truncated);
+    EXPECT_TRUE(batches < total);
+
+    InetAddr clientAddr;
+    client.getLocalAddr(&clientAddr);
+    EXPECT_EQ(clientAddr.port(), peerAddr.port());
+
+    // sends 3 datagrams back with one call
+    std::vector<std::string> replies = {"a", "bb", "ccc"};
+    std::vector<UdpDatagram> datagrams;
+    for (auto &reply : replies)
+    {
+    	datagrams.push_back(UdpDatagram{reply.data(), reply.size(), &peerAddr, false});
+    }
+    EXPECT_EQ(3, udpConnection.sendBatch(datagrams.data(), static_cast<int>(datagrams.size())));
+
+    for (auto &reply : replies)
+    {
+    	char buf[64];
+    	InetAddr from;
+    	ssize_t n = client.recvFrom(buf, sizeof(buf), &from);
+    	EXPECT_EQ(reply, std::string(buf, n > 0 ? n : 0));
+    	EXPECT_EQ(port, from.port());
+    }
+}
+
+TEST(UdpConnection, testSegmentOffload)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+	LOG_INFO("----------------------------------------------");
+	LOG_INFO("UdpConnection-testSegmentOffload");
+	LOG_INFO("----------------------------------------------");
+
+    std::string ip = "127.0.0.1";
+    unsigned short port = 12254;
+    size_t segmentSize = 100;
+    int total = 150;   // more than one sendmsg() can carry
+
+    EventLoop loop;
+    UdpConnection server(&loop);
+    ASSERT_EQ(0, server.bind(ip, port));
+    server.setGro(true);
+
+    std::vector<std::string> received;
+    server.setBatchMessageHandler([&](UdpConnection &udpConnection, const UdpDatagram *datagrams, int num){
+    	for (int i = 0; i < num; i++)
+    	{
+    		received.push_back(std::string(datagrams[i].data, datagrams[i].len));
+    	}
+
+    	if (static_cast<int>(received.size()) >= total + 1)
+    	{
+    		loop.quit();
+    	}
+    });
+
+    // @total datagrams of @segmentSize bytes and a shorter one, each filled with its index
+    std::string data;
+    for (int i = 0; i <= total; i++)
+    {
+    	data.append(i < total ? segmentSize : segmentSize / 2, static_cast<char>('a' + i % 26));
+    }
+
+    UdpConnection client(&loop);
+    ASSERT_EQ(0, client.connect(ip, port));
+    EXPECT_EQ(static_cast<ssize_t>(data.size()), client.sendSegments(data.data(), data.size(), segmentSize));
+
+    loop.runAfter(2000, [&]{
+    	loop.quit();
+    });
+    loop.loop();
+
+    ASSERT_EQ(total + 1, static_cast<int>(received.size()));
+    for (int i = 0; i <= total; i++)
+    {
+    	EXPECT_EQ(std::string(i < total ? segmentSize : segmentSize / 2, static_cast<char>('a' + i % 26)), received[i]);
+    }
+}
+
+TEST(UdpServer, testReusePort)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+	LOG_INFO("----------------------------------------------");
+	LOG_INFO("UdpServer-testReusePort");
+	LOG_INFO("----------------------------------------------");
+
+    std::string ip = "127.0.0.1";
+    unsigned short port = 12255;
+    int workerNum = 2;
+    int clientNum = 32;
+
+    for (int steering = 0; steering <= 1; steering++)
+    {
+	    std::mutex lock;
+	    std::map<std::thread::id, int> nums;   // datagrams received by each worker
+	    std::atomic<int> total(0);
+
+	    UdpServer udpServer(port);
+	    udpServer.setWorkerNum(workerNum);
+	    udpServer.setWorkerCpuSteering(steering == 1);
+	    udpServer.setMessageHandler([&](UdpConnection &udpConnection){
+	    	Buffer &buffer = udpConnection.getInputBuffer();
+	    	buffer.deleteBegin(buffer.size());
+	    	std::lock_guard<std::mutex> guard(lock);
+	    	nums[std::this_thread::get_id()]++;
+	    	total++;
+	    });
+	    udpServer.start();
+	    ASSERT_EQ(workerNum, static_cast<int>(udpServer.getWorkersLoops().size()));
+
+	    // every client is a different flow
+	    std::vector<std::unique_ptr<Socket>> clients;
+	    for (int i = 0; i < clientNum; i++)
+	    {
+	    	std::unique_ptr<Socket> client(new Socket(Socket::SocketType::SOCKET_UDP));
+	    	client->sendTo("hello", 5, ip, port);
+	    	clients.push_back(std::move(client));
+	    }
+
+	    for (int i = 0; i < 200 && total.load() < clientNum; i++)
+	    {
+	    	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	    }
+	    udpServer.stop();
+
+	    EXPECT_EQ(clientNum, total.load());
+	    if (steering == 0)
+	    {
+	    	// spread by the flow hash
+	    	EXPECT_EQ(workerNum, static_cast<int>(nums.size()));
+	    }
+	}
+}
+
+TEST(UdpConnection, testDatagramView)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+	LOG_INFO("----------------------------------------------");
+	LOG_INFO("UdpConnection-testDatagramView");
+	LOG_INFO("----------------------------------------------");
+
+    std::string ip = "127.0.0.1";
+    unsigned short port = 12256;
+    int total = 50;
+
+    EventLoop loop;
+    UdpConnection udpConnection(&loop);
+    ASSERT_EQ(0, udpConnection.bind(ip, port));
+
+    std::vector<std::string> received;
+    std::vector<unsigned short> peerPorts;
+    udpConnection.setDatagramHandler([&](UdpConnection &udpConnection, const UdpDatagram &datagram){
+    	received.push_back(std::string(datagram.data, datagram.len));
+    	peerPorts.push_back(datagram.peerAddr->port());
+    	if (static_cast<int>(received.size()) >= total)
+    	{
+    		loop.quit();
+    	}
+    });
+
+    // datagrams of different lengths from 2 peers, the boundaries are kept
+    Socket client1(Socket::SocketType::SOCKET_UDP);
+    Socket client2(Socket::SocketType::SOCKET_UDP);
+    for (int i = 0; i < total; i++)
+    {
+    	std::string msg(i + 1, static_cast<char>('a' + i % 26));
+    	(i % 2 == 0 ? client1 : client2).sendTo(msg.data(), msg.size(), ip, port);
+    }
+
+    loop.runAfter(2000, [&]{
+    	loop.quit();
+    });
+    loop.loop();
+
+    InetAddr addr1;
+    InetAddr addr2;
+    client1.getLocalAddr(&addr1);
+    client2.getLocalAddr(&addr2);
+
+    ASSERT_EQ(total, static_cast<int>(received.size()));
+    for (int i = 0; i < total; i++)
+    {
+    	EXPECT_EQ(std::string(i + 1, static_cast<char>('a' + i % 26)), received[i]);
+    	EXPECT_EQ(i % 2 == 0 ? addr1.port() : addr2.port(), peerPorts[i]);
+    }
+    EXPECT_EQ(0u, udpConnection.getInputBuffer().size());
+    EXPECT_EQ(0, udpConnection.getPeerAddr().port());
 }
@@ -0,0 +1,159 @@
+#include <arpa/inet.h>
+
+#include <string>
+#include <vector>
+#include <set>
+#include <functional>
+
+#include "EventLoop.h"
+#include "UdpSessionTable.h"
+#include "utils/log.h"
+
+#include <test_harness.h>
+
+using namespace std;
+using namespace easynet;
+
+namespace
+{
+
+// a distinct peer for every @i, 10.x.x.x with a few ports
+InetAddr makePeerAddr(int i)
+{
+	struct sockaddr_in addr;
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(0x0A000000u + static_cast<uint32_t>(i / 4));
+	addr.sin_port = htons(static_cast<unsigned short>(10000 + i % 4));
+	return InetAddr(addr);
+}
+
+}
+
+TEST(UdpSessionTable, testTouchFindErase)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+    LOG_INFO("-----------------------------------------------------");
+    LOG_INFO("UdpSessionTable-testTouchFindErase");
+    LOG_INFO("-----------------------------------------------------");
+
+	EventLoop loop;
+	UdpSessionTable table(&loop, 0, 64 * 1024 * 1024);
+	int total = 100000;   // grows several times
+
+	for (int i = 0; i < total; i++)
+	{
+		UdpSession *session = table.touch(makePeerAddr(i));
+		ASSERT_TRUE(session != nullptr);
+		EXPECT_TRUE(session->data == nullptr);
+		session->data = reinterpret_cast<void*>(static_cast<intptr_t>(i + 1));
+	}
+	EXPECT_EQ(static_cast<size_t>(total), table.size());
+	EXPECT_TRUE(table.capacity() >= table.size() + table.size() / 3);
+
+	// an existing session keeps its data
+	UdpSession *session = table.touch(makePeerAddr(7));
+	ASSERT_TRUE(session != nullptr);
+	EXPECT_EQ(8, static_cast<int>(reinterpret_cast<intptr_t>(session->data)));
+	EXPECT_EQ(makePeerAddr(7).toString(), session->getPeerAddr().toString());
+	EXPECT_EQ(static_cast<size_t>(total), table.size());
+
+	// erases the even ones, the probes of the odd ones are still intact
+	for (int i = 0; i < total; i += 2)
+	{
+		table.erase(makePeerAddr(i));
+	}
+	EXPECT_EQ(static_cast<size_t>(total / 2), table.size());
+
+	for (int i = 0; i < total; i++)
+	{
+		UdpSession *session = table.find(makePeerAddr(i));
+		if (i % 2 == 0)
+		{
+			EXPECT_TRUE(session == nullptr);
+		}
+		else
+		{
+			ASSERT_TRUE(session != nullptr);
+			EXPECT_EQ(i + 1, static_cast<int>(reinterpret_cast<intptr_t>(session->data)));
+		}
+	}
+}
+
+TEST(UdpSessionTable, testMemoryLimit)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+    LOG_INFO("-----------------------------------------------------");
+    LOG_INFO("UdpSessionTable-testMemoryLimit");
+    LOG_INFO("-----------------------------------------------------");
+
+	EventLoop loop;
+	size_t memoryLimit = 64 * 1024;
+	UdpSessionTable table(&loop, 0, memoryLimit);
+
+	int total = 4000;
+	int created = 0;
+	for (int i = 0; i < total; i++)
+	{
+		if (table.touch(makePeerAddr(i)) != nullptr)
+		{
+			created++;
+		}
+	}
+
+	EXPECT_TRUE(table.memoryBytes() <= memoryLimit);
+	EXPECT_EQ(table.maxSize(), table.size());
+	EXPECT_EQ(static_cast<int>(table.maxSize()), created);
+	EXPECT_EQ(static_cast<uint64_t>(total - created), table.rejected());
+
+	// the known peers are still served
+	EXPECT_TRUE(table.touch(makePeerAddr(0)) != nullptr);
+}
+
+TEST(UdpSessionTable, testIdleExpiry)
+{
+    Logger::getInstance().setLogLevel(Logger::LOG_LEVEL_INFO);
+    LOG_INFO("-----------------------------------------------------");
+    LOG_INFO("UdpSessionTable-testIdleExpiry");
+    LOG_INFO("-----------------------------------------------------");
+
+	std::set<int> expired;   // outlives the table, which calls the handler for the remaining sessions
+
+	EventLoop loop;
+	int64_t idleMillis = 1000;
+	UdpSessionTable table(&loop, idleMillis, 1024 * 1024);
+
+	table.setExpiredHandler([&](UdpSession &session){
+		expired.insert(static_cast<int>(reinterpret_cast<intptr_t>(session.data)));
+	});
+
+	int total = 100;
+	for (int i = 0; i < total; i++)
+	{
+		table.touch(makePeerAddr(i))->data = reinterpret_cast<void*>(static_cast<intptr_t>(i));
+	}
+
+	// the first half keeps active
+	loop.runAfter(200, [&]{
+		for (int i = 0; i < total / 2; i++)
+		{
+			table.touch(makePeerAddr(i));
+		}
+	}, 200);
+
+	loop.runAfter(4000, [&]{
+		loop.quit();
+	});
+	loop.loop();
+
+	EXPECT_EQ(static_cast<size_t>(total / 2), expired.size());
+	for (int i = total / 2; i < total; i++)
+	{
+		EXPECT_TRUE(expired.count(i) == 1);
+	}
+
+	EXPECT_EQ(static_cast<size_t>(total / 2), table.size());
+	for (int i = 0; i < total / 2; i++)
+	{
+		EXPECT_TRUE(table.find(makePeerAddr(i)) != nullptr);
+	}
+}